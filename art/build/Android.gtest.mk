@@ -24,6 +24,7 @@ include art/build/Android.common_path.mk
 GTEST_DEX_DIRECTORIES := \
   AbstractMethod \
   AllFields \
+  BackgroundVerification \
   ExceptionHandle \
   GetMethodSignature \
   Interfaces \
@@ -45,7 +46,8 @@ $(foreach dir,$(GTEST_DEX_DIRECTORIES), $(eval $(call build-art-test-dex,art-gte
   $(ART_TARGET_NATIVETEST_OUT),art/build/Android.gtest.mk,ART_GTEST_$(dir)_DEX)))
 
 # Dex file dependencies for each gtest.
-ART_GTEST_class_linker_test_DEX_DEPS := Interfaces MyClass Nested Statics StaticsFromCode
+ART_GTEST_class_linker_test_DEX_DEPS := BackgroundVerification Interfaces MyClass Nested Statics \
+  StaticsFromCode
 ART_GTEST_compiler_driver_test_DEX_DEPS := AbstractMethod
 ART_GTEST_dex_file_test_DEX_DEPS := GetMethodSignature
 ART_GTEST_exception_test_DEX_DEPS := ExceptionHandle
@@ -92,6 +94,7 @@ RUNTIME_GTEST_COMMON_SRC_FILES := \
   runtime/exception_test.cc \
   runtime/gc/accounting/space_bitmap_test.cc \
   runtime/gc/heap_test.cc \
+  runtime/gc/reference_queue_test.cc \
   runtime/gc/space/dlmalloc_space_base_test.cc \
   runtime/gc/space/dlmalloc_space_static_test.cc \
   runtime/gc/space/dlmalloc_space_random_test.cc \
@@ -1364,9 +1364,11 @@ class ParallelCompilationManager {
     CHECK_GT(work_units, 0U);
 
     index_.StoreRelaxed(begin);
+    std::vector<Task*> tasks;
     for (size_t i = 0; i < work_units; ++i) {
-      thread_pool_->AddTask(self, new ForAllClosure(this, end, callback));
+      tasks.push_back(new ForAllClosure(this, end, callback));
     }
+    thread_pool_->AddTasks(self, tasks);
     thread_pool_->StartWorkers(self);
 
     // Ensure we're suspended while we're blocked waiting for the other threads to finish (worker
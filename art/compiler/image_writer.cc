@@ -411,7 +411,7 @@ ObjectArray<Object>* ImageWriter::CreateImageRoots() const {
   Runtime* runtime = Runtime::Current();
   ClassLinker* class_linker = runtime->GetClassLinker();
   Thread* self = Thread::Current();
-  StackHandleScope<3> hs(self);
+  StackHandleScope<4> hs(self);
   Handle<Class> object_array_class(hs.NewHandle(
       class_linker->FindSystemClass(self, "[Ljava/lang/Object;")));
 
@@ -438,6 +438,11 @@ ObjectArray<Object>* ImageWriter::CreateImageRoots() const {
     }
   }
 
+  // build a String[] of the strings resolved in the DexCaches, searched by the intern table
+  Handle<ObjectArray<String>> interned_strings(
+      hs.NewHandle(InternTable::CreateImageStrings(self, dex_caches)));
+  CHECK(interned_strings.Get() != nullptr) << "Failed to allocate the interned strings array.";
+
   // build an Object[] of the roots needed to restore the runtime
   Handle<ObjectArray<Object>> image_roots(hs.NewHandle(
       ObjectArray<Object>::Alloc(self, object_array_class.Get(), ImageHeader::kImageRootsMax)));
@@ -452,6 +457,7 @@ ObjectArray<Object>* ImageWriter::CreateImageRoots() const {
                           runtime->GetCalleeSaveMethod(Runtime::kRefsAndArgs));
   image_roots->Set<false>(ImageHeader::kDexCaches, dex_caches.Get());
   image_roots->Set<false>(ImageHeader::kClassRoots, class_linker->GetClassRoots());
+  image_roots->Set<false>(ImageHeader::kInternedStrings, interned_strings.Get());
   for (int i = 0; i < ImageHeader::kImageRootsMax; i++) {
     CHECK(image_roots->Get(i) != NULL);
   }
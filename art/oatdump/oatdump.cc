@@ -103,6 +103,7 @@ const char* image_roots_descriptions_[] = {
   "kRefsAndArgsSaveMethod",
   "kDexCaches",
   "kClassRoots",
+  "kInternedStrings",
 };
 
 class OatDumper {
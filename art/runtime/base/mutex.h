@@ -72,6 +72,7 @@ enum LockLevel {
   kInternTableLock,
   kMonitorPoolLock,
   kDefaultMutexLevel,
+  kBackgroundVerificationLock,
   kMarkSweepLargeObjectLock,
   kPinTableLock,
   kLoadLibraryLock,
@@ -30,7 +30,7 @@
 namespace art {
 
 inline bool ClassLinker::IsInBootClassPath(const char* descriptor) {
-  DexFile::ClassPathEntry pair = DexFile::FindInClassPath(descriptor, boot_class_path_);
+  DexFile::ClassPathEntry pair = boot_class_path_index_.Find(descriptor);
   return pair.second != nullptr;
 }
 
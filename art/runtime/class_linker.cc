@@ -19,6 +19,8 @@
 #include <fcntl.h>
 #include <sys/file.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
 #include <deque>
 #include <memory>
 #include <string>
@@ -63,6 +65,8 @@
 #include "scoped_thread_state_change.h"
 #include "handle_scope-inl.h"
 #include "thread.h"
+#include "thread_pool.h"
+#include "utf.h"
 #include "utils.h"
 #include "verifier/method_verifier.h"
 #include "well_known_classes.h"
@@ -122,15 +126,6 @@ static void WrapExceptionInInitializer() SHARED_LOCKS_REQUIRED(Locks::mutator_lo
   }
 }
 
-static size_t Hash(const char* s) {
-  // This is the java.lang.String hashcode for convenience, not interoperability.
-  size_t hash = 0;
-  for (; *s != '\0'; ++s) {
-    hash = hash * 31 + *s;
-  }
-  return hash;
-}
-
 const char* ClassLinker::class_roots_descriptors_[] = {
   "Ljava/lang/Class;",
   "Ljava/lang/Object;",
@@ -181,6 +176,10 @@ ClassLinker::ClassLinker(InternTable* intern_table)
       log_new_dex_caches_roots_(false),
       log_new_class_table_roots_(false),
       intern_table_(intern_table),
+      background_verification_lock_("ClassLinker background verification lock",
+                                    kBackgroundVerificationLock),
+      background_verification_stopped_(false),
+      background_verification_timings_("Background verification"),
       portable_resolution_trampoline_(nullptr),
       quick_resolution_trampoline_(nullptr),
       portable_imt_conflict_trampoline_(nullptr),
@@ -1180,6 +1179,10 @@ void ClassLinker::InitFromImage() {
           AsObjectArray<mirror::Class>()));
   class_roots_ = class_roots.Get();
 
+  intern_table_->SetImageStrings(
+      space->GetImageHeader().GetImageRoot(ImageHeader::kInternedStrings)->
+      AsObjectArray<mirror::String>());
+
   // Special case of setting up the String class early so that we can test arbitrary objects
   // as being Strings or not
   mirror::String::SetClass(GetClassRoot(kJavaLangString));
@@ -1512,7 +1515,7 @@ mirror::Class* ClassLinker::FindClass(Thread* self, const char* descriptor,
   if (descriptor[0] == '[') {
     return CreateArrayClass(self, descriptor, class_loader);
   } else if (class_loader.Get() == nullptr) {
-    DexFile::ClassPathEntry pair = DexFile::FindInClassPath(descriptor, boot_class_path_);
+    DexFile::ClassPathEntry pair = boot_class_path_index_.Find(descriptor);
     if (pair.second != NULL) {
       StackHandleScope<1> hs(self);
       return DefineClass(descriptor, NullHandle<mirror::ClassLoader>(), *pair.first, *pair.second);
@@ -1617,7 +1620,8 @@ mirror::Class* ClassLinker::DefineClass(const char* descriptor,
   ObjectLock<mirror::Class> lock(self, klass);
   klass->SetClinitThreadId(self->GetTid());
   // Add the newly loaded class to the loaded classes table.
-  mirror::Class* existing = InsertClass(descriptor, klass.Get(), Hash(descriptor));
+  mirror::Class* existing =
+      InsertClass(descriptor, klass.Get(), ComputeModifiedUtf8Hash(descriptor));
   if (existing != NULL) {
     // We failed to insert because we raced with another thread. Calling EnsureResolved may cause
     // this thread to block.
@@ -2213,6 +2217,7 @@ void ClassLinker::AppendToBootClassPath(const DexFile& dex_file,
                                         Handle<mirror::DexCache> dex_cache) {
   CHECK(dex_cache.Get() != NULL) << dex_file.GetLocation();
   boot_class_path_.push_back(&dex_file);
+  boot_class_path_index_.Append(&dex_file);
   RegisterDexFile(dex_file, dex_cache);
 }
 
@@ -2329,7 +2334,8 @@ mirror::Class* ClassLinker::InitializePrimitiveClass(mirror::Class* primitive_cl
   primitive_class->SetPrimitiveType(type);
   primitive_class->SetStatus(mirror::Class::kStatusInitialized, self);
   const char* descriptor = Primitive::Descriptor(type);
-  mirror::Class* existing = InsertClass(descriptor, primitive_class, Hash(descriptor));
+  mirror::Class* existing =
+      InsertClass(descriptor, primitive_class, ComputeModifiedUtf8Hash(descriptor));
   CHECK(existing == NULL) << "InitPrimitiveClass(" << type << ") failed";
   return primitive_class;
 }
@@ -2463,7 +2469,8 @@ mirror::Class* ClassLinker::CreateArrayClass(Thread* self, const char* descripto
 
   new_class->SetAccessFlags(access_flags);
 
-  mirror::Class* existing = InsertClass(descriptor, new_class.Get(), Hash(descriptor));
+  mirror::Class* existing =
+      InsertClass(descriptor, new_class.Get(), ComputeModifiedUtf8Hash(descriptor));
   if (existing == nullptr) {
     return new_class.Get();
   }
@@ -2538,7 +2545,7 @@ mirror::Class* ClassLinker::InsertClass(const char* descriptor, mirror::Class* k
 }
 
 bool ClassLinker::RemoveClass(const char* descriptor, const mirror::ClassLoader* class_loader) {
-  size_t hash = Hash(descriptor);
+  size_t hash = ComputeModifiedUtf8Hash(descriptor);
   WriterMutexLock mu(Thread::Current(), *Locks::classlinker_classes_lock_);
   for (auto it = class_table_.lower_bound(hash), end = class_table_.end();
        it != end && it->first == hash;
@@ -2555,7 +2562,7 @@ bool ClassLinker::RemoveClass(const char* descriptor, const mirror::ClassLoader*
 
 mirror::Class* ClassLinker::LookupClass(const char* descriptor,
                                         const mirror::ClassLoader* class_loader) {
-  size_t hash = Hash(descriptor);
+  size_t hash = ComputeModifiedUtf8Hash(descriptor);
   {
     ReaderMutexLock mu(Thread::Current(), *Locks::classlinker_classes_lock_);
     mirror::Class* result = LookupClassFromTableLocked(descriptor, class_loader, hash);
@@ -2633,7 +2640,7 @@ void ClassLinker::MoveImageClassesToClassTable() {
       if (klass != NULL) {
         DCHECK(klass->GetClassLoader() == NULL);
         std::string descriptor = klass->GetDescriptor();
-        size_t hash = Hash(descriptor.c_str());
+        size_t hash = ComputeModifiedUtf8Hash(descriptor.c_str());
         mirror::Class* existing = LookupClassFromTableLocked(descriptor.c_str(), NULL, hash);
         if (existing != NULL) {
           CHECK(existing == klass) << PrettyClassAndClassLoader(existing) << " != "
@@ -2683,7 +2690,7 @@ void ClassLinker::LookupClasses(const char* descriptor, std::vector<mirror::Clas
   if (dex_cache_image_class_lookup_required_) {
     MoveImageClassesToClassTable();
   }
-  size_t hash = Hash(descriptor);
+  size_t hash = ComputeModifiedUtf8Hash(descriptor);
   ReaderMutexLock mu(Thread::Current(), *Locks::classlinker_classes_lock_);
   for (auto it = class_table_.lower_bound(hash), end = class_table_.end();
       it != end && it->first == hash; ++it) {
@@ -2831,6 +2838,133 @@ void ClassLinker::VerifyClass(Handle<mirror::Class> klass) {
   }
 }
 
+// Loads and verifies the classes of one dex file on the background verification thread pool.
+// The tasks for a dex file take its classes in turn, and the last one to finish releases the
+// class loader.
+class ClassLinker::BackgroundVerificationTask : public Task {
+ public:
+  struct Job {
+    Job(const DexFile* job_dex_file, jobject job_class_loader, size_t num_tasks)
+        : dex_file(job_dex_file), class_loader(job_class_loader), next_class_def_index(0),
+          running_tasks(num_tasks) {}
+
+    const DexFile* const dex_file;
+    // A global reference.
+    const jobject class_loader;
+    AtomicInteger next_class_def_index;
+    AtomicInteger running_tasks;
+  };
+
+  BackgroundVerificationTask(ClassLinker* class_linker, Job* job)
+      : class_linker_(class_linker), job_(job) {}
+
+  virtual void Run(Thread* self) {
+    const DexFile& dex_file = *job_->dex_file;
+    const size_t num_class_defs = dex_file.NumClassDefs();
+    TimingLogger timings("Background verification", false, false);
+    ScopedObjectAccess soa(self);
+    StackHandleScope<2> hs(self);
+    Handle<mirror::ClassLoader> class_loader(
+        hs.NewHandle(soa.Decode<mirror::ClassLoader*>(job_->class_loader)));
+    Handle<mirror::Class> klass(hs.NewHandle<mirror::Class>(nullptr));
+    while (!class_linker_->background_verification_stopped_.LoadRelaxed()) {
+      const size_t class_def_index =
+          job_->next_class_def_index.FetchAndAddSequentiallyConsistent(1);
+      if (class_def_index >= num_class_defs) {
+        break;
+      }
+      const char* descriptor = dex_file.GetClassDescriptor(dex_file.GetClassDef(class_def_index));
+      {
+        TimingLogger::ScopedTiming t("LoadClass", &timings);
+        klass.Assign(class_linker_->FindClass(self, descriptor, class_loader));
+        // Skip classes that the loader takes from elsewhere, such as the boot class path, and
+        // classes that were verified ahead of time or since this dex file was scheduled.
+        if (klass.Get() != nullptr && &klass->GetDexFile() == &dex_file &&
+            !klass->IsVerified() && !klass->IsErroneous()) {
+          t.NewTiming("VerifyClass");
+          // Publishes the result in the class status. A class that fails verification is
+          // erroneous, and its first use throws the failure again.
+          class_linker_->VerifyClass(klass);
+        }
+      }
+      self->ClearException();
+      class_linker_->background_verification_timings_.AddLogger(timings);
+      timings.Reset();
+    }
+  }
+
+  virtual void Finalize() {
+    if (job_->running_tasks.FetchAndSubSequentiallyConsistent(1) == 1) {
+      VLOG(class_linker) << "Finished background verification of " << job_->dex_file->GetLocation();
+      Thread::Current()->GetJniEnv()->DeleteGlobalRef(job_->class_loader);
+      delete job_;
+    }
+    delete this;
+  }
+
+ private:
+  ClassLinker* const class_linker_;
+  Job* const job_;
+};
+
+void ClassLinker::VerifyDexFileInBackground(JNIEnv* env, const DexFile& dex_file,
+                                            jobject class_loader) {
+  Runtime* const runtime = Runtime::Current();
+  // The zygote must not start threads before it forks.
+  if (!runtime->IsBackgroundVerificationEnabled() || runtime->IsZygote() ||
+      class_loader == nullptr || dex_file.NumClassDefs() == 0) {
+    return;
+  }
+  Thread* const self = Thread::Current();
+  // Global references are created and deleted holding the mutator lock, which must not be taken
+  // while holding background_verification_lock_.
+  jobject loader_ref = env->NewGlobalRef(class_loader);
+  bool scheduled = false;
+  {
+    MutexLock mu(self, background_verification_lock_);
+    if (!background_verification_stopped_.LoadRelaxed() &&
+        background_verified_dex_files_.insert(&dex_file).second) {
+      if (background_verification_pool_.get() == nullptr) {
+        // Leave a processor to the threads that the classes are being verified for. The workers
+        // run class loaders, so they need peers.
+        const long num_processors = sysconf(_SC_NPROCESSORS_CONF);
+        const size_t num_threads = static_cast<size_t>(std::max(num_processors - 1, 1L));
+        background_verification_pool_.reset(
+            new ThreadPool("Background verification thread pool", num_threads, true));
+        background_verification_pool_->StartWorkers(self);
+      }
+      const size_t num_tasks = std::min(background_verification_pool_->GetThreadCount(),
+                                        dex_file.NumClassDefs());
+      BackgroundVerificationTask::Job* job =
+          new BackgroundVerificationTask::Job(&dex_file, loader_ref, num_tasks);
+      std::vector<Task*> tasks;
+      for (size_t i = 0; i < num_tasks; ++i) {
+        tasks.push_back(new BackgroundVerificationTask(this, job));
+      }
+      VLOG(class_linker) << "Verifying " << dex_file.NumClassDefs() << " classes of "
+                         << dex_file.GetLocation() << " in the background";
+      background_verification_pool_->AddTasks(self, tasks);
+      scheduled = true;
+    }
+  }
+  if (!scheduled) {
+    env->DeleteGlobalRef(loader_ref);
+  }
+}
+
+void ClassLinker::StopBackgroundVerification(Thread* self) {
+  std::unique_ptr<ThreadPool> pool;
+  {
+    MutexLock mu(self, background_verification_lock_);
+    background_verification_stopped_.StoreRelaxed(true);
+    pool.swap(background_verification_pool_);
+  }
+  // Joins the workers once their current classes are done, without holding the lock since a
+  // worker may be scheduling a dex file of its own. Tasks that have not started yet are left, as
+  // the runtime is going away.
+  pool.reset();
+}
+
 bool ClassLinker::VerifyClassUsingOatFile(const DexFile& dex_file, mirror::Class* klass,
                                           mirror::Class::Status& oat_file_class_status) {
   // If we're compiling, we can only verify the class using the oat file if
@@ -3095,7 +3229,8 @@ mirror::Class* ClassLinker::CreateProxyClass(ScopedObjectAccessAlreadyRunnable&
              soa.Decode<mirror::ObjectArray<mirror::ObjectArray<mirror::Class>>*>(throws));
   }
   std::string descriptor(GetDescriptorForProxy(klass.Get()));
-  mirror::Class* existing = InsertClass(descriptor.c_str(), klass.Get(), Hash(descriptor.c_str()));
+  mirror::Class* existing = InsertClass(descriptor.c_str(), klass.Get(),
+                                        ComputeModifiedUtf8Hash(descriptor.c_str()));
   CHECK(existing == nullptr);
   return klass.Get();
 }
@@ -4573,8 +4708,13 @@ void ClassLinker::DumpForSigQuit(std::ostream& os) {
   if (dex_cache_image_class_lookup_required_) {
     MoveImageClassesToClassTable();
   }
-  ReaderMutexLock mu(Thread::Current(), *Locks::classlinker_classes_lock_);
-  os << "Loaded classes: " << class_table_.size() << " allocated classes\n";
+  {
+    ReaderMutexLock mu(Thread::Current(), *Locks::classlinker_classes_lock_);
+    os << "Loaded classes: " << class_table_.size() << " allocated classes\n";
+  }
+  if (background_verification_timings_.GetIterations() != 0) {
+    background_verification_timings_.Dump(os);
+  }
 }
 
 size_t ClassLinker::NumLoadedClasses() {
@@ -17,12 +17,15 @@
 #ifndef ART_RUNTIME_CLASS_LINKER_H_
 #define ART_RUNTIME_CLASS_LINKER_H_
 
+#include <memory>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "base/macros.h"
 #include "base/mutex.h"
+#include "base/timing_logger.h"
 #include "dex_file.h"
 #include "gtest/gtest.h"
 #include "jni.h"
@@ -48,6 +51,7 @@ namespace mirror {
 class InternTable;
 template<class T> class ObjectLock;
 class ScopedObjectAccessAlreadyRunnable;
+class ThreadPool;
 template<class T> class Handle;
 
 typedef bool (ClassVisitor)(mirror::Class* c, void* arg);
@@ -312,6 +316,16 @@ class ClassLinker {
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
   void VerifyClass(Handle<mirror::Class> klass) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
+  // With -Xverify:background, starts loading and verifying the classes of a dex file, as seen
+  // from class_loader, on the background verification thread pool. Each dex file is only
+  // scheduled once, and the boot class path never is.
+  void VerifyDexFileInBackground(JNIEnv* env, const DexFile& dex_file, jobject class_loader)
+      LOCKS_EXCLUDED(background_verification_lock_, Locks::mutator_lock_);
+  // Lets the background verification finish the classes it is working on, then joins its threads.
+  void StopBackgroundVerification(Thread* self)
+      LOCKS_EXCLUDED(background_verification_lock_, Locks::mutator_lock_);
+
   bool VerifyClassUsingOatFile(const DexFile& dex_file, mirror::Class* klass,
                                mirror::Class::Status& oat_file_class_status)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
@@ -585,6 +599,8 @@ class ClassLinker {
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
   std::vector<const DexFile*> boot_class_path_;
+  // The class definitions of boot_class_path_, searched by FindClass for the boot class loader.
+  DexFile::ClassPathIndex boot_class_path_index_;
 
   mutable ReaderWriterMutex dex_lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
   std::vector<size_t> new_dex_cache_roots_ GUARDED_BY(dex_lock_);;
@@ -695,6 +711,18 @@ class ClassLinker {
 
   InternTable* intern_table_;
 
+  class BackgroundVerificationTask;
+  // Held while creating the thread pool and adding tasks to it, so above the pool's own locks.
+  Mutex background_verification_lock_;
+  std::set<const DexFile*> background_verified_dex_files_
+      GUARDED_BY(background_verification_lock_);
+  std::unique_ptr<ThreadPool> background_verification_pool_
+      GUARDED_BY(background_verification_lock_);
+  // Set by StopBackgroundVerification, read by the tasks between classes.
+  Atomic<bool> background_verification_stopped_;
+  // How long the background verification spends loading and verifying each class.
+  CumulativeLogger background_verification_timings_;
+
   const void* portable_resolution_trampoline_;
   const void* quick_resolution_trampoline_;
   const void* portable_imt_conflict_trampoline_;
@@ -1091,4 +1091,80 @@ TEST_F(ClassLinkerTest, ClassRootDescriptors) {
   }
 }
 
+class ClassLinkerBackgroundVerificationTest : public ClassLinkerTest {
+ protected:
+  void SetUpRuntimeOptions(Runtime::Options* options) OVERRIDE {
+    options->push_back(std::make_pair("-Xverify:background", nullptr));
+  }
+
+  // Waits for the background verification to load and verify or reject the class named by
+  // descriptor. Returns null if it has not after ten seconds.
+  mirror::Class* WaitForBackgroundVerification(const char* descriptor,
+                                               Handle<mirror::ClassLoader> class_loader)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+    for (size_t i = 0; i < 1000; ++i) {
+      mirror::Class* klass = class_linker_->LookupClass(descriptor, class_loader.Get());
+      if (klass != nullptr && (klass->IsVerified() || klass->IsErroneous())) {
+        return klass;
+      }
+      ScopedThreadStateChange tsc(Thread::Current(), kSleeping);
+      NanoSleep(MsToNs(10));
+    }
+    return nullptr;
+  }
+};
+
+TEST_F(ClassLinkerBackgroundVerificationTest, VerifyDexFileInBackground) {
+  Thread* self = Thread::Current();
+  self->TransitionFromSuspendedToRunnable();
+  // The MyClass dex file comes first, so that Bad sees a MyClass that does not extend Base.
+  std::vector<const DexFile*> dex_files = OpenTestDexFiles("MyClass");
+  std::vector<const DexFile*> background_dex_files = OpenTestDexFiles("BackgroundVerification");
+  ASSERT_EQ(1U, background_dex_files.size());
+  const DexFile* dex_file = background_dex_files[0];
+  dex_files.push_back(dex_file);
+  jobject jclass_loader = LoadDexFiles(dex_files);
+  // The workers of the background verification need a started runtime for their peers.
+  bool started = runtime_->Start();
+  ASSERT_TRUE(started);
+
+  JNIEnv* env = self->GetJniEnv();
+  {
+    ScopedThreadStateChange tsc(self, kNative);
+    class_linker_->VerifyDexFileInBackground(env, *dex_file, jclass_loader);
+    // Scheduling the same dex file again does nothing.
+    class_linker_->VerifyDexFileInBackground(env, *dex_file, jclass_loader);
+  }
+
+  {
+    ScopedObjectAccess soa(self);
+    StackHandleScope<2> hs(soa.Self());
+    Handle<mirror::ClassLoader> class_loader(
+        hs.NewHandle(soa.Decode<mirror::ClassLoader*>(jclass_loader)));
+
+    // Nothing else loads Later, so only the background verification can have verified it.
+    mirror::Class* later = WaitForBackgroundVerification("LLater;", class_loader);
+    ASSERT_TRUE(later != nullptr);
+    EXPECT_TRUE(later->IsVerified());
+
+    // Bad was rejected in the background, and its first use still throws the VerifyError.
+    Handle<mirror::Class> bad(
+        hs.NewHandle(WaitForBackgroundVerification("LBad;", class_loader)));
+    ASSERT_TRUE(bad.Get() != nullptr);
+    EXPECT_TRUE(bad->IsErroneous());
+    EXPECT_FALSE(class_linker_->EnsureInitialized(bad, true, true));
+    ASSERT_TRUE(soa.Self()->IsExceptionPending());
+    EXPECT_EQ("Ljava/lang/VerifyError;",
+              soa.Self()->GetException(nullptr)->GetClass()->GetDescriptor());
+    soa.Self()->ClearException();
+  }
+
+  {
+    ScopedThreadStateChange tsc(self, kNative);
+    // Joins the workers. Dex files scheduled after this are left alone.
+    class_linker_->StopBackgroundVerification(self);
+    class_linker_->VerifyDexFileInBackground(env, *dex_files[0], jclass_loader);
+  }
+}
+
 }  // namespace art
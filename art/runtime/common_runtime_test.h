@@ -314,7 +314,12 @@ class CommonRuntimeTest : public testing::Test {
   }
 
   jobject LoadDex(const char* dex_name) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
-    std::vector<const DexFile*> dex_files = OpenTestDexFiles(dex_name);
+    return LoadDexFiles(OpenTestDexFiles(dex_name));
+  }
+
+  // Returns a class loader for dex_files, which finds a class in the first of them that has it.
+  jobject LoadDexFiles(const std::vector<const DexFile*>& dex_files)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
     CHECK_NE(0U, dex_files.size());
     for (const DexFile* dex_file : dex_files) {
       class_linker_->RegisterDexFile(*dex_file);
@@ -25,6 +25,7 @@
 #include <sys/stat.h>
 #include <memory>
 
+#include "atomic.h"
 #include "base/logging.h"
 #include "base/stringprintf.h"
 #include "class_linker.h"
@@ -52,9 +53,10 @@ const byte DexFile::kDexMagicVersion[] = { '0', '3', '5', '\0' };
 
 DexFile::ClassPathEntry DexFile::FindInClassPath(const char* descriptor,
                                                  const ClassPath& class_path) {
+  const size_t hash = ComputeModifiedUtf8Hash(descriptor);
   for (size_t i = 0; i != class_path.size(); ++i) {
     const DexFile* dex_file = class_path[i];
-    const DexFile::ClassDef* dex_class_def = dex_file->FindClassDef(descriptor);
+    const DexFile::ClassDef* dex_class_def = dex_file->FindClassDef(descriptor, hash);
     if (dex_class_def != NULL) {
       return ClassPathEntry(dex_file, dex_class_def);
     }
@@ -64,6 +66,72 @@ DexFile::ClassPathEntry DexFile::FindInClassPath(const char* descriptor,
                         reinterpret_cast<const DexFile::ClassDef*>(NULL));
 }
 
+// The smallest number of slots of a ClassPathIndex.
+static constexpr size_t kClassPathIndexMinSize = 64;
+
+DexFile::ClassPathIndex::ClassPathIndex() : size_(0) {
+  Slot free_slot = { 0, kDexNoIndex16, 0 };
+  slots_.resize(kClassPathIndexMinSize, free_slot);
+}
+
+void DexFile::ClassPathIndex::Append(const DexFile* dex_file) {
+  CHECK_LT(class_path_.size(), static_cast<size_t>(kDexNoIndex16)) << dex_file->GetLocation();
+  const uint16_t class_path_idx = class_path_.size();
+  class_path_.push_back(dex_file);
+  for (size_t i = 0; i < dex_file->NumClassDefs(); ++i) {
+    const char* descriptor = dex_file->GetClassDescriptor(dex_file->GetClassDef(i));
+    const uint32_t hash = ComputeModifiedUtf8Hash(descriptor);
+    // A class defined by an earlier dex file hides this one.
+    if (Find(descriptor, hash).second == nullptr) {
+      Slot slot = { hash, class_path_idx, static_cast<uint16_t>(i) };
+      Insert(slot);
+    }
+  }
+}
+
+void DexFile::ClassPathIndex::Insert(const Slot& slot) {
+  // Keep the index at most half full, since most lookups from class loaders that delegate to
+  // the boot class path miss, and a miss probes up to the next free slot.
+  if ((size_ + 1) * 2 > slots_.size()) {
+    Slot free_slot = { 0, kDexNoIndex16, 0 };
+    std::vector<Slot> old_slots(slots_.size() * 2, free_slot);
+    old_slots.swap(slots_);
+    size_ = 0;
+    for (const Slot& old_slot : old_slots) {
+      if (old_slot.class_path_idx != kDexNoIndex16) {
+        Insert(old_slot);
+      }
+    }
+  }
+  const size_t mask = slots_.size() - 1;
+  size_t i = slot.hash & mask;
+  while (slots_[i].class_path_idx != kDexNoIndex16) {
+    i = (i + 1) & mask;
+  }
+  slots_[i] = slot;
+  ++size_;
+}
+
+DexFile::ClassPathEntry DexFile::ClassPathIndex::Find(const char* descriptor) const {
+  return Find(descriptor, ComputeModifiedUtf8Hash(descriptor));
+}
+
+DexFile::ClassPathEntry DexFile::ClassPathIndex::Find(const char* descriptor,
+                                                      uint32_t hash) const {
+  const size_t mask = slots_.size() - 1;
+  for (size_t i = hash & mask; slots_[i].class_path_idx != kDexNoIndex16; i = (i + 1) & mask) {
+    const Slot& slot = slots_[i];
+    if (slot.hash == hash) {
+      const DexFile* dex_file = class_path_[slot.class_path_idx];
+      const ClassDef& class_def = dex_file->GetClassDef(slot.class_def_idx);
+      if (strcmp(dex_file->GetClassDescriptor(class_def), descriptor) == 0) {
+        return ClassPathEntry(dex_file, &class_def);
+      }
+    }
+  }
+  return ClassPathEntry(nullptr, nullptr);
+}
+
 static int OpenAndReadMagic(const char* filename, uint32_t* magic, std::string* error_msg) {
   CHECK(magic != NULL);
   ScopedFd fd(open(filename, O_RDONLY, 0));
@@ -366,7 +434,8 @@ DexFile::DexFile(const byte* base, size_t size,
       field_ids_(reinterpret_cast<const FieldId*>(base + header_->field_ids_off_)),
       method_ids_(reinterpret_cast<const MethodId*>(base + header_->method_ids_off_)),
       proto_ids_(reinterpret_cast<const ProtoId*>(base + header_->proto_ids_off_)),
-      class_defs_(reinterpret_cast<const ClassDef*>(base + header_->class_defs_off_)) {
+      class_defs_(reinterpret_cast<const ClassDef*>(base + header_->class_defs_off_)),
+      class_def_index_(nullptr) {
   CHECK(begin_ != NULL) << GetLocation();
   CHECK_GT(size_, 0U) << GetLocation();
 }
@@ -376,6 +445,7 @@ DexFile::~DexFile() {
   // that's only called after DetachCurrentThread, which means there's no JNIEnv. We could
   // re-attach, but cleaning up these global references is not obviously useful. It's not as if
   // the global reference table is otherwise empty!
+  delete[] class_def_index_;
 }
 
 bool DexFile::Init(std::string* error_msg) {
@@ -424,24 +494,75 @@ uint32_t DexFile::GetVersion() const {
   return atoi(version);
 }
 
+size_t DexFile::ClassDefIndexSize() const {
+  // Keep the index at most half full.
+  return RoundUpToPowerOfTwo(NumClassDefs() * 2);
+}
+
+const uint32_t* DexFile::GetClassDefIndex() const {
+  const uint32_t* index = class_def_index_;
+  if (index != nullptr) {
+    QuasiAtomic::ThreadFenceAcquire();
+    return index;
+  }
+  // The bottom half of a slot holds the class def index plus one.
+  const size_t num_class_defs = NumClassDefs();
+  if (num_class_defs >= 0xFFFF) {
+    return nullptr;
+  }
+  const size_t size = ClassDefIndexSize();
+  const size_t mask = size - 1;
+  std::unique_ptr<uint32_t[]> new_index(new uint32_t[size]());
+  for (size_t i = 0; i < num_class_defs; ++i) {
+    const uint32_t hash = ComputeModifiedUtf8Hash(GetClassDescriptor(GetClassDef(i)));
+    size_t j = hash & mask;
+    while (new_index[j] != 0) {
+      j = (j + 1) & mask;
+    }
+    new_index[j] = (hash & 0xFFFF0000) | (i + 1);
+  }
+  // Another thread may have built the index meanwhile, in which case use that one. The
+  // compare and swap is a full barrier, publishing the contents of the index.
+  if (__sync_bool_compare_and_swap(&class_def_index_, static_cast<uint32_t*>(nullptr),
+                                   new_index.get())) {
+    return new_index.release();
+  }
+  index = class_def_index_;
+  QuasiAtomic::ThreadFenceAcquire();
+  return index;
+}
+
 const DexFile::ClassDef* DexFile::FindClassDef(const char* descriptor) const {
+  return FindClassDef(descriptor, ComputeModifiedUtf8Hash(descriptor));
+}
+
+const DexFile::ClassDef* DexFile::FindClassDef(const char* descriptor, size_t hash) const {
   size_t num_class_defs = NumClassDefs();
   if (num_class_defs == 0) {
     return NULL;
   }
-  const StringId* string_id = FindStringId(descriptor);
-  if (string_id == NULL) {
-    return NULL;
-  }
-  const TypeId* type_id = FindTypeId(GetIndexForStringId(*string_id));
-  if (type_id == NULL) {
-    return NULL;
-  }
-  uint16_t type_idx = GetIndexForTypeId(*type_id);
-  for (size_t i = 0; i < num_class_defs; ++i) {
-    const ClassDef& class_def = GetClassDef(i);
-    if (class_def.class_idx_ == type_idx) {
-      return &class_def;
+  const uint32_t* index = GetClassDefIndex();
+  if (UNLIKELY(index == nullptr)) {
+    const StringId* string_id = FindStringId(descriptor);
+    if (string_id == NULL) {
+      return NULL;
+    }
+    const TypeId* type_id = FindTypeId(GetIndexForStringId(*string_id));
+    if (type_id == NULL) {
+      return NULL;
+    }
+    return FindClassDef(GetIndexForTypeId(*type_id));
+  }
+  // Class defs are in the index in order, so the first one found is the first with this
+  // descriptor.
+  const size_t mask = ClassDefIndexSize() - 1;
+  const uint32_t hash_top = static_cast<uint32_t>(hash) & 0xFFFF0000;
+  for (size_t i = hash & mask; index[i] != 0; i = (i + 1) & mask) {
+    if ((index[i] & 0xFFFF0000) == hash_top) {
+      const ClassDef& class_def = GetClassDef((index[i] & 0xFFFF) - 1);
+      if (strcmp(GetClassDescriptor(class_def), descriptor) == 0) {
+        return &class_def;
+      }
     }
   }
   return NULL;
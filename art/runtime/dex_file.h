@@ -353,6 +353,40 @@ class DexFile {
   static ClassPathEntry FindInClassPath(const char* descriptor,
                                         const ClassPath& class_path);
 
+  // The class definitions of a whole class path indexed by descriptor, so that finding a class
+  // takes a single probe rather than a search of each dex file in turn. As with FindInClassPath,
+  // the first dex file defining a class takes precedence. Dex files can only be appended, and
+  // not while the index is being searched.
+  class ClassPathIndex {
+   public:
+    ClassPathIndex();
+
+    void Append(const DexFile* dex_file);
+
+    ClassPathEntry Find(const char* descriptor) const;
+
+    const ClassPath& GetClassPath() const {
+      return class_path_;
+    }
+
+   private:
+    struct Slot {
+      uint32_t hash;
+      uint16_t class_path_idx;  // kDexNoIndex16 for a free slot.
+      uint16_t class_def_idx;
+    };
+
+    ClassPathEntry Find(const char* descriptor, uint32_t hash) const;
+    void Insert(const Slot& slot);
+
+    ClassPath class_path_;
+    // The number of slots is a power of two.
+    std::vector<Slot> slots_;
+    size_t size_;
+
+    DISALLOW_COPY_AND_ASSIGN(ClassPathIndex);
+  };
+
   // Returns the checksum of a file for comparison with GetLocationChecksum().
   // For .dex files, this is the header checksum.
   // For zip files, this is the classes.dex zip entry CRC32 checksum.
@@ -608,6 +642,10 @@ class DexFile {
   // Looks up a class definition by its class descriptor.
   const ClassDef* FindClassDef(const char* descriptor) const;
 
+  // Looks up a class definition by its class descriptor and the descriptor's
+  // ComputeModifiedUtf8Hash.
+  const ClassDef* FindClassDef(const char* descriptor, size_t hash) const;
+
   // Looks up a class definition by its type index.
   const ClassDef* FindClassDef(uint16_t type_idx) const;
 
@@ -890,6 +928,13 @@ class DexFile {
   // Bug 15313523: gcc/libc++ don't allow a unique_ptr for the first component
   static std::pair<const char*, const char*> SplitMultiDexLocation(const char* location);
 
+  // Returns the index of the class definitions by descriptor hash, building it on first use, or
+  // null if there are too many class definitions for it.
+  const uint32_t* GetClassDefIndex() const;
+
+  // The number of slots of the class definition index, a power of two.
+  size_t ClassDefIndexSize() const;
+
 
   // The base address of the memory mapping.
   const byte* const begin_;
@@ -928,6 +973,11 @@ class DexFile {
 
   // Points to the base of the class definition list.
   const ClassDef* const class_defs_;
+
+  // The index of the class definitions by descriptor hash. Each slot holds the top half of the
+  // hash in its top half and the class def index plus one in its bottom half, or 0 if it is free.
+  // Built by the first thread to need it, and published with a compare and swap.
+  mutable uint32_t* volatile class_def_index_;
 };
 std::ostream& operator<<(std::ostream& os, const DexFile& dex_file);
 
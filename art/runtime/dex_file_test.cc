@@ -293,6 +293,52 @@ TEST_F(DexFileTest, FindTypeId) {
   }
 }
 
+TEST_F(DexFileTest, FindClassDef) {
+  for (size_t i = 0; i < java_lang_dex_file_->NumClassDefs(); i++) {
+    const DexFile::ClassDef& class_def = java_lang_dex_file_->GetClassDef(i);
+    const char* descriptor = java_lang_dex_file_->GetClassDescriptor(class_def);
+    EXPECT_EQ(&class_def, java_lang_dex_file_->FindClassDef(descriptor)) << descriptor;
+    EXPECT_EQ(&class_def, java_lang_dex_file_->FindClassDef(class_def.class_idx_)) << descriptor;
+  }
+  // Types that are referenced but not defined, and types that aren't referenced at all.
+  EXPECT_TRUE(java_lang_dex_file_->FindClassDef("[Ljava/lang/Object;") == NULL);
+  EXPECT_TRUE(java_lang_dex_file_->FindClassDef("LNested;") == NULL);
+}
+
+TEST_F(DexFileTest, ClassPathIndex) {
+  ScopedObjectAccess soa(Thread::Current());
+  const DexFile* nested_1(OpenTestDexFile("Nested"));
+  ASSERT_TRUE(nested_1 != NULL);
+  const DexFile* nested_2(OpenTestDexFile("Nested"));
+  ASSERT_TRUE(nested_2 != NULL);
+
+  DexFile::ClassPathIndex index;
+  EXPECT_TRUE(index.Find("LNested;").second == NULL);
+  index.Append(nested_1);
+  index.Append(java_lang_dex_file_);
+  index.Append(nested_2);
+  ASSERT_EQ(3U, index.GetClassPath().size());
+
+  // The same classes are found as by searching each dex file in turn.
+  for (size_t i = 0; i < java_lang_dex_file_->NumClassDefs(); i++) {
+    const DexFile::ClassDef& class_def = java_lang_dex_file_->GetClassDef(i);
+    const char* descriptor = java_lang_dex_file_->GetClassDescriptor(class_def);
+    DexFile::ClassPathEntry entry = index.Find(descriptor);
+    EXPECT_EQ(java_lang_dex_file_, entry.first) << descriptor;
+    EXPECT_EQ(&class_def, entry.second) << descriptor;
+  }
+  // The first dex file to define a class takes precedence.
+  DexFile::ClassPathEntry nested = index.Find("LNested;");
+  EXPECT_EQ(nested_1, nested.first);
+  EXPECT_EQ(nested, DexFile::FindInClassPath("LNested;", index.GetClassPath()));
+  DexFile::ClassPathEntry inner = index.Find("LNested$Inner;");
+  EXPECT_EQ(nested_1, inner.first);
+  EXPECT_STREQ("LNested$Inner;", nested_1->GetClassDescriptor(*inner.second));
+
+  EXPECT_TRUE(index.Find("LNoSuchClass;").second == NULL);
+  EXPECT_TRUE(index.Find("I").second == NULL);
+}
+
 TEST_F(DexFileTest, FindProtoId) {
   for (size_t i = 0; i < java_lang_dex_file_->NumProtoIds(); i++) {
     const DexFile::ProtoId& to_find = java_lang_dex_file_->GetProtoId(i);
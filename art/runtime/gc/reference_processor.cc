@@ -27,8 +27,9 @@ namespace art {
 namespace gc {
 
 ReferenceProcessor::ReferenceProcessor()
-    : process_references_args_(nullptr, nullptr, nullptr), slow_path_enabled_(false),
-      preserving_references_(false), lock_("reference processor lock", kReferenceProcessorLock),
+    : process_references_args_(nullptr, nullptr, nullptr), marked_referent_sequence_(0),
+      slow_path_enabled_(false), preserving_references_(false),
+      lock_("reference processor lock", kReferenceProcessorLock),
       condition_("reference processor condition", lock_) {
 }
 
@@ -49,6 +50,12 @@ mirror::Object* ReferenceProcessor::GetReferent(Thread* self, mirror::Reference*
   if (LIKELY(!slow_path_enabled_) || referent == nullptr) {
     return referent;
   }
+  // Most referents of a large WeakHashMap are reachable and already marked, don't make the
+  // mutators queue up on lock_ for those.
+  mirror::Object* const marked_referent = GetMarkedReferent(reference);
+  if (marked_referent != nullptr) {
+    return marked_referent;
+  }
   MutexLock mu(self, lock_);
   while (slow_path_enabled_) {
     mirror::HeapReference<mirror::Object>* const referent_addr =
@@ -91,14 +98,45 @@ bool ReferenceProcessor::PreserveSoftReferenceCallback(mirror::HeapReference<mir
   return true;
 }
 
+mirror::Object* ReferenceProcessor::GetMarkedReferent(mirror::Reference* reference) {
+  const int32_t sequence = marked_referent_sequence_.LoadSequentiallyConsistent();
+  if ((sequence & 1) != 0) {
+    return nullptr;
+  }
+  IsHeapReferenceMarkedCallback* const is_marked_callback =
+      process_references_args_.is_marked_callback_;
+  void* const arg = process_references_args_.arg_;
+  // The args are only consistent if they were not being changed while we read them.
+  QuasiAtomic::ThreadFenceAcquire();
+  if (is_marked_callback == nullptr || marked_referent_sequence_.LoadRelaxed() != sequence) {
+    return nullptr;
+  }
+  mirror::HeapReference<mirror::Object>* const referent_addr =
+      reference->GetReferentReferenceAddr();
+  if (referent_addr->AsMirrorPtr() == nullptr || !is_marked_callback(referent_addr, arg)) {
+    return nullptr;
+  }
+  // The callback may have forwarded the referent in place, so read it again.
+  mirror::Object* const referent = referent_addr->AsMirrorPtr();
+  // If the GC started preserving references in the mean time, the referent may only have been
+  // marked by it and still have white fields, see GetReferent.
+  QuasiAtomic::ThreadFenceAcquire();
+  if (marked_referent_sequence_.LoadRelaxed() != sequence) {
+    return nullptr;
+  }
+  return referent;
+}
+
 void ReferenceProcessor::StartPreservingReferences(Thread* self) {
   MutexLock mu(self, lock_);
+  marked_referent_sequence_.FetchAndAddSequentiallyConsistent(1);
   preserving_references_ = true;
 }
 
 void ReferenceProcessor::StopPreservingReferences(Thread* self) {
   MutexLock mu(self, lock_);
   preserving_references_ = false;
+  marked_referent_sequence_.FetchAndAddSequentiallyConsistent(1);
   // We are done preserving references, some people who are blocked may see a marked referent.
   condition_.Broadcast(self);
 }
@@ -114,9 +152,11 @@ void ReferenceProcessor::ProcessReferences(bool concurrent, TimingLogger* timing
   Thread* self = Thread::Current();
   {
     MutexLock mu(self, lock_);
+    marked_referent_sequence_.FetchAndAddSequentiallyConsistent(1);
     process_references_args_.is_marked_callback_ = is_marked_callback;
     process_references_args_.mark_callback_ = mark_object_callback;
     process_references_args_.arg_ = arg;
+    marked_referent_sequence_.FetchAndAddSequentiallyConsistent(1);
     CHECK_EQ(slow_path_enabled_, concurrent) << "Slow path must be enabled iff concurrent";
   }
   // Unless required to clear soft references with white references, preserve some white referents.
@@ -167,7 +207,9 @@ void ReferenceProcessor::ProcessReferences(bool concurrent, TimingLogger* timing
     // could result in a stale is_marked_callback_ being called before the reference processing
     // starts since there is a small window of time where slow_path_enabled_ is enabled but the
     // callback isn't yet set.
+    marked_referent_sequence_.FetchAndAddSequentiallyConsistent(1);
     process_references_args_.is_marked_callback_ = nullptr;
+    marked_referent_sequence_.FetchAndAddSequentiallyConsistent(1);
     if (concurrent) {
       // Done processing, disable the slow path and broadcast to the waiters.
       DisableSlowPath(self);
@@ -185,18 +227,17 @@ void ReferenceProcessor::DelayReferenceReferent(mirror::Class* klass, mirror::Re
   DCHECK(klass->IsReferenceClass());
   mirror::HeapReference<mirror::Object>* referent = ref->GetReferentReferenceAddr();
   if (referent->AsMirrorPtr() != nullptr && !is_marked_callback(referent, arg)) {
-    Thread* self = Thread::Current();
-    // TODO: Remove these locks, and use atomic stacks for storing references?
     // We need to check that the references haven't already been enqueued since we can end up
-    // scanning the same reference multiple times due to dirty cards.
+    // scanning the same reference multiple times due to dirty cards. The parallel marking threads
+    // enqueue without a lock.
     if (klass->IsSoftReferenceClass()) {
-      soft_reference_queue_.AtomicEnqueueIfNotEnqueued(self, ref);
+      soft_reference_queue_.AtomicEnqueueIfNotEnqueued(ref);
     } else if (klass->IsWeakReferenceClass()) {
-      weak_reference_queue_.AtomicEnqueueIfNotEnqueued(self, ref);
+      weak_reference_queue_.AtomicEnqueueIfNotEnqueued(ref);
     } else if (klass->IsFinalizerReferenceClass()) {
-      finalizer_reference_queue_.AtomicEnqueueIfNotEnqueued(self, ref);
+      finalizer_reference_queue_.AtomicEnqueueIfNotEnqueued(ref);
     } else if (klass->IsPhantomReferenceClass()) {
-      phantom_reference_queue_.AtomicEnqueueIfNotEnqueued(self, ref);
+      phantom_reference_queue_.AtomicEnqueueIfNotEnqueued(ref);
     } else {
       LOG(FATAL) << "Invalid reference type " << PrettyClass(klass) << " " << std::hex
                  << klass->GetAccessFlags();
@@ -17,6 +17,7 @@
 #ifndef ART_RUNTIME_GC_REFERENCE_PROCESSOR_H_
 #define ART_RUNTIME_GC_REFERENCE_PROCESSOR_H_
 
+#include "atomic.h"
 #include "base/mutex.h"
 #include "globals.h"
 #include "jni.h"
@@ -77,13 +78,23 @@ class ReferenceProcessor {
   };
   // Called by ProcessReferences.
   void DisableSlowPath(Thread* self) EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  // Called by GetReferent while the slow path is enabled. Returns the referent without taking
+  // lock_ if the GC already marked it and is not preserving references, null if the caller needs
+  // to take the lock.
+  mirror::Object* GetMarkedReferent(mirror::Reference* reference)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) LOCKS_EXCLUDED(lock_);
   // If we are preserving references it means that some dead objects may become live, we use start
   // and stop preserving to block mutators using GetReferrent from getting access to these
   // referents.
   void StartPreservingReferences(Thread* self) LOCKS_EXCLUDED(lock_);
   void StopPreservingReferences(Thread* self) LOCKS_EXCLUDED(lock_);
-  // Process args, used by the GetReferent to return referents which are already marked.
-  ProcessReferencesArgs process_references_args_ GUARDED_BY(lock_);
+  // Process args, used by the GetReferent to return referents which are already marked. Written
+  // holding lock_, but GetMarkedReferent reads them without it.
+  ProcessReferencesArgs process_references_args_;
+  // A sequence lock for GetMarkedReferent. Odd while process_references_args_ is being changed or
+  // references are being preserved, and changed only holding lock_. The referent is only handed
+  // out if the sequence was even and the same before and after it was found to be marked.
+  AtomicInteger marked_referent_sequence_;
   // Boolean for whether or not we need to go slow path in GetReferent.
   volatile bool slow_path_enabled_;
   // Boolean for whether or not we are preserving references (either soft references or finalizers).
@@ -100,6 +111,8 @@ class ReferenceProcessor {
   ReferenceQueue finalizer_reference_queue_;
   ReferenceQueue phantom_reference_queue_;
   ReferenceQueue cleared_references_;
+
+  friend class ReferenceQueueTest;  // To test GetMarkedReferent.
 };
 
 }  // namespace gc
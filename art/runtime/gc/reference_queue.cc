@@ -26,14 +26,42 @@ namespace art {
 namespace gc {
 
 ReferenceQueue::ReferenceQueue()
-    : lock_("reference queue lock"), list_(nullptr) {
+    : list_(nullptr) {
 }
 
-void ReferenceQueue::AtomicEnqueueIfNotEnqueued(Thread* self, mirror::Reference* ref) {
+void ReferenceQueue::AtomicEnqueueIfNotEnqueued(mirror::Reference* ref) {
   DCHECK(ref != NULL);
-  MutexLock mu(self, lock_);
-  if (!ref->IsEnqueued()) {
-    EnqueuePendingReference(ref);
+  const bool transaction_active = Runtime::Current()->IsActiveTransaction();
+  // Pointing the pending next at the reference itself makes it enqueued. Of the threads that see
+  // the same reference, for instance when rescanning dirty cards, only the first one gets past.
+  const bool claimed = transaction_active ? ref->CasPendingNext<true>(nullptr, ref) :
+      ref->CasPendingNext<false>(nullptr, ref);
+  if (!claimed) {
+    return;
+  }
+  while (true) {
+    mirror::Reference* const tail = list_;
+    if (tail == nullptr) {
+      // 1 element cyclic queue, the pending next of ref already points to itself.
+      if (__sync_bool_compare_and_swap(&list_, static_cast<mirror::Reference*>(nullptr), ref)) {
+        return;
+      }
+      continue;
+    }
+    // Insert ref after the tail, as EnqueuePendingReference does. References are only ever added
+    // while enqueuing in parallel, so seeing the same head again means nothing changed.
+    mirror::Reference* const head = tail->GetPendingNext();
+    if (transaction_active) {
+      ref->SetPendingNext<true>(head);
+      if (tail->CasPendingNext<true>(head, ref)) {
+        return;
+      }
+    } else {
+      ref->SetPendingNext<false>(head);
+      if (tail->CasPendingNext<false>(head, ref)) {
+        return;
+      }
+    }
   }
 }
 
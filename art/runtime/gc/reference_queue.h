@@ -46,10 +46,12 @@ class ReferenceQueue {
  public:
   explicit ReferenceQueue();
   // Enqueue a reference if is not already enqueued. Thread safe to call from multiple threads
-  // since it uses a lock to avoid a race between checking for the references presence and adding
-  // it.
-  void AtomicEnqueueIfNotEnqueued(Thread* self, mirror::Reference* ref)
-      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) LOCKS_EXCLUDED(lock_);
+  // without a lock: the enqueuing thread claims the reference with a CAS of its pending next, then
+  // links it in with a CAS of the pending next of list_, which never changes while the queue is
+  // non-empty. Must not run concurrently with the other methods, which the GC only calls once it
+  // is done enqueuing.
+  void AtomicEnqueueIfNotEnqueued(mirror::Reference* ref)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
   // Enqueue a reference, unlike EnqueuePendingReference, enqueue reference checks that the
   // reference IsEnqueueable. Not thread safe, used when mutators are paused to minimize lock
   // overhead.
@@ -88,9 +90,6 @@ class ReferenceQueue {
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
  private:
-  // Lock, used for parallel GC reference enqueuing. It allows for multiple threads simultaneously
-  // calling AtomicEnqueueIfNotEnqueued.
-  Mutex lock_ DEFAULT_MUTEX_ACQUIRED_AFTER;
   // The actual reference list. Only a root for the mark compact GC since it will be null for other
   // GC types.
   mirror::Reference* list_;
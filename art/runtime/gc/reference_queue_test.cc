@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "reference_queue.h"
+
+#include <set>
+
+#include "common_runtime_test.h"
+#include "handle_scope-inl.h"
+#include "mirror/class-inl.h"
+#include "mirror/object-inl.h"
+#include "mirror/object_array-inl.h"
+#include "mirror/reference-inl.h"
+#include "reference_processor.h"
+#include "scoped_thread_state_change.h"
+#include "thread_pool.h"
+
+namespace art {
+namespace gc {
+
+static constexpr size_t kNumReferences = 1000;
+static constexpr size_t kNumThreads = 4;
+
+class ReferenceQueueTest : public CommonRuntimeTest {
+ public:
+  // Allocates kNumReferences weak references with null referents.
+  mirror::ObjectArray<mirror::Object>* AllocReferences(Thread* self)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+    StackHandleScope<2> hs(self);
+    Handle<mirror::Class> weak_reference_class(
+        hs.NewHandle(class_linker_->FindSystemClass(self, "Ljava/lang/ref/WeakReference;")));
+    EXPECT_TRUE(class_linker_->EnsureInitialized(weak_reference_class, true, true));
+    Handle<mirror::ObjectArray<mirror::Object>> references(hs.NewHandle(
+        mirror::ObjectArray<mirror::Object>::Alloc(
+            self, class_linker_->FindSystemClass(self, "[Ljava/lang/Object;"), kNumReferences)));
+    for (size_t i = 0; i < kNumReferences; ++i) {
+      references->Set<false>(i, weak_reference_class->AllocNonMovableObject(self));
+    }
+    return references.Get();
+  }
+
+  // Dequeues all of queue, checking that it holds each of references exactly once.
+  void CheckQueue(ReferenceQueue* queue, mirror::ObjectArray<mirror::Object>* references)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+    std::set<mirror::Reference*> dequeued;
+    while (!queue->IsEmpty()) {
+      mirror::Reference* ref = queue->DequeuePendingReference();
+      EXPECT_FALSE(ref->IsEnqueued());
+      EXPECT_TRUE(dequeued.insert(ref).second);
+    }
+    ASSERT_EQ(kNumReferences, dequeued.size());
+    for (size_t i = 0; i < kNumReferences; ++i) {
+      EXPECT_EQ(1U, dequeued.count(references->Get(i)->AsReference()));
+    }
+  }
+
+  // Sets the is marked callback that GetMarkedReferent uses, as ProcessReferences does.
+  void SetIsMarkedCallback(ReferenceProcessor* processor,
+                           IsHeapReferenceMarkedCallback* is_marked_callback) {
+    MutexLock mu(Thread::Current(), processor->lock_);
+    processor->marked_referent_sequence_.FetchAndAddSequentiallyConsistent(1);
+    processor->process_references_args_.is_marked_callback_ = is_marked_callback;
+    processor->marked_referent_sequence_.FetchAndAddSequentiallyConsistent(1);
+  }
+
+  mirror::Object* GetMarkedReferent(ReferenceProcessor* processor, mirror::Reference* reference)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+    return processor->GetMarkedReferent(reference);
+  }
+
+  void StartPreservingReferences(ReferenceProcessor* processor) {
+    processor->StartPreservingReferences(Thread::Current());
+  }
+
+  void StopPreservingReferences(ReferenceProcessor* processor) {
+    processor->StopPreservingReferences(Thread::Current());
+  }
+};
+
+TEST_F(ReferenceQueueTest, AtomicEnqueueIfNotEnqueued) {
+  ScopedObjectAccess soa(Thread::Current());
+  StackHandleScope<1> hs(soa.Self());
+  Handle<mirror::ObjectArray<mirror::Object>> references(
+      hs.NewHandle(AllocReferences(soa.Self())));
+  ReferenceQueue queue;
+  EXPECT_TRUE(queue.IsEmpty());
+  for (size_t i = 0; i < kNumReferences; ++i) {
+    mirror::Reference* ref = references->Get(i)->AsReference();
+    EXPECT_FALSE(ref->IsEnqueued());
+    queue.AtomicEnqueueIfNotEnqueued(ref);
+    EXPECT_TRUE(ref->IsEnqueued());
+    // A reference that is already enqueued is not added again.
+    queue.AtomicEnqueueIfNotEnqueued(ref);
+  }
+  CheckQueue(&queue, references.Get());
+}
+
+static bool IsMarked(mirror::HeapReference<mirror::Object>*, void*) {
+  return true;
+}
+
+static bool IsNotMarked(mirror::HeapReference<mirror::Object>*, void*) {
+  return false;
+}
+
+// Check that the referent is only handed out without the lock while the GC has it marked and is
+// not preserving references.
+TEST_F(ReferenceQueueTest, GetMarkedReferent) {
+  ScopedObjectAccess soa(Thread::Current());
+  StackHandleScope<2> hs(soa.Self());
+  Handle<mirror::ObjectArray<mirror::Object>> references(
+      hs.NewHandle(AllocReferences(soa.Self())));
+  Handle<mirror::Reference> ref(hs.NewHandle(references->Get(0)->AsReference()));
+  mirror::Object* referent = references->Get(1);
+  ref->SetReferent<false>(referent);
+  ReferenceProcessor processor;
+
+  // Before the GC has set up its callbacks.
+  EXPECT_EQ(nullptr, GetMarkedReferent(&processor, ref.Get()));
+
+  SetIsMarkedCallback(&processor, IsNotMarked);
+  EXPECT_EQ(nullptr, GetMarkedReferent(&processor, ref.Get()));
+  SetIsMarkedCallback(&processor, IsMarked);
+  EXPECT_EQ(referent, GetMarkedReferent(&processor, ref.Get()));
+
+  // While preserving references the sequence is odd.
+  StartPreservingReferences(&processor);
+  EXPECT_EQ(nullptr, GetMarkedReferent(&processor, ref.Get()));
+  StopPreservingReferences(&processor);
+  EXPECT_EQ(referent, GetMarkedReferent(&processor, ref.Get()));
+
+  // After the GC has cleared its callbacks.
+  SetIsMarkedCallback(&processor, nullptr);
+  EXPECT_EQ(nullptr, GetMarkedReferent(&processor, ref.Get()));
+}
+
+class EnqueueTask : public Task {
+ public:
+  EnqueueTask(ReferenceQueue* queue, Handle<mirror::ObjectArray<mirror::Object>>* references)
+      : queue_(queue), references_(references) {}
+
+  virtual void Run(Thread* self) {
+    ScopedObjectAccess soa(self);
+    mirror::ObjectArray<mirror::Object>* references = references_->Get();
+    for (int32_t i = 0; i < references->GetLength(); ++i) {
+      queue_->AtomicEnqueueIfNotEnqueued(references->Get(i)->AsReference());
+    }
+  }
+
+  virtual void Finalize() {
+    delete this;
+  }
+
+ private:
+  ReferenceQueue* const queue_;
+  Handle<mirror::ObjectArray<mirror::Object>>* const references_;
+};
+
+// Check that threads racing to enqueue the same references add each of them once.
+TEST_F(ReferenceQueueTest, ParallelEnqueue) {
+  ScopedObjectAccess soa(Thread::Current());
+  Thread* self = soa.Self();
+  StackHandleScope<1> hs(self);
+  Handle<mirror::ObjectArray<mirror::Object>> references(hs.NewHandle(AllocReferences(self)));
+  ReferenceQueue queue;
+  {
+    // Let the workers run while we wait for them.
+    ScopedThreadStateChange tsc(self, kNative);
+    ThreadPool thread_pool("Reference queue test thread pool", kNumThreads);
+    for (size_t i = 0; i < kNumThreads; ++i) {
+      thread_pool.AddTask(self, new EnqueueTask(&queue, &references));
+    }
+    thread_pool.StartWorkers(self);
+    thread_pool.Wait(self, true, false);
+  }
+  CheckQueue(&queue, references.Get());
+}
+
+}  // namespace gc
+}  // namespace art
@@ -107,6 +107,7 @@ class PACKED(4) ImageHeader {
     kRefsAndArgsSaveMethod,
     kDexCaches,
     kClassRoots,
+    kInternedStrings,
     kImageRootsMax,
   };
 
@@ -16,67 +16,193 @@
 
 #include "intern_table.h"
 
+#include <algorithm>
 #include <memory>
 
-#include "gc/space/image_space.h"
+#include "class_linker.h"
+#include "handle_scope-inl.h"
 #include "mirror/dex_cache.h"
 #include "mirror/object_array-inl.h"
 #include "mirror/object-inl.h"
 #include "mirror/string.h"
+#include "runtime.h"
 #include "thread.h"
 #include "utf.h"
+#include "utils.h"
 
 namespace art {
 
+// The largest fraction of the slots of a table that can be used before it grows, and the
+// smallest fraction that can be left used by a sweep before it shrinks, in percent.
+static constexpr size_t kMaxLoadPercent = 70;
+static constexpr size_t kMinLoadPercent = 20;
+static constexpr size_t kMinCapacity = 16;
+
+InternTable::Table::Table() : slots_(kMinCapacity), size_(0) {
+}
+
+mirror::String* InternTable::Table::Find(mirror::String* s, int32_t hash_code) {
+  for (size_t i = FirstIndex(hash_code); slots_[i].string != nullptr; i = NextIndex(i)) {
+    if (slots_[i].hash_code == hash_code) {
+      mirror::String** root = &slots_[i].string;
+      mirror::String* existing_string =
+          ReadBarrier::BarrierForRoot<mirror::String, kWithReadBarrier>(root);
+      if (existing_string->Equals(s)) {
+        return existing_string;
+      }
+    }
+  }
+  return nullptr;
+}
+
+void InternTable::Table::Insert(mirror::String* s, int32_t hash_code) {
+  if ((size_ + 1) * 100 > slots_.size() * kMaxLoadPercent) {
+    Resize(slots_.size() * 2);
+  }
+  size_t i = FirstIndex(hash_code);
+  while (slots_[i].string != nullptr) {
+    i = NextIndex(i);
+  }
+  slots_[i].string = s;
+  slots_[i].hash_code = hash_code;
+  ++size_;
+}
+
+void InternTable::Table::Remove(mirror::String* s, int32_t hash_code) {
+  for (size_t i = FirstIndex(hash_code); slots_[i].string != nullptr; i = NextIndex(i)) {
+    if (slots_[i].hash_code == hash_code) {
+      mirror::String** root = &slots_[i].string;
+      mirror::String* existing_string =
+          ReadBarrier::BarrierForRoot<mirror::String, kWithReadBarrier>(root);
+      if (existing_string == s) {
+        EraseAt(i);
+        return;
+      }
+    }
+  }
+}
+
+void InternTable::Table::Replace(mirror::String* old_s, mirror::String* new_s,
+                                 int32_t hash_code) {
+  for (size_t i = FirstIndex(hash_code); slots_[i].string != nullptr; i = NextIndex(i)) {
+    if (slots_[i].string == old_s) {
+      slots_[i].string = new_s;
+      return;
+    }
+  }
+}
+
+void InternTable::Table::EraseAt(size_t index) {
+  // Rather than leaving a tombstone, move back each of the following strings up to the next free
+  // slot that would still be found by probing from its hash code at the vacated slot.
+  const size_t mask = slots_.size() - 1;
+  size_t hole = index;
+  for (size_t i = NextIndex(index); slots_[i].string != nullptr; i = NextIndex(i)) {
+    size_t first = FirstIndex(slots_[i].hash_code);
+    if (((i - first) & mask) >= ((i - hole) & mask)) {
+      slots_[hole] = slots_[i];
+      hole = i;
+    }
+  }
+  slots_[hole].string = nullptr;
+  --size_;
+}
+
+void InternTable::Table::Resize(size_t capacity) {
+  std::vector<Slot> old_slots(capacity);
+  old_slots.swap(slots_);
+  for (const Slot& slot : old_slots) {
+    if (slot.string != nullptr) {
+      size_t i = FirstIndex(slot.hash_code);
+      while (slots_[i].string != nullptr) {
+        i = NextIndex(i);
+      }
+      slots_[i] = slot;
+    }
+  }
+}
+
+void InternTable::Table::VisitRoots(RootCallback* callback, void* arg) {
+  for (Slot& slot : slots_) {
+    if (slot.string != nullptr) {
+      callback(reinterpret_cast<mirror::Object**>(&slot.string), arg, 0, kRootInternedString);
+      DCHECK(slot.string != nullptr);
+    }
+  }
+}
+
+void InternTable::Table::SweepWeaks(IsMarkedCallback* callback, void* arg) {
+  // Start after a free slot, which the table always has. EraseAt then only moves strings that
+  // are still to be visited, since it never moves a string past a free slot.
+  const size_t capacity = slots_.size();
+  size_t start = 0;
+  while (slots_[start].string != nullptr) {
+    ++start;
+  }
+  for (size_t n = 1; n < capacity;) {
+    Slot& slot = slots_[(start + n) & (capacity - 1)];
+    if (slot.string == nullptr) {
+      ++n;
+      continue;
+    }
+    // This does not need a read barrier because this is called by GC.
+    mirror::Object* new_object = callback(slot.string, arg);
+    if (new_object == nullptr) {
+      // The slot may now hold a string moved back from later on, so look at it again.
+      EraseAt((start + n) & (capacity - 1));
+    } else {
+      slot.string = down_cast<mirror::String*>(new_object);
+      ++n;
+    }
+  }
+  size_t new_capacity = capacity;
+  while (new_capacity > kMinCapacity && size_ * 100 < new_capacity * kMinLoadPercent) {
+    new_capacity /= 2;
+  }
+  if (new_capacity != capacity) {
+    Resize(new_capacity);
+  }
+}
+
 InternTable::InternTable()
     : log_new_roots_(false), allow_new_interns_(true),
-      new_intern_condition_("New intern condition", *Locks::intern_table_lock_) {
+      new_intern_condition_("New intern condition", *Locks::intern_table_lock_),
+      image_strings_(nullptr) {
 }
 
 size_t InternTable::Size() const {
   MutexLock mu(Thread::Current(), *Locks::intern_table_lock_);
-  return strong_interns_.size() + weak_interns_.size();
+  return strong_interns_.Size() + weak_interns_.Size();
 }
 
 size_t InternTable::StrongSize() const {
   MutexLock mu(Thread::Current(), *Locks::intern_table_lock_);
-  return strong_interns_.size();
+  return strong_interns_.Size();
 }
 
 size_t InternTable::WeakSize() const {
   MutexLock mu(Thread::Current(), *Locks::intern_table_lock_);
-  return weak_interns_.size();
+  return weak_interns_.Size();
 }
 
 void InternTable::DumpForSigQuit(std::ostream& os) const {
   MutexLock mu(Thread::Current(), *Locks::intern_table_lock_);
-  os << "Intern table: " << strong_interns_.size() << " strong; "
-     << weak_interns_.size() << " weak\n";
+  os << "Intern table: " << strong_interns_.Size() << " strong; "
+     << weak_interns_.Size() << " weak\n";
 }
 
 void InternTable::VisitRoots(RootCallback* callback, void* arg, VisitRootFlags flags) {
   MutexLock mu(Thread::Current(), *Locks::intern_table_lock_);
   if ((flags & kVisitRootFlagAllRoots) != 0) {
-    for (auto& strong_intern : strong_interns_) {
-      callback(reinterpret_cast<mirror::Object**>(&strong_intern.second), arg, 0,
-               kRootInternedString);
-      DCHECK(strong_intern.second != nullptr);
-    }
+    strong_interns_.VisitRoots(callback, arg);
   } else if ((flags & kVisitRootFlagNewRoots) != 0) {
     for (auto& pair : new_strong_intern_roots_) {
        mirror::String* old_ref = pair.second;
        callback(reinterpret_cast<mirror::Object**>(&pair.second), arg, 0, kRootInternedString);
        if (UNLIKELY(pair.second != old_ref)) {
          // Uh ohes, GC moved a root in the log. Need to search the strong interns and update the
-         // corresponding object. This is slow, but luckily for us, this may only happen with a
-         // concurrent moving GC.
-         for (auto it = strong_interns_.lower_bound(pair.first), end = strong_interns_.end();
-             it != end && it->first == pair.first; ++it) {
-           // If the class stored matches the old class, update it to the new value.
-           if (old_ref == it->second) {
-             it->second = pair.second;
-           }
-         }
+         // corresponding object. This may only happen with a concurrent moving GC.
+         strong_interns_.Replace(old_ref, pair.second, pair.first);
        }
      }
   }
@@ -93,26 +219,28 @@ void InternTable::VisitRoots(RootCallback* callback, void* arg, VisitRootFlags f
 }
 
 mirror::String* InternTable::LookupStrong(mirror::String* s, int32_t hash_code) {
-  return Lookup(&strong_interns_, s, hash_code);
+  return strong_interns_.Find(s, hash_code);
 }
 
 mirror::String* InternTable::LookupWeak(mirror::String* s, int32_t hash_code) {
   // Weak interns need a read barrier because they are weak roots.
-  return Lookup(&weak_interns_, s, hash_code);
-}
-
-mirror::String* InternTable::Lookup(Table* table, mirror::String* s, int32_t hash_code) {
-  Locks::intern_table_lock_->AssertHeld(Thread::Current());
-  for (auto it = table->lower_bound(hash_code), end = table->end();
-       it != end && it->first == hash_code; ++it) {
-    mirror::String* existing_string;
-    mirror::String** root = &it->second;
-    existing_string = ReadBarrier::BarrierForRoot<mirror::String, kWithReadBarrier>(root);
-    if (existing_string->Equals(s)) {
-      return existing_string;
+  return weak_interns_.Find(s, hash_code);
+}
+
+mirror::String* InternTable::LookupImage(mirror::String* s, int32_t hash_code) {
+  if (image_strings_ == nullptr) {
+    return nullptr;  // No image present.
+  }
+  const size_t mask = image_strings_->GetLength() - 1;
+  for (size_t i = HashIndex(hash_code) & mask; ; i = (i + 1) & mask) {
+    mirror::String* image_string = image_strings_->GetWithoutChecks(i);
+    if (image_string == nullptr) {
+      return nullptr;
+    }
+    if (image_string->GetHashCode() == hash_code && image_string->Equals(s)) {
+      return image_string;
     }
   }
-  return NULL;
 }
 
 mirror::String* InternTable::InsertStrong(mirror::String* s, int32_t hash_code) {
@@ -123,7 +251,7 @@ mirror::String* InternTable::InsertStrong(mirror::String* s, int32_t hash_code)
   if (log_new_roots_) {
     new_strong_intern_roots_.push_back(std::make_pair(hash_code, s));
   }
-  strong_interns_.insert(std::make_pair(hash_code, s));
+  strong_interns_.Insert(s, hash_code);
   return s;
 }
 
@@ -132,12 +260,12 @@ mirror::String* InternTable::InsertWeak(mirror::String* s, int32_t hash_code) {
   if (runtime->IsActiveTransaction()) {
     runtime->RecordWeakStringInsertion(s, hash_code);
   }
-  weak_interns_.insert(std::make_pair(hash_code, s));
+  weak_interns_.Insert(s, hash_code);
   return s;
 }
 
 void InternTable::RemoveStrong(mirror::String* s, int32_t hash_code) {
-  Remove(&strong_interns_, s, hash_code);
+  strong_interns_.Remove(s, hash_code);
 }
 
 void InternTable::RemoveWeak(mirror::String* s, int32_t hash_code) {
@@ -145,20 +273,7 @@ void InternTable::RemoveWeak(mirror::String* s, int32_t hash_code) {
   if (runtime->IsActiveTransaction()) {
     runtime->RecordWeakStringRemoval(s, hash_code);
   }
-  Remove(&weak_interns_, s, hash_code);
-}
-
-void InternTable::Remove(Table* table, mirror::String* s, int32_t hash_code) {
-  for (auto it = table->lower_bound(hash_code), end = table->end();
-       it != end && it->first == hash_code; ++it) {
-    mirror::String* existing_string;
-    mirror::String** root = &it->second;
-    existing_string = ReadBarrier::BarrierForRoot<mirror::String, kWithReadBarrier>(root);
-    if (existing_string == s) {
-      table->erase(it);
-      return;
-    }
-  }
+  weak_interns_.Remove(s, hash_code);
 }
 
 // Insert/remove methods used to undo changes made during an aborted transaction.
@@ -179,29 +294,68 @@ void InternTable::RemoveWeakFromTransaction(mirror::String* s, int32_t hash_code
   RemoveWeak(s, hash_code);
 }
 
-static mirror::String* LookupStringFromImage(mirror::String* s)
-    SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
-  gc::space::ImageSpace* image = Runtime::Current()->GetHeap()->GetImageSpace();
-  if (image == NULL) {
-    return NULL;  // No image present.
+void InternTable::SetImageStrings(mirror::ObjectArray<mirror::String>* image_strings) {
+  MutexLock mu(Thread::Current(), *Locks::intern_table_lock_);
+  DCHECK(IsPowerOfTwo(image_strings->GetLength()));
+  image_strings_ = image_strings;
+}
+
+mirror::ObjectArray<mirror::String>* InternTable::CreateImageStrings(
+    Thread* self, Handle<mirror::ObjectArray<mirror::Object>> dex_caches) {
+  // Count the distinct strings before allocating the table, since that may move them. This also
+  // computes their hash codes, so that they are stored in the image.
+  size_t count;
+  {
+    Table distinct;
+    for (int32_t i = 0; i < dex_caches->GetLength(); ++i) {
+      mirror::ObjectArray<mirror::String>* strings =
+          down_cast<mirror::DexCache*>(dex_caches->Get(i))->GetStrings();
+      for (int32_t j = 0; j < strings->GetLength(); ++j) {
+        mirror::String* string = strings->Get(j);
+        if (string != nullptr) {
+          int32_t hash_code = string->GetHashCode();
+          if (distinct.Find(string, hash_code) == nullptr) {
+            distinct.Insert(string, hash_code);
+          }
+        }
+      }
+    }
+    count = distinct.Size();
   }
-  mirror::Object* root = image->GetImageHeader().GetImageRoot(ImageHeader::kDexCaches);
-  mirror::ObjectArray<mirror::DexCache>* dex_caches = root->AsObjectArray<mirror::DexCache>();
-  const std::string utf8 = s->ToModifiedUtf8();
+
+  // Keep the table at most half full so that lookups of missing strings stay short.
+  mirror::Class* string_array_class =
+      Runtime::Current()->GetClassLinker()->FindSystemClass(self, "[Ljava/lang/String;");
+  CHECK(string_array_class != nullptr);
+  const size_t capacity = RoundUpToPowerOfTwo(std::max<size_t>(count * 2, 1));
+  mirror::ObjectArray<mirror::String>* image_strings =
+      mirror::ObjectArray<mirror::String>::Alloc(self, string_array_class, capacity);
+  if (image_strings == nullptr) {
+    return nullptr;
+  }
+  const size_t mask = capacity - 1;
   for (int32_t i = 0; i < dex_caches->GetLength(); ++i) {
-    mirror::DexCache* dex_cache = dex_caches->Get(i);
-    const DexFile* dex_file = dex_cache->GetDexFile();
-    // Binary search the dex file for the string index.
-    const DexFile::StringId* string_id = dex_file->FindStringId(utf8.c_str());
-    if (string_id != NULL) {
-      uint32_t string_idx = dex_file->GetIndexForStringId(*string_id);
-      mirror::String* image = dex_cache->GetResolvedString(string_idx);
-      if (image != NULL) {
-        return image;
+    mirror::ObjectArray<mirror::String>* strings =
+        down_cast<mirror::DexCache*>(dex_caches->Get(i))->GetStrings();
+    for (int32_t j = 0; j < strings->GetLength(); ++j) {
+      mirror::String* string = strings->Get(j);
+      if (string == nullptr) {
+        continue;
+      }
+      int32_t hash_code = string->GetHashCode();
+      for (size_t k = HashIndex(hash_code) & mask; ; k = (k + 1) & mask) {
+        mirror::String* existing_string = image_strings->GetWithoutChecks(k);
+        if (existing_string == nullptr) {
+          image_strings->Set<false>(k, string);
+          break;
+        }
+        if (existing_string->GetHashCode() == hash_code && existing_string->Equals(string)) {
+          break;
+        }
       }
     }
   }
-  return NULL;
+  return image_strings;
 }
 
 void InternTable::AllowNewInterns() {
@@ -235,10 +389,11 @@ mirror::String* InternTable::Insert(mirror::String* s, bool is_strong) {
       return strong;
     }
 
-    // Check the image for a match.
-    mirror::String* image = LookupStringFromImage(s);
+    // Check the image for a match. Image strings are never moved or freed, so they don't
+    // need to be in the strong table.
+    mirror::String* image = LookupImage(s, hash_code);
     if (image != NULL) {
-      return InsertStrong(image, hash_code);
+      return image;
     }
 
     // There is no match in the strong table, check the weak table.
@@ -260,9 +415,9 @@ mirror::String* InternTable::Insert(mirror::String* s, bool is_strong) {
     return strong;
   }
   // Check the image for a match.
-  mirror::String* image = LookupStringFromImage(s);
+  mirror::String* image = LookupImage(s, hash_code);
   if (image != NULL) {
-    return InsertWeak(image, hash_code);
+    return image;
   }
   // Check the weak table for a match.
   mirror::String* weak = LookupWeak(s, hash_code);
@@ -306,18 +461,7 @@ bool InternTable::ContainsWeak(mirror::String* s) {
 
 void InternTable::SweepInternTableWeaks(IsMarkedCallback* callback, void* arg) {
   MutexLock mu(Thread::Current(), *Locks::intern_table_lock_);
-  for (auto it = weak_interns_.begin(), end = weak_interns_.end(); it != end;) {
-    // This does not need a read barrier because this is called by GC.
-    mirror::Object* object = it->second;
-    mirror::Object* new_object = callback(object, arg);
-    if (new_object == nullptr) {
-      // TODO: use it = weak_interns_.erase(it) when we get a c++11 stl.
-      weak_interns_.erase(it++);
-    } else {
-      it->second = down_cast<mirror::String*>(new_object);
-      ++it;
-    }
-  }
+  weak_interns_.SweepWeaks(callback, arg);
 }
 
 }  // namespace art
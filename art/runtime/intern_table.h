@@ -17,7 +17,7 @@
 #ifndef ART_RUNTIME_INTERN_TABLE_H_
 #define ART_RUNTIME_INTERN_TABLE_H_
 
-#include <map>
+#include <vector>
 
 #include "base/mutex.h"
 #include "object_callbacks.h"
@@ -27,8 +27,11 @@ namespace art {
 enum VisitRootFlags : uint8_t;
 
 namespace mirror {
+class Object;
+template<class T> class ObjectArray;
 class String;
 }  // namespace mirror
+template<class T> class Handle;
 class Transaction;
 
 /**
@@ -40,6 +43,9 @@ class Transaction;
  * String.intern. Some code (XML parsers being a prime example) relies on being able to intern
  * arbitrarily many strings for the duration of a parse without permanently increasing the memory
  * footprint.
+ *
+ * Strings from the boot image are found in a third, read-only table stored in the image itself,
+ * so that they don't need to be copied into the strong table when they are first interned.
  */
 class InternTable {
  public:
@@ -74,19 +80,84 @@ class InternTable {
   void DisallowNewInterns() EXCLUSIVE_LOCKS_REQUIRED(Locks::mutator_lock_);
   void AllowNewInterns() SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
+  // Use the table of strings stored in the boot image, as made by CreateImageStrings.
+  void SetImageStrings(mirror::ObjectArray<mirror::String>* image_strings)
+      LOCKS_EXCLUDED(Locks::intern_table_lock_);
+
+  // Make the table of strings to store in an image, holding the strings resolved in the given
+  // dex caches. Each string is at the first free index probing from its hash code, so that
+  // the table can be searched in place when the image is loaded. As in the dex caches, the
+  // earlier dex caches take precedence for strings that are equal.
+  static mirror::ObjectArray<mirror::String>* CreateImageStrings(
+      Thread* self, Handle<mirror::ObjectArray<mirror::Object>> dex_caches)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+
  private:
-  typedef std::multimap<int32_t, mirror::String*> Table;
+  // A hash set of strings using open addressing with linear probing. The hash code of each
+  // string is kept alongside it so that probing only reads the strings with a matching hash
+  // code, and so that strings can be moved around the table without being read, as needed
+  // while the weak table is swept.
+  class Table {
+   public:
+    Table();
+
+    size_t Size() const {
+      return size_;
+    }
+
+    // Return the string in the table equal to s, or null.
+    mirror::String* Find(mirror::String* s, int32_t hash_code)
+        SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+    void Insert(mirror::String* s, int32_t hash_code);
+    // Remove s itself, rather than a string equal to it, if it is in the table.
+    void Remove(mirror::String* s, int32_t hash_code)
+        SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+    // Replace old_s with new_s, for a string moved by the GC.
+    void Replace(mirror::String* old_s, mirror::String* new_s, int32_t hash_code);
+
+    void VisitRoots(RootCallback* callback, void* arg);
+    // Update the strings moved by the GC and remove the ones that are no longer marked.
+    void SweepWeaks(IsMarkedCallback* callback, void* arg);
+
+   private:
+    struct Slot {
+      mirror::String* string;  // Null for a free slot.
+      int32_t hash_code;
+    };
+
+    size_t FirstIndex(int32_t hash_code) const {
+      return HashIndex(hash_code) & (slots_.size() - 1);
+    }
+    size_t NextIndex(size_t index) const {
+      return (index + 1) & (slots_.size() - 1);
+    }
+    void EraseAt(size_t index);
+    void Resize(size_t capacity);
+
+    // The number of slots is a power of two.
+    std::vector<Slot> slots_;
+    size_t size_;
+  };
+
+  static size_t HashIndex(int32_t hash_code) {
+    // Mix the high bits in, since only the low bits pick the slot.
+    uint32_t hash = static_cast<uint32_t>(hash_code);
+    return hash ^ (hash >> 16);
+  }
 
   mirror::String* Insert(mirror::String* s, bool is_strong)
       LOCKS_EXCLUDED(Locks::intern_table_lock_)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 
   mirror::String* LookupStrong(mirror::String* s, int32_t hash_code)
-      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
+      EXCLUSIVE_LOCKS_REQUIRED(Locks::intern_table_lock_);
   mirror::String* LookupWeak(mirror::String* s, int32_t hash_code)
-      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
-  mirror::String* Lookup(Table* table, mirror::String* s, int32_t hash_code)
-      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
+      EXCLUSIVE_LOCKS_REQUIRED(Locks::intern_table_lock_);
+  mirror::String* LookupImage(mirror::String* s, int32_t hash_code)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
+      EXCLUSIVE_LOCKS_REQUIRED(Locks::intern_table_lock_);
   mirror::String* InsertStrong(mirror::String* s, int32_t hash_code)
       EXCLUSIVE_LOCKS_REQUIRED(Locks::intern_table_lock_);
   mirror::String* InsertWeak(mirror::String* s, int32_t hash_code)
@@ -97,9 +168,6 @@ class InternTable {
   void RemoveWeak(mirror::String* s, int32_t hash_code)
       SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
       EXCLUSIVE_LOCKS_REQUIRED(Locks::intern_table_lock_);
-  void Remove(Table* table, mirror::String* s, int32_t hash_code)
-      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_)
-      EXCLUSIVE_LOCKS_REQUIRED(Locks::intern_table_lock_);
 
   // Transaction rollback access.
   mirror::String* InsertStrongFromTransaction(mirror::String* s, int32_t hash_code)
@@ -128,6 +196,9 @@ class InternTable {
   // not directly access the strings in it. Use functions that contain
   // read barriers.
   Table weak_interns_ GUARDED_BY(Locks::intern_table_lock_);
+  // The table stored in the boot image, or null. It is never modified and its strings are never
+  // moved, so it needs neither a read barrier nor visiting as a root.
+  mirror::ObjectArray<mirror::String>* image_strings_ GUARDED_BY(Locks::intern_table_lock_);
 };
 
 }  // namespace art
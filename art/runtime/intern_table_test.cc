@@ -16,9 +16,13 @@
 
 #include "intern_table.h"
 
+#include <set>
+
 #include "common_runtime_test.h"
 #include "mirror/object.h"
+#include "mirror/object_array-inl.h"
 #include "handle_scope-inl.h"
+#include "base/stringprintf.h"
 
 namespace art {
 
@@ -125,6 +129,68 @@ TEST_F(InternTableTest, SweepInternTableWeaks) {
   EXPECT_EQ(3U, t.Size());
 }
 
+mirror::Object* IsInSetSweepingCallback(mirror::Object* object, void* arg) {
+  std::set<mirror::Object*>* marked = reinterpret_cast<std::set<mirror::Object*>*>(arg);
+  if (marked->find(object) != marked->end()) {
+    return object;
+  }
+  return nullptr;
+}
+
+TEST_F(InternTableTest, SweepManyInternTableWeaks) {
+  ScopedObjectAccess soa(Thread::Current());
+  InternTable t;
+  // "Aa" and "BB" have the same hash code, so all the strings made of those have the same hash
+  // code too, and fill a run of slots in the table. Mix them with strings that don't collide.
+  static const size_t kColliding = 64;
+  static const size_t kCount = kColliding + 256;
+  StackHandleScope<1> hs(soa.Self());
+  Handle<mirror::ObjectArray<mirror::String>> strings(hs.NewHandle(
+      mirror::ObjectArray<mirror::String>::Alloc(
+          soa.Self(), class_linker_->FindSystemClass(soa.Self(), "[Ljava/lang/String;"),
+          kCount)));
+  ASSERT_TRUE(strings.Get() != nullptr);
+  for (size_t i = 0; i < kCount; ++i) {
+    std::string utf8;
+    if (i < kColliding) {
+      for (size_t bit = 1; bit < kColliding; bit <<= 1) {
+        utf8 += (i & bit) != 0 ? "Aa" : "BB";
+      }
+    } else {
+      utf8 = StringPrintf("string %zu", i);
+    }
+    strings->Set<false>(i, mirror::String::AllocFromModifiedUtf8(soa.Self(), utf8.c_str()));
+  }
+  for (size_t i = 0; i < kCount; ++i) {
+    EXPECT_EQ(strings->Get(i), t.InternWeak(strings->Get(i)));
+  }
+  EXPECT_EQ(kCount, t.WeakSize());
+
+  // Keep every third string, so that the sweep removes strings from the middle of the runs.
+  std::set<mirror::Object*> marked;
+  for (size_t i = 0; i < kCount; i += 3) {
+    marked.insert(strings->Get(i));
+  }
+  {
+    ReaderMutexLock mu(soa.Self(), *Locks::heap_bitmap_lock_);
+    t.SweepInternTableWeaks(IsInSetSweepingCallback, &marked);
+  }
+  EXPECT_EQ(marked.size(), t.WeakSize());
+  for (size_t i = 0; i < kCount; ++i) {
+    EXPECT_EQ(i % 3 == 0, t.ContainsWeak(strings->Get(i))) << i;
+  }
+
+  // Sweeping everything else away leaves a working, empty table.
+  marked.clear();
+  {
+    ReaderMutexLock mu(soa.Self(), *Locks::heap_bitmap_lock_);
+    t.SweepInternTableWeaks(IsInSetSweepingCallback, &marked);
+  }
+  EXPECT_EQ(0U, t.WeakSize());
+  EXPECT_EQ(strings->Get(1), t.InternWeak(strings->Get(1)));
+  EXPECT_TRUE(t.ContainsWeak(strings->Get(1)));
+}
+
 TEST_F(InternTableTest, ContainsWeak) {
   ScopedObjectAccess soa(Thread::Current());
   {
@@ -71,6 +71,12 @@ class MANAGED Reference : public Object {
   void SetPendingNext(Reference* pending_next) SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
     SetFieldObject<kTransactionActive>(PendingNextOffset(), pending_next);
   }
+  // Used by the GC threads that enqueue references in parallel.
+  template<bool kTransactionActive>
+  bool CasPendingNext(Reference* expected, Reference* pending_next)
+      SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
+    return CasFieldObject<kTransactionActive>(PendingNextOffset(), expected, pending_next);
+  }
 
   bool IsEnqueued() SHARED_LOCKS_REQUIRED(Locks::mutator_lock_) {
     // Since the references are stored as cyclic lists it means that once enqueued, the pending
@@ -180,9 +180,15 @@ static jclass DexFile_defineClassNative(JNIEnv* env, jclass, jstring javaName, j
   for (const DexFile* dex_file : *dex_files) {
     const DexFile::ClassDef* dex_class_def = dex_file->FindClassDef(descriptor.c_str());
     if (dex_class_def != nullptr) {
-      ScopedObjectAccess soa(env);
       ClassLinker* class_linker = Runtime::Current()->GetClassLinker();
-      class_linker->RegisterDexFile(*dex_file);
+      {
+        ScopedObjectAccess soa(env);
+        class_linker->RegisterDexFile(*dex_file);
+      }
+      // Registered dex files are never closed, so the first class defined from one can start the
+      // verification of the rest.
+      class_linker->VerifyDexFileInBackground(env, *dex_file, javaLoader);
+      ScopedObjectAccess soa(env);
       StackHandleScope<1> hs(soa.Self());
       Handle<mirror::ClassLoader> class_loader(
           hs.NewHandle(soa.Decode<mirror::ClassLoader*>(javaLoader)));
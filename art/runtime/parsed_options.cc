@@ -256,6 +256,7 @@ bool ParsedOptions::Parse(const Runtime::Options& options, bool ignore_unrecogni
   profile_clock_source_ = kDefaultProfilerClockSource;
 
   verify_ = true;
+  background_verify_ = false;
   image_isa_ = kRuntimeISA;
 
   // Default to explicit checks.  Switch off with -implicit-checks:.
@@ -645,6 +646,9 @@ bool ParsedOptions::Parse(const Runtime::Options& options, bool ignore_unrecogni
         verify_ = false;
       } else if (verify_mode == "remote" || verify_mode == "all") {
         verify_ = true;
+      } else if (verify_mode == "background") {
+        verify_ = true;
+        background_verify_ = true;
       } else {
         Usage("Unknown -Xverify option %s\n", verify_mode.c_str());
         return false;
@@ -804,6 +808,7 @@ void ParsedOptions::Usage(const char* fmt, ...) {
   UsageMessage(stream, "  -XX:IgnoreMaxFootprint\n");
   UsageMessage(stream, "  -XX:UseTLAB\n");
   UsageMessage(stream, "  -XX:BackgroundGC=none\n");
+  UsageMessage(stream, "  -Xverify:background\n");
   UsageMessage(stream, "  -Xmethod-trace\n");
   UsageMessage(stream, "  -Xmethod-trace-file:filename");
   UsageMessage(stream, "  -Xmethod-trace-file-size:integervalue\n");
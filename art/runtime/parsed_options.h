@@ -82,6 +82,7 @@ class ParsedOptions {
   std::string profile_output_filename_;
   ProfilerClockSource profile_clock_source_;
   bool verify_;
+  bool background_verify_;
   InstructionSet image_isa_;
 
   static constexpr uint32_t kExplicitNullCheck = 1;
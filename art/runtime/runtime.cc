@@ -140,6 +140,7 @@ Runtime::Runtime()
       suspend_handler_(nullptr),
       stack_overflow_handler_(nullptr),
       verify_(false),
+      background_verify_(false),
       target_sdk_version_(0) {
   for (int i = 0; i < Runtime::kLastCalleeSaveType; i++) {
     callee_save_methods_[i] = nullptr;
@@ -173,6 +174,9 @@ Runtime::~Runtime() {
   // Make sure to let the GC complete if it is running.
   heap_->WaitForGcToComplete(gc::kGcCauseBackground, self);
   heap_->DeleteThreadPool();
+  if (class_linker_ != nullptr) {
+    class_linker_->StopBackgroundVerification(self);
+  }
 
   // Make sure our internal threads are dead before we start tearing down things they're using.
   Dbg::StopJdwp();
@@ -568,6 +572,7 @@ bool Runtime::Init(const Options& raw_options, bool ignore_unrecognized) {
   intern_table_ = new InternTable;
 
   verify_ = options->verify_;
+  background_verify_ = options->background_verify_;
 
   if (options->interpreter_only_) {
     GetInstrumentation()->ForceInterpretOnly();
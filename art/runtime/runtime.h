@@ -440,6 +440,10 @@ class Runtime {
     return verify_;
   }
 
+  bool IsBackgroundVerificationEnabled() const {
+    return background_verify_;
+  }
+
   bool RunningOnValgrind() const {
     return running_on_valgrind_;
   }
@@ -593,6 +597,10 @@ class Runtime {
   // If false, verification is disabled. True by default.
   bool verify_;
 
+  // If true, the classes of dex files used by class loaders are verified on a thread pool ahead
+  // of their first use. Set by -Xverify:background.
+  bool background_verify_;
+
   // Specifies target SDK version to allow workarounds for certain API levels.
   int32_t target_sdk_version_;
 
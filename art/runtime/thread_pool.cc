@@ -28,7 +28,12 @@ static constexpr bool kMeasureWaitTime = false;
 ThreadPoolWorker::ThreadPoolWorker(ThreadPool* thread_pool, const std::string& name,
                                    size_t stack_size)
     : thread_pool_(thread_pool),
-      name_(name) {
+      name_(name),
+      thread_(nullptr),
+      queue_lock_("thread pool worker queue lock"),
+      queue_size_(0),
+      steal_count_(0),
+      idle_count_(0) {
   std::string error_msg;
   stack_.reset(MemMap::MapAnonymous(name.c_str(), nullptr, stack_size, PROT_READ | PROT_WRITE,
                                     false, &error_msg));
@@ -42,7 +47,6 @@ ThreadPoolWorker::ThreadPoolWorker(ThreadPool* thread_pool, const std::string& n
 }
 
 ThreadPoolWorker::~ThreadPoolWorker() {
-  CHECK_PTHREAD_CALL(pthread_join, (pthread_, NULL), "thread pool worker shutdown");
 }
 
 void ThreadPoolWorker::Run() {
@@ -58,30 +62,114 @@ void ThreadPoolWorker::Run() {
 void* ThreadPoolWorker::Callback(void* arg) {
   ThreadPoolWorker* worker = reinterpret_cast<ThreadPoolWorker*>(arg);
   Runtime* runtime = Runtime::Current();
-  CHECK(runtime->AttachCurrentThread(worker->name_.c_str(), true, NULL, false));
+  const bool create_peer = worker->thread_pool_->create_peers_;
+  CHECK(runtime->AttachCurrentThread(worker->name_.c_str(), true,
+                                     create_peer ? runtime->GetSystemThreadGroup() : NULL,
+                                     create_peer));
+  worker->thread_ = Thread::Current();
   // Do work until its time to shut down.
   worker->Run();
   runtime->DetachCurrentThread();
   return NULL;
 }
 
+ThreadPoolWorker* ThreadPool::FindWorker(Thread* self) const {
+  for (ThreadPoolWorker* worker : threads_) {
+    if (worker->thread_ == self) {
+      return worker;
+    }
+  }
+  return NULL;
+}
+
 void ThreadPool::AddTask(Thread* self, Task* task) {
-  MutexLock mu(self, task_queue_lock_);
-  tasks_.push_back(task);
-  // If we have any waiters, signal one.
-  if (started_ && waiting_count_ != 0) {
-    task_queue_condition_.Signal(self);
+  ThreadPoolWorker* worker = FindWorker(self);
+  if (worker != NULL) {
+    pending_count_.FetchAndAddSequentiallyConsistent(1);
+    {
+      MutexLock mu(self, worker->queue_lock_);
+      worker->queue_.push_back(task);
+      worker->queue_size_.StoreRelaxed(worker->queue_.size());
+    }
+    SignalTasksAdded(self, 1);
+  } else {
+    MutexLock mu(self, task_queue_lock_);
+    // waiting_count_ only changes holding the lock, so no worker can be going to sleep now.
+    pending_count_.FetchAndAddSequentiallyConsistent(1);
+    tasks_.push_back(task);
+    tasks_size_.StoreRelaxed(tasks_.size());
+    WakeWorkersLocked(self, 1);
+  }
+}
+
+void ThreadPool::AddTasks(Thread* self, const std::vector<Task*>& tasks) {
+  if (tasks.empty()) {
+    return;
+  }
+  ThreadPoolWorker* worker = FindWorker(self);
+  if (worker != NULL) {
+    pending_count_.FetchAndAddSequentiallyConsistent(tasks.size());
+    MutexLock mu(self, worker->queue_lock_);
+    worker->queue_.insert(worker->queue_.end(), tasks.begin(), tasks.end());
+    worker->queue_size_.StoreRelaxed(worker->queue_.size());
+  } else if (threads_.empty()) {
+    MutexLock mu(self, task_queue_lock_);
+    pending_count_.FetchAndAddSequentiallyConsistent(tasks.size());
+    tasks_.insert(tasks_.end(), tasks.begin(), tasks.end());
+    tasks_size_.StoreRelaxed(tasks_.size());
+    WakeWorkersLocked(self, tasks.size());
+    return;
+  } else {
+    // Give each worker a contiguous run of the tasks, so that the workers start without
+    // contending on one queue, and neighbouring tasks tend to run on the same worker.
+    pending_count_.FetchAndAddSequentiallyConsistent(tasks.size());
+    const size_t thread_count = GetThreadCount();
+    size_t begin = 0;
+    for (size_t i = 0; i < thread_count; ++i) {
+      const size_t end = tasks.size() * (i + 1) / thread_count;
+      if (begin != end) {
+        ThreadPoolWorker* target = threads_[i];
+        MutexLock mu(self, target->queue_lock_);
+        target->queue_.insert(target->queue_.end(), tasks.begin() + begin, tasks.begin() + end);
+        target->queue_size_.StoreRelaxed(target->queue_.size());
+      }
+      begin = end;
+    }
+  }
+  SignalTasksAdded(self, tasks.size());
+}
+
+void ThreadPool::SignalTasksAdded(Thread* self, size_t count) {
+  // A worker about to sleep increments waiting_count_ and then checks pending_count_, which was
+  // increased before these tasks were queued, so either it sees them or we see it waiting.
+  if (waiting_count_.LoadSequentiallyConsistent() != 0) {
+    MutexLock mu(self, task_queue_lock_);
+    WakeWorkersLocked(self, count);
   }
 }
 
-ThreadPool::ThreadPool(const char* name, size_t num_threads)
+void ThreadPool::WakeWorkersLocked(Thread* self, size_t count) {
+  // If we have any waiters, signal them.
+  if (started_.LoadRelaxed() && waiting_count_.LoadRelaxed() != 0) {
+    if (count == 1) {
+      task_queue_condition_.Signal(self);
+    } else {
+      task_queue_condition_.Broadcast(self);
+    }
+  }
+}
+
+ThreadPool::ThreadPool(const char* name, size_t num_threads, bool create_peers)
   : name_(name),
+    create_peers_(create_peers),
     task_queue_lock_("task queue lock"),
     task_queue_condition_("task queue condition", task_queue_lock_),
     completion_condition_("task completion condition", task_queue_lock_),
     started_(false),
     shutting_down_(false),
     waiting_count_(0),
+    pending_count_(0),
+    tasks_size_(0),
     start_time_(0),
     total_wait_time_(0),
     // Add one since the caller of constructor waits on the barrier too.
@@ -107,69 +195,175 @@ ThreadPool::~ThreadPool() {
     Thread* self = Thread::Current();
     MutexLock mu(self, task_queue_lock_);
     // Tell any remaining workers to shut down.
-    shutting_down_ = true;
+    shutting_down_.StoreSequentiallyConsistent(true);
     // Broadcast to everyone waiting.
     task_queue_condition_.Broadcast(self);
     completion_condition_.Broadcast(self);
   }
-  // Wait for the threads to finish.
+  // Wait for the threads to finish. Workers steal from each other, so none can be deleted until
+  // all of them have stopped.
+  for (ThreadPoolWorker* worker : threads_) {
+    CHECK_PTHREAD_CALL(pthread_join, (worker->pthread_, NULL), "thread pool worker shutdown");
+  }
   STLDeleteElements(&threads_);
 }
 
 void ThreadPool::StartWorkers(Thread* self) {
   MutexLock mu(self, task_queue_lock_);
-  started_ = true;
+  started_.StoreSequentiallyConsistent(true);
   task_queue_condition_.Broadcast(self);
   start_time_ = NanoTime();
   total_wait_time_ = 0;
+  for (ThreadPoolWorker* worker : threads_) {
+    worker->steal_count_.StoreRelaxed(0);
+    worker->idle_count_.StoreRelaxed(0);
+  }
 }
 
 void ThreadPool::StopWorkers(Thread* self) {
-  MutexLock mu(self, task_queue_lock_);
-  started_ = false;
+  {
+    MutexLock mu(self, task_queue_lock_);
+    started_.StoreSequentiallyConsistent(false);
+  }
+  // Workers check started_ holding the lock of the queue they take a task from, so once we have
+  // held each of those locks no worker can take a task added after this returns.
+  for (ThreadPoolWorker* worker : threads_) {
+    MutexLock mu(self, worker->queue_lock_);
+  }
+}
+
+uint64_t ThreadPool::GetStealCount() const {
+  uint64_t steal_count = 0;
+  for (ThreadPoolWorker* worker : threads_) {
+    steal_count += worker->GetStealCount();
+  }
+  return steal_count;
+}
+
+uint64_t ThreadPool::GetIdleCount() const {
+  uint64_t idle_count = 0;
+  for (ThreadPoolWorker* worker : threads_) {
+    idle_count += worker->GetIdleCount();
+  }
+  return idle_count;
 }
 
 Task* ThreadPool::GetTask(Thread* self) {
-  MutexLock mu(self, task_queue_lock_);
+  ThreadPoolWorker* worker = FindWorker(self);
   while (!IsShuttingDown()) {
-    const size_t thread_count = GetThreadCount();
-    // Ensure that we don't use more threads than the maximum active workers.
-    const size_t active_threads = thread_count - waiting_count_;
+    // Ensure that we don't use more threads than the maximum active workers. Reading
+    // max_active_workers_ without the lock is racy, but it only changes while the pool is stopped.
+    const size_t active_threads = GetThreadCount() - waiting_count_.LoadRelaxed();
     // <= since self is considered an active worker.
     if (active_threads <= max_active_workers_) {
-      Task* task = TryGetTaskLocked(self);
+      Task* task = TryGetTask(self, worker);
       if (task != NULL) {
         return task;
       }
     }
 
-    ++waiting_count_;
-    if (waiting_count_ == GetThreadCount() && tasks_.empty()) {
+    MutexLock mu(self, task_queue_lock_);
+    if (IsShuttingDown()) {
+      break;
+    }
+    const size_t waiting_count = waiting_count_.FetchAndAddSequentiallyConsistent(1) + 1;
+    const bool tasks_pending = pending_count_.LoadSequentiallyConsistent() != 0;
+    if (tasks_pending && started_.LoadRelaxed() &&
+        GetThreadCount() - waiting_count < max_active_workers_) {
+      // A task was added since we looked, try again.
+      waiting_count_.FetchAndSubSequentiallyConsistent(1);
+      continue;
+    }
+    if (waiting_count == GetThreadCount() && !tasks_pending) {
       // We may be done, lets broadcast to the completion condition.
       completion_condition_.Broadcast(self);
     }
+    if (worker != NULL) {
+      worker->idle_count_.FetchAndAddSequentiallyConsistent(1);
+    }
     const uint64_t wait_start = kMeasureWaitTime ? NanoTime() : 0;
     task_queue_condition_.Wait(self);
     if (kMeasureWaitTime) {
       const uint64_t wait_end = NanoTime();
       total_wait_time_ += wait_end - std::max(wait_start, start_time_);
     }
-    --waiting_count_;
+    waiting_count_.FetchAndSubSequentiallyConsistent(1);
   }
 
   // We are shutting down, return NULL to tell the worker thread to stop looping.
   return NULL;
 }
 
+Task* ThreadPool::PopTask(Thread* self, ThreadPoolWorker* worker, bool steal) {
+  if (worker->queue_size_.LoadRelaxed() == 0) {
+    return NULL;
+  }
+  MutexLock mu(self, worker->queue_lock_);
+  if (!started_.LoadRelaxed() || worker->queue_.empty()) {
+    return NULL;
+  }
+  Task* task;
+  if (steal) {
+    task = worker->queue_.front();
+    worker->queue_.pop_front();
+  } else {
+    task = worker->queue_.back();
+    worker->queue_.pop_back();
+  }
+  worker->queue_size_.StoreRelaxed(worker->queue_.size());
+  pending_count_.FetchAndSubSequentiallyConsistent(1);
+  return task;
+}
+
 Task* ThreadPool::TryGetTask(Thread* self) {
-  MutexLock mu(self, task_queue_lock_);
-  return TryGetTaskLocked(self);
+  return TryGetTask(self, FindWorker(self));
+}
+
+Task* ThreadPool::TryGetTask(Thread* self, ThreadPoolWorker* worker) {
+  if (pending_count_.LoadSequentiallyConsistent() == 0) {
+    return NULL;
+  }
+  Task* task = NULL;
+  if (worker != NULL) {
+    task = PopTask(self, worker, false);
+    if (task != NULL) {
+      return task;
+    }
+  }
+  if (tasks_size_.LoadRelaxed() != 0) {
+    MutexLock mu(self, task_queue_lock_);
+    task = TryGetTaskLocked(self);
+    if (task != NULL) {
+      return task;
+    }
+  }
+  // Steal, starting after our own queue so that thieves spread out over the victims.
+  const size_t thread_count = GetThreadCount();
+  size_t index = 0;
+  while (index < thread_count && threads_[index] != worker) {
+    ++index;
+  }
+  for (size_t i = 1; i <= thread_count; ++i) {
+    ThreadPoolWorker* victim = threads_[(index + i) % thread_count];
+    if (victim != worker) {
+      task = PopTask(self, victim, true);
+      if (task != NULL) {
+        if (worker != NULL) {
+          worker->steal_count_.FetchAndAddSequentiallyConsistent(1);
+        }
+        return task;
+      }
+    }
+  }
+  return NULL;
 }
 
 Task* ThreadPool::TryGetTaskLocked(Thread* self) {
-  if (started_ && !tasks_.empty()) {
+  if (started_.LoadRelaxed() && !tasks_.empty()) {
     Task* task = tasks_.front();
     tasks_.pop_front();
+    tasks_size_.StoreRelaxed(tasks_.size());
+    pending_count_.FetchAndSubSequentiallyConsistent(1);
     return task;
   }
   return NULL;
@@ -183,9 +377,11 @@ void ThreadPool::Wait(Thread* self, bool do_work, bool may_hold_locks) {
       task->Finalize();
     }
   }
-  // Wait until each thread is waiting and the task list is empty.
+  // Wait until each thread is waiting and no task is left.
   MutexLock mu(self, task_queue_lock_);
-  while (!shutting_down_ && (waiting_count_ != GetThreadCount() || !tasks_.empty())) {
+  while (!IsShuttingDown() &&
+      (static_cast<size_t>(waiting_count_.LoadSequentiallyConsistent()) != GetThreadCount() ||
+       pending_count_.LoadSequentiallyConsistent() != 0)) {
     if (!may_hold_locks) {
       completion_condition_.Wait(self);
     } else {
@@ -195,8 +391,7 @@ void ThreadPool::Wait(Thread* self, bool do_work, bool may_hold_locks) {
 }
 
 size_t ThreadPool::GetTaskCount(Thread* self) {
-  MutexLock mu(self, task_queue_lock_);
-  return tasks_.size();
+  return pending_count_.LoadSequentiallyConsistent();
 }
 
 WorkStealingWorker::WorkStealingWorker(ThreadPool* thread_pool, const std::string& name,
@@ -20,6 +20,7 @@
 #include <deque>
 #include <vector>
 
+#include "atomic.h"
 #include "barrier.h"
 #include "base/mutex.h"
 #include "closure.h"
@@ -44,6 +45,16 @@ class ThreadPoolWorker {
     return stack_->Size();
   }
 
+  // Returns how many tasks this worker took from the queues of other workers.
+  uint64_t GetStealCount() const {
+    return steal_count_.LoadRelaxed();
+  }
+
+  // Returns how many times this worker found no task to run and went to sleep.
+  uint64_t GetIdleCount() const {
+    return idle_count_.LoadRelaxed();
+  }
+
   virtual ~ThreadPoolWorker();
 
  protected:
@@ -55,6 +66,20 @@ class ThreadPoolWorker {
   const std::string name_;
   std::unique_ptr<MemMap> stack_;
   pthread_t pthread_;
+  // The runtime thread of this worker, set once it has attached.
+  Thread* thread_;
+
+  // Tasks added by this worker. The worker runs the newest task first, while the other workers
+  // steal the oldest, which for recursively split work tends to be the largest. No other lock is
+  // taken while holding queue_lock_.
+  Mutex queue_lock_;
+  std::deque<Task*> queue_ GUARDED_BY(queue_lock_);
+  // The size of queue_, read without the lock so that thieves can pass over empty queues.
+  AtomicInteger queue_size_;
+
+  // Statistics, counted by the worker itself and reset by StartWorkers.
+  Atomic<uint64_t> steal_count_;
+  Atomic<uint64_t> idle_count_;
 
  private:
   friend class ThreadPool;
@@ -75,10 +100,17 @@ class ThreadPool {
   void StopWorkers(Thread* self);
 
   // Add a new task, the first available started worker will process it. Does not delete the task
-  // after running it, it is the caller's responsibility.
+  // after running it, it is the caller's responsibility. A task added by one of the workers goes
+  // on that worker's own queue, and idle workers steal from there.
   void AddTask(Thread* self, Task* task);
 
-  explicit ThreadPool(const char* name, size_t num_threads);
+  // Add a batch of tasks, as if by AddTask but waking the workers only once. Tasks added by other
+  // threads than the workers are dealt out between the workers' queues.
+  void AddTasks(Thread* self, const std::vector<Task*>& tasks);
+
+  // Workers that run managed code, such as class loaders, need create_peers so that they have a
+  // java.lang.Thread in the system thread group.
+  ThreadPool(const char* name, size_t num_threads, bool create_peers = false);
   virtual ~ThreadPool();
 
   // Wait for all tasks currently on queue to get completed.
@@ -91,6 +123,12 @@ class ThreadPool {
     return total_wait_time_;
   }
 
+  // Returns the total number of tasks that workers took from the queues of other workers.
+  uint64_t GetStealCount() const;
+
+  // Returns the total number of times workers went to sleep for want of a task.
+  uint64_t GetIdleCount() const;
+
   // Provides a way to bound the maximum number of worker threads, threads must be less the the
   // thread count of the thread pool.
   void SetMaxActiveWorkers(size_t threads);
@@ -99,31 +137,53 @@ class ThreadPool {
   // get a task to run, blocks if there are no tasks left
   virtual Task* GetTask(Thread* self);
 
-  // Try to get a task, returning NULL if there is none available.
+  // Try to get a task, returning NULL if there is none available. Workers look in their own queue
+  // first, then the shared queue, and then steal from the other workers.
   Task* TryGetTask(Thread* self);
+  Task* TryGetTask(Thread* self, ThreadPoolWorker* worker);
   Task* TryGetTaskLocked(Thread* self) EXCLUSIVE_LOCKS_REQUIRED(task_queue_lock_);
 
+  // Returns the worker running on self, or NULL if self is not one of the workers.
+  ThreadPoolWorker* FindWorker(Thread* self) const;
+
+  // Take the newest task of the worker's own queue, or with steal the oldest.
+  Task* PopTask(Thread* self, ThreadPoolWorker* worker, bool steal)
+      LOCKS_EXCLUDED(task_queue_lock_);
+
+  // Wake the workers to run count tasks that have been queued. pending_count_ must have been
+  // increased before the tasks were published, so that no thief can take one first.
+  void SignalTasksAdded(Thread* self, size_t count) LOCKS_EXCLUDED(task_queue_lock_);
+  void WakeWorkersLocked(Thread* self, size_t count) EXCLUSIVE_LOCKS_REQUIRED(task_queue_lock_);
+
   // Are we shutting down?
-  bool IsShuttingDown() const EXCLUSIVE_LOCKS_REQUIRED(task_queue_lock_) {
-    return shutting_down_;
+  bool IsShuttingDown() const {
+    return shutting_down_.LoadSequentiallyConsistent();
   }
 
   const std::string name_;
+  const bool create_peers_;
   Mutex task_queue_lock_;
   ConditionVariable task_queue_condition_ GUARDED_BY(task_queue_lock_);
   ConditionVariable completion_condition_ GUARDED_BY(task_queue_lock_);
-  volatile bool started_ GUARDED_BY(task_queue_lock_);
-  volatile bool shutting_down_ GUARDED_BY(task_queue_lock_);
-  // How many worker threads are waiting on the condition.
-  volatile size_t waiting_count_ GUARDED_BY(task_queue_lock_);
+  // Only written holding task_queue_lock_, but read without it when looking for a task.
+  Atomic<bool> started_;
+  Atomic<bool> shutting_down_;
+  // How many worker threads are waiting on the condition. Only changed holding task_queue_lock_.
+  AtomicInteger waiting_count_;
+  // How many tasks are queued in total, in the shared queue and the workers' queues.
+  AtomicInteger pending_count_;
+  // Tasks added by other threads than the workers.
   std::deque<Task*> tasks_ GUARDED_BY(task_queue_lock_);
+  // The size of tasks_, read without the lock.
+  AtomicInteger tasks_size_;
   // TODO: make this immutable/const?
   std::vector<ThreadPoolWorker*> threads_;
   // Work balance detection.
   uint64_t start_time_ GUARDED_BY(task_queue_lock_);
   uint64_t total_wait_time_;
   Barrier creation_barier_;
-  size_t max_active_workers_ GUARDED_BY(task_queue_lock_);
+  // Only written holding task_queue_lock_ while the workers are stopped.
+  size_t max_active_workers_;
 
  private:
   friend class ThreadPoolWorker;
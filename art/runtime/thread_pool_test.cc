@@ -139,4 +139,66 @@ TEST_F(ThreadPoolTest, RecursiveTest) {
   EXPECT_EQ((1 << depth) - 1, count.LoadSequentiallyConsistent());
 }
 
+// Test that a batch of tasks added at once all run.
+TEST_F(ThreadPoolTest, AddTasks) {
+  Thread* self = Thread::Current();
+  ThreadPool thread_pool("Thread pool test thread pool", num_threads);
+  AtomicInteger count(0);
+  static const int32_t num_tasks = num_threads * 16;
+  std::vector<Task*> tasks;
+  for (int32_t i = 0; i < num_tasks; ++i) {
+    tasks.push_back(new CountTask(&count));
+  }
+  thread_pool.AddTasks(self, tasks);
+  EXPECT_EQ(static_cast<size_t>(num_tasks), thread_pool.GetTaskCount(self));
+  thread_pool.StartWorkers(self);
+  thread_pool.Wait(self, true, false);
+  EXPECT_EQ(num_tasks, count.LoadSequentiallyConsistent());
+  EXPECT_EQ(0U, thread_pool.GetTaskCount(self));
+}
+
+class SpawnTask : public Task {
+ public:
+  SpawnTask(ThreadPool* const thread_pool, AtomicInteger* count, int num_children)
+      : thread_pool_(thread_pool),
+        count_(count),
+        num_children_(num_children) {}
+
+  void Run(Thread* self) {
+    std::vector<Task*> children;
+    for (int i = 0; i < num_children_; ++i) {
+      children.push_back(new CountTask(count_));
+    }
+    // The children go on this worker's own queue, and this worker is busy until they have all
+    // run, so the other workers have to steal every one of them.
+    thread_pool_->AddTasks(self, children);
+    while (count_->LoadSequentiallyConsistent() != num_children_) {
+      usleep(100);
+    }
+  }
+
+  void Finalize() {
+    delete this;
+  }
+
+ private:
+  ThreadPool* const thread_pool_;
+  AtomicInteger* const count_;
+  const int num_children_;
+};
+
+// Test that idle workers steal the tasks queued by a busy worker.
+TEST_F(ThreadPoolTest, WorkStealing) {
+  Thread* self = Thread::Current();
+  ThreadPool thread_pool("Thread pool test thread pool", num_threads);
+  AtomicInteger count(0);
+  static const int num_children = num_threads * 8;
+  thread_pool.AddTask(self, new SpawnTask(&thread_pool, &count, num_children));
+  thread_pool.StartWorkers(self);
+  thread_pool.Wait(self, false, false);
+  EXPECT_EQ(num_children, count.LoadSequentiallyConsistent());
+  EXPECT_EQ(static_cast<uint64_t>(num_children), thread_pool.GetStealCount());
+  EXPECT_LT(0U, thread_pool.GetIdleCount());
+}
+
 }  // namespace art
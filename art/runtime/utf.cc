@@ -85,6 +85,14 @@ int32_t ComputeUtf16Hash(const uint16_t* chars, size_t char_count) {
   return hash;
 }
 
+size_t ComputeModifiedUtf8Hash(const char* chars) {
+  size_t hash = 0;
+  while (*chars != '\0') {
+    hash = hash * 31 + *chars++;
+  }
+  return hash;
+}
+
 int CompareModifiedUtf8ToUtf16AsCodePointValues(const char* utf8_1, const uint16_t* utf8_2) {
   for (;;) {
     if (*utf8_1 == '\0') {
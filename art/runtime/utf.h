@@ -78,6 +78,12 @@ int32_t ComputeUtf16Hash(mirror::CharArray* chars, int32_t offset, size_t char_c
     SHARED_LOCKS_REQUIRED(Locks::mutator_lock_);
 int32_t ComputeUtf16Hash(const uint16_t* chars, size_t char_count);
 
+/*
+ * A hash of a modified UTF-8 string such as a class descriptor, computed like the
+ * java.lang.String hashCode() but over the bytes, for convenience rather than interoperability.
+ */
+size_t ComputeModifiedUtf8Hash(const char* chars);
+
 /*
  * Retrieve the next UTF-16 character from a UTF-8 string.
  *
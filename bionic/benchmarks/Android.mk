@@ -31,6 +31,7 @@ benchmark_c_flags = \
 
 benchmark_src_files = \
     benchmark_main.cpp \
+    malloc_benchmark.cpp \
     math_benchmark.cpp \
     property_benchmark.cpp \
     pthread_benchmark.cpp \
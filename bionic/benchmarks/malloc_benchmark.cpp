@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "benchmark.h"
+
+#include <malloc.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Sizes cycled through by the small-allocation benchmarks. These all fall in
+// the range served by the malloc thread cache when it is enabled.
+static const size_t kSmallSizes[] = { 8, 16, 24, 32, 48, 64, 96, 128, 256, 512 };
+static const size_t kSmallSizeCount = sizeof(kSmallSizes) / sizeof(kSmallSizes[0]);
+
+// How many allocations each thread keeps live at once, so that frees don't
+// always hand back the chunk the next malloc will ask for.
+static const int kLiveAllocations = 64;
+
+static void BM_malloc_free_small(int iters) {
+  StartBenchmarkTiming();
+
+  void* ptrs[kLiveAllocations] = {};
+  for (int i = 0; i < iters; ++i) {
+    int slot = i % kLiveAllocations;
+    free(ptrs[slot]);
+    ptrs[slot] = malloc(kSmallSizes[i % kSmallSizeCount]);
+  }
+
+  StopBenchmarkTiming();
+  for (int i = 0; i < kLiveAllocations; ++i) {
+    free(ptrs[i]);
+  }
+}
+BENCHMARK(BM_malloc_free_small);
+
+// Holds worker threads until all of them have been created, so that thread
+// creation isn't part of the measured time.
+class StartGate {
+ public:
+  StartGate() : open_(false) {
+    pthread_mutex_init(&lock_, NULL);
+    pthread_cond_init(&cond_, NULL);
+  }
+
+  ~StartGate() {
+    pthread_cond_destroy(&cond_);
+    pthread_mutex_destroy(&lock_);
+  }
+
+  void Wait() {
+    pthread_mutex_lock(&lock_);
+    while (!open_) {
+      pthread_cond_wait(&cond_, &lock_);
+    }
+    pthread_mutex_unlock(&lock_);
+  }
+
+  void Open() {
+    pthread_mutex_lock(&lock_);
+    open_ = true;
+    pthread_cond_broadcast(&cond_);
+    pthread_mutex_unlock(&lock_);
+  }
+
+ private:
+  pthread_mutex_t lock_;
+  pthread_cond_t cond_;
+  bool open_;
+};
+
+struct MallocThreadArgs {
+  int iters;
+  StartGate* start;
+};
+
+static void* MallocFreeThread(void* arg) {
+  MallocThreadArgs* args = reinterpret_cast<MallocThreadArgs*>(arg);
+  args->start->Wait();
+
+  void* ptrs[kLiveAllocations] = {};
+  for (int i = 0; i < args->iters; ++i) {
+    int slot = i % kLiveAllocations;
+    free(ptrs[slot]);
+    ptrs[slot] = malloc(kSmallSizes[i % kSmallSizeCount]);
+  }
+  for (int i = 0; i < kLiveAllocations; ++i) {
+    free(ptrs[i]);
+  }
+  return NULL;
+}
+
+// Every thread runs 'iters' malloc/free pairs concurrently, so the reported
+// time per iteration shows how well the allocator scales: with no contention
+// it stays flat as the thread count grows.
+static void BM_malloc_free_multithreaded(int iters, int thread_count) {
+  StopBenchmarkTiming();
+  StartGate start;
+
+  MallocThreadArgs args;
+  args.iters = iters;
+  args.start = &start;
+
+  pthread_t* threads = new pthread_t[thread_count];
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_create(&threads[i], NULL, MallocFreeThread, &args);
+  }
+
+  StartBenchmarkTiming();
+  start.Open();
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  StopBenchmarkTiming();
+
+  delete[] threads;
+}
+BENCHMARK(BM_malloc_free_multithreaded)->Arg(1)->Arg(2)->Arg(4)->Arg(8);
+
+// The benchmarks below only use the public allocation API, so they measure
+// whichever allocator this libc was built with (dlmalloc, dlmalloc with the
+// thread cache, or jemalloc). To measure the malloc_debug paths instead, run
+// them with the libc.debug.malloc property set before the process starts.
+
+#define KB 1024
+#define MB 1024*KB
+
+#define AT_ALLOCATION_SIZES \
+    Arg(8)->Arg(16)->Arg(64)->Arg(256)->Arg(512)->Arg(1*KB)->Arg(4*KB)->Arg(16*KB)->Arg(64*KB)->Arg(256*KB)->Arg(1*MB)
+
+static void BM_malloc_sweep(int iters, int nbytes) {
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    free(malloc(nbytes));
+  }
+
+  StopBenchmarkTiming();
+}
+BENCHMARK(BM_malloc_sweep)->AT_ALLOCATION_SIZES;
+
+static void BM_calloc_sweep(int iters, int nbytes) {
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    free(calloc(1, nbytes));
+  }
+
+  StopBenchmarkTiming();
+  SetBenchmarkBytesProcessed(int64_t(iters) * int64_t(nbytes));
+}
+BENCHMARK(BM_calloc_sweep)->AT_ALLOCATION_SIZES;
+
+static void BM_memalign_sweep(int iters, int nbytes) {
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    free(memalign(64, nbytes));
+  }
+
+  StopBenchmarkTiming();
+}
+BENCHMARK(BM_memalign_sweep)->AT_ALLOCATION_SIZES;
+
+// Grows a buffer one step at a time up to 'nbytes', the way a naive string
+// or vector builder would, then frees it.
+static void BM_realloc_grow_linear(int iters, int nbytes) {
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    void* p = NULL;
+    for (int size = 64; size <= nbytes; size += 64) {
+      p = realloc(p, size);
+    }
+    free(p);
+  }
+
+  StopBenchmarkTiming();
+}
+BENCHMARK(BM_realloc_grow_linear)->Arg(1*KB)->Arg(4*KB)->Arg(16*KB)->Arg(64*KB);
+
+// Grows a buffer by doubling up to 'nbytes', as std::vector does.
+static void BM_realloc_grow_doubling(int iters, int nbytes) {
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    void* p = NULL;
+    for (int size = 16; size <= nbytes; size *= 2) {
+      p = realloc(p, size);
+    }
+    free(p);
+  }
+
+  StopBenchmarkTiming();
+}
+BENCHMARK(BM_realloc_grow_doubling)->Arg(1*KB)->Arg(64*KB)->Arg(1*MB)->Arg(4*MB);
+
+// Producer/consumer: one thread allocates and the other frees, so every free
+// is of memory allocated by a different thread. This is the pattern thread
+// caching allocators handle worst.
+struct CrossThreadQueue {
+  static const int kCapacity = 1024;
+
+  CrossThreadQueue() : head(0), tail(0), done(false) {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&not_empty, NULL);
+    pthread_cond_init(&not_full, NULL);
+  }
+
+  ~CrossThreadQueue() {
+    pthread_cond_destroy(&not_full);
+    pthread_cond_destroy(&not_empty);
+    pthread_mutex_destroy(&lock);
+  }
+
+  void Push(void* p) {
+    pthread_mutex_lock(&lock);
+    while (tail - head == kCapacity) {
+      pthread_cond_wait(&not_full, &lock);
+    }
+    items[tail++ % kCapacity] = p;
+    pthread_cond_signal(&not_empty);
+    pthread_mutex_unlock(&lock);
+  }
+
+  // Returns NULL once the producer is done and the queue is empty.
+  void* Pop() {
+    pthread_mutex_lock(&lock);
+    while (head == tail && !done) {
+      pthread_cond_wait(&not_empty, &lock);
+    }
+    void* p = (head == tail) ? NULL : items[head++ % kCapacity];
+    pthread_cond_signal(&not_full);
+    pthread_mutex_unlock(&lock);
+    return p;
+  }
+
+  void Finish() {
+    pthread_mutex_lock(&lock);
+    done = true;
+    pthread_cond_broadcast(&not_empty);
+    pthread_mutex_unlock(&lock);
+  }
+
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  void* items[kCapacity];
+  long head;
+  long tail;
+  bool done;
+};
+
+static void* ConsumerThread(void* arg) {
+  CrossThreadQueue* queue = reinterpret_cast<CrossThreadQueue*>(arg);
+  while (void* p = queue->Pop()) {
+    free(p);
+  }
+  return NULL;
+}
+
+static void BM_malloc_cross_thread_free(int iters, int nbytes) {
+  StopBenchmarkTiming();
+  CrossThreadQueue queue;
+  pthread_t consumer;
+  pthread_create(&consumer, NULL, ConsumerThread, &queue);
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    queue.Push(malloc(nbytes));
+  }
+  queue.Finish();
+  pthread_join(consumer, NULL);
+
+  StopBenchmarkTiming();
+}
+BENCHMARK(BM_malloc_cross_thread_free)->Arg(16)->Arg(128)->Arg(1*KB)->Arg(16*KB);
+
+// Fragmentation over time: keeps a working set of 'live_count' allocations of
+// pseudo-random sizes and repeatedly replaces random members of it, so the
+// heap ends up with holes of many sizes. Reports time per replacement; run
+// with a large iteration count and compare mallinfo() before and after to see
+// how much the heap has grown.
+static void BM_malloc_fragmentation(int iters, int live_count) {
+  StopBenchmarkTiming();
+  void** live = new void*[live_count];
+  uint32_t seed = 1;
+  for (int i = 0; i < live_count; ++i) {
+    seed = seed * 1103515245 + 12345;
+    live[i] = malloc(16 + (seed >> 16) % (4*KB));
+  }
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    seed = seed * 1103515245 + 12345;
+    int victim = (seed >> 8) % live_count;
+    free(live[victim]);
+    live[victim] = malloc(16 + (seed >> 16) % (4*KB));
+  }
+
+  StopBenchmarkTiming();
+  for (int i = 0; i < live_count; ++i) {
+    free(live[i]);
+  }
+  delete[] live;
+}
+BENCHMARK(BM_malloc_fragmentation)->Arg(1*KB)->Arg(16*KB)->Arg(64*KB);
@@ -16,6 +16,7 @@
 
 #include "benchmark.h"
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -156,3 +157,174 @@ static void BM_property_find(int iters, int nprops)
     StopBenchmarkTiming();
 }
 BENCHMARK(BM_property_find)->TEST_NUM_PROPS;
+
+static void BM_property_read_batch(int iters, int nprops)
+{
+    StopBenchmarkTiming();
+
+    LocalPropertyTestState pa(nprops);
+
+    if (!pa.valid)
+        return;
+
+    const prop_info** pis = new const prop_info*[nprops];
+    char (*values)[PROP_VALUE_MAX] = new char[nprops][PROP_VALUE_MAX];
+    __system_property_find_batch(pa.names, pis, nprops);
+
+    StartBenchmarkTiming();
+
+    for (int i = 0; i < iters; i++) {
+        __system_property_read_batch(pis, values, NULL, nprops);
+    }
+    StopBenchmarkTiming();
+
+    delete[] values;
+    delete[] pis;
+}
+BENCHMARK(BM_property_read_batch)->TEST_NUM_PROPS;
+
+// Round-trip latency of a wakeup: the main thread updates "ping" and waits
+// for a helper blocked in __system_property_wait to answer on "pong".
+struct PingPongState {
+    const prop_info* ping;
+    const prop_info* pong;
+    unsigned int initial_ping_serial;
+    volatile bool stop;
+};
+
+static void* PingPongHelper(void* arg)
+{
+    PingPongState* state = reinterpret_cast<PingPongState*>(arg);
+    unsigned int serial = state->initial_ping_serial;
+    while (true) {
+        __system_property_wait(state->ping, serial, &serial, NULL);
+        if (state->stop)
+            break;
+        __system_property_update(const_cast<prop_info*>(state->pong), "pong", 4);
+    }
+    return NULL;
+}
+
+static void BM_property_wait_latency(int iters)
+{
+    StopBenchmarkTiming();
+
+    LocalPropertyTestState pa(0);
+
+    if (!pa.valid)
+        return;
+
+    __system_property_add("ping", 4, "", 0);
+    __system_property_add("pong", 4, "", 0);
+
+    PingPongState state;
+    state.ping = __system_property_find("ping");
+    state.pong = __system_property_find("pong");
+    // Read before the helper starts, so that it can't miss the first ping.
+    state.initial_ping_serial = __system_property_serial(state.ping);
+    state.stop = false;
+    unsigned int serial = __system_property_serial(state.pong);
+
+    pthread_t helper;
+    pthread_create(&helper, NULL, PingPongHelper, &state);
+
+    StartBenchmarkTiming();
+
+    for (int i = 0; i < iters; i++) {
+        __system_property_update(const_cast<prop_info*>(state.ping), "ping", 4);
+        __system_property_wait(state.pong, serial, &serial, NULL);
+    }
+    StopBenchmarkTiming();
+
+    state.stop = true;
+    __system_property_update(const_cast<prop_info*>(state.ping), "stop", 4);
+    pthread_join(helper, NULL);
+}
+BENCHMARK(BM_property_wait_latency);
+
+// Cost of updating unrelated properties while watchers wait on one
+// property that never changes. With __system_property_wait_any every
+// update is a spurious wakeup that makes each watcher re-read its
+// property; with __system_property_wait the watchers stay asleep. The
+// difference between the two for the same number of watchers is the
+// cost of the spurious wakeups.
+struct WatcherState {
+    const prop_info* watched;
+    unsigned int initial_serial;
+    volatile bool stop;
+};
+
+static void* WaitAnyWatcher(void* arg)
+{
+    WatcherState* state = reinterpret_cast<WatcherState*>(arg);
+    unsigned int area_serial = __system_property_wait_any(0);
+    char value[PROP_VALUE_MAX];
+    while (!state->stop) {
+        area_serial = __system_property_wait_any(area_serial);
+        __system_property_read(state->watched, NULL, value);
+    }
+    return NULL;
+}
+
+static void* WaitOneWatcher(void* arg)
+{
+    WatcherState* state = reinterpret_cast<WatcherState*>(arg);
+    unsigned int serial = state->initial_serial;
+    char value[PROP_VALUE_MAX];
+    while (!state->stop) {
+        __system_property_wait(state->watched, serial, &serial, NULL);
+        __system_property_read(state->watched, NULL, value);
+    }
+    return NULL;
+}
+
+static void RunUnrelatedUpdates(int iters, int nwatchers, void* (*watcher_fn)(void*))
+{
+    StopBenchmarkTiming();
+
+    LocalPropertyTestState pa(64);
+
+    if (!pa.valid)
+        return;
+
+    __system_property_add("watched", 7, "", 0);
+    __system_property_add("unrelated", 9, "", 0);
+    prop_info* unrelated = const_cast<prop_info*>(__system_property_find("unrelated"));
+
+    WatcherState state;
+    state.watched = __system_property_find("watched");
+    state.initial_serial = __system_property_serial(state.watched);
+    state.stop = false;
+
+    pthread_t* watchers = new pthread_t[nwatchers];
+    for (int i = 0; i < nwatchers; i++) {
+        pthread_create(&watchers[i], NULL, watcher_fn, &state);
+    }
+    usleep(10000);
+
+    StartBenchmarkTiming();
+
+    for (int i = 0; i < iters; i++) {
+        __system_property_update(unrelated, (i & 1) ? "1" : "0", 1);
+    }
+    StopBenchmarkTiming();
+
+    state.stop = true;
+    __system_property_update(const_cast<prop_info*>(state.watched), "stop", 4);
+    for (int i = 0; i < nwatchers; i++) {
+        pthread_join(watchers[i], NULL);
+    }
+    delete[] watchers;
+}
+
+static void BM_property_wait_any_unrelated(int iters, int nwatchers)
+{
+    RunUnrelatedUpdates(iters, nwatchers, WaitAnyWatcher);
+}
+BENCHMARK(BM_property_wait_any_unrelated)->Arg(1)->Arg(4)->Arg(16);
+
+static void BM_property_wait_unrelated(int iters, int nwatchers)
+{
+    RunUnrelatedUpdates(iters, nwatchers, WaitOneWatcher);
+}
+BENCHMARK(BM_property_wait_unrelated)->Arg(1)->Arg(4)->Arg(16);
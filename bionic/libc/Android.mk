@@ -508,6 +508,12 @@ ifeq ($(MALLOC_IMPL),jemalloc)
 else
   libc_common_cflags += -DUSE_DLMALLOC
   libc_malloc_src := bionic/dlmalloc.c
+  # To put a per-thread cache of small chunks in front of dlmalloc, set
+  # MALLOC_THREAD_CACHE := true in the appropriate BoardConfig.mk file.
+  ifeq ($(strip $(MALLOC_THREAD_CACHE)),true)
+    libc_common_cflags += -DUSE_MALLOC_THREAD_CACHE
+    libc_malloc_src += bionic/malloc_thread_cache.cpp
+  endif
 endif
 
 # To customize dlmalloc's alignment, set BOARD_MALLOC_ALIGNMENT in
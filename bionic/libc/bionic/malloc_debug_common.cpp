@@ -54,19 +54,19 @@ static HashTable g_hash_table;
 // Support for malloc debugging.
 // Table for dispatching malloc calls, initialized with default dispatchers.
 static const MallocDebug __libc_malloc_default_dispatch __attribute__((aligned(32))) = {
-  Malloc(calloc),
-  Malloc(free),
-  Malloc(mallinfo),
-  Malloc(malloc),
-  Malloc(malloc_usable_size),
-  Malloc(memalign),
-  Malloc(posix_memalign),
+  DefaultMalloc(calloc),
+  DefaultMalloc(free),
+  DefaultMalloc(mallinfo),
+  DefaultMalloc(malloc),
+  DefaultMalloc(malloc_usable_size),
+  DefaultMalloc(memalign),
+  DefaultMalloc(posix_memalign),
 #if defined(HAVE_DEPRECATED_MALLOC_FUNCS)
-  Malloc(pvalloc),
+  DefaultMalloc(pvalloc),
 #endif
-  Malloc(realloc),
+  DefaultMalloc(realloc),
 #if defined(HAVE_DEPRECATED_MALLOC_FUNCS)
-  Malloc(valloc),
+  DefaultMalloc(valloc),
 #endif
 };
 
@@ -278,6 +278,16 @@ extern "C" void* valloc(size_t bytes) {
 }
 #endif
 
+#if defined(USE_MALLOC_THREAD_CACHE)
+extern "C" size_t malloc_size_class_stats(struct malloc_size_class_stats* stats, size_t count) {
+  return tc_size_class_stats(stats, count);
+}
+#else
+extern "C" size_t malloc_size_class_stats(struct malloc_size_class_stats*, size_t) {
+  return 0;
+}
+#endif
+
 // We implement malloc debugging only in libc.so, so the code below
 // must be excluded if we compile this file for static libc.a
 #ifndef LIBC_STATIC
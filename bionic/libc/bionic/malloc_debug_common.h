@@ -62,6 +62,16 @@
 #define Malloc(function)  dl ## function
 #endif
 
+// The functions the default (non-debug) dispatch table points at. With
+// MALLOC_THREAD_CACHE, small allocations go through a per-thread cache in
+// front of dlmalloc; the debug implementations always talk to dlmalloc.
+#if defined(USE_MALLOC_THREAD_CACHE)
+#include "malloc_thread_cache.h"
+#define DefaultMalloc(function)  tc_ ## function
+#else
+#define DefaultMalloc(function)  Malloc(function)
+#endif
+
 // =============================================================================
 // Structures
 // =============================================================================
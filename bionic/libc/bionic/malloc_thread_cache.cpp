@@ -0,0 +1,372 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "malloc_thread_cache.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "dlmalloc.h"
+#include "pthread_internal.h"
+#include "private/bionic_macros.h"
+#include "private/ScopedPthreadMutexLocker.h"
+
+// Requests of up to kMaxCachedSize bytes are rounded up to a multiple of
+// kSizeClassGranularity and served from the thread cache.
+static const size_t kSizeClassGranularity = 16;
+static const size_t kMaxCachedSize = 512;
+static const size_t kSizeClassCount = kMaxCachedSize / kSizeClassGranularity;
+
+// Bounds on how much memory one thread may keep cached. When a size class
+// overflows, half of it is returned to dlmalloc in one go so that a thread
+// that only frees doesn't hit dlmalloc's lock on every call.
+static const size_t kMaxChunksPerClass = 64;
+static const size_t kMaxCachedBytesPerThread = 64 * 1024;
+
+struct FreeChunk {
+  FreeChunk* next;
+};
+
+struct SizeClassCounters {
+  size_t hits;
+  size_t misses;
+  size_t frees;
+  size_t flushes;
+};
+
+struct SizeClassBin {
+  FreeChunk* head;
+  size_t count;
+  SizeClassCounters counters;
+};
+
+struct ThreadCache {
+  SizeClassBin bins[kSizeClassCount];
+  size_t cached_bytes;
+
+  // All live thread caches, for malloc_size_class_stats().
+  ThreadCache* prev;
+  ThreadCache* next;
+};
+
+static pthread_key_t g_thread_cache_key;
+static bool g_thread_cache_key_created = false;
+
+// Protects the list of live caches and the counters of exited threads.
+static pthread_mutex_t g_thread_cache_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static ThreadCache* g_thread_cache_list = NULL;
+static SizeClassCounters g_exited_counters[kSizeClassCount];
+
+static inline size_t size_class_size(size_t size_class) {
+  return (size_class + 1) * kSizeClassGranularity;
+}
+
+// Returns the size class that serves a request of 'bytes' bytes.
+static inline size_t size_class_for_request(size_t bytes) {
+  return (bytes == 0) ? 0 : (bytes - 1) / kSizeClassGranularity;
+}
+
+static void thread_cache_flush_bin(ThreadCache* cache, SizeClassBin* bin, size_t keep) {
+  while (bin->count > keep) {
+    FreeChunk* chunk = bin->head;
+    bin->head = chunk->next;
+    --bin->count;
+    ++bin->counters.flushes;
+    cache->cached_bytes -= dlmalloc_usable_size(chunk);
+    dlfree(chunk);
+  }
+}
+
+// Folds the counters of a cache that is going away into g_exited_counters
+// and takes it off the list. g_thread_cache_list_lock assumed.
+static void thread_cache_retire_locked(ThreadCache* cache) {
+  for (size_t i = 0; i < kSizeClassCount; ++i) {
+    const SizeClassCounters& counters = cache->bins[i].counters;
+    g_exited_counters[i].hits += counters.hits;
+    g_exited_counters[i].misses += counters.misses;
+    g_exited_counters[i].frees += counters.frees;
+    g_exited_counters[i].flushes += counters.flushes;
+  }
+  if (cache->prev != NULL) {
+    cache->prev->next = cache->next;
+  } else {
+    g_thread_cache_list = cache->next;
+  }
+  if (cache->next != NULL) {
+    cache->next->prev = cache->prev;
+  }
+}
+
+static void thread_cache_destroy(void* data) {
+  ThreadCache* cache = reinterpret_cast<ThreadCache*>(data);
+  for (size_t i = 0; i < kSizeClassCount; ++i) {
+    thread_cache_flush_bin(cache, &cache->bins[i], 0);
+  }
+
+  {
+    ScopedPthreadMutexLocker locker(&g_thread_cache_list_lock);
+    thread_cache_retire_locked(cache);
+  }
+
+  dlfree(cache);
+
+  // pthread_exit() clears the slot before calling us; keep later TLS
+  // destructors that free memory from creating a new cache. This isn't done
+  // with the key itself, since a non-NULL value would get us called again.
+  __get_thread()->malloc_thread_cache_disabled = true;
+}
+
+// Keep the child from inheriting the list lock held by another thread.
+static void thread_cache_prepare_fork() {
+  pthread_mutex_lock(&g_thread_cache_list_lock);
+}
+
+static void thread_cache_parent_fork() {
+  pthread_mutex_unlock(&g_thread_cache_list_lock);
+}
+
+// The child only has the forking thread, so the other threads' caches would
+// leak. dlmalloc registered its own fork handlers before ours, so its lock is
+// usable again by the time we run.
+static void thread_cache_child_fork() {
+  ThreadCache* self = reinterpret_cast<ThreadCache*>(pthread_getspecific(g_thread_cache_key));
+  ThreadCache* cache = g_thread_cache_list;
+  while (cache != NULL) {
+    ThreadCache* next = cache->next;
+    if (cache != self) {
+      for (size_t i = 0; i < kSizeClassCount; ++i) {
+        thread_cache_flush_bin(cache, &cache->bins[i], 0);
+      }
+      thread_cache_retire_locked(cache);
+      dlfree(cache);
+    }
+    cache = next;
+  }
+  pthread_mutex_unlock(&g_thread_cache_list_lock);
+}
+
+// Keys are allocated up front like the other libc-internal keys (see
+// GLOBAL_INIT_THREAD_LOCAL_BUFFER); allocations made before this runs simply
+// bypass the cache.
+__attribute__((constructor)) static void thread_cache_key_init() {
+  if (pthread_key_create(&g_thread_cache_key, thread_cache_destroy) == 0) {
+    pthread_atfork(thread_cache_prepare_fork, thread_cache_parent_fork, thread_cache_child_fork);
+    g_thread_cache_key_created = true;
+  }
+}
+
+// Returns the calling thread's cache, creating it if necessary, or NULL if
+// the calling thread can't use one.
+static ThreadCache* thread_cache_get() {
+  if (!g_thread_cache_key_created) {
+    return NULL;
+  }
+
+  ThreadCache* cache = reinterpret_cast<ThreadCache*>(pthread_getspecific(g_thread_cache_key));
+  if (__predict_true(cache != NULL)) {
+    return cache;
+  }
+  if (__get_thread()->malloc_thread_cache_disabled) {
+    return NULL;
+  }
+
+  cache = reinterpret_cast<ThreadCache*>(dlcalloc(1, sizeof(ThreadCache)));
+  if (cache == NULL) {
+    return NULL;
+  }
+  {
+    ScopedPthreadMutexLocker locker(&g_thread_cache_list_lock);
+    cache->next = g_thread_cache_list;
+    if (g_thread_cache_list != NULL) {
+      g_thread_cache_list->prev = cache;
+    }
+    g_thread_cache_list = cache;
+  }
+  pthread_setspecific(g_thread_cache_key, cache);
+  return cache;
+}
+
+void* tc_malloc(size_t bytes) {
+  if (bytes > kMaxCachedSize) {
+    return dlmalloc(bytes);
+  }
+
+  ThreadCache* cache = thread_cache_get();
+  if (cache == NULL) {
+    return dlmalloc(bytes);
+  }
+
+  size_t size_class = size_class_for_request(bytes);
+  SizeClassBin* bin = &cache->bins[size_class];
+  FreeChunk* chunk = bin->head;
+  if (chunk != NULL) {
+    bin->head = chunk->next;
+    --bin->count;
+    ++bin->counters.hits;
+    cache->cached_bytes -= dlmalloc_usable_size(chunk);
+    return chunk;
+  }
+
+  // Allocate the full class size so that the chunk can be reused for any
+  // request in this class once it has been freed.
+  ++bin->counters.misses;
+  return dlmalloc(size_class_size(size_class));
+}
+
+void tc_free(void* mem) {
+  if (mem == NULL) {
+    return;
+  }
+
+  // Chunks are cached by their usable size, rounded down to a size class,
+  // so that anything dlmalloc handed out (including chunks from memalign or
+  // realloc) can be reused safely.
+  size_t usable = dlmalloc_usable_size(mem);
+  if (usable < kSizeClassGranularity || usable > kMaxCachedSize + kSizeClassGranularity) {
+    dlfree(mem);
+    return;
+  }
+  size_t size_class = usable / kSizeClassGranularity - 1;
+  if (size_class >= kSizeClassCount) {
+    size_class = kSizeClassCount - 1;
+  }
+
+  ThreadCache* cache = thread_cache_get();
+  if (cache == NULL) {
+    dlfree(mem);
+    return;
+  }
+
+  SizeClassBin* bin = &cache->bins[size_class];
+  if (bin->count >= kMaxChunksPerClass ||
+      cache->cached_bytes + usable > kMaxCachedBytesPerThread) {
+    thread_cache_flush_bin(cache, bin, bin->count / 2);
+    if (cache->cached_bytes + usable > kMaxCachedBytesPerThread) {
+      // Other classes hold the budget; don't let this one grow.
+      ++bin->counters.flushes;
+      dlfree(mem);
+      return;
+    }
+  }
+
+  FreeChunk* chunk = reinterpret_cast<FreeChunk*>(mem);
+  chunk->next = bin->head;
+  bin->head = chunk;
+  ++bin->count;
+  ++bin->counters.frees;
+  cache->cached_bytes += usable;
+}
+
+void* tc_calloc(size_t n_elements, size_t elem_size) {
+  size_t bytes = n_elements * elem_size;
+  if (elem_size != 0 && bytes / elem_size != n_elements) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  if (bytes > kMaxCachedSize) {
+    return dlcalloc(n_elements, elem_size);
+  }
+
+  void* mem = tc_malloc(bytes);
+  if (mem != NULL) {
+    memset(mem, 0, bytes);
+  }
+  return mem;
+}
+
+void* tc_realloc(void* old_mem, size_t bytes) {
+  if (old_mem == NULL) {
+    return tc_malloc(bytes);
+  }
+  if (bytes == 0) {
+    tc_free(old_mem);
+    return NULL;
+  }
+  // Every pointer we hand out is a live dlmalloc chunk, so dlrealloc can
+  // grow or shrink it in place where possible.
+  return dlrealloc(old_mem, bytes);
+}
+
+struct mallinfo tc_mallinfo() {
+  struct mallinfo info = dlmallinfo();
+
+  // Chunks sitting in thread caches are free as far as callers are concerned.
+  size_t cached_bytes = 0;
+  {
+    ScopedPthreadMutexLocker locker(&g_thread_cache_list_lock);
+    for (ThreadCache* cache = g_thread_cache_list; cache != NULL; cache = cache->next) {
+      cached_bytes += cache->cached_bytes;
+    }
+  }
+  if (cached_bytes > info.uordblks) {
+    cached_bytes = info.uordblks;
+  }
+  info.uordblks -= cached_bytes;
+  info.fordblks += cached_bytes;
+  return info;
+}
+
+size_t tc_malloc_usable_size(const void* mem) {
+  return dlmalloc_usable_size(mem);
+}
+
+void* tc_memalign(size_t alignment, size_t bytes) {
+  return dlmemalign(alignment, bytes);
+}
+
+int tc_posix_memalign(void** memptr, size_t alignment, size_t size) {
+  return dlposix_memalign(memptr, alignment, size);
+}
+
+void* tc_pvalloc(size_t bytes) {
+  return dlpvalloc(bytes);
+}
+
+void* tc_valloc(size_t bytes) {
+  return dlvalloc(bytes);
+}
+
+size_t tc_size_class_stats(struct malloc_size_class_stats* stats, size_t count) {
+  if (count > kSizeClassCount) {
+    count = kSizeClassCount;
+  }
+
+  ScopedPthreadMutexLocker locker(&g_thread_cache_list_lock);
+  for (size_t i = 0; i < count; ++i) {
+    struct malloc_size_class_stats& out = stats[i];
+    out.size = size_class_size(i);
+    out.cached = 0;
+    out.hits = g_exited_counters[i].hits;
+    out.misses = g_exited_counters[i].misses;
+    out.frees = g_exited_counters[i].frees;
+    out.flushes = g_exited_counters[i].flushes;
+
+    // Other threads update their own counters without locking; these reads
+    // may be slightly stale but are never torn on word-sized fields.
+    for (ThreadCache* cache = g_thread_cache_list; cache != NULL; cache = cache->next) {
+      const SizeClassBin& bin = cache->bins[i];
+      out.cached += bin.count;
+      out.hits += bin.counters.hits;
+      out.misses += bin.counters.misses;
+      out.frees += bin.counters.frees;
+      out.flushes += bin.counters.flushes;
+    }
+  }
+  return kSizeClassCount;
+}
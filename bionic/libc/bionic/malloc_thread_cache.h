@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LIBC_BIONIC_MALLOC_THREAD_CACHE_H_
+#define LIBC_BIONIC_MALLOC_THREAD_CACHE_H_
+
+// A per-thread cache of small dlmalloc chunks, sorted into size classes, that
+// sits in front of dlmalloc when bionic is built with MALLOC_THREAD_CACHE.
+// Small allocations and frees are served from the calling thread's cache
+// without taking dlmalloc's global lock; only cache misses and flushes of
+// over-full size classes go to dlmalloc.
+
+#include <sys/cdefs.h>
+#include <stddef.h>
+#include <malloc.h>
+
+__BEGIN_DECLS
+
+void* tc_calloc(size_t, size_t);
+void tc_free(void*);
+struct mallinfo tc_mallinfo();
+void* tc_malloc(size_t);
+size_t tc_malloc_usable_size(const void*);
+void* tc_memalign(size_t, size_t);
+int tc_posix_memalign(void**, size_t, size_t);
+void* tc_pvalloc(size_t);
+void* tc_realloc(void*, size_t);
+void* tc_valloc(size_t);
+
+size_t tc_size_class_stats(struct malloc_size_class_stats*, size_t);
+
+__END_DECLS
+
+#endif  // LIBC_BIONIC_MALLOC_THREAD_CACHE_H_
@@ -70,6 +70,10 @@ struct pthread_internal_t {
 
   pthread_mutex_t startup_handshake_mutex;
 
+  // Set once the malloc thread cache has been torn down by pthread_exit(), so
+  // that later TLS destructors don't create a new one.
+  bool malloc_thread_cache_disabled;
+
   /*
    * The dynamic linker implements dlerror(3), which makes it hard for us to implement this
    * per-thread buffer by simply using malloc(3) and free(3).
@@ -590,12 +590,85 @@ int __system_property_area_init()
     return map_prop_area_rw();
 }
 
+/*
+ * Per-process cache of recent __system_property_find results, so that hot
+ * names don't re-walk the trie on every lookup. Each slot holds the offset
+ * of a prop_info in the property area (0 means empty, since offset 0 is the
+ * root prop_bt). Because a prop_info never moves or changes its name once
+ * allocated, a slot can be read and written without locking: a hit is
+ * confirmed by comparing the name stored in the prop_info itself, so a
+ * slot overwritten by another thread just turns into a miss.
+ */
+#define PROP_LOOKUP_CACHE_SIZE 256
+
+static volatile uint32_t prop_lookup_cache[PROP_LOOKUP_CACHE_SIZE];
+static const prop_area *prop_lookup_cache_area = NULL;
+
+static uint32_t prop_name_hash(const char *name, size_t *namelen)
+{
+    // FNV-1a.
+    uint32_t h = 2166136261u;
+    const char *p = name;
+    for (; *p != '\0'; ++p) {
+        h = (h ^ static_cast<uint8_t>(*p)) * 16777619u;
+    }
+    *namelen = p - name;
+    return h;
+}
+
+static const prop_info *find_property_cached(const char *name)
+{
+    prop_area *pa = __system_property_area__;
+    if (!pa) {
+        return NULL;
+    }
+
+    // The area only changes when a test maps its own; start over if so.
+    if (__predict_false(pa != prop_lookup_cache_area)) {
+        for (size_t i = 0; i < PROP_LOOKUP_CACHE_SIZE; ++i) {
+            prop_lookup_cache[i] = 0;
+        }
+        prop_lookup_cache_area = pa;
+    }
+
+    size_t namelen;
+    volatile uint32_t *slot =
+        &prop_lookup_cache[prop_name_hash(name, &namelen) % PROP_LOOKUP_CACHE_SIZE];
+
+    const uint32_t off = *slot;
+    if (off != 0 && off < pa->bytes_used) {
+        const prop_info *pi = reinterpret_cast<prop_info*>(to_prop_obj(off));
+        if (pi && strcmp(pi->name, name) == 0) {
+            return pi;
+        }
+    }
+
+    const prop_info *pi = find_property(root_node(), name, namelen, NULL, 0, false);
+    if (pi) {
+        *slot = reinterpret_cast<const char*>(pi) - pa->data;
+    }
+    return pi;
+}
+
 const prop_info *__system_property_find(const char *name)
 {
     if (__predict_false(compat_mode)) {
         return __system_property_find_compat(name);
     }
-    return find_property(root_node(), name, strlen(name), NULL, 0, false);
+    return find_property_cached(name);
+}
+
+int __system_property_find_batch(const char *const *names, const prop_info **pis,
+        size_t count)
+{
+    int found = 0;
+    for (size_t i = 0; i < count; ++i) {
+        pis[i] = __system_property_find(names[i]);
+        if (pis[i]) {
+            found++;
+        }
+    }
+    return found;
 }
 
 int __system_property_read(const prop_info *pi, char *name, char *value)
@@ -618,6 +691,65 @@ int __system_property_read(const prop_info *pi, char *name, char *value)
     }
 }
 
+int __system_property_read_batch(const prop_info *const *pis,
+        char (*values)[PROP_VALUE_MAX], unsigned int *serials, size_t count)
+{
+    if (__predict_false(compat_mode)) {
+        for (size_t i = 0; i < count; ++i) {
+            if (pis[i]) {
+                __system_property_read_compat(pis[i], NULL, values[i]);
+            } else {
+                values[i][0] = '\0';
+            }
+            if (serials) {
+                serials[i] = 0;
+            }
+        }
+        return 0;
+    }
+
+    prop_area *pa = __system_property_area__;
+    if (!pa) {
+        return -1;
+    }
+
+    while (true) {
+        // Every add and update bumps the area serial, so if it is unchanged
+        // after the pass then no value changed while we were copying and the
+        // values form a consistent snapshot.
+        const uint32_t area_serial = pa->serial;
+        ANDROID_MEMBAR_FULL();
+
+        bool torn = false;
+        for (size_t i = 0; i < count; ++i) {
+            const prop_info *pi = pis[i];
+            if (!pi) {
+                values[i][0] = '\0';
+                if (serials) {
+                    serials[i] = 0;
+                }
+                continue;
+            }
+
+            const uint32_t serial = __system_property_serial(pi);
+            memcpy(values[i], pi->value, SERIAL_VALUE_LEN(serial) + 1);
+            ANDROID_MEMBAR_FULL();
+            if (serial != pi->serial) {
+                torn = true;
+                break;
+            }
+            if (serials) {
+                serials[i] = serial;
+            }
+        }
+
+        ANDROID_MEMBAR_FULL();
+        if (!torn && area_serial == pa->serial) {
+            return 0;
+        }
+    }
+}
+
 int __system_property_get(const char *name, char *value)
 {
     const prop_info *pi = __system_property_find(name);
@@ -714,6 +846,45 @@ unsigned int __system_property_wait_any(unsigned int serial)
     return pa->serial;
 }
 
+int __system_property_wait(const prop_info *pi, unsigned int old_serial,
+        unsigned int *new_serial_ptr, const struct timespec *relative_timeout)
+{
+    if (__predict_false(compat_mode)) {
+        // An old init may not wake waiters on the property itself, so wait
+        // on the area and re-check.
+        prop_area *pa = __system_property_area__;
+        while (true) {
+            const uint32_t area_serial = pa->serial;
+            const uint32_t serial = __system_property_serial(pi);
+            if (serial != old_serial) {
+                *new_serial_ptr = serial;
+                return 0;
+            }
+            if (__futex_wait(&pa->serial, area_serial, relative_timeout) == -ETIMEDOUT) {
+                return -1;
+            }
+        }
+    }
+
+    // __system_property_update wakes waiters on pi->serial itself, so only
+    // changes to this property end the wait.
+    while (true) {
+        const uint32_t serial = pi->serial;
+        if (serial != old_serial) {
+            const uint32_t new_serial = __system_property_serial(pi);
+            if (new_serial != old_serial) {
+                *new_serial_ptr = new_serial;
+                return 0;
+            }
+            continue;
+        }
+        if (__futex_wait(const_cast<volatile uint32_t*>(&pi->serial), serial,
+                         relative_timeout) == -ETIMEDOUT) {
+            return -1;
+        }
+    }
+}
+
 const prop_info *__system_property_find_nth(unsigned n)
 {
     find_nth_cookie cookie(n);
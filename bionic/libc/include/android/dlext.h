@@ -54,12 +54,34 @@ enum {
    */
   ANDROID_DLEXT_USE_LIBRARY_FD        = 0x10,
 
+  /* When set, record how each symbol relocation of the library was resolved
+   * and write it to reloc_cache_fd after relocation has been performed, to
+   * allow a later load of the same library against the same dependencies to
+   * skip symbol lookup.
+   */
+  ANDROID_DLEXT_WRITE_RELOC_CACHE     = 0x20,
+
+  /* When set, resolve symbol relocations using a cache previously written to
+   * reloc_cache_fd with ANDROID_DLEXT_WRITE_RELOC_CACHE. The cache is ignored
+   * if the library or any library in its lookup scope has changed since.
+   */
+  ANDROID_DLEXT_USE_RELOC_CACHE       = 0x40,
+
+  /* When set with ANDROID_DLEXT_USE_RELOC_CACHE, fail the load instead of
+   * falling back to symbol lookup if the cache can't be used to resolve every
+   * symbol relocation. This is mainly useful for testing.
+   */
+  ANDROID_DLEXT_RELOC_CACHE_REQUIRED  = 0x80,
+
   /* Mask of valid bits */
   ANDROID_DLEXT_VALID_FLAG_BITS       = ANDROID_DLEXT_RESERVED_ADDRESS |
                                         ANDROID_DLEXT_RESERVED_ADDRESS_HINT |
                                         ANDROID_DLEXT_WRITE_RELRO |
                                         ANDROID_DLEXT_USE_RELRO |
-                                        ANDROID_DLEXT_USE_LIBRARY_FD,
+                                        ANDROID_DLEXT_USE_LIBRARY_FD |
+                                        ANDROID_DLEXT_WRITE_RELOC_CACHE |
+                                        ANDROID_DLEXT_USE_RELOC_CACHE |
+                                        ANDROID_DLEXT_RELOC_CACHE_REQUIRED,
 };
 
 typedef struct {
@@ -68,6 +90,7 @@ typedef struct {
   size_t  reserved_size;
   int     relro_fd;
   int     library_fd;
+  int     reloc_cache_fd;
 } android_dlextinfo;
 
 extern void* android_dlopen_ext(const char* filename, int flag, const android_dlextinfo* extinfo);
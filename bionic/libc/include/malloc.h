@@ -53,6 +53,26 @@ struct mallinfo {
 
 extern struct mallinfo mallinfo(void);
 
+/*
+ * Statistics for one size class of the malloc thread cache. Counters are
+ * totals since process start over all threads, including exited ones.
+ */
+struct malloc_size_class_stats {
+  size_t size;     /* Largest request size served by this size class. */
+  size_t cached;   /* Number of chunks currently held in thread caches. */
+  size_t hits;     /* Allocations served from a thread cache. */
+  size_t misses;   /* Allocations passed through to the underlying allocator. */
+  size_t frees;    /* Frees kept in a thread cache. */
+  size_t flushes;  /* Chunks returned from thread caches to the underlying allocator. */
+};
+
+/*
+ * Fills in up to 'count' entries of 'stats', smallest size class first, and
+ * returns the total number of size classes. Returns 0 if this libc was built
+ * without the malloc thread cache.
+ */
+extern size_t malloc_size_class_stats(struct malloc_size_class_stats* stats, size_t count);
+
 __END_DECLS
 
 #endif  /* LIBC_INCLUDE_MALLOC_H_ */
@@ -130,6 +130,19 @@ unsigned int __system_property_serial(const prop_info *pi);
 ** successive call. */
 unsigned int __system_property_wait_any(unsigned int serial);
 
+/* Wait for the system property returned by __system_property_find
+** to be updated.  Caller passes in the serial of the value it last
+** saw (from __system_property_serial or a previous call).  Unlike
+** __system_property_wait_any, only updates to this property wake
+** the caller.  On return, *new_serial_ptr holds the new serial.
+** relative_timeout may be NULL to wait forever.
+**
+** Returns 0 if the property changed, -1 if the timeout expired.
+*/
+struct timespec;
+int __system_property_wait(const prop_info *pi, unsigned int old_serial,
+        unsigned int *new_serial_ptr, const struct timespec *relative_timeout);
+
 /*  Compatibility functions to support using an old init with a new libc,
  ** mostly for the OTA updater binary.  These can be deleted once OTAs from
  ** a pre-K release no longer needed to be supported. */
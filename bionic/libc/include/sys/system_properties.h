@@ -30,6 +30,7 @@
 #define _INCLUDE_SYS_SYSTEM_PROPERTIES_H
 
 #include <sys/cdefs.h>
+#include <stddef.h>
 
 __BEGIN_DECLS
 
@@ -97,6 +98,31 @@ int __system_property_foreach(
         void (*propfn)(const prop_info *pi, void *cookie),
         void *cookie);
 
+/* Look up 'count' system properties by name in one call, storing
+** a prop_info pointer for each in pis, or NULL for properties that
+** do not exist.  The pointers remain valid for the life of the
+** process, so callers that read the same properties repeatedly
+** should resolve them once and use __system_property_read_batch.
+**
+** Returns the number of properties found.
+*/
+int __system_property_find_batch(const char* const* names, const prop_info** pis,
+        size_t count);
+
+/* Read the values of 'count' system properties returned by
+** __system_property_find or __system_property_find_batch into
+** values.  A NULL prop_info reads as the empty string.  The values
+** are a consistent snapshot: no property changed while they were
+** being read.  If serials is not NULL, the serial number of each
+** value is stored there (0 for NULL entries) so that callers can
+** cheaply tell which values changed since their last read.
+**
+** Returns 0 on success, or -1 if the property area is not yet
+** initialized.
+*/
+int __system_property_read_batch(const prop_info* const* pis,
+        char (*values)[PROP_VALUE_MAX], unsigned int* serials, size_t count);
+
 __END_DECLS
 
 #endif
@@ -81,6 +81,9 @@ enum {
 #if defined(USE_JEMALLOC)
 /* jemalloc uses 5 keys for itself. */
 #define BIONIC_TLS_RESERVED_SLOTS (GLOBAL_INIT_THREAD_LOCAL_BUFFER_COUNT + 5)
+#elif defined(USE_MALLOC_THREAD_CACHE)
+/* The dlmalloc thread cache uses 1 key for itself. */
+#define BIONIC_TLS_RESERVED_SLOTS (GLOBAL_INIT_THREAD_LOCAL_BUFFER_COUNT + 1)
 #else
 #define BIONIC_TLS_RESERVED_SLOTS GLOBAL_INIT_THREAD_LOCAL_BUFFER_COUNT
 #endif
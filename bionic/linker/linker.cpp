@@ -35,6 +35,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/param.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -49,6 +50,7 @@
 #include "linker_environ.h"
 #include "linker_phdr.h"
 #include "linker_allocator.h"
+#include "linker_reloc_cache.h"
 
 /* >>> IMPORTANT NOTE - READ ME BEFORE MODIFYING <<<
  *
@@ -130,9 +132,16 @@ enum class SymbolLookupScope {
   kExcludeLocal,
 };
 
+enum SymbolLookupKind {
+    kLookupFull = 0,    // Searched the global/needed scope.
+    kLookupCached,      // Reused the result for the previous relocation.
+    kLookupMax
+};
+
 #if STATS
 struct linker_stats_t {
     int count[kRelocMax];
+    int lookup_count[kLookupMax];
 };
 
 static linker_stats_t linker_stats;
@@ -140,9 +149,16 @@ static linker_stats_t linker_stats;
 static void count_relocation(RelocationKind kind) {
     ++linker_stats.count[kind];
 }
+
+static void count_symbol_lookup(SymbolLookupKind kind) {
+    ++linker_stats.lookup_count[kind];
+}
 #else
 static void count_relocation(RelocationKind) {
 }
+
+static void count_symbol_lookup(SymbolLookupKind) {
+}
 #endif
 
 #if COUNT_PAGES
@@ -284,6 +300,116 @@ void SoinfoListAllocator::free(LinkedListEntry<soinfo>* entry) {
   g_soinfo_links_allocator.free(entry);
 }
 
+/*
+ * Indexes over the loaded libraries, so that dlopen(3) by name and
+ * dladdr(3)/dlsym(3) caller lookup don't have to walk the whole solist.
+ *
+ * The name index is a fixed-size hash table chained through
+ * soinfo::name_index_next, maintained by soinfo_alloc()/soinfo_free().
+ * The address index is an array of the mapped libraries sorted by base
+ * address; it is invalidated on load/unload and rebuilt on the next lookup,
+ * so repeated dladdr(3) calls between loads are a binary search.
+ */
+#define SOINFO_NAME_INDEX_SIZE 256
+
+static soinfo* g_soinfo_name_index[SOINFO_NAME_INDEX_SIZE];
+
+static soinfo** g_soinfo_address_index = NULL;
+static size_t g_soinfo_address_index_count = 0;
+static size_t g_soinfo_address_index_capacity = 0;
+static bool g_soinfo_address_index_valid = false;
+
+static uint32_t gnuhash(const char* name);
+
+static size_t soinfo_name_index_bucket(const char* name) {
+  return gnuhash(name) % SOINFO_NAME_INDEX_SIZE;
+}
+
+static void soinfo_name_index_add(soinfo* si) {
+  // Append to the end of the chain so that, as with the solist walk this
+  // replaces, the earliest loaded library with a given name wins.
+  soinfo** link = &g_soinfo_name_index[soinfo_name_index_bucket(si->name)];
+  while (*link != NULL) {
+    link = &(*link)->name_index_next;
+  }
+  si->name_index_next = NULL;
+  *link = si;
+}
+
+static void soinfo_name_index_remove(soinfo* si) {
+  for (soinfo** link = &g_soinfo_name_index[soinfo_name_index_bucket(si->name)];
+       *link != NULL; link = &(*link)->name_index_next) {
+    if (*link == si) {
+      *link = si->name_index_next;
+      si->name_index_next = NULL;
+      return;
+    }
+  }
+}
+
+static soinfo* soinfo_name_index_find(const char* name) {
+  for (soinfo* si = g_soinfo_name_index[soinfo_name_index_bucket(name)];
+       si != NULL; si = si->name_index_next) {
+    if (!strcmp(name, si->name)) {
+      return si;
+    }
+  }
+  return NULL;
+}
+
+static void soinfo_address_index_invalidate() {
+  g_soinfo_address_index_valid = false;
+}
+
+// Rebuilds the address index if a library has been loaded or unloaded since
+// it was last built. Returns false if we couldn't allocate the index, in
+// which case callers should fall back to walking the solist.
+static bool soinfo_address_index_update() {
+  if (g_soinfo_address_index_valid) {
+    return true;
+  }
+
+  size_t count = 0;
+  for (soinfo* si = solist; si != NULL; si = si->next) {
+    if (si->size != 0) {
+      ++count;
+    }
+  }
+
+  if (count > g_soinfo_address_index_capacity) {
+    size_t capacity = PAGE_END(count * sizeof(soinfo*)) / sizeof(soinfo*);
+    void* map = mmap(NULL, capacity * sizeof(soinfo*), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+      return false;
+    }
+    if (g_soinfo_address_index != NULL) {
+      munmap(g_soinfo_address_index, g_soinfo_address_index_capacity * sizeof(soinfo*));
+    }
+    g_soinfo_address_index = reinterpret_cast<soinfo**>(map);
+    g_soinfo_address_index_capacity = capacity;
+  }
+
+  // Libraries are mostly loaded at decreasing addresses, so this is close to
+  // a reversed sorted input; an insertion sort is fine for a few hundred
+  // entries and only runs once per load/unload.
+  size_t n = 0;
+  for (soinfo* si = solist; si != NULL; si = si->next) {
+    if (si->size == 0) {
+      continue;
+    }
+    size_t i = n++;
+    while (i > 0 && g_soinfo_address_index[i - 1]->base > si->base) {
+      g_soinfo_address_index[i] = g_soinfo_address_index[i - 1];
+      --i;
+    }
+    g_soinfo_address_index[i] = si;
+  }
+  g_soinfo_address_index_count = n;
+  g_soinfo_address_index_valid = true;
+  return true;
+}
+
 static void protect_data(int protection) {
   g_soinfo_allocator.protect_all(protection);
   g_soinfo_links_allocator.protect_all(protection);
@@ -305,11 +431,15 @@ static soinfo* soinfo_alloc(const char* name, struct stat* file_stat) {
   if (file_stat != NULL) {
     si->set_st_dev(file_stat->st_dev);
     si->set_st_ino(file_stat->st_ino);
+    si->set_st_mtime(file_stat->st_mtime);
   }
 
   sonext->next = si;
   sonext = si;
 
+  soinfo_name_index_add(si);
+  soinfo_address_index_invalidate();
+
   TRACE("name %s: allocated soinfo @ %p", name, si);
   return si;
 }
@@ -349,6 +479,9 @@ static void soinfo_free(soinfo* si) {
         sonext = prev;
     }
 
+    soinfo_name_index_remove(si);
+    soinfo_address_index_invalidate();
+
     g_soinfo_allocator.free(si);
 }
 
@@ -433,7 +566,144 @@ int dl_iterate_phdr(int (*cb)(dl_phdr_info* info, size_t size, void* data), void
     return rv;
 }
 
-static ElfW(Sym)* soinfo_elf_lookup(soinfo* si, unsigned hash, const char* name, const SymbolLookupScope& lookup_scope) {
+static unsigned elfhash(const char* _name) {
+    const unsigned char* name = reinterpret_cast<const unsigned char*>(_name);
+    unsigned h = 0, g;
+
+    while (*name) {
+        h = (h << 4) + *name++;
+        g = h & 0xf0000000;
+        h ^= g;
+        h ^= g >> 24;
+    }
+    return h;
+}
+
+static uint32_t gnuhash(const char* _name) {
+    const unsigned char* name = reinterpret_cast<const unsigned char*>(_name);
+    uint32_t h = 5381;
+
+    while (*name) {
+        h += (h << 5) + *name++; // h*33 + c = h + h * 32 + c = h + h << 5 + c
+    }
+    return h;
+}
+
+// A symbol name with lazily computed SysV and GNU hashes, so that a single
+// lookup across many libraries with mixed hash styles hashes the name at most
+// once per style.
+class SymbolName {
+ public:
+  explicit SymbolName(const char* name)
+      : name_(name), has_elf_hash_(false), has_gnu_hash_(false),
+        elf_hash_(0), gnu_hash_(0) { }
+
+  const char* get_name() const {
+    return name_;
+  }
+
+  uint32_t elf_hash() {
+    if (!has_elf_hash_) {
+      elf_hash_ = elfhash(name_);
+      has_elf_hash_ = true;
+    }
+    return elf_hash_;
+  }
+
+  uint32_t gnu_hash() {
+    if (!has_gnu_hash_) {
+      gnu_hash_ = gnuhash(name_);
+      has_gnu_hash_ = true;
+    }
+    return gnu_hash_;
+  }
+
+ private:
+  const char* name_;
+  bool has_elf_hash_;
+  bool has_gnu_hash_;
+  uint32_t elf_hash_;
+  uint32_t gnu_hash_;
+
+  DISALLOW_IMPLICIT_CONSTRUCTORS(SymbolName);
+};
+
+// Returns true if 's' (whose name is already known to match) is a definition
+// that may be returned for the given lookup scope.
+static bool is_symbol_visible(soinfo* si, ElfW(Sym)* s, const char* name,
+                              const SymbolLookupScope& lookup_scope) {
+  switch (ELF_ST_BIND(s->st_info)) {
+    case STB_GLOBAL:
+    case STB_WEAK:
+      if (s->st_shndx == SHN_UNDEF) {
+        return false;
+      }
+
+      TRACE_TYPE(LOOKUP, "FOUND %s in %s (%p) %zd",
+               name, si->name, reinterpret_cast<void*>(s->st_value),
+               static_cast<size_t>(s->st_size));
+      return true;
+    case STB_LOCAL:
+      if (lookup_scope != SymbolLookupScope::kAllowLocal) {
+        return false;
+      }
+      TRACE_TYPE(LOOKUP, "FOUND LOCAL %s in %s (%p) %zd",
+              name, si->name, reinterpret_cast<void*>(s->st_value),
+              static_cast<size_t>(s->st_size));
+      return true;
+    default:
+      __libc_fatal("ERROR: Unexpected ST_BIND value: %d for '%s' in '%s'",
+          ELF_ST_BIND(s->st_info), name, si->name);
+  }
+}
+
+static ElfW(Sym)* soinfo_gnu_lookup(soinfo* si, SymbolName& symbol_name, const SymbolLookupScope& lookup_scope) {
+  uint32_t hash = symbol_name.gnu_hash();
+  uint32_t h2 = hash >> si->gnu_shift2;
+  const char* name = symbol_name.get_name();
+
+  uint32_t bloom_mask_bits = sizeof(ElfW(Addr)) * 8;
+  uint32_t word_num = (hash / bloom_mask_bits) & si->gnu_maskwords;
+  ElfW(Addr) bloom_word = si->gnu_bloom_filter[word_num];
+
+  // Test against the bloom filter first: most lookups are for symbols that
+  // are not defined in this library and are rejected here without touching
+  // the bucket, chain, symtab or strtab.
+  if ((1 & (bloom_word >> (hash % bloom_mask_bits)) & (bloom_word >> (h2 % bloom_mask_bits))) == 0) {
+    TRACE_TYPE(LOOKUP, "NOT FOUND %s in %s@%p (gnu hash bloom filter reject) %x",
+               name, si->name, reinterpret_cast<void*>(si->base), hash);
+    return NULL;
+  }
+
+  uint32_t n = si->gnu_bucket[hash % si->gnu_nbucket];
+  if (n == 0) {
+    return NULL;
+  }
+
+  TRACE_TYPE(LOOKUP, "SEARCH %s in %s@%p (gnu hash) %x %zd",
+             name, si->name, reinterpret_cast<void*>(si->base), hash,
+             static_cast<size_t>(hash % si->gnu_nbucket));
+
+  ElfW(Sym)* symtab = si->symtab;
+  const char* strtab = si->strtab;
+  do {
+    ElfW(Sym)* s = symtab + n;
+    // The low bit of each chain entry marks the end of the chain; the
+    // remaining bits are the hash, which filters out almost every
+    // non-matching name before the strcmp.
+    if (((si->gnu_chain[n] ^ hash) >> 1) == 0 &&
+        strcmp(strtab + s->st_name, name) == 0 &&
+        is_symbol_visible(si, s, name, lookup_scope)) {
+      return s;
+    }
+  } while ((si->gnu_chain[n++] & 1) == 0);
+
+  return NULL;
+}
+
+static ElfW(Sym)* soinfo_elf_lookup(soinfo* si, SymbolName& symbol_name, const SymbolLookupScope& lookup_scope) {
+  uint32_t hash = symbol_name.elf_hash();
+  const char* name = symbol_name.get_name();
   ElfW(Sym)* symtab = si->symtab;
   const char* strtab = si->strtab;
 
@@ -442,51 +712,26 @@ static ElfW(Sym)* soinfo_elf_lookup(soinfo* si, unsigned hash, const char* name,
 
   for (unsigned n = si->bucket[hash % si->nbucket]; n != 0; n = si->chain[n]) {
     ElfW(Sym)* s = symtab + n;
-    if (strcmp(strtab + s->st_name, name)) continue;
-
-    switch (ELF_ST_BIND(s->st_info)) {
-      case STB_GLOBAL:
-      case STB_WEAK:
-        if (s->st_shndx == SHN_UNDEF) {
-          continue;
-        }
-
-        TRACE_TYPE(LOOKUP, "FOUND %s in %s (%p) %zd",
-                 name, si->name, reinterpret_cast<void*>(s->st_value),
-                 static_cast<size_t>(s->st_size));
-        return s;
-      case STB_LOCAL:
-        if (lookup_scope != SymbolLookupScope::kAllowLocal) {
-          continue;
-        }
-        TRACE_TYPE(LOOKUP, "FOUND LOCAL %s in %s (%p) %zd",
-                name, si->name, reinterpret_cast<void*>(s->st_value),
-                static_cast<size_t>(s->st_size));
-        return s;
-      default:
-        __libc_fatal("ERROR: Unexpected ST_BIND value: %d for '%s' in '%s'",
-            ELF_ST_BIND(s->st_info), name, si->name);
+    if (strcmp(strtab + s->st_name, name) == 0 &&
+        is_symbol_visible(si, s, name, lookup_scope)) {
+      return s;
     }
   }
 
   return NULL;
 }
 
-static unsigned elfhash(const char* _name) {
-    const unsigned char* name = reinterpret_cast<const unsigned char*>(_name);
-    unsigned h = 0, g;
-
-    while (*name) {
-        h = (h << 4) + *name++;
-        g = h & 0xf0000000;
-        h ^= g;
-        h ^= g >> 24;
-    }
-    return h;
+// Looks 'symbol_name' up in 'si', preferring the DT_GNU_HASH table when the
+// library has one and falling back to the SysV DT_HASH table otherwise.
+static ElfW(Sym)* soinfo_lookup(soinfo* si, SymbolName& symbol_name, const SymbolLookupScope& lookup_scope) {
+  if ((si->flags & FLAG_GNU_HASH) != 0) {
+    return soinfo_gnu_lookup(si, symbol_name, lookup_scope);
+  }
+  return soinfo_elf_lookup(si, symbol_name, lookup_scope);
 }
 
 static ElfW(Sym)* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, soinfo* needed[]) {
-    unsigned elf_hash = elfhash(name);
+    SymbolName symbol_name(name);
     ElfW(Sym)* s = NULL;
 
     if (si != NULL && somain != NULL) {
@@ -496,7 +741,7 @@ static ElfW(Sym)* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, s
          */
 
         if (si == somain) {
-            s = soinfo_elf_lookup(si, elf_hash, name, SymbolLookupScope::kAllowLocal);
+            s = soinfo_lookup(si, symbol_name, SymbolLookupScope::kAllowLocal);
             if (s != NULL) {
                 *lsi = si;
                 goto done;
@@ -513,7 +758,7 @@ static ElfW(Sym)* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, s
             if (!si->has_DT_SYMBOLIC) {
                 DEBUG("%s: looking up %s in executable %s",
                       si->name, name, somain->name);
-                s = soinfo_elf_lookup(somain, elf_hash, name, SymbolLookupScope::kExcludeLocal);
+                s = soinfo_lookup(somain, symbol_name, SymbolLookupScope::kExcludeLocal);
                 if (s != NULL) {
                     *lsi = somain;
                     goto done;
@@ -530,7 +775,7 @@ static ElfW(Sym)* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, s
              * and some the first non-weak definition.   This is system dependent.
              * Here we return the first definition found for simplicity.  */
 
-            s = soinfo_elf_lookup(si, elf_hash, name, SymbolLookupScope::kAllowLocal);
+            s = soinfo_lookup(si, symbol_name, SymbolLookupScope::kAllowLocal);
             if (s != NULL) {
                 *lsi = si;
                 goto done;
@@ -544,7 +789,7 @@ static ElfW(Sym)* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, s
             if (si->has_DT_SYMBOLIC) {
                 DEBUG("%s: looking up %s in executable %s after local scope",
                       si->name, name, somain->name);
-                s = soinfo_elf_lookup(somain, elf_hash, name, SymbolLookupScope::kExcludeLocal);
+                s = soinfo_lookup(somain, symbol_name, SymbolLookupScope::kExcludeLocal);
                 if (s != NULL) {
                     *lsi = somain;
                     goto done;
@@ -555,7 +800,7 @@ static ElfW(Sym)* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, s
 
     /* Next, look for it in the preloads list */
     for (int i = 0; g_ld_preloads[i] != NULL; i++) {
-        s = soinfo_elf_lookup(g_ld_preloads[i], elf_hash, name, SymbolLookupScope::kExcludeLocal);
+        s = soinfo_lookup(g_ld_preloads[i], symbol_name, SymbolLookupScope::kExcludeLocal);
         if (s != NULL) {
             *lsi = g_ld_preloads[i];
             goto done;
@@ -565,7 +810,7 @@ static ElfW(Sym)* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, s
     for (int i = 0; needed[i] != NULL; i++) {
         DEBUG("%s: looking up %s in %s",
               si->name, name, needed[i]->name);
-        s = soinfo_elf_lookup(needed[i], elf_hash, name, SymbolLookupScope::kExcludeLocal);
+        s = soinfo_lookup(needed[i], symbol_name, SymbolLookupScope::kExcludeLocal);
         if (s != NULL) {
             *lsi = needed[i];
             goto done;
@@ -595,7 +840,8 @@ done:
    Object Dependencies" in breadth first search order.
  */
 ElfW(Sym)* dlsym_handle_lookup(soinfo* si, const char* name, soinfo* caller) {
-    return soinfo_elf_lookup(si, elfhash(name), name,
+    SymbolName symbol_name(name);
+    return soinfo_lookup(si, symbol_name,
         caller == si ? SymbolLookupScope::kAllowLocal : SymbolLookupScope::kExcludeLocal);
 }
 
@@ -605,7 +851,7 @@ ElfW(Sym)* dlsym_handle_lookup(soinfo* si, const char* name, soinfo* caller) {
    specified soinfo (for RTLD_NEXT).
  */
 ElfW(Sym)* dlsym_linear_lookup(const char* name, soinfo** found, soinfo* start, soinfo* caller) {
-  unsigned elf_hash = elfhash(name);
+  SymbolName symbol_name(name);
 
   if (start == NULL) {
     start = solist;
@@ -613,7 +859,7 @@ ElfW(Sym)* dlsym_linear_lookup(const char* name, soinfo** found, soinfo* start,
 
   ElfW(Sym)* s = NULL;
   for (soinfo* si = start; (s == NULL) && (si != NULL); si = si->next) {
-    s = soinfo_elf_lookup(si, elf_hash, name,
+    s = soinfo_lookup(si, symbol_name,
         caller == si ? SymbolLookupScope::kAllowLocal : SymbolLookupScope::kExcludeLocal);
     if (s != NULL) {
       *found = si;
@@ -631,6 +877,26 @@ ElfW(Sym)* dlsym_linear_lookup(const char* name, soinfo** found, soinfo* start,
 
 soinfo* find_containing_library(const void* p) {
   ElfW(Addr) address = reinterpret_cast<ElfW(Addr)>(p);
+
+  if (soinfo_address_index_update()) {
+    // Find the last library starting at or below 'address'.
+    size_t lo = 0;
+    size_t hi = g_soinfo_address_index_count;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (g_soinfo_address_index[mid]->base <= address) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    if (lo == 0) {
+      return NULL;
+    }
+    soinfo* si = g_soinfo_address_index[lo - 1];
+    return (address - si->base < si->size) ? si : NULL;
+  }
+
   for (soinfo* si = solist; si != NULL; si = si->next) {
     if (address >= si->base && address - si->base < si->size) {
       return si;
@@ -639,16 +905,42 @@ soinfo* find_containing_library(const void* p) {
   return NULL;
 }
 
+static bool symbol_matches_soaddr(const ElfW(Sym)* sym, ElfW(Addr) soaddr) {
+  return sym->st_shndx != SHN_UNDEF &&
+      soaddr >= sym->st_value &&
+      soaddr < sym->st_value + sym->st_size;
+}
+
 ElfW(Sym)* dladdr_find_symbol(soinfo* si, const void* addr) {
   ElfW(Addr) soaddr = reinterpret_cast<ElfW(Addr)>(addr) - si->base;
 
   // Search the library's symbol table for any defined symbol which
-  // contains this address.
+  // contains this address. DT_HASH gives the number of symbols, so that's
+  // used whenever the library has one.
+  if (si->nbucket == 0 && (si->flags & FLAG_GNU_HASH) != 0) {
+    // Libraries with only DT_GNU_HASH do not record the number of symbols,
+    // so walk every hash chain instead. Symbols below symoffset are never
+    // exported and can't be hit by dladdr(3) anyway.
+    for (size_t i = 0; i < si->gnu_nbucket; ++i) {
+      uint32_t n = si->gnu_bucket[i];
+      if (n == 0) {
+        continue;
+      }
+
+      do {
+        ElfW(Sym)* sym = &si->symtab[n];
+        if (symbol_matches_soaddr(sym, soaddr)) {
+          return sym;
+        }
+      } while ((si->gnu_chain[n++] & 1) == 0);
+    }
+
+    return NULL;
+  }
+
   for (size_t i = 0; i < si->nchain; ++i) {
     ElfW(Sym)* sym = &si->symtab[i];
-    if (sym->st_shndx != SHN_UNDEF &&
-        soaddr >= sym->st_value &&
-        soaddr < sym->st_value + sym->st_size) {
+    if (symbol_matches_soaddr(sym, soaddr)) {
       return sym;
     }
   }
@@ -765,13 +1057,7 @@ static soinfo* load_library(const char* name, int dlflags, const android_dlextin
 }
 
 static soinfo *find_loaded_library_by_name(const char* name) {
-  const char* search_name = SEARCH_NAME(name);
-  for (soinfo* si = solist; si != NULL; si = si->next) {
-    if (!strcmp(search_name, si->name)) {
-      return si;
-    }
-  }
-  return NULL;
+  return soinfo_name_index_find(SEARCH_NAME(name));
 }
 
 static soinfo* find_library_internal(const char* name, int dlflags, const android_dlextinfo* extinfo) {
@@ -874,10 +1160,25 @@ void do_dlclose(soinfo* si) {
   protect_data(PROT_READ);
 }
 
-#if defined(USE_RELA)
-static int soinfo_relocate(soinfo* si, ElfW(Rela)* rela, unsigned count, soinfo* needed[]) {
+// The most recent symbol lookup made while relocating a library. The static
+// linker groups relocations against the same symbol together (e.g. GLOB_DAT
+// and ABS64 for one function), so remembering it avoids walking the whole
+// search scope again for each of them. It's kept for the whole library
+// rather than per call, so that a group that continues from one relocation
+// table into the next is still looked up only once.
+struct last_symbol_lookup_t {
+  last_symbol_lookup_t() : sym(0), s(NULL), lsi(NULL) {}
+
+  unsigned sym;
   ElfW(Sym)* s;
   soinfo* lsi;
+};
+
+#if defined(USE_RELA)
+static int soinfo_relocate(soinfo* si, ElfW(Rela)* rela, unsigned count, soinfo* needed[],
+                           RelocationCache* reloc_cache, last_symbol_lookup_t* last_lookup) {
+  ElfW(Sym)* s;
+  soinfo* lsi = NULL;
 
   for (size_t idx = 0; idx < count; ++idx, ++rela) {
     unsigned type = ELFW(R_TYPE)(rela->r_info);
@@ -892,7 +1193,22 @@ static int soinfo_relocate(soinfo* si, ElfW(Rela)* rela, unsigned count, soinfo*
     }
     if (sym != 0) {
       sym_name = reinterpret_cast<const char*>(si->strtab + si->symtab[sym].st_name);
-      s = soinfo_do_lookup(si, sym_name, &lsi, needed);
+      if (sym == last_lookup->sym) {
+        s = last_lookup->s;
+        lsi = last_lookup->lsi;
+        count_symbol_lookup(kLookupCached);
+      } else {
+        if (reloc_cache->Next(sym_name, &s, &lsi)) {
+          count_symbol_lookup(kLookupCached);
+        } else {
+          s = soinfo_do_lookup(si, sym_name, &lsi, needed);
+          reloc_cache->Record(s, lsi);
+          count_symbol_lookup(kLookupFull);
+        }
+        last_lookup->sym = sym;
+        last_lookup->s = s;
+        last_lookup->lsi = lsi;
+      }
       if (s == NULL) {
         // We only allow an undefined symbol if this is a weak reference...
         s = &si->symtab[sym];
@@ -1139,9 +1455,10 @@ static int soinfo_relocate(soinfo* si, ElfW(Rela)* rela, unsigned count, soinfo*
 
 #else // REL, not RELA.
 
-static int soinfo_relocate(soinfo* si, ElfW(Rel)* rel, unsigned count, soinfo* needed[]) {
+static int soinfo_relocate(soinfo* si, ElfW(Rel)* rel, unsigned count, soinfo* needed[],
+                           RelocationCache* reloc_cache, last_symbol_lookup_t* last_lookup) {
     ElfW(Sym)* s;
-    soinfo* lsi;
+    soinfo* lsi = NULL;
 
     for (size_t idx = 0; idx < count; ++idx, ++rel) {
         unsigned type = ELFW(R_TYPE)(rel->r_info);
@@ -1157,7 +1474,22 @@ static int soinfo_relocate(soinfo* si, ElfW(Rel)* rel, unsigned count, soinfo* n
         }
         if (sym != 0) {
             sym_name = reinterpret_cast<const char*>(si->strtab + si->symtab[sym].st_name);
-            s = soinfo_do_lookup(si, sym_name, &lsi, needed);
+            if (sym == last_lookup->sym) {
+                s = last_lookup->s;
+                lsi = last_lookup->lsi;
+                count_symbol_lookup(kLookupCached);
+            } else {
+                if (reloc_cache->Next(sym_name, &s, &lsi)) {
+                    count_symbol_lookup(kLookupCached);
+                } else {
+                    s = soinfo_do_lookup(si, sym_name, &lsi, needed);
+                    reloc_cache->Record(s, lsi);
+                    count_symbol_lookup(kLookupFull);
+                }
+                last_lookup->sym = sym;
+                last_lookup->s = s;
+                last_lookup->lsi = lsi;
+            }
             if (s == NULL) {
                 // We only allow an undefined symbol if this is a weak reference...
                 s = &si->symtab[sym];
@@ -1524,6 +1856,14 @@ void soinfo::set_st_ino(ino_t ino) {
   st_ino = ino;
 }
 
+void soinfo::set_st_mtime(time_t t) {
+  if ((this->flags & FLAG_NEW_SOINFO) == 0) {
+    return;
+  }
+
+  mtime = t;
+}
+
 dev_t soinfo::get_st_dev() {
   if ((this->flags & FLAG_NEW_SOINFO) == 0) {
     return 0;
@@ -1540,6 +1880,14 @@ ino_t soinfo::get_st_ino() {
   return st_ino;
 }
 
+time_t soinfo::get_st_mtime() {
+  if ((this->flags & FLAG_NEW_SOINFO) == 0) {
+    return 0;
+  }
+
+  return mtime;
+}
+
 // This is a return on get_children() in case
 // 'this->flags' does not have FLAG_NEW_SOINFO set.
 static soinfo::soinfo_list_t g_empty_list;
@@ -1613,6 +1961,20 @@ static int nullify_closed_stdio() {
     return return_value;
 }
 
+// Records the identity of the file at "path" for an soinfo that wasn't loaded
+// from a file of its own, so that relocation caches can tell it apart.
+static void set_file_identity_lazily(soinfo* si, const char* path) {
+  if (si->get_st_ino() != 0) {
+    return;
+  }
+  struct stat file_stat;
+  if (TEMP_FAILURE_RETRY(stat(path, &file_stat)) == 0) {
+    si->set_st_dev(file_stat.st_dev);
+    si->set_st_ino(file_stat.st_ino);
+    si->set_st_mtime(file_stat.st_mtime);
+  }
+}
+
 static bool soinfo_link_image(soinfo* si, const android_dlextinfo* extinfo) {
     /* "base" might wrap around UINT32_MAX. */
     ElfW(Addr) base = si->load_bias;
@@ -1659,6 +2021,29 @@ static bool soinfo_link_image(soinfo* si, const android_dlextinfo* extinfo) {
             si->bucket = reinterpret_cast<uint32_t*>(base + d->d_un.d_ptr + 8);
             si->chain = reinterpret_cast<uint32_t*>(base + d->d_un.d_ptr + 8 + si->nbucket * 4);
             break;
+        case DT_GNU_HASH:
+            si->gnu_nbucket = reinterpret_cast<uint32_t*>(base + d->d_un.d_ptr)[0];
+            // skip symndx
+            si->gnu_maskwords = reinterpret_cast<uint32_t*>(base + d->d_un.d_ptr)[2];
+            si->gnu_shift2 = reinterpret_cast<uint32_t*>(base + d->d_un.d_ptr)[3];
+
+            si->gnu_bloom_filter = reinterpret_cast<ElfW(Addr)*>(base + d->d_un.d_ptr + 16);
+            si->gnu_bucket = reinterpret_cast<uint32_t*>(si->gnu_bloom_filter + si->gnu_maskwords);
+            // amend chain for symndx = header[1]
+            si->gnu_chain = si->gnu_bucket + si->gnu_nbucket -
+                reinterpret_cast<uint32_t*>(base + d->d_un.d_ptr)[1];
+
+            if (si->gnu_nbucket == 0 || !powerof2(si->gnu_maskwords)) {
+                DL_ERR("invalid DT_GNU_HASH in \"%s\": nbucket=%zd maskwords=%x",
+                       si->name, si->gnu_nbucket, si->gnu_maskwords);
+                return false;
+            }
+            --si->gnu_maskwords;
+
+            si->flags |= FLAG_GNU_HASH;
+            DEBUG("%s uses DT_GNU_HASH: nbucket=%zd maskwords=%x shift2=%x",
+                  si->name, si->gnu_nbucket, si->gnu_maskwords, si->gnu_shift2);
+            break;
         case DT_STRTAB:
             si->strtab = reinterpret_cast<const char*>(base + d->d_un.d_ptr);
             break;
@@ -1832,8 +2217,8 @@ static bool soinfo_link_image(soinfo* si, const android_dlextinfo* extinfo) {
         DL_ERR("linker cannot have DT_NEEDED dependencies on other libraries");
         return false;
     }
-    if (si->nbucket == 0) {
-        DL_ERR("empty/missing DT_HASH in \"%s\" (built with --hash-style=gnu?)", si->name);
+    if (si->nbucket == 0 && (si->flags & FLAG_GNU_HASH) == 0) {
+        DL_ERR("empty/missing DT_HASH/DT_GNU_HASH in \"%s\" (new hash type from the future?)", si->name);
         return false;
     }
     if (si->strtab == 0) {
@@ -1896,40 +2281,107 @@ static bool soinfo_link_image(soinfo* si, const android_dlextinfo* extinfo) {
     }
 #endif
 
+    RelocationCache reloc_cache;
+    if (extinfo != NULL &&
+        (extinfo->flags & (ANDROID_DLEXT_WRITE_RELOC_CACHE | ANDROID_DLEXT_USE_RELOC_CACHE)) != 0) {
+        // Identify the executable by file like any other library, so that the
+        // cache can tell whether it might interpose different symbols. libdl's
+        // symbols are built into the linker, so it's identified by the linker's
+        // file. This is only done the first time a relocation cache is used.
+        set_file_identity_lazily(somain, "/proc/self/exe");
+#if defined(__LP64__)
+        set_file_identity_lazily(get_libdl_info(), "/system/bin/linker64");
+#else
+        set_file_identity_lazily(get_libdl_info(), "/system/bin/linker");
+#endif
+
+        // The lookup scope, in the order soinfo_do_lookup() searches it.
+        soinfo** scope = reinterpret_cast<soinfo**>(alloca((2 + LDPRELOAD_MAX + needed_count) * sizeof(soinfo*)));
+        size_t scope_count = 0;
+        scope[scope_count++] = si;
+        scope[scope_count++] = somain;
+        for (size_t i = 0; g_ld_preloads[i] != NULL; i++) {
+            scope[scope_count++] = g_ld_preloads[i];
+        }
+        for (size_t i = 0; needed[i] != NULL; i++) {
+            scope[scope_count++] = needed[i];
+        }
+
+        if ((extinfo->flags & ANDROID_DLEXT_WRITE_RELOC_CACHE) != 0) {
+#if defined(USE_RELA)
+            size_t reloc_count = si->plt_rela_count + si->rela_count;
+#else
+            size_t reloc_count = si->plt_rel_count + si->rel_count;
+#endif
+            if (!reloc_cache.BeginWrite(scope, scope_count, reloc_count)) {
+                DL_ERR("can't allocate relocation cache for \"%s\": %s", si->name, strerror(errno));
+                return false;
+            }
+        } else if (!reloc_cache.Load(extinfo->reloc_cache_fd, scope, scope_count)) {
+            // A missing or stale cache just means we do the lookups ourselves.
+            DEBUG("%s: not using relocation cache", si->name);
+        }
+    }
+
+#if TIMING
+    // gettimeofday(2) can't be called before the linker has relocated itself.
+    struct timeval relocation_start;
+    if (!relocating_linker) {
+        gettimeofday(&relocation_start, NULL);
+    }
+#endif
+
+    last_symbol_lookup_t last_lookup;
 #if defined(USE_RELA)
     if (si->plt_rela != NULL) {
         DEBUG("[ relocating %s plt ]\n", si->name);
-        if (soinfo_relocate(si, si->plt_rela, si->plt_rela_count, needed)) {
+        if (soinfo_relocate(si, si->plt_rela, si->plt_rela_count, needed, &reloc_cache, &last_lookup)) {
             return false;
         }
     }
     if (si->rela != NULL) {
         DEBUG("[ relocating %s ]\n", si->name);
-        if (soinfo_relocate(si, si->rela, si->rela_count, needed)) {
+        if (soinfo_relocate(si, si->rela, si->rela_count, needed, &reloc_cache, &last_lookup)) {
             return false;
         }
     }
 #else
     if (si->plt_rel != NULL) {
         DEBUG("[ relocating %s plt ]", si->name);
-        if (soinfo_relocate(si, si->plt_rel, si->plt_rel_count, needed)) {
+        if (soinfo_relocate(si, si->plt_rel, si->plt_rel_count, needed, &reloc_cache, &last_lookup)) {
             return false;
         }
     }
     if (si->rel != NULL) {
         DEBUG("[ relocating %s ]", si->name);
-        if (soinfo_relocate(si, si->rel, si->rel_count, needed)) {
+        if (soinfo_relocate(si, si->rel, si->rel_count, needed, &reloc_cache, &last_lookup)) {
             return false;
         }
     }
 #endif
 
+    if (extinfo != NULL && (extinfo->flags & ANDROID_DLEXT_RELOC_CACHE_REQUIRED) != 0 &&
+        (!reloc_cache.is_reading() || reloc_cache.hit_count() != reloc_cache.entry_count())) {
+        DL_ERR("relocation cache for \"%s\" was not used", si->name);
+        return false;
+    }
+
 #if defined(__mips__)
     if (!mips_relocate_got(si, needed)) {
         return false;
     }
 #endif
 
+#if TIMING
+    if (!relocating_linker) {
+        struct timeval relocation_end;
+        gettimeofday(&relocation_end, NULL);
+        PRINT("RELO TIME: %s: %d microseconds", si->name, (int) (
+                   (((long long)relocation_end.tv_sec * 1000000LL) + (long long)relocation_end.tv_usec) -
+                   (((long long)relocation_start.tv_sec * 1000000LL) + (long long)relocation_start.tv_usec)));
+    }
+#endif
+
     si->flags |= FLAG_LINKED;
     DEBUG("[ finished linking %s ]", si->name);
 
@@ -1951,6 +2403,14 @@ static bool soinfo_link_image(soinfo* si, const android_dlextinfo* extinfo) {
         return false;
     }
 
+    if (extinfo && (extinfo->flags & ANDROID_DLEXT_WRITE_RELOC_CACHE)) {
+      if (!reloc_cache.Write(extinfo->reloc_cache_fd)) {
+        DL_ERR("failed writing relocation cache for \"%s\": %s",
+               si->name, strerror(errno));
+        return false;
+      }
+    }
+
     /* Handle serializing/sharing the RELRO segment */
     if (extinfo && (extinfo->flags & ANDROID_DLEXT_WRITE_RELRO)) {
       if (phdr_table_serialize_gnu_relro(si->phdr, si->phnum, si->load_bias,
@@ -2171,6 +2631,9 @@ static ElfW(Addr) __linker_init_post_relocation(KernelArgumentBlock& args, ElfW(
            linker_stats.count[kRelocRelative],
            linker_stats.count[kRelocCopy],
            linker_stats.count[kRelocSymbol]);
+    PRINT("LOOKUP STATS: %s: %d full, %d cached", args.argv[0],
+           linker_stats.lookup_count[kLookupFull],
+           linker_stats.lookup_count[kLookupCached]);
 #endif
 #if COUNT_PAGES
     {
@@ -2240,6 +2703,7 @@ extern "C" ElfW(Addr) __linker_init(void* raw_args) {
   // Initialize static variables.
   solist = get_libdl_info();
   sonext = get_libdl_info();
+  soinfo_name_index_add(get_libdl_info());
 
   KernelArgumentBlock args(raw_args);
 
@@ -86,6 +86,7 @@
 #define FLAG_LINKED     0x00000001
 #define FLAG_EXE        0x00000004 // The main executable
 #define FLAG_LINKER     0x00000010 // The linker itself
+#define FLAG_GNU_HASH   0x00000040 // Uses DT_GNU_HASH for symbol lookup
 #define FLAG_NEW_SOINFO 0x40000000 // new soinfo format
 
 #define SOINFO_NAME_LEN 128
@@ -204,8 +205,10 @@ struct soinfo {
 
   void set_st_dev(dev_t st_dev);
   void set_st_ino(ino_t st_ino);
+  void set_st_mtime(time_t mtime);
   ino_t get_st_ino();
   dev_t get_st_dev();
+  time_t get_st_mtime();
 
   soinfo_list_t& get_children();
 
@@ -220,11 +223,26 @@ struct soinfo {
 
   dev_t st_dev;
   ino_t st_ino;
+  time_t mtime;
 
   // dependency graph
   soinfo_list_t children;
   soinfo_list_t parents;
 
+ public:
+  // DT_GNU_HASH table, only valid when FLAG_GNU_HASH is set in this->flags.
+  // gnu_maskwords is stored as (number of bloom filter words - 1) so that it
+  // can be used directly as a mask, and gnu_chain is pre-biased by symoffset
+  // so that it can be indexed by symbol index.
+  size_t gnu_nbucket;
+  uint32_t* gnu_bucket;
+  uint32_t* gnu_chain;
+  uint32_t gnu_maskwords;
+  uint32_t gnu_shift2;
+  ElfW(Addr)* gnu_bloom_filter;
+
+  // Next soinfo in the same bucket of the loaded library name index.
+  soinfo* name_index_next;
 };
 
 extern soinfo* get_libdl_info();
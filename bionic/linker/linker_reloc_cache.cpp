@@ -0,0 +1,333 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "linker_reloc_cache.h"
+
+#include <alloca.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "linker_debug.h"
+
+static const uint32_t kRelocCacheMagic = 0x43524c41; // "ALRC"
+static const uint32_t kRelocCacheVersion = 1;
+
+// Marks a relocation whose symbol was not found anywhere in the scope.
+static const uint32_t kUndefinedProvider = 0xffffffff;
+
+struct RelocationCache::Header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t addr_size;
+  uint32_t scope_count;
+  uint32_t entry_count;
+};
+
+struct RelocationCache::ScopeKey {
+  uint64_t st_dev;
+  uint64_t st_ino;
+  int64_t st_mtime;
+};
+
+struct RelocationCache::Entry {
+  uint32_t provider;  // Index into the lookup scope, or kUndefinedProvider.
+  uint32_t sym_index; // Index into the provider's symbol table.
+};
+
+RelocationCache::RelocationCache()
+    : reading_(false), writing_(false), mapping_(NULL), mapping_size_(0),
+      scope_(NULL), scope_count_(0), entries_(NULL), entry_count_(0),
+      max_entries_(0), cursor_(0), hit_count_(0) {
+}
+
+RelocationCache::~RelocationCache() {
+  Reset();
+}
+
+void RelocationCache::Reset() {
+  if (mapping_ != NULL) {
+    munmap(mapping_, mapping_size_);
+  }
+  mapping_ = NULL;
+  mapping_size_ = 0;
+  entries_ = NULL;
+  entry_count_ = 0;
+  hit_count_ = 0;
+  reading_ = false;
+  writing_ = false;
+}
+
+void RelocationCache::GetScopeKey(soinfo* si, ScopeKey* key) {
+  // Anything we can't identify by file (the main executable before it has
+  // been stat'ed, the vdso) gets an all-zero key, which never matches a
+  // real file.
+  memset(key, 0, sizeof(*key));
+  if (si != NULL) {
+    key->st_dev = si->get_st_dev();
+    key->st_ino = si->get_st_ino();
+    key->st_mtime = si->get_st_mtime();
+  }
+}
+
+size_t RelocationCache::GetSymbolCount(soinfo* si) {
+  if ((si->flags & FLAG_GNU_HASH) == 0) {
+    return si->nchain;
+  }
+  // DT_GNU_HASH doesn't record the number of symbols. The last one is at the
+  // end of the chain that starts at the highest bucket. If no symbol is
+  // hashed at all we can't tell, so nothing in this library can be used.
+  uint32_t last = 0;
+  for (size_t i = 0; i < si->gnu_nbucket; ++i) {
+    if (si->gnu_bucket[i] > last) {
+      last = si->gnu_bucket[i];
+    }
+  }
+  if (last == 0) {
+    return 0;
+  }
+  while ((si->gnu_chain[last] & 1) == 0) {
+    ++last;
+  }
+  return last + 1;
+}
+
+bool RelocationCache::BeginWrite(soinfo* const scope[], size_t scope_count, size_t max_entries) {
+  Reset();
+
+  mapping_size_ = PAGE_END(max_entries * sizeof(Entry));
+  if (mapping_size_ != 0) {
+    mapping_ = mmap(NULL, mapping_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping_ == MAP_FAILED) {
+      mapping_ = NULL;
+      mapping_size_ = 0;
+      return false;
+    }
+  }
+
+  scope_ = scope;
+  scope_count_ = scope_count;
+  entries_ = reinterpret_cast<Entry*>(mapping_);
+  max_entries_ = max_entries;
+  entry_count_ = 0;
+  cursor_ = 0;
+  writing_ = true;
+  return true;
+}
+
+bool RelocationCache::Load(int fd, soinfo* const scope[], size_t scope_count) {
+  Reset();
+
+  struct stat file_stat;
+  if (TEMP_FAILURE_RETRY(fstat(fd, &file_stat)) != 0) {
+    return false;
+  }
+  size_t file_size = file_stat.st_size;
+  if (static_cast<off_t>(file_size) != file_stat.st_size || file_size < sizeof(Header)) {
+    return false;
+  }
+
+  // Copy the file in rather than mapping it, so that a file truncated
+  // while we use it can't fault in the middle of relocation.
+  void* map = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  mapping_ = map;
+  mapping_size_ = file_size;
+  size_t read_size = 0;
+  while (read_size < file_size) {
+    ssize_t n = TEMP_FAILURE_RETRY(pread64(fd, reinterpret_cast<char*>(mapping_) + read_size,
+                                           file_size - read_size, read_size));
+    if (n <= 0) {
+      DEBUG("relocation cache read %zd of %zd bytes", read_size, file_size);
+      Reset();
+      return false;
+    }
+    read_size += n;
+  }
+  mprotect(mapping_, mapping_size_, PROT_READ);
+
+  const Header* header = reinterpret_cast<const Header*>(mapping_);
+  if (header->magic != kRelocCacheMagic ||
+      header->version != kRelocCacheVersion ||
+      header->addr_size != sizeof(ElfW(Addr)) ||
+      header->scope_count != scope_count) {
+    DEBUG("relocation cache header mismatch");
+    Reset();
+    return false;
+  }
+
+  // Check the size without overflowing, even for a corrupt entry_count.
+  size_t payload_size = file_size - sizeof(Header);
+  if (scope_count > payload_size / sizeof(ScopeKey)) {
+    DEBUG("relocation cache too small for %zd scope entries", scope_count);
+    Reset();
+    return false;
+  }
+  payload_size -= scope_count * sizeof(ScopeKey);
+  if (payload_size % sizeof(Entry) != 0 || header->entry_count != payload_size / sizeof(Entry)) {
+    DEBUG("relocation cache size mismatch: %zd bytes for %u entries", file_size,
+          header->entry_count);
+    Reset();
+    return false;
+  }
+
+  const ScopeKey* keys = reinterpret_cast<const ScopeKey*>(header + 1);
+  size_t* symbol_counts = reinterpret_cast<size_t*>(alloca(scope_count * sizeof(size_t)));
+  for (size_t i = 0; i < scope_count; ++i) {
+    ScopeKey key;
+    GetScopeKey(scope[i], &key);
+    if (key.st_dev == 0 || key.st_ino == 0 || memcmp(&key, &keys[i], sizeof(key)) != 0) {
+      DEBUG("relocation cache is stale for scope entry %zd", i);
+      Reset();
+      return false;
+    }
+    symbol_counts[i] = GetSymbolCount(scope[i]);
+  }
+
+  // Next() indexes the providers' symbol tables with these, so a corrupt
+  // cache must not get that far.
+  const Entry* entries = reinterpret_cast<const Entry*>(keys + scope_count);
+  for (size_t i = 0; i < header->entry_count; ++i) {
+    const Entry& entry = entries[i];
+    if (entry.provider != kUndefinedProvider &&
+        (entry.provider >= scope_count || entry.sym_index >= symbol_counts[entry.provider])) {
+      DEBUG("relocation cache entry %zd is out of range", i);
+      Reset();
+      return false;
+    }
+  }
+
+  scope_ = scope;
+  scope_count_ = scope_count;
+  entries_ = const_cast<Entry*>(reinterpret_cast<const Entry*>(keys + scope_count));
+  entry_count_ = header->entry_count;
+  max_entries_ = entry_count_;
+  cursor_ = 0;
+  reading_ = true;
+  return true;
+}
+
+bool RelocationCache::Next(const char* sym_name, ElfW(Sym)** s, soinfo** lsi) {
+  if (!reading_) {
+    return false;
+  }
+
+  if (cursor_ < entry_count_) {
+    // Load() checked that every entry is in range.
+    const Entry& entry = entries_[cursor_++];
+    if (entry.provider == kUndefinedProvider) {
+      *s = NULL;
+      *lsi = NULL;
+      ++hit_count_;
+      return true;
+    }
+    soinfo* provider = scope_[entry.provider];
+    ElfW(Sym)* sym = &provider->symtab[entry.sym_index];
+    // The scope keys already matched, so this is only a cheap guard
+    // against a cache that was written for a different relocation order.
+    if (strcmp(provider->strtab + sym->st_name, sym_name) == 0) {
+      *s = sym;
+      *lsi = provider;
+      ++hit_count_;
+      return true;
+    }
+  }
+
+  DEBUG("relocation cache out of sync at entry %zd (%s); disabling it", cursor_, sym_name);
+  Reset();
+  return false;
+}
+
+void RelocationCache::Record(ElfW(Sym)* s, soinfo* lsi) {
+  if (!writing_) {
+    return;
+  }
+  if (entry_count_ >= max_entries_) {
+    // A cache missing the later lookups would still look complete, so
+    // don't write one at all.
+    DEBUG("relocation cache: more than %zd lookups; not writing cache", max_entries_);
+    writing_ = false;
+    return;
+  }
+
+  Entry& entry = entries_[entry_count_++];
+  entry.provider = kUndefinedProvider;
+  entry.sym_index = 0;
+  if (s == NULL) {
+    return;
+  }
+
+  for (size_t i = 0; i < scope_count_; ++i) {
+    if (scope_[i] == lsi) {
+      entry.provider = i;
+      entry.sym_index = s - lsi->symtab;
+      return;
+    }
+  }
+
+  // soinfo_do_lookup() only ever returns symbols from the scope we were
+  // given, so this means the scope is incomplete. Don't write a cache that
+  // would silently resolve this symbol differently.
+  DEBUG("relocation cache: provider %s not in scope; not writing cache", lsi->name);
+  writing_ = false;
+}
+
+bool RelocationCache::Write(int fd) {
+  if (!writing_) {
+    errno = EINVAL;
+    return false;
+  }
+
+  Header header;
+  header.magic = kRelocCacheMagic;
+  header.version = kRelocCacheVersion;
+  header.addr_size = sizeof(ElfW(Addr));
+  header.scope_count = scope_count_;
+  header.entry_count = entry_count_;
+  if (TEMP_FAILURE_RETRY(write(fd, &header, sizeof(header))) != static_cast<ssize_t>(sizeof(header))) {
+    return false;
+  }
+
+  for (size_t i = 0; i < scope_count_; ++i) {
+    ScopeKey key;
+    GetScopeKey(scope_[i], &key);
+    if (TEMP_FAILURE_RETRY(write(fd, &key, sizeof(key))) != static_cast<ssize_t>(sizeof(key))) {
+      return false;
+    }
+  }
+
+  ssize_t size = entry_count_ * sizeof(Entry);
+  if (size != 0 && TEMP_FAILURE_RETRY(write(fd, entries_, size)) != size) {
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LINKER_RELOC_CACHE_H
+#define LINKER_RELOC_CACHE_H
+
+/* Persistent cache of symbol resolutions for a library's relocations.
+ *
+ * The cache records, for every symbol relocation of a library in the order
+ * soinfo_relocate() processes them, which library in the lookup scope
+ * provided the definition and the index of that definition in the
+ * provider's symbol table. The lookup scope (the library itself, the main
+ * executable, LD_PRELOAD libraries and DT_NEEDED libraries, in search order)
+ * is recorded by (st_dev, st_ino, st_mtime), so a cache is only used when
+ * exactly the same files are being linked together again.
+ *
+ * A cache file is written with ANDROID_DLEXT_WRITE_RELOC_CACHE and used with
+ * ANDROID_DLEXT_USE_RELOC_CACHE; either way it is accessed through
+ * android_dlextinfo::reloc_cache_fd.
+ */
+
+#include "linker.h"
+
+class RelocationCache {
+ public:
+  RelocationCache();
+  ~RelocationCache();
+
+  // Prepares to record resolutions for at most 'max_entries' relocations
+  // against the given lookup scope. Returns false on failure.
+  bool BeginWrite(soinfo* const scope[], size_t scope_count, size_t max_entries);
+
+  // Maps the cache in 'fd' and checks that it was written for the given
+  // lookup scope. Returns false if the cache can't be used; the caller
+  // should then fall back to normal symbol lookup.
+  bool Load(int fd, soinfo* const scope[], size_t scope_count);
+
+  // Returns the next cached resolution. On success, '*s' is NULL if the
+  // symbol was not found when the cache was written (a weak reference).
+  // Returns false once the cache is exhausted or turns out to be stale,
+  // after which the cache is no longer used.
+  bool Next(const char* sym_name, ElfW(Sym)** s, soinfo** lsi);
+
+  // Records the resolution of the next symbol relocation.
+  void Record(ElfW(Sym)* s, soinfo* lsi);
+
+  // Writes the recorded resolutions to 'fd'. Returns false on failure
+  // (error code in errno).
+  bool Write(int fd);
+
+  bool is_reading() const { return reading_; }
+  bool is_writing() const { return writing_; }
+
+  // The number of resolutions Next() has returned from the cache, and the
+  // number the cache holds.
+  size_t hit_count() const { return hit_count_; }
+  size_t entry_count() const { return entry_count_; }
+
+ private:
+  struct Header;
+  struct ScopeKey;
+  struct Entry;
+
+  static void GetScopeKey(soinfo* si, ScopeKey* key);
+  static size_t GetSymbolCount(soinfo* si);
+  void Reset();
+
+  bool reading_;
+  bool writing_;
+
+  void* mapping_;
+  size_t mapping_size_;
+
+  soinfo* const* scope_;
+  size_t scope_count_;
+
+  Entry* entries_;
+  size_t entry_count_;
+  size_t max_entries_;
+  size_t cursor_;
+  size_t hit_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(RelocationCache);
+};
+
+#endif /* LINKER_RELOC_CACHE_H */
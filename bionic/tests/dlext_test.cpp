@@ -43,6 +43,7 @@
 typedef int (*fn)(void);
 #define LIBNAME "libdlext_test.so"
 #define LIBNAME_NORELRO "libdlext_test_norelro.so"
+#define LIBNAME_LIBDL "libdlext_test_libdl.so"
 #define LIBSIZE 1024*1024 // how much address space to reserve for it
 
 #if defined(__LP64__)
@@ -375,3 +376,106 @@ void DlExtRelroSharingTest::SpawnChildrenAndMeasurePss(const char* lib, bool sha
     ASSERT_EQ(0, WEXITSTATUS(status));
   }
 }
+
+class DlExtRelocCacheTest : public DlExtTest {
+protected:
+  virtual void SetUp() {
+    DlExtTest::SetUp();
+    extinfo_.flags = 0;
+    extinfo_.reloc_cache_fd = -1;
+
+    const char* android_data = getenv("ANDROID_DATA");
+    ASSERT_TRUE(android_data != NULL);
+    snprintf(cache_file_, sizeof(cache_file_), "%s/local/tmp/libdlext_test.reloc", android_data);
+  }
+
+  virtual void TearDown() {
+    DlExtTest::TearDown();
+    if (extinfo_.reloc_cache_fd != -1) {
+      ASSERT_NOERROR(close(extinfo_.reloc_cache_fd));
+    }
+  }
+
+  void CreateCacheFile(const char* lib) {
+    int cache_fd = open(cache_file_, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    ASSERT_NOERROR(cache_fd);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+      // child process
+      extinfo_.flags |= ANDROID_DLEXT_WRITE_RELOC_CACHE;
+      extinfo_.reloc_cache_fd = cache_fd;
+      void* handle = android_dlopen_ext(lib, RTLD_NOW, &extinfo_);
+      if (handle == NULL) {
+        fprintf(stderr, "in child: %s\n", dlerror());
+        exit(1);
+      }
+      exit(0);
+    }
+
+    // continuing in parent
+    ASSERT_NOERROR(close(cache_fd));
+    ASSERT_NOERROR(pid);
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(0, WEXITSTATUS(status));
+
+    // reopen file for reading so it can be used
+    cache_fd = open(cache_file_, O_RDONLY);
+    ASSERT_NOERROR(cache_fd);
+    extinfo_.flags |= ANDROID_DLEXT_USE_RELOC_CACHE;
+    extinfo_.reloc_cache_fd = cache_fd;
+  }
+
+  void TryUsingCache(const char* lib) {
+    handle_ = android_dlopen_ext(lib, RTLD_NOW, &extinfo_);
+    ASSERT_DL_NOTNULL(handle_);
+    fn f = reinterpret_cast<fn>(dlsym(handle_, "getRandomNumber"));
+    ASSERT_DL_NOTNULL(f);
+    EXPECT_EQ(4, f());
+  }
+
+  android_dlextinfo extinfo_;
+  char cache_file_[PATH_MAX];
+};
+
+TEST_F(DlExtRelocCacheTest, ChildWritesGoodData) {
+  ASSERT_NO_FATAL_FAILURE(CreateCacheFile(LIBNAME));
+  // Every symbol relocation must come from the cache.
+  extinfo_.flags |= ANDROID_DLEXT_RELOC_CACHE_REQUIRED;
+  ASSERT_NO_FATAL_FAILURE(TryUsingCache(LIBNAME));
+}
+
+TEST_F(DlExtRelocCacheTest, ChildWritesGoodDataWithLibdl) {
+  // libdl isn't loaded from a file of its own, but must still be usable.
+  ASSERT_NO_FATAL_FAILURE(CreateCacheFile(LIBNAME_LIBDL));
+  extinfo_.flags |= ANDROID_DLEXT_RELOC_CACHE_REQUIRED;
+  ASSERT_NO_FATAL_FAILURE(TryUsingCache(LIBNAME_LIBDL));
+}
+
+TEST_F(DlExtRelocCacheTest, CacheFileEmpty) {
+  int cache_fd = open(cache_file_, O_CREAT | O_RDWR | O_TRUNC, 0644);
+  ASSERT_NOERROR(cache_fd);
+  ASSERT_NOERROR(close(cache_fd));
+
+  // An empty cache is ignored rather than failing the load.
+  cache_fd = open(cache_file_, O_RDONLY);
+  ASSERT_NOERROR(cache_fd);
+  extinfo_.flags |= ANDROID_DLEXT_USE_RELOC_CACHE;
+  extinfo_.reloc_cache_fd = cache_fd;
+  ASSERT_NO_FATAL_FAILURE(TryUsingCache(LIBNAME));
+}
+
+TEST_F(DlExtRelocCacheTest, CacheForDifferentLibraryIgnored) {
+  // A cache written for one library must not be applied to another.
+  ASSERT_NO_FATAL_FAILURE(CreateCacheFile(LIBNAME_NORELRO));
+  ASSERT_NO_FATAL_FAILURE(TryUsingCache(LIBNAME));
+}
+
+TEST_F(DlExtRelocCacheTest, CacheRequiredButNotUsable) {
+  ASSERT_NO_FATAL_FAILURE(CreateCacheFile(LIBNAME_NORELRO));
+  extinfo_.flags |= ANDROID_DLEXT_RELOC_CACHE_REQUIRED;
+  handle_ = android_dlopen_ext(LIBNAME, RTLD_NOW, &extinfo_);
+  ASSERT_TRUE(handle_ == NULL);
+}
@@ -22,7 +22,7 @@ TEST_PATH := $(LOCAL_PATH)/..
 # -----------------------------------------------------------------------------
 ifneq ($(TARGET_ARCH),$(filter $(TARGET_ARCH),mips mips64))
 no-elf-hash-table-library_src_files := \
-    empty.cpp \
+    dlopen_testlib_gnu_hash.cpp \
 
 no-elf-hash-table-library_ldflags := \
     -Wl,--hash-style=gnu \
@@ -90,6 +90,19 @@ build_type := target
 build_target := SHARED_LIBRARY
 include $(TEST_PATH)/Android.build.mk
 
+# -----------------------------------------------------------------------------
+# Library used by dlext tests - with relocations against libdl
+# -----------------------------------------------------------------------------
+libdlext_test_libdl_src_files := \
+    dlext_test_libdl_library.cpp \
+
+libdlext_test_libdl_shared_libraries_target := libdl
+module := libdlext_test_libdl
+module_tag := optional
+build_type := target
+build_target := SHARED_LIBRARY
+include $(TEST_PATH)/Android.build.mk
+
 # -----------------------------------------------------------------------------
 # Library used by dlfcn tests
 # -----------------------------------------------------------------------------
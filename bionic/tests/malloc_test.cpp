@@ -322,3 +322,30 @@ TEST(malloc, valloc_overflow) {
   ASSERT_EQ(NULL, valloc(SIZE_MAX));
 }
 #endif
+
+TEST(malloc, malloc_size_class_stats) {
+#if defined(__BIONIC__)
+  size_t class_count = malloc_size_class_stats(NULL, 0);
+  if (class_count == 0) {
+    GTEST_LOG_(INFO) << "This test does nothing: malloc thread cache not enabled.\n";
+    return;
+  }
+
+  // Free something small so the calling thread's cache has been used.
+  free(malloc(8));
+
+  struct malloc_size_class_stats* stats = new struct malloc_size_class_stats[class_count];
+  ASSERT_EQ(class_count, malloc_size_class_stats(stats, class_count));
+  size_t activity = 0;
+  for (size_t i = 0; i < class_count; ++i) {
+    if (i > 0) {
+      ASSERT_LT(stats[i - 1].size, stats[i].size);
+    }
+    activity += stats[i].hits + stats[i].misses + stats[i].frees;
+  }
+  ASSERT_NE(0U, activity);
+  delete[] stats;
+#else
+  GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
+}
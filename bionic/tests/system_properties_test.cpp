@@ -357,6 +357,76 @@ TEST(properties, serial) {
 #endif // __BIONIC__
 }
 
+TEST(properties, find_cached) {
+#if defined(__BIONIC__)
+    LocalPropertyTestState pa;
+    ASSERT_TRUE(pa.valid);
+
+    char propvalue[PROP_VALUE_MAX];
+
+    ASSERT_EQ(0, __system_property_add("debug.a", 7, "value1", 6));
+    const prop_info *pi = __system_property_find("debug.a");
+    ASSERT_NE((const prop_info *)NULL, pi);
+
+    // A repeated lookup must return the same prop_info and see updates to it.
+    ASSERT_EQ(pi, __system_property_find("debug.a"));
+    ASSERT_EQ(0, __system_property_update((prop_info *)pi, "value2", 6));
+    ASSERT_EQ(6, __system_property_get("debug.a", propvalue));
+    ASSERT_STREQ("value2", propvalue);
+
+    // A miss must not be cached: the property can be added later.
+    ASSERT_EQ((const prop_info *)NULL, __system_property_find("debug.b"));
+    ASSERT_EQ(0, __system_property_add("debug.b", 7, "value3", 6));
+    ASSERT_NE((const prop_info *)NULL, __system_property_find("debug.b"));
+    ASSERT_EQ(pi, __system_property_find("debug.a"));
+#else // __BIONIC__
+    GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif // __BIONIC__
+}
+
+TEST(properties, batch) {
+#if defined(__BIONIC__)
+    LocalPropertyTestState pa;
+    ASSERT_TRUE(pa.valid);
+
+    ASSERT_EQ(0, __system_property_add("debug.one", 9, "1", 1));
+    ASSERT_EQ(0, __system_property_add("debug.two", 9, "22", 2));
+    ASSERT_EQ(0, __system_property_add("debug.three", 11, "333", 3));
+
+    const char* names[] = { "debug.one", "debug.missing", "debug.two", "debug.three" };
+    const prop_info* pis[4];
+    ASSERT_EQ(3, __system_property_find_batch(names, pis, 4));
+    ASSERT_EQ(__system_property_find("debug.one"), pis[0]);
+    ASSERT_EQ((const prop_info *)NULL, pis[1]);
+    ASSERT_EQ(__system_property_find("debug.two"), pis[2]);
+    ASSERT_EQ(__system_property_find("debug.three"), pis[3]);
+
+    char values[4][PROP_VALUE_MAX];
+    unsigned int serials[4];
+    ASSERT_EQ(0, __system_property_read_batch(pis, values, serials, 4));
+    ASSERT_STREQ("1", values[0]);
+    ASSERT_STREQ("", values[1]);
+    ASSERT_STREQ("22", values[2]);
+    ASSERT_STREQ("333", values[3]);
+    ASSERT_EQ(0U, serials[1]);
+
+    ASSERT_EQ(0, __system_property_update((prop_info *)pis[2], "44", 2));
+
+    unsigned int new_serials[4];
+    ASSERT_EQ(0, __system_property_read_batch(pis, values, new_serials, 4));
+    ASSERT_STREQ("44", values[2]);
+    ASSERT_EQ(serials[0], new_serials[0]);
+    ASSERT_NE(serials[2], new_serials[2]);
+    ASSERT_EQ(serials[3], new_serials[3]);
+
+    // Serials are optional.
+    ASSERT_EQ(0, __system_property_read_batch(pis, values, NULL, 4));
+    ASSERT_STREQ("1", values[0]);
+#else // __BIONIC__
+    GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif // __BIONIC__
+}
+
 TEST(properties, wait) {
 #if defined(__BIONIC__)
     LocalPropertyTestState pa;
@@ -385,6 +455,52 @@ TEST(properties, wait) {
 #endif // __BIONIC__
 }
 
+static void *PropertyWaitOneHelperFn(void *arg) {
+    int *flag = (int *)arg;
+    usleep(100000);
+
+    // Updates to other properties must not wake the waiter.
+    __system_property_update((prop_info *)__system_property_find("other"), "noise", 5);
+    usleep(100000);
+
+    *flag = 1;
+    __system_property_update((prop_info *)__system_property_find("property"), "value3", 6);
+
+    return NULL;
+}
+
+TEST(properties, wait_one) {
+#if defined(__BIONIC__)
+    LocalPropertyTestState pa;
+    ASSERT_TRUE(pa.valid);
+    pthread_t t;
+    int flag = 0;
+
+    ASSERT_EQ(0, __system_property_add("property", 8, "value1", 6));
+    ASSERT_EQ(0, __system_property_add("other", 5, "value2", 6));
+    const prop_info *pi = __system_property_find("property");
+    ASSERT_NE((const prop_info *)NULL, pi);
+    unsigned int serial = __system_property_serial(pi);
+
+    timespec timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_nsec = 1000000;
+    unsigned int new_serial = 0;
+    ASSERT_EQ(-1, __system_property_wait(pi, serial, &new_serial, &timeout));
+
+    ASSERT_EQ(0, pthread_create(&t, NULL, PropertyWaitOneHelperFn, &flag));
+    ASSERT_EQ(0, __system_property_wait(pi, serial, &new_serial, NULL));
+    ASSERT_EQ(1, flag);
+    ASSERT_NE(serial, new_serial);
+    ASSERT_EQ(new_serial, __system_property_serial(pi));
+
+    void* result;
+    ASSERT_EQ(0, pthread_join(t, &result));
+#else // __BIONIC__
+    GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif // __BIONIC__
+}
+
 class KilledByFault {
     public:
         explicit KilledByFault() {};
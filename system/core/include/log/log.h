@@ -567,6 +567,21 @@ int __android_log_buf_print(int bufID, int prio, const char *tag, const char *fm
 #endif
     ;
 
+/*
+ * Queue this process's log records in per-thread buffers and send them to
+ * the logger in batches, each record at most about max_latency_ms after it
+ * was written. Pass 0 to send every record as it is written again, which
+ * is the default. Fatal records and records for the crash buffer are never
+ * delayed. Returns 0, or a negative errno if batching is not supported.
+ */
+int __android_log_set_batching(unsigned int max_latency_ms);
+
+/*
+ * Send any records waiting in batch buffers. Safe to call from a crash
+ * handler: buffers that are in use are skipped rather than waited for.
+ */
+void __android_log_flush(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -21,6 +21,7 @@
 #include <log/logger.h>
 #include <log/event_tag_map.h>
 #include <pthread.h>
+#include <sys/types.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -94,6 +95,9 @@ int android_log_addFilterString(AndroidLogFormat *p_format,
 /** 
  * returns 1 if this log line should be printed based on its priority
  * and tag, and 0 if it should not
+ *
+ * Assumes single threaded execution: the filters are indexed in p_format
+ * on first use
  */
 int android_log_shouldPrintLine (
         AndroidLogFormat *p_format, const char *tag, android_LogPriority pri);
@@ -126,6 +130,9 @@ int android_log_processBinaryLogBuffer(struct logger_entry *buf,
  * Uses defaultBuffer if it can, otherwise malloc()'s a new buffer
  * If return value != defaultBuffer, caller must call free()
  * Returns NULL on malloc error
+ *
+ * Assumes single threaded execution: the last time stamp formatted is
+ * cached in p_format
  */
 
 char *android_log_formatLogLine (    
@@ -135,6 +142,24 @@ char *android_log_formatLogLine (
     const AndroidLogEntry *p_line,
     size_t *p_outLength);
 
+/**
+ * Formats a log message directly into the caller's buffer, never
+ * allocating, so that a run of lines can be packed into one buffer
+ * and written out together.
+ *
+ * Returns the length of the formatted message excluding the terminating
+ * null, or -1 if it does not fit in bufferSize bytes
+ *
+ * Produces the same bytes as android_log_formatLogLine. Assumes single
+ * threaded execution, as it does.
+ */
+
+ssize_t android_log_formatLogLineToBuffer(
+    AndroidLogFormat *p_format,
+    char *buffer,
+    size_t bufferSize,
+    const AndroidLogEntry *p_line);
+
 
 /**
  * Either print or do not print log line, based on filter
@@ -19,9 +19,9 @@
 
 #include <stddef.h>
 
+#include <utils/BasicHashtable.h>
 #include <utils/Flattenable.h>
 #include <utils/RefBase.h>
-#include <utils/SortedVector.h>
 #include <utils/threads.h>
 
 namespace android {
@@ -29,10 +29,14 @@ namespace android {
 // A BlobCache is an in-memory cache for binary key/value pairs.  A BlobCache
 // does NOT provide any thread-safety guarantees.
 //
+// Entries are found through a hash of the key and, when the cache is full,
+// the least recently used entries are evicted until the new one fits.
+//
 // The cache contents can be serialized to an in-memory buffer or mmap'd file
 // and then reloaded in a subsequent execution of the program.  This
 // serialization is non-portable and the data should only be used by the device
-// that generated it.
+// that generated it.  Entries are serialized from least to most recently used,
+// so the order survives a reload.
 class BlobCache : public RefBase {
 
 public:
@@ -42,6 +46,7 @@ public:
     // maxValueSize, respectively. The total combined size of ALL cache entries
     // (key sizes plus value sizes) will not exceed maxTotalSize.
     BlobCache(size_t maxKeySize, size_t maxValueSize, size_t maxTotalSize);
+    ~BlobCache();
 
     // set inserts a new binary value into the cache and associates it with the
     // given binary key.  If the key or value are too large for the cache then
@@ -51,7 +56,8 @@ public:
     // put in the cache (based on the maxKeySize, maxValueSize, and maxTotalSize
     // values specified to the BlobCache constructor), then the key/value pair
     // will be in the cache after set returns.  Note, however, that a subsequent
-    // call to set may evict old key/value pairs from the cache.
+    // call to set may evict the least recently used key/value pairs from the
+    // cache.
     //
     // Preconditions:
     //   key != NULL
@@ -67,7 +73,8 @@ public:
     // is non-NULL and the size of the cached value is less than valueSize bytes
     // then the cached value is copied into the buffer pointed to by the value
     // argument.  If the key is not present in the cache then 0 is returned and
-    // the buffer pointed to by the value argument is not modified.
+    // the buffer pointed to by the value argument is not modified.  Finding the
+    // key makes its entry the most recently used.
     //
     // Note that when calling get multiple times with the same key, the later
     // calls may fail, returning 0, even if earlier calls succeeded.  The return
@@ -101,30 +108,33 @@ public:
     //
     status_t unflatten(void const* buffer, size_t size);
 
+    // writeToFile serializes the current contents of the cache to the file
+    // descriptor, in the same format as flatten, without first building the
+    // whole serialization in memory.
+    status_t writeToFile(int fd) const;
+
+    // mapFromFile replaces the contents of the cache with the serialized cache
+    // contents of the file, as written by writeToFile or flatten.  The file is
+    // mmap'd and the loaded keys and values are used in place rather than
+    // copied, so the mapping is kept until the cache is destroyed or reloaded.
+    // The mapping is private but not a snapshot: the file must not be
+    // truncated or rewritten in place while it is mapped, or reading an entry
+    // may fault with SIGBUS or see changed data.  Writers must instead write a
+    // new file and rename it over, or unlink and recreate, the old one.
+    // Errors leave the cache empty, as for unflatten.
+    status_t mapFromFile(int fd);
+
 private:
     // Copying is disallowed.
     BlobCache(const BlobCache&);
     void operator=(const BlobCache&);
 
-    // A random function helper to get around MinGW not having nrand48()
-    long int blob_random();
-
-    // clean evicts a randomly chosen set of entries from the cache such that
-    // the total size of all remaining entries is less than mMaxTotalSize/2.
-    void clean();
-
-    // isCleanable returns true if the cache is full enough for the clean method
-    // to have some effect, and false otherwise.
-    bool isCleanable() const;
-
     // A Blob is an immutable sized unstructured data blob.
     class Blob : public RefBase {
     public:
         Blob(const void* data, size_t size, bool copyData);
         ~Blob();
 
-        bool operator<(const Blob& rhs) const;
-
         const void* getData() const;
         size_t getSize() const;
 
@@ -144,30 +154,92 @@ private:
         bool mOwnsData;
     };
 
-    // A CacheEntry is a single key/value pair in the cache.
+    // A KeyRef refers to key data owned elsewhere, either by the key Blob of
+    // a cache entry or by the caller while looking it up.
+    struct KeyRef {
+        KeyRef(const void* data, size_t size);
+
+        bool operator==(const KeyRef& rhs) const;
+        bool operator!=(const KeyRef& rhs) const;
+
+        const void* mData;
+        size_t mSize;
+    };
+
+    // A CacheEntry is a single key/value pair in the cache, indexed in
+    // mCacheEntries by the hash of its key and linked into the cache's list
+    // of entries from least to most recently used.
     class CacheEntry {
     public:
-        CacheEntry();
         CacheEntry(const sp<Blob>& key, const sp<Blob>& value);
         CacheEntry(const CacheEntry& ce);
 
-        bool operator<(const CacheEntry& rhs) const;
         const CacheEntry& operator=(const CacheEntry&);
 
-        sp<Blob> getKey() const;
+        const KeyRef& getKey() const;
+        sp<Blob> getKeyBlob() const;
         sp<Blob> getValue() const;
+        size_t getSize() const;
 
         void setValue(const sp<Blob>& value);
 
+        // mOlder and mYounger link the entry into the recently used list.
+        CacheEntry* mOlder;
+        CacheEntry* mYounger;
+
     private:
 
         // mKey is the key that identifies the cache entry.
         sp<Blob> mKey;
 
+        // mKeyRef refers to the data of mKey, for the hashtable lookups.
+        KeyRef mKeyRef;
+
         // mValue is the cached data associated with the key.
         sp<Blob> mValue;
     };
 
+    // set inserts a key/value pair as the public set does.  If copyData is
+    // false then the key and value data are used in place, and must outlive
+    // the entry.
+    void set(const void* key, size_t keySize, const void* value,
+            size_t valueSize, bool copyData);
+
+    // unflatten loads serialized cache contents as the public unflatten does,
+    // either copying the keys and values or using them in place.
+    status_t unflatten(void const* buffer, size_t size, bool copyData);
+
+    // hashKey returns the hash of the key data used to index mCacheEntries.
+    static hash_t hashKey(const void* key, size_t keySize);
+
+    // findEntry returns the index of the key's entry in mCacheEntries, or -1.
+    ssize_t findEntry(hash_t hash, const void* key, size_t keySize) const;
+
+    // addEntry inserts a new entry as the most recently used.  The key must not
+    // already be in the cache and there must be room for it.
+    void addEntry(hash_t hash, const sp<Blob>& key, const sp<Blob>& value);
+
+    // removeEntry removes the entry at the given index of mCacheEntries.
+    void removeEntry(ssize_t index);
+
+    // evictFor evicts the least recently used entries, other than the one
+    // being set, until the total size of the remaining entries plus size fits
+    // within mMaxTotalSize.
+    void evictFor(size_t size, const CacheEntry* keep);
+
+    // attach links an entry in as the most recently used, and detach unlinks
+    // it from the recently used list.
+    void attach(CacheEntry& entry);
+    void detach(CacheEntry& entry);
+
+    // rehash grows mCacheEntries, relinking the recently used list since the
+    // entries move to new buckets.
+    void rehash(size_t newCapacity);
+
+    // removeAll empties the cache and releases any file mapping it was loaded
+    // from.
+    void removeAll();
+
     // A Header is the header for the entire BlobCache serialization format. No
     // need to make this portable, so we simply write the struct out.
     struct Header {
@@ -229,13 +301,20 @@ private:
     // the cache.
     size_t mTotalSize;
 
-    // mRandState is the pseudo-random number generator state. It is passed to
-    // nrand48 to generate random numbers when needed.
-    unsigned short mRandState[3];
-
     // mCacheEntries stores all the cache entries that are resident in memory.
     // Cache entries are added to it by the 'set' method.
-    SortedVector<CacheEntry> mCacheEntries;
+    BasicHashtable<KeyRef, CacheEntry> mCacheEntries;
+
+    // mOldest and mYoungest are the ends of the list of entries from least to
+    // most recently used.  Eviction starts from mOldest.
+    CacheEntry* mOldest;
+    CacheEntry* mYoungest;
+
+    // mMappedData and mMappedSize describe the file mapping the cache was
+    // loaded from by mapFromFile, if any.  Keys and values loaded from it
+    // refer directly into the mapping.
+    void* mMappedData;
+    size_t mMappedSize;
 };
 
 }
@@ -35,6 +35,10 @@ static inline off64_t lseek64(int fd, off64_t offset, int whence) {
 static inline ssize_t pread64(int fd, void* buf, size_t nbytes, off64_t offset) {
     return pread(fd, buf, nbytes, offset);
 }
+
+static inline ssize_t pwrite64(int fd, const void* buf, size_t nbytes, off64_t offset) {
+    return pwrite(fd, buf, nbytes, offset);
+}
 #endif
 
 #endif /* !HAVE_OFF64_T */
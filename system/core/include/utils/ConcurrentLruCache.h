@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_UTILS_CONCURRENT_LRU_CACHE_H
+#define ANDROID_UTILS_CONCURRENT_LRU_CACHE_H
+
+#include <utils/BasicHashtable.h>
+#include <utils/LruCache.h>
+#include <utils/RWLock.h>
+
+namespace android {
+
+/**
+ * A thread-safe counterpart of LruCache.
+ *
+ * Entries are spread over a power of two number of shards by key hash, each
+ * with its own lock, hashtable and eviction order, so threads working on
+ * different keys rarely contend.  Capacity is divided evenly between the
+ * shards and eviction is decided per shard, which makes the cache as a whole
+ * only approximately least recently used.
+ *
+ * With kEvictLru every get() moves the entry to the young end of its shard's
+ * list and so takes the shard's write lock.  With kEvictClock a get() only
+ * sets the entry's referenced bit under the read lock, and eviction sweeps a
+ * clock hand over the shard giving referenced entries a second chance; this
+ * lets concurrent readers of one shard proceed in parallel.
+ *
+ * The OnEntryRemoved listener is called with the same contract as LruCache,
+ * while holding the lock of the entry's shard.  It may be called from several
+ * threads at once for entries of different shards, and must not call back
+ * into the cache.
+ *
+ * get() returns a copy of the value, since a reference could not be used
+ * safely once the shard lock is released.
+ */
+template <typename TKey, typename TValue>
+class ConcurrentLruCache {
+public:
+    enum Capacity {
+        kUnlimitedCapacity,
+    };
+
+    enum EvictionPolicy {
+        kEvictLru,
+        kEvictClock,
+    };
+
+    /**
+     * maxCapacity: the most entries held, or kUnlimitedCapacity.
+     * shardCount: the number of shards, rounded up to a power of two, but no
+     *     more than maxCapacity so that every shard can hold an entry.
+     */
+    explicit ConcurrentLruCache(uint32_t maxCapacity, size_t shardCount = 16,
+            EvictionPolicy policy = kEvictLru);
+    ~ConcurrentLruCache();
+
+    void setOnEntryRemovedListener(OnEntryRemoved<TKey, TValue>* listener);
+    size_t size() const;
+    bool get(const TKey& key, TValue* outValue);
+    bool put(const TKey& key, const TValue& value);
+    bool remove(const TKey& key);
+    void clear();
+
+private:
+    ConcurrentLruCache(const ConcurrentLruCache& that);  // disallow copy constructor
+
+    struct Entry {
+        TKey key;
+        TValue value;
+        Entry* parent;
+        Entry* child;
+        // Set on access under the read lock, cleared by the clock hand.
+        mutable volatile int32_t referenced;
+
+        Entry(TKey key_, TValue value_) : key(key_), value(value_), parent(NULL), child(NULL),
+                referenced(0) {
+        }
+        const TKey& getKey() const { return key; }
+    };
+
+    struct Shard {
+        RWLock lock;
+        BasicHashtable<TKey, Entry>* table;
+        Entry* oldest;
+        Entry* youngest;
+        ssize_t hand;
+        uint32_t capacity;
+
+        Shard() : table(new BasicHashtable<TKey, Entry>), oldest(NULL), youngest(NULL),
+                hand(-1), capacity(kUnlimitedCapacity) {
+        }
+        ~Shard() { delete table; }
+    };
+
+    Shard& shardFor(hash_t hash) const;
+    void attach(Shard& shard, Entry& entry);
+    void detach(Shard& shard, Entry& entry);
+    void removeAt(Shard& shard, ssize_t index);
+    void evict(Shard& shard);
+    void rehash(Shard& shard, size_t newCapacity);
+
+    Shard* mShards;
+    size_t mShardCount;
+    size_t mShardShift;
+    EvictionPolicy mPolicy;
+    OnEntryRemoved<TKey, TValue>* mListener;
+};
+
+// Implementation is here, because it's fully templated
+template <typename TKey, typename TValue>
+ConcurrentLruCache<TKey, TValue>::ConcurrentLruCache(uint32_t maxCapacity, size_t shardCount,
+        EvictionPolicy policy)
+    : mShardCount(1)
+    , mShardShift(32)
+    , mPolicy(policy)
+    , mListener(NULL) {
+    while (mShardCount < shardCount
+            && (maxCapacity == kUnlimitedCapacity || mShardCount * 2 <= maxCapacity)) {
+        mShardCount <<= 1;
+        mShardShift -= 1;
+    }
+    mShards = new Shard[mShardCount];
+    if (maxCapacity != kUnlimitedCapacity) {
+        // Split the remainder over the first shards, so that the shard
+        // capacities add up to exactly maxCapacity.
+        for (size_t i = 0; i < mShardCount; i++) {
+            mShards[i].capacity = maxCapacity / mShardCount
+                    + (i < maxCapacity % mShardCount ? 1 : 0);
+        }
+    }
+}
+
+template <typename TKey, typename TValue>
+ConcurrentLruCache<TKey, TValue>::~ConcurrentLruCache() {
+    delete[] mShards;
+}
+
+template <typename TKey, typename TValue>
+void ConcurrentLruCache<TKey, TValue>::setOnEntryRemovedListener(
+        OnEntryRemoved<TKey, TValue>* listener) {
+    mListener = listener;
+}
+
+template <typename TKey, typename TValue>
+size_t ConcurrentLruCache<TKey, TValue>::size() const {
+    size_t total = 0;
+    for (size_t i = 0; i < mShardCount; i++) {
+        RWLock::AutoRLock _l(mShards[i].lock);
+        total += mShards[i].table->size();
+    }
+    return total;
+}
+
+template <typename TKey, typename TValue>
+typename ConcurrentLruCache<TKey, TValue>::Shard&
+ConcurrentLruCache<TKey, TValue>::shardFor(hash_t hash) const {
+    // Take the high bits of a multiplicative hash; the hashtable within the
+    // shard starts its chains from the low bits.
+    if (mShardCount == 1) {
+        return mShards[0];
+    }
+    return mShards[(uint32_t(hash) * 2654435761u) >> mShardShift];
+}
+
+template <typename TKey, typename TValue>
+bool ConcurrentLruCache<TKey, TValue>::get(const TKey& key, TValue* outValue) {
+    hash_t hash = hash_type(key);
+    Shard& shard = shardFor(hash);
+
+    if (mPolicy == kEvictClock) {
+        RWLock::AutoRLock _l(shard.lock);
+        ssize_t index = shard.table->find(-1, hash, key);
+        if (index < 0) {
+            return false;
+        }
+        const Entry& entry = shard.table->entryAt(index);
+        entry.referenced = 1;
+        *outValue = entry.value;
+        return true;
+    }
+
+    RWLock::AutoWLock _l(shard.lock);
+    ssize_t index = shard.table->find(-1, hash, key);
+    if (index < 0) {
+        return false;
+    }
+    Entry& entry = shard.table->editEntryAt(index);
+    detach(shard, entry);
+    attach(shard, entry);
+    *outValue = entry.value;
+    return true;
+}
+
+template <typename TKey, typename TValue>
+bool ConcurrentLruCache<TKey, TValue>::put(const TKey& key, const TValue& value) {
+    hash_t hash = hash_type(key);
+    Shard& shard = shardFor(hash);
+    RWLock::AutoWLock _l(shard.lock);
+
+    if (shard.table->find(-1, hash, key) >= 0) {
+        return false;
+    }
+    if (shard.capacity != kUnlimitedCapacity
+            && shard.table->size() >= shard.capacity) {
+        evict(shard);
+    }
+    if (!shard.table->hasMoreRoom()) {
+        rehash(shard, shard.table->capacity() * 2);
+    }
+
+    Entry initEntry(key, value);
+    ssize_t index = shard.table->add(hash, initEntry);
+    attach(shard, shard.table->editEntryAt(index));
+    return true;
+}
+
+template <typename TKey, typename TValue>
+bool ConcurrentLruCache<TKey, TValue>::remove(const TKey& key) {
+    hash_t hash = hash_type(key);
+    Shard& shard = shardFor(hash);
+    RWLock::AutoWLock _l(shard.lock);
+
+    ssize_t index = shard.table->find(-1, hash, key);
+    if (index < 0) {
+        return false;
+    }
+    removeAt(shard, index);
+    return true;
+}
+
+template <typename TKey, typename TValue>
+void ConcurrentLruCache<TKey, TValue>::clear() {
+    for (size_t i = 0; i < mShardCount; i++) {
+        Shard& shard = mShards[i];
+        RWLock::AutoWLock _l(shard.lock);
+        if (mListener) {
+            for (Entry* p = shard.oldest; p != NULL; p = p->child) {
+                (*mListener)(p->key, p->value);
+            }
+        }
+        shard.youngest = NULL;
+        shard.oldest = NULL;
+        shard.hand = -1;
+        shard.table->clear();
+    }
+}
+
+template <typename TKey, typename TValue>
+void ConcurrentLruCache<TKey, TValue>::attach(Shard& shard, Entry& entry) {
+    if (shard.youngest == NULL) {
+        shard.youngest = shard.oldest = &entry;
+    } else {
+        entry.parent = shard.youngest;
+        shard.youngest->child = &entry;
+        shard.youngest = &entry;
+    }
+}
+
+template <typename TKey, typename TValue>
+void ConcurrentLruCache<TKey, TValue>::detach(Shard& shard, Entry& entry) {
+    if (entry.parent != NULL) {
+        entry.parent->child = entry.child;
+    } else {
+        shard.oldest = entry.child;
+    }
+    if (entry.child != NULL) {
+        entry.child->parent = entry.parent;
+    } else {
+        shard.youngest = entry.parent;
+    }
+
+    entry.parent = NULL;
+    entry.child = NULL;
+}
+
+template <typename TKey, typename TValue>
+void ConcurrentLruCache<TKey, TValue>::removeAt(Shard& shard, ssize_t index) {
+    Entry& entry = shard.table->editEntryAt(index);
+    if (mListener) {
+        (*mListener)(entry.key, entry.value);
+    }
+    detach(shard, entry);
+    shard.table->removeAt(index);
+}
+
+template <typename TKey, typename TValue>
+void ConcurrentLruCache<TKey, TValue>::evict(Shard& shard) {
+    if (shard.table->size() == 0) {
+        return;
+    }
+
+    if (mPolicy == kEvictLru) {
+        hash_t hash = hash_type(shard.oldest->key);
+        removeAt(shard, shard.table->find(-1, hash, shard.oldest->key));
+        return;
+    }
+
+    // Sweep the hand round, clearing referenced bits, until it reaches an
+    // entry that has not been used since the last pass.  At most one full
+    // turn clears every bit.
+    for (;;) {
+        shard.hand = shard.table->next(shard.hand);
+        if (shard.hand < 0) {
+            shard.hand = shard.table->next(-1);
+        }
+        const Entry& entry = shard.table->entryAt(shard.hand);
+        if (!entry.referenced) {
+            break;
+        }
+        entry.referenced = 0;
+    }
+    removeAt(shard, shard.hand);
+}
+
+template <typename TKey, typename TValue>
+void ConcurrentLruCache<TKey, TValue>::rehash(Shard& shard, size_t newCapacity) {
+    // Entries move in the rehash, so rebuild the list in the same order.
+    BasicHashtable<TKey, Entry>* oldTable = shard.table;
+    Entry* oldest = shard.oldest;
+
+    shard.oldest = NULL;
+    shard.youngest = NULL;
+    shard.hand = -1;
+    shard.table = new BasicHashtable<TKey, Entry>(newCapacity);
+    for (Entry* p = oldest; p != NULL; p = p->child) {
+        Entry initEntry(p->key, p->value);
+        initEntry.referenced = p->referenced;
+        ssize_t index = shard.table->add(hash_type(p->key), initEntry);
+        attach(shard, shard.table->editEntryAt(index));
+    }
+    delete oldTable;
+}
+
+}
+
+#endif // ANDROID_UTILS_CONCURRENT_LRU_CACHE_H
@@ -206,6 +206,16 @@ public:
          * to specify this event flag in the requested event set.
          */
         EVENT_INVALID = 1 << 4,
+
+        /**
+         * Option for addFd(): report events only when they newly occur, rather than
+         * for as long as the condition holds (epoll's EPOLLET).  The handler must then
+         * consume everything available, such as by reading until EAGAIN, or it will
+         * not be told about the rest.
+         *
+         * This flag is never reported back in a set of events.
+         */
+        EVENT_EDGE_TRIGGERED = 1 << 5,
     };
 
     enum {
@@ -317,6 +327,28 @@ public:
     int addFd(int fd, int ident, int events, Looper_callbackFunc callback, void* data);
     int addFd(int fd, int ident, int events, const sp<LooperCallback>& callback, void* data);
 
+    /**
+     * The arguments to addFd() for one file descriptor, for use with addFds().
+     */
+    struct FdRegistration {
+        int fd;
+        int ident;
+        int events;
+        sp<LooperCallback> callback;
+        void* data;
+    };
+
+    /**
+     * Adds or replaces a set of file descriptors, each as addFd() would, while
+     * acquiring the looper's lock only once.
+     *
+     * Returns the number of file descriptors added.  Registrations with invalid
+     * arguments, or that cannot be added to the epoll instance, are skipped.
+     *
+     * This method can be called on any thread.
+     */
+    int addFds(const FdRegistration* registrations, size_t count);
+
     /**
      * Removes a previously added file descriptor from the looper.
      *
@@ -417,6 +449,8 @@ public:
 
 private:
     struct Request {
+        Request() : fd(-1), ident(0), data(NULL) { }
+
         int fd;
         int ident;
         sp<LooperCallback> callback;
@@ -429,24 +463,34 @@ private:
     };
 
     struct MessageEnvelope {
-        MessageEnvelope() : uptime(0) { }
+        MessageEnvelope() : uptime(0), sequence(0) { }
+
+        MessageEnvelope(nsecs_t uptime, uint64_t sequence, const sp<MessageHandler> handler,
+                const Message& message) : uptime(uptime), sequence(sequence),
+                handler(handler), message(message) {
+        }
 
-        MessageEnvelope(nsecs_t uptime, const sp<MessageHandler> handler,
-                const Message& message) : uptime(uptime), handler(handler), message(message) {
+        // Messages due at the same time are delivered in the order they were sent.
+        bool isBefore(const MessageEnvelope& other) const {
+            return uptime < other.uptime
+                    || (uptime == other.uptime && sequence < other.sequence);
         }
 
         nsecs_t uptime;
+        uint64_t sequence;
         sp<MessageHandler> handler;
         Message message;
     };
 
     const bool mAllowNonCallbacks; // immutable
 
-    int mWakeReadPipeFd;  // immutable
-    int mWakeWritePipeFd; // immutable
+    int mWakeEventFd;  // immutable
     Mutex mLock;
 
+    // Binary min-heap of pending messages ordered by MessageEnvelope::isBefore,
+    // so the next message due is always at index 0.
     Vector<MessageEnvelope> mMessageEnvelopes; // guarded by mLock
+    uint64_t mNextMessageSequence; // guarded by mLock
     bool mSendingMessage; // guarded by mLock
 
     // Whether we are currently waiting for work.  Not protected by a lock,
@@ -455,8 +499,9 @@ private:
 
     int mEpollFd; // immutable
 
-    // Locked list of file descriptor monitoring requests.
-    KeyedVector<int, Request> mRequests;  // guarded by mLock
+    // Locked table of file descriptor monitoring requests, indexed by fd.
+    // Slots for file descriptors that are not registered have a Request::fd of -1.
+    Vector<Request> mRequests;  // guarded by mLock
 
     // This state is only used privately by pollOnce and does not require a lock since
     // it runs on a single thread.
@@ -467,6 +512,17 @@ private:
     int pollInner(int timeoutMillis);
     void awoken();
     void pushResponse(int events, const Request& request);
+    bool checkFdRequest(int ident, const sp<LooperCallback>& callback) const;
+    int addFdLocked(int fd, int ident, int events, const sp<LooperCallback>& callback,
+            void* data);
+    inline bool isFdRegisteredLocked(int fd) const {
+        return fd >= 0 && size_t(fd) < mRequests.size() && mRequests.itemAt(fd).fd == fd;
+    }
+
+    size_t siftMessageUp(size_t index);
+    void siftMessageDown(size_t index);
+    void removeFirstMessage();
+    void rebuildMessageHeap();
 
     static void initTLSKey();
     static void threadDestructor(void *st);
@@ -20,6 +20,7 @@
 #ifndef LIBZIPARCHIVE_ZIPARCHIVE_H_
 #define LIBZIPARCHIVE_ZIPARCHIVE_H_
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <sys/types.h>
 #include <utils/Compat.h>
@@ -75,6 +76,15 @@ struct ZipEntry {
 
 typedef void* ZipArchiveHandle;
 
+/* Flags for OpenArchiveWithFlags and OpenArchiveFdWithFlags */
+enum {
+  // Build the sorted index of entry names, used to iterate over the
+  // entries with a given prefix, while opening the archive.  By default it
+  // is built by the first StartIteration with a prefix, so that callers
+  // that only look entries up by name don't pay for sorting the names.
+  kOpenBuildPrefixIndex = 1 << 0,
+};
+
 /*
  * Open a Zip archive, and sets handle to the value of the opaque
  * handle for the file. This handle must be released by calling
@@ -102,6 +112,15 @@ int32_t OpenArchive(const char* fileName, ZipArchiveHandle* handle);
 int32_t OpenArchiveFd(const int fd, const char* debugFileName,
                       ZipArchiveHandle *handle);
 
+/*
+ * Like OpenArchive and OpenArchiveFd, with |flags| from the kOpen
+ * constants above.
+ */
+int32_t OpenArchiveWithFlags(const char* fileName, uint32_t flags,
+                             ZipArchiveHandle* handle);
+int32_t OpenArchiveFdWithFlags(const int fd, const char* debugFileName,
+                               uint32_t flags, ZipArchiveHandle* handle);
+
 /*
  * Close archive, releasing resources associated with it. This will
  * unmap the central directory of the zipfile and free all internal
@@ -136,7 +155,10 @@ int32_t FindEntry(const ZipArchiveHandle handle, const char* entryName,
  * Next.
  *
  * This method also accepts an optional prefix to restrict iteration to
- * entry names that start with |prefix|.
+ * entry names that start with |prefix|. Entries are then returned in
+ * name order, and the cost of the iteration depends on the number of
+ * matching entries rather than the size of the archive. |prefix| must
+ * remain valid until the iteration is finished.
  *
  * Returns 0 on success and negative values on failure.
  */
@@ -161,6 +183,39 @@ int32_t Next(void* cookie, ZipEntry* data, ZipEntryName *name);
  */
 int32_t ExtractEntryToFile(ZipArchiveHandle handle, ZipEntry* entry, int fd);
 
+/*
+ * An entry for ExtractEntriesToFiles to extract, and where to put it.
+ */
+struct ZipExtractRequest {
+  // The entry, as returned by FindEntry or Next.  It is updated from the
+  // entry's data descriptor as ExtractEntryToFile would update it.
+  ZipEntry entry;
+
+  // The file to write the entry to, at its current offset, as for
+  // ExtractEntryToFile.  Each request of a batch must have its own open
+  // file, since the requests run concurrently.
+  int fd;
+
+  // Set to 0 if the entry was extracted, and to a negative value otherwise.
+  int32_t result;
+};
+
+/*
+ * Extract a batch of entries as ExtractEntryToFile would, spreading them
+ * over |num_threads| threads including the calling one, or one per CPU if
+ * |num_threads| is 0.  Each thread reads, inflates and checks the crc of
+ * one entry at a time, largest entries first, so that the reads of one
+ * entry overlap the decompression of another.  The crc of every entry is
+ * checked, including that of stored entries.
+ *
+ * The handle must not be used to extract anything else until this returns.
+ *
+ * Returns 0 if every entry was extracted, and otherwise the result of the
+ * first request that failed.
+ */
+int32_t ExtractEntriesToFiles(ZipArchiveHandle handle, ZipExtractRequest* requests,
+                              size_t num_requests, uint32_t num_threads);
+
 /**
  * Uncompress a given zip entry to the memory region at |begin| and of
  * size |size|. This size is expected to be the same as the *declared*
@@ -172,6 +227,45 @@ int32_t ExtractEntryToFile(ZipArchiveHandle handle, ZipEntry* entry, int fd);
 int32_t ExtractToMemory(ZipArchiveHandle handle, ZipEntry* entry,
                         uint8_t* begin, uint32_t size);
 
+/*
+ * Receives the uncompressed contents of an entry a chunk at a time from
+ * ProcessZipEntryContents.  |buf| is only valid for the duration of the
+ * call.  Returns true to continue, or false to stop the extraction.
+ */
+typedef bool (*ProcessZipEntryFunction)(const uint8_t* buf, size_t buf_size,
+                                        void* cookie);
+
+/*
+ * Uncompress a given zip entry, passing the data to |func| in order, a
+ * chunk of at most 32KB at a time, along with |cookie|. Unlike
+ * ExtractToMemory, no buffer for the whole entry is needed.
+ *
+ * Returns 0 on success and negative values on failure, including when
+ * |func| returns false.
+ */
+int32_t ProcessZipEntryContents(ZipArchiveHandle handle, ZipEntry* entry,
+                                ProcessZipEntryFunction func, void* cookie);
+
+typedef void* ZipEntryMapHandle;
+
+/*
+ * Map the data of a stored (uncompressed) entry read-only, so that it can
+ * be used without copying it out of the archive.  On success |data| points
+ * at the |entry->uncompressed_length| bytes of the entry and |map_handle|
+ * must be released with UnmapEntry once the data is no longer needed.  The
+ * mapping remains valid after the archive is closed.
+ *
+ * Returns 0 on success and negative values on failure, including for
+ * entries that are not stored.
+ */
+int32_t MapStoredEntry(ZipArchiveHandle handle, const ZipEntry* entry,
+                       const uint8_t** data, ZipEntryMapHandle* map_handle);
+
+/*
+ * Release a mapping made by MapStoredEntry.
+ */
+void UnmapEntry(ZipEntryMapHandle map_handle);
+
 int GetFileDescriptor(const ZipArchiveHandle handle);
 
 const char* ErrorCodeString(int32_t error_code);
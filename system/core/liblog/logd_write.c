@@ -18,7 +18,9 @@
 #ifdef HAVE_PTHREADS
 #include <pthread.h>
 #endif
+#include <signal.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -134,6 +136,370 @@ static int __write_to_log_initialize()
     return ret;
 }
 
+#if !FAKE_LOG_DEVICE && defined(HAVE_PTHREADS)
+#define LOG_BATCHING 1
+#endif
+
+#if LOG_BATCHING
+/*
+ * Optional batching: rather than one writev() per record, each thread
+ * copies its records into its own buffer, and the buffers are sent to
+ * logd with one sendmmsg() each, one datagram per record just as before.
+ * A buffer is sent when it fills, by a flusher thread every
+ * log_batch_latency_ms, and at once before a fatal or crash record.
+ *
+ * Each buffer has a lock, but only its own thread takes it outside of the
+ * periodic flush, so appending a record costs no system call. A signal
+ * handler that logs while its thread is using the buffer must not wait for
+ * that lock, so it writes directly instead; see 'busy'.
+ */
+#define LOG_BATCH_BUFFER_SIZE (16 * 1024)
+#define LOG_BATCH_MAX_RECORDS 32
+
+struct log_batch {
+    struct log_batch *next;
+    pthread_mutex_t lock;
+    volatile sig_atomic_t busy; /* owning thread is inside lock */
+    unsigned int count;
+    size_t used;
+    uint16_t lens[LOG_BATCH_MAX_RECORDS];
+    char data[LOG_BATCH_BUFFER_SIZE];
+};
+
+static pthread_mutex_t log_batch_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_batch_cond = PTHREAD_COND_INITIALIZER;
+static struct log_batch *log_batch_list;
+static pthread_key_t log_batch_key;
+static pthread_once_t log_batch_once = PTHREAD_ONCE_INIT;
+static volatile unsigned int log_batch_latency_ms; /* 0 when disabled */
+static volatile bool log_batch_flusher_running;
+
+/* b->lock assumed */
+static void __log_batch_send_locked(struct log_batch *b)
+{
+    struct mmsghdr msgs[LOG_BATCH_MAX_RECORDS];
+    struct iovec iov[LOG_BATCH_MAX_RECORDS];
+    unsigned int i, sent;
+    char *p = b->data;
+    bool retried = false;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < b->count; i++) {
+        iov[i].iov_base = p;
+        iov[i].iov_len = b->lens[i];
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        p += b->lens[i];
+    }
+
+    /*
+     * As with writev() below, records may be lost if logd is overloaded,
+     * but we will never block.
+     */
+    sent = 0;
+    while (sent < b->count) {
+        int ret = sendmmsg(logd_fd, &msgs[sent], b->count - sent, 0);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == ENOTCONN) && !retried) {
+                retried = true;
+                pthread_mutex_lock(&log_init_lock);
+                ret = __write_to_log_initialize();
+                pthread_mutex_unlock(&log_init_lock);
+                if (ret == 0) {
+                    continue;
+                }
+            }
+            break;
+        }
+        sent += ret;
+    }
+
+    b->count = 0;
+    b->used = 0;
+}
+
+static void __log_batch_thread_exit(void *arg)
+{
+    struct log_batch *b = arg;
+    struct log_batch **pb;
+
+    pthread_mutex_lock(&log_batch_list_lock);
+    for (pb = &log_batch_list; *pb; pb = &(*pb)->next) {
+        if (*pb == b) {
+            *pb = b->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&log_batch_list_lock);
+
+    pthread_mutex_lock(&b->lock);
+    if (b->count) {
+        __log_batch_send_locked(b);
+    }
+    pthread_mutex_unlock(&b->lock);
+    pthread_mutex_destroy(&b->lock);
+    free(b);
+}
+
+static void __log_batch_prepare_fork(void)
+{
+    pthread_mutex_lock(&log_batch_list_lock);
+}
+
+static void __log_batch_parent_fork(void)
+{
+    pthread_mutex_unlock(&log_batch_list_lock);
+}
+
+/*
+ * The child has none of our threads, the flusher included, and must not
+ * send the parent's pending records a second time. Only the forking
+ * thread's buffer can still be used; the others would leak. The flusher
+ * is restarted by the next append.
+ */
+static void __log_batch_child_fork(void)
+{
+    struct log_batch *self = pthread_getspecific(log_batch_key);
+    struct log_batch *b, *next;
+
+    for (b = log_batch_list; b; b = next) {
+        next = b->next;
+        if (b != self) {
+            free(b);
+        }
+    }
+    log_batch_list = self;
+    if (self) {
+        self->next = NULL;
+        pthread_mutex_init(&self->lock, NULL);
+        self->busy = 0;
+        self->count = 0;
+        self->used = 0;
+    }
+    log_batch_flusher_running = false;
+    pthread_mutex_unlock(&log_batch_list_lock);
+}
+
+static void __log_batch_init(void)
+{
+    pthread_key_create(&log_batch_key, __log_batch_thread_exit);
+    pthread_atfork(__log_batch_prepare_fork, __log_batch_parent_fork,
+                   __log_batch_child_fork);
+}
+
+/* log_batch_list_lock assumed */
+static void __log_batch_flush_all_locked(void)
+{
+    struct log_batch *b;
+
+    for (b = log_batch_list; b; b = b->next) {
+        pthread_mutex_lock(&b->lock);
+        if (b->count) {
+            __log_batch_send_locked(b);
+        }
+        pthread_mutex_unlock(&b->lock);
+    }
+}
+
+static void *__log_batch_flusher(void *arg __unused)
+{
+    pthread_mutex_lock(&log_batch_list_lock);
+    while (log_batch_latency_ms) {
+        struct timespec ts;
+        unsigned int ms = log_batch_latency_ms;
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += ms / 1000;
+        ts.tv_nsec += (ms % 1000) * 1000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&log_batch_cond, &log_batch_list_lock, &ts);
+
+        __log_batch_flush_all_locked();
+    }
+    log_batch_flusher_running = false;
+    pthread_mutex_unlock(&log_batch_list_lock);
+    return NULL;
+}
+
+/* log_batch_list_lock assumed */
+static int __log_batch_start_flusher_locked(void)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+    int ret;
+
+    if (log_batch_flusher_running) {
+        return 0;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    ret = pthread_create(&thread, &attr, __log_batch_flusher, NULL);
+    pthread_attr_destroy(&attr);
+    if (ret) {
+        return -ret;
+    }
+    log_batch_flusher_running = true;
+    return 0;
+}
+
+static struct log_batch *__log_batch_get(bool create)
+{
+    struct log_batch *b;
+
+    pthread_once(&log_batch_once, __log_batch_init);
+
+    b = pthread_getspecific(log_batch_key);
+    if (b || !create) {
+        return b;
+    }
+
+    b = calloc(1, sizeof(*b));
+    if (!b) {
+        return NULL;
+    }
+    pthread_mutex_init(&b->lock, NULL);
+    pthread_setspecific(log_batch_key, b);
+
+    pthread_mutex_lock(&log_batch_list_lock);
+    b->next = log_batch_list;
+    log_batch_list = b;
+    pthread_mutex_unlock(&log_batch_list_lock);
+
+    return b;
+}
+
+/*
+ * Queue a complete record for this thread. Returns the number of bytes
+ * queued, or a negative errno if the caller should write it directly.
+ */
+static ssize_t __log_batch_append(struct iovec *vec, size_t nr)
+{
+    struct log_batch *b;
+    size_t i, len;
+    char *p;
+
+    for (len = 0, i = 0; i < nr; i++) {
+        len += vec[i].iov_len;
+    }
+    if (len > LOG_BATCH_BUFFER_SIZE) {
+        return -EMSGSIZE;
+    }
+
+    b = __log_batch_get(true);
+    if (!b) {
+        return -ENOMEM;
+    }
+    if (b->busy) {
+        /* a signal handler interrupted this thread while it held the lock */
+        return -EBUSY;
+    }
+
+    b->busy = 1;
+    pthread_mutex_lock(&b->lock);
+    if ((b->count == LOG_BATCH_MAX_RECORDS)
+            || ((b->used + len) > LOG_BATCH_BUFFER_SIZE)) {
+        __log_batch_send_locked(b);
+    }
+    p = b->data + b->used;
+    for (i = 0; i < nr; i++) {
+        memcpy(p, vec[i].iov_base, vec[i].iov_len);
+        p += vec[i].iov_len;
+    }
+    b->lens[b->count++] = len;
+    b->used += len;
+    pthread_mutex_unlock(&b->lock);
+    b->busy = 0;
+
+    /*
+     * Queued records need a flusher to bound their latency, and there is
+     * none yet in a forked child. We may be in a signal handler, so don't
+     * wait for the lock; the next record will try again.
+     */
+    if (log_batch_latency_ms && !log_batch_flusher_running
+            && (pthread_mutex_trylock(&log_batch_list_lock) == 0)) {
+        if (log_batch_latency_ms) {
+            __log_batch_start_flusher_locked();
+        }
+        pthread_mutex_unlock(&log_batch_list_lock);
+    }
+
+    return len;
+}
+
+/* Send this thread's queued records ahead of a record that must go now. */
+static void __log_batch_flush_self(void)
+{
+    struct log_batch *b = __log_batch_get(false);
+
+    if (b && !b->busy) {
+        b->busy = 1;
+        pthread_mutex_lock(&b->lock);
+        if (b->count) {
+            __log_batch_send_locked(b);
+        }
+        pthread_mutex_unlock(&b->lock);
+        b->busy = 0;
+    }
+}
+#endif
+
+int __android_log_set_batching(unsigned int max_latency_ms)
+{
+#if LOG_BATCHING
+    int ret = 0;
+
+    pthread_once(&log_batch_once, __log_batch_init);
+
+    pthread_mutex_lock(&log_batch_list_lock);
+    log_batch_latency_ms = max_latency_ms;
+    if (max_latency_ms) {
+        ret = __log_batch_start_flusher_locked();
+        if (ret < 0) {
+            log_batch_latency_ms = 0;
+        }
+    } else {
+        __log_batch_flush_all_locked();
+    }
+    pthread_cond_broadcast(&log_batch_cond);
+    pthread_mutex_unlock(&log_batch_list_lock);
+
+    return ret;
+#else
+    return max_latency_ms ? -ENOSYS : 0;
+#endif
+}
+
+void __android_log_flush(void)
+{
+#if LOG_BATCHING
+    struct log_batch *b;
+
+    /*
+     * May be called from a crash handler, so never wait on a lock that
+     * the crashing thread could be holding; skip what we cannot take.
+     */
+    if (pthread_mutex_trylock(&log_batch_list_lock) != 0) {
+        return;
+    }
+    for (b = log_batch_list; b; b = b->next) {
+        if (pthread_mutex_trylock(&b->lock) == 0) {
+            if (b->count) {
+                __log_batch_send_locked(b);
+            }
+            pthread_mutex_unlock(&b->lock);
+        }
+    }
+    pthread_mutex_unlock(&log_batch_list_lock);
+#endif
+}
+
 static int __write_to_log_kernel(log_id_t log_id, struct iovec *vec, size_t nr)
 {
     ssize_t ret;
@@ -224,6 +590,24 @@ static int __write_to_log_kernel(log_id_t log_id, struct iovec *vec, size_t nr)
         }
     }
 
+#if LOG_BATCHING
+    if (log_batch_latency_ms) {
+        bool urgent = (log_id == LOG_ID_CRASH)
+                || ((log_id != LOG_ID_EVENTS) && (nr > 0)
+                    && (*(unsigned char *)vec[0].iov_base >= ANDROID_LOG_FATAL));
+
+        if (!urgent) {
+            ret = __log_batch_append(newVec, i);
+            if (ret >= 0) {
+                return ret - (sizeof_log_id_t + sizeof(tid) + sizeof(log_time));
+            }
+        } else {
+            /* keep order with what this thread has already queued */
+            __log_batch_flush_self();
+        }
+    }
+#endif
+
     /*
      * The write below could be lost, but will never block.
      *
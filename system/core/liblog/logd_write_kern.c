@@ -150,6 +150,16 @@ static int __write_to_log_init(log_id_t log_id, struct iovec *vec, size_t nr)
     return write_to_log(log_id, vec, nr);
 }
 
+int __android_log_set_batching(unsigned int max_latency_ms)
+{
+    /* each record is a single write to the kernel logger */
+    return max_latency_ms ? -ENOSYS : 0;
+}
+
+void __android_log_flush(void)
+{
+}
+
 int __android_log_write(int prio, const char *tag, const char *msg)
 {
     struct iovec vec[3];
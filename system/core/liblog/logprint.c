@@ -31,6 +31,7 @@
 
 typedef struct FilterInfo_t {
     char *mTag;
+    uint32_t mHash;
     android_LogPriority mPri;
     struct FilterInfo_t *p_next;
 } FilterInfo;
@@ -39,14 +40,38 @@ struct AndroidLogFormat_t {
     android_LogPriority global_pri;
     FilterInfo *filters;
     AndroidLogPrintFormat format;
+
+    /*
+     * The filters by tag, in an open addressed hash table built on first
+     * use after the rules change; NULL until then.
+     */
+    FilterInfo **filterTable;
+    size_t filterTableMask;
+
+    /* The last time stamp formatted, kept to skip localtime() per line */
+    time_t timeBufSec;
+    int timeBufValid;
+    char timeBuf[32];
 };
 
+static uint32_t hashTag(const char *tag)
+{
+    /* FNV-1a */
+    uint32_t hash = 2166136261u;
+
+    while (*tag) {
+        hash = (hash ^ (unsigned char)*tag++) * 16777619u;
+    }
+    return hash;
+}
+
 static FilterInfo * filterinfo_new(const char * tag, android_LogPriority pri)
 {
     FilterInfo *p_ret;
 
     p_ret = (FilterInfo *)calloc(1, sizeof(FilterInfo));
     p_ret->mTag = strdup(tag);
+    p_ret->mHash = hashTag(tag);
     p_ret->mPri = pri;
 
     return p_ret;
@@ -110,25 +135,91 @@ static char filterPriToChar (android_LogPriority pri)
     }
 }
 
-static android_LogPriority filterPriForTag(
-        AndroidLogFormat *p_format, const char *tag)
+/*
+ * Build the hash table of filters by tag. The newest rule for a tag is
+ * first in the list and wins, as it does in the list scan.
+ *
+ * returns 0 on success and -1 on malloc failure
+ */
+static int compileFilters(AndroidLogFormat *p_format)
 {
     FilterInfo *p_curFilter;
+    size_t count = 0;
+    size_t size = 16;
 
     for (p_curFilter = p_format->filters
             ; p_curFilter != NULL
             ; p_curFilter = p_curFilter->p_next
     ) {
-        if (0 == strcmp(tag, p_curFilter->mTag)) {
-            if (p_curFilter->mPri == ANDROID_LOG_DEFAULT) {
-                return p_format->global_pri;
-            } else {
-                return p_curFilter->mPri;
+        count++;
+    }
+    while (size < (count * 2)) {
+        size *= 2;
+    }
+
+    p_format->filterTable = (FilterInfo **)calloc(size, sizeof(FilterInfo *));
+    if (p_format->filterTable == NULL) {
+        return -1;
+    }
+    p_format->filterTableMask = size - 1;
+
+    for (p_curFilter = p_format->filters
+            ; p_curFilter != NULL
+            ; p_curFilter = p_curFilter->p_next
+    ) {
+        size_t i = p_curFilter->mHash & p_format->filterTableMask;
+        FilterInfo *p_slot;
+
+        while ((p_slot = p_format->filterTable[i]) != NULL) {
+            if ((p_slot->mHash == p_curFilter->mHash)
+                    && (0 == strcmp(p_slot->mTag, p_curFilter->mTag))) {
+                break;
+            }
+            i = (i + 1) & p_format->filterTableMask;
+        }
+        if (p_slot == NULL) {
+            p_format->filterTable[i] = p_curFilter;
+        }
+    }
+
+    return 0;
+}
+
+static android_LogPriority filterPriForTag(
+        AndroidLogFormat *p_format, const char *tag)
+{
+    FilterInfo *p_curFilter = NULL;
+
+    if (p_format->filters == NULL) {
+        return p_format->global_pri;
+    }
+
+    if ((p_format->filterTable != NULL) || (compileFilters(p_format) == 0)) {
+        uint32_t hash = hashTag(tag);
+        size_t i = hash & p_format->filterTableMask;
+
+        while ((p_curFilter = p_format->filterTable[i]) != NULL) {
+            if ((p_curFilter->mHash == hash)
+                    && (0 == strcmp(tag, p_curFilter->mTag))) {
+                break;
+            }
+            i = (i + 1) & p_format->filterTableMask;
+        }
+    } else {
+        for (p_curFilter = p_format->filters
+                ; p_curFilter != NULL
+                ; p_curFilter = p_curFilter->p_next
+        ) {
+            if (0 == strcmp(tag, p_curFilter->mTag)) {
+                break;
             }
         }
     }
 
-    return p_format->global_pri;
+    if ((p_curFilter == NULL) || (p_curFilter->mPri == ANDROID_LOG_DEFAULT)) {
+        return p_format->global_pri;
+    }
+    return p_curFilter->mPri;
 }
 
 /**
@@ -166,6 +257,7 @@ void android_log_format_free(AndroidLogFormat *p_format)
         free(p_info_old);
     }
 
+    free(p_format->filterTable);
     free(p_format);
 }
 
@@ -259,6 +351,9 @@ int android_log_addFilterRule(AndroidLogFormat *p_format,
 
         p_fi->p_next = p_format->filters;
         p_format->filters = p_fi;
+
+        free(p_format->filterTable);
+        p_format->filterTable = NULL;
     }
 
     return 0;
@@ -672,30 +767,22 @@ int android_log_processBinaryLogBuffer(struct logger_entry *buf,
     return 0;
 }
 
-/**
- * Formats a log message into a buffer
- *
- * Uses defaultBuffer if it can, otherwise malloc()'s a new buffer
- * If return value != defaultBuffer, caller must call free()
- * Returns NULL on malloc error
+/*
+ * Formats the per line prefix and suffix of an entry, into buffers of
+ * 128 bytes each. If *p_headerFooter is set on return they wrap the whole
+ * message rather than each of its lines.
  */
-
-char *android_log_formatLogLine (
+static void formatPrefixSuffix(
     AndroidLogFormat *p_format,
-    char *defaultBuffer,
-    size_t defaultBufferSize,
     const AndroidLogEntry *entry,
-    size_t *p_outLength)
+    char *prefixBuf, size_t *p_prefixLen,
+    char *suffixBuf, size_t *p_suffixLen,
+    int *p_headerFooter)
 {
-#if defined(HAVE_LOCALTIME_R)
-    struct tm tmBuf;
-#endif
-    struct tm* ptm;
-    char timeBuf[32];
-    char prefixBuf[128], suffixBuf[128];
+    const size_t bufSize = 128;
     char priChar;
-    int prefixSuffixIsHeaderFooter = 0;
-    char * ret = NULL;
+    const char *timeBuf;
+    size_t prefixLen, suffixLen;
 
     priChar = filterPriToChar(entry->priority);
 
@@ -707,34 +794,41 @@ char *android_log_formatLogLine (
      * For this reason it's very annoying to have regexp meta characters
      * in the time stamp.  Don't use forward slashes, parenthesis,
      * brackets, asterisks, or other special chars here.
+     *
+     * Consecutive entries are usually in the same second, so reuse the
+     * last result rather than converting each time.
      */
+    if (!p_format->timeBufValid || (p_format->timeBufSec != entry->tv_sec)) {
 #if defined(HAVE_LOCALTIME_R)
-    ptm = localtime_r(&(entry->tv_sec), &tmBuf);
+        struct tm tmBuf;
+        struct tm* ptm = localtime_r(&(entry->tv_sec), &tmBuf);
 #else
-    ptm = localtime(&(entry->tv_sec));
+        struct tm* ptm = localtime(&(entry->tv_sec));
 #endif
-    //strftime(timeBuf, sizeof(timeBuf), "%Y-%m-%d %H:%M:%S", ptm);
-    strftime(timeBuf, sizeof(timeBuf), "%m-%d %H:%M:%S", ptm);
+        //strftime(timeBuf, sizeof(timeBuf), "%Y-%m-%d %H:%M:%S", ptm);
+        strftime(p_format->timeBuf, sizeof(p_format->timeBuf),
+                 "%m-%d %H:%M:%S", ptm);
+        p_format->timeBufSec = entry->tv_sec;
+        p_format->timeBufValid = 1;
+    }
+    timeBuf = p_format->timeBuf;
 
-    /*
-     * Construct a buffer containing the log header and log message.
-     */
-    size_t prefixLen, suffixLen;
+    *p_headerFooter = 0;
 
     switch (p_format->format) {
         case FORMAT_TAG:
-            prefixLen = snprintf(prefixBuf, sizeof(prefixBuf),
+            prefixLen = snprintf(prefixBuf, bufSize,
                 "%c/%-8s: ", priChar, entry->tag);
             strcpy(suffixBuf, "\n"); suffixLen = 1;
             break;
         case FORMAT_PROCESS:
-            prefixLen = snprintf(prefixBuf, sizeof(prefixBuf),
+            prefixLen = snprintf(prefixBuf, bufSize,
                 "%c(%5d) ", priChar, entry->pid);
-            suffixLen = snprintf(suffixBuf, sizeof(suffixBuf),
+            suffixLen = snprintf(suffixBuf, bufSize,
                 "  (%s)\n", entry->tag);
             break;
         case FORMAT_THREAD:
-            prefixLen = snprintf(prefixBuf, sizeof(prefixBuf),
+            prefixLen = snprintf(prefixBuf, bufSize,
                 "%c(%5d:%5d) ", priChar, entry->pid, entry->tid);
             strcpy(suffixBuf, "\n");
             suffixLen = 1;
@@ -746,31 +840,31 @@ char *android_log_formatLogLine (
             suffixLen = 1;
             break;
         case FORMAT_TIME:
-            prefixLen = snprintf(prefixBuf, sizeof(prefixBuf),
+            prefixLen = snprintf(prefixBuf, bufSize,
                 "%s.%03ld %c/%-8s(%5d): ", timeBuf, entry->tv_nsec / 1000000,
                 priChar, entry->tag, entry->pid);
             strcpy(suffixBuf, "\n");
             suffixLen = 1;
             break;
         case FORMAT_THREADTIME:
-            prefixLen = snprintf(prefixBuf, sizeof(prefixBuf),
+            prefixLen = snprintf(prefixBuf, bufSize,
                 "%s.%03ld %5d %5d %c %-8s: ", timeBuf, entry->tv_nsec / 1000000,
                 entry->pid, entry->tid, priChar, entry->tag);
             strcpy(suffixBuf, "\n");
             suffixLen = 1;
             break;
         case FORMAT_LONG:
-            prefixLen = snprintf(prefixBuf, sizeof(prefixBuf),
+            prefixLen = snprintf(prefixBuf, bufSize,
                 "[ %s.%03ld %5d:%5d %c/%-8s ]\n",
                 timeBuf, entry->tv_nsec / 1000000, entry->pid,
                 entry->tid, priChar, entry->tag);
             strcpy(suffixBuf, "\n\n");
             suffixLen = 2;
-            prefixSuffixIsHeaderFooter = 1;
+            *p_headerFooter = 1;
             break;
         case FORMAT_BRIEF:
         default:
-            prefixLen = snprintf(prefixBuf, sizeof(prefixBuf),
+            prefixLen = snprintf(prefixBuf, bufSize,
                 "%c/%-8s(%5d): ", priChar, entry->tag, entry->pid);
             strcpy(suffixBuf, "\n");
             suffixLen = 1;
@@ -782,19 +876,26 @@ char *android_log_formatLogLine (
      * possibly causing heap corruption.  To avoid this we double check and
      * set the length at the maximum (size minus null byte)
      */
-    if(prefixLen >= sizeof(prefixBuf))
-        prefixLen = sizeof(prefixBuf) - 1;
-    if(suffixLen >= sizeof(suffixBuf))
-        suffixLen = sizeof(suffixBuf) - 1;
+    if(prefixLen >= bufSize)
+        prefixLen = bufSize - 1;
+    if(suffixLen >= bufSize)
+        suffixLen = bufSize - 1;
 
-    /* the following code is tragically unreadable */
+    *p_prefixLen = prefixLen;
+    *p_suffixLen = suffixLen;
+}
 
+/*
+ * Returns the buffer size, including the terminating null, needed to
+ * format an entry with the given prefix and suffix.
+ */
+static size_t formattedSize(const AndroidLogEntry *entry,
+    size_t prefixLen, size_t suffixLen, int headerFooter)
+{
     size_t numLines;
-    char *p;
-    size_t bufferSize;
     const char *pm;
 
-    if (prefixSuffixIsHeaderFooter) {
+    if (headerFooter) {
         // we're just wrapping message with a header/footer
         numLines = 1;
     } else {
@@ -802,7 +903,7 @@ char *android_log_formatLogLine (
         numLines = 0;
 
         // The line-end finding here must match the line-end finding
-        // in for ( ... numLines...) loop below
+        // in formatLines() below
         while (pm < (entry->message + entry->messageLen)) {
             if (*pm++ == '\n') numLines++;
         }
@@ -812,59 +913,129 @@ char *android_log_formatLogLine (
 
     // this is an upper bound--newlines in message may be counted
     // extraneously
-    bufferSize = (numLines * (prefixLen + suffixLen)) + entry->messageLen + 1;
-
-    if (defaultBufferSize >= bufferSize) {
-        ret = defaultBuffer;
-    } else {
-        ret = (char *)malloc(bufferSize);
-
-        if (ret == NULL) {
-            return ret;
-        }
-    }
+    return (numLines * (prefixLen + suffixLen)) + entry->messageLen + 1;
+}
 
-    ret[0] = '\0';       /* to start strcat off */
+/*
+ * Writes the formatted entry to out, which must have room for
+ * formattedSize() bytes. Returns its length, excluding the terminating null.
+ */
+static size_t formatLines(char *out, const AndroidLogEntry *entry,
+    const char *prefixBuf, size_t prefixLen,
+    const char *suffixBuf, size_t suffixLen, int headerFooter)
+{
+    char *p = out;
+    const char *pm = entry->message;
+    const char *end = entry->message + entry->messageLen;
 
-    p = ret;
-    pm = entry->message;
+    if (headerFooter) {
+        size_t messageLen = strnlen(entry->message, entry->messageLen);
 
-    if (prefixSuffixIsHeaderFooter) {
-        strcat(p, prefixBuf);
+        memcpy(p, prefixBuf, prefixLen);
         p += prefixLen;
-        strncat(p, entry->message, entry->messageLen);
-        p += entry->messageLen;
-        strcat(p, suffixBuf);
+        memcpy(p, entry->message, messageLen);
+        p += messageLen;
+        memcpy(p, suffixBuf, suffixLen);
         p += suffixLen;
     } else {
-        while(pm < (entry->message + entry->messageLen)) {
+        while(pm < end) {
             const char *lineStart;
             size_t lineLen;
             lineStart = pm;
 
             // Find the next end-of-line in message
-            while (pm < (entry->message + entry->messageLen)
-                    && *pm != '\n') pm++;
-            lineLen = pm - lineStart;
+            while (pm < end && *pm != '\n') pm++;
+            lineLen = strnlen(lineStart, pm - lineStart);
 
-            strcat(p, prefixBuf);
+            memcpy(p, prefixBuf, prefixLen);
             p += prefixLen;
-            strncat(p, lineStart, lineLen);
+            memcpy(p, lineStart, lineLen);
             p += lineLen;
-            strcat(p, suffixBuf);
+            memcpy(p, suffixBuf, suffixLen);
             p += suffixLen;
 
-            if (*pm == '\n') pm++;
+            if (pm < end && *pm == '\n') pm++;
+        }
+    }
+    *p = '\0';
+
+    return p - out;
+}
+
+/**
+ * Formats a log message into a buffer
+ *
+ * Uses defaultBuffer if it can, otherwise malloc()'s a new buffer
+ * If return value != defaultBuffer, caller must call free()
+ * Returns NULL on malloc error
+ */
+
+char *android_log_formatLogLine (
+    AndroidLogFormat *p_format,
+    char *defaultBuffer,
+    size_t defaultBufferSize,
+    const AndroidLogEntry *entry,
+    size_t *p_outLength)
+{
+    char prefixBuf[128], suffixBuf[128];
+    size_t prefixLen, suffixLen, bufferSize, outLength;
+    int headerFooter;
+    char * ret = NULL;
+
+    formatPrefixSuffix(p_format, entry, prefixBuf, &prefixLen,
+                       suffixBuf, &suffixLen, &headerFooter);
+
+    bufferSize = formattedSize(entry, prefixLen, suffixLen, headerFooter);
+
+    if (defaultBufferSize >= bufferSize) {
+        ret = defaultBuffer;
+    } else {
+        ret = (char *)malloc(bufferSize);
+
+        if (ret == NULL) {
+            return ret;
         }
     }
 
+    outLength = formatLines(ret, entry, prefixBuf, prefixLen,
+                            suffixBuf, suffixLen, headerFooter);
+
     if (p_outLength != NULL) {
-        *p_outLength = p - ret;
+        *p_outLength = outLength;
     }
 
     return ret;
 }
 
+/**
+ * Formats a log message directly into the caller's buffer, never
+ * allocating.
+ *
+ * Returns the length of the formatted message, excluding the
+ * terminating null, or -1 if it does not fit in bufferSize bytes.
+ */
+
+ssize_t android_log_formatLogLineToBuffer (
+    AndroidLogFormat *p_format,
+    char *buffer,
+    size_t bufferSize,
+    const AndroidLogEntry *entry)
+{
+    char prefixBuf[128], suffixBuf[128];
+    size_t prefixLen, suffixLen;
+    int headerFooter;
+
+    formatPrefixSuffix(p_format, entry, prefixBuf, &prefixLen,
+                       suffixBuf, &suffixLen, &headerFooter);
+
+    if (formattedSize(entry, prefixLen, suffixLen, headerFooter) > bufferSize) {
+        return -1;
+    }
+
+    return formatLines(buffer, entry, prefixBuf, prefixLen,
+                       suffixBuf, suffixLen, headerFooter);
+}
+
 /**
  * Either print or do not print log line, based on filter
  *
@@ -19,6 +19,7 @@
 #include <log/log.h>
 #include <log/logger.h>
 #include <log/log_read.h>
+#include <log/logprint.h>
 
 #include "benchmark.h"
 
@@ -71,6 +72,26 @@ static void BM_log_maximum(int iters) {
 }
 BENCHMARK(BM_log_maximum);
 
+/*
+ *	Measure the fastest rate we can stuff print messages into the log
+ * at high pressure when they are queued per thread and sent in batches.
+ * Expect this to be a fraction of BM_log_maximum, with no syscall on most
+ * calls.
+ */
+static void BM_log_maximum_batched(int iters) {
+    __android_log_set_batching(100);
+    StartBenchmarkTiming();
+
+    for (int i = 0; i < iters; ++i) {
+        __android_log_print(ANDROID_LOG_INFO, "BM_log_maximum_batched", "%d", i);
+    }
+    __android_log_flush();
+
+    StopBenchmarkTiming();
+    __android_log_set_batching(0);
+}
+BENCHMARK(BM_log_maximum_batched);
+
 /*
  *	Measure the time it takes to submit the android logging call using
  * discrete acquisition under light load. Expect this to be a pair of
@@ -99,6 +120,57 @@ static void BM_log_overhead(int iters) {
 }
 BENCHMARK(BM_log_overhead);
 
+/*
+ *	Measure the time logcat spends filtering and formatting a line into
+ * its output buffer, with a filter spec of a few dozen tags.
+ */
+static void BM_log_filter_format(int iters) {
+    static const char *tags[] = {
+        "ActivityManager", "PackageManager", "WindowManager", "dalvikvm",
+    };
+    AndroidLogFormat *p_format = android_log_format_new();
+    char spec[32];
+    for (int i = 0; i < 32; ++i) {
+        snprintf(spec, sizeof(spec), "Tag%d:W", i);
+        android_log_addFilterString(p_format, spec);
+    }
+    android_log_addFilterString(p_format, "ActivityManager:I *:V");
+    android_log_setPrintFormat(p_format, FORMAT_THREADTIME);
+
+    static const char message[] = "Displayed com.android.settings/.Settings";
+    AndroidLogEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.tv_sec = time(NULL);
+    entry.priority = ANDROID_LOG_INFO;
+    entry.pid = getpid();
+    entry.tid = gettid();
+    entry.message = message;
+    entry.messageLen = sizeof(message) - 1;
+
+    char buffer[64 * 1024];
+    size_t len = 0;
+
+    StartBenchmarkTiming();
+    for (int i = 0; i < iters; ++i) {
+        entry.tag = tags[i % (sizeof(tags) / sizeof(tags[0]))];
+        if (!android_log_shouldPrintLine(p_format, entry.tag, entry.priority)) {
+            continue;
+        }
+        ssize_t ret = android_log_formatLogLineToBuffer(p_format,
+                buffer + len, sizeof(buffer) - len, &entry);
+        if (ret < 0) {
+            len = 0;
+            ret = android_log_formatLogLineToBuffer(p_format,
+                    buffer, sizeof(buffer), &entry);
+        }
+        len += ret;
+    }
+    StopBenchmarkTiming();
+
+    android_log_format_free(p_format);
+}
+BENCHMARK(BM_log_filter_format);
+
 static void caught_latency(int /*signum*/)
 {
     unsigned long long v = 0xDEADBEEFA55A5AA5ULL;
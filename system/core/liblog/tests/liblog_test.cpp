@@ -17,6 +17,7 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <signal.h>
+#include <string.h>
 #include <gtest/gtest.h>
 #include <log/log.h>
 #include <log/logger.h>
@@ -161,6 +162,76 @@ TEST(liblog, __android_log_btwrite__android_logger_list_read) {
     android_logger_list_close(logger_list);
 }
 
+// Reads this process's long events with values in [base, base + max) into
+// values, less base and in the order they arrived. Returns how many.
+static int read_batched_events(long long base, long long *values, int max) {
+    struct logger_list *logger_list;
+    pid_t pid = getpid();
+
+    if (NULL == (logger_list = android_logger_list_open(
+            LOG_ID_EVENTS, O_RDONLY | O_NDELAY, 1000, pid))) {
+        return -1;
+    }
+
+    int count = 0;
+    for (;;) {
+        log_msg log_msg;
+        if (android_logger_list_read(logger_list, &log_msg) <= 0) {
+            break;
+        }
+
+        if ((log_msg.entry.pid != pid)
+         || (log_msg.entry.len != (4 + 1 + 8))
+         || (log_msg.id() != LOG_ID_EVENTS)) {
+            continue;
+        }
+
+        char *eventData = log_msg.msg();
+
+        if (eventData[4] != EVENT_TYPE_LONG) {
+            continue;
+        }
+
+        long long v;
+        memcpy(&v, eventData + 4 + 1, sizeof(v));
+        if ((v >= base) && (v < (base + max)) && (count < max)) {
+            values[count++] = v - base;
+        }
+    }
+
+    android_logger_list_close(logger_list);
+    return count;
+}
+
+TEST(liblog, __android_log_set_batching__android_log_flush) {
+    static const int batch_test_records = 10;
+
+    // A latency long enough that only a flush can send the records, and
+    // few enough records that they all fit in the thread's buffer.
+    ASSERT_EQ(0, __android_log_set_batching(60000));
+
+    long long base = log_time(CLOCK_MONOTONIC).nsec() & ~0xFFFFLL;
+    for (int i = 0; i < batch_test_records; ++i) {
+        long long v = base + i;
+        EXPECT_LT(0, __android_log_btwrite(0, EVENT_TYPE_LONG, &v, sizeof(v)));
+    }
+    usleep(1000000);
+
+    long long values[batch_test_records];
+    EXPECT_EQ(0, read_batched_events(base, values, batch_test_records));
+
+    __android_log_flush();
+    usleep(1000000);
+
+    ASSERT_EQ(batch_test_records,
+              read_batched_events(base, values, batch_test_records));
+    for (int i = 0; i < batch_test_records; ++i) {
+        EXPECT_EQ(i, values[i]);
+    }
+
+    EXPECT_EQ(0, __android_log_set_batching(0));
+}
+
 static unsigned signaled;
 log_time signal_time;
 
@@ -682,3 +753,67 @@ TEST(liblog, filterRule) {
 
     android_log_format_free(p_format);
 }
+
+TEST(liblog, android_log_formatLogLineToBuffer) {
+    static const AndroidLogPrintFormat formats[] = {
+        FORMAT_BRIEF, FORMAT_PROCESS, FORMAT_TAG, FORMAT_THREAD,
+        FORMAT_RAW, FORMAT_TIME, FORMAT_THREADTIME, FORMAT_LONG
+    };
+    static const char *messages[] = {
+        "", "one line", "two\nlines", "trailing newline\n", "\n\nblank lines\n\n"
+    };
+    // Revisit a second, so that a stale cached time stamp would show.
+    static const time_t seconds[] = { 1000000000, 1000000001, 1000000000 };
+
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f) {
+        AndroidLogFormat *p_format = android_log_format_new();
+        android_log_setPrintFormat(p_format, formats[f]);
+
+        for (size_t m = 0; m < sizeof(messages) / sizeof(messages[0]); ++m) {
+            for (size_t t = 0; t < sizeof(seconds) / sizeof(seconds[0]); ++t) {
+                AndroidLogEntry entry;
+                entry.tv_sec = seconds[t];
+                entry.tv_nsec = 123456789;
+                entry.priority = ANDROID_LOG_INFO;
+                entry.pid = 1234;
+                entry.tid = 5678;
+                entry.tag = "liblog";
+                entry.message = messages[m];
+                entry.messageLen = strlen(messages[m]);
+
+                char defaultBuffer[512];
+                size_t expectedLen;
+                char *expected = android_log_formatLogLine(p_format,
+                        defaultBuffer, sizeof(defaultBuffer), &entry,
+                        &expectedLen);
+                ASSERT_TRUE(NULL != expected);
+
+                // A fresh format, with nothing cached, must agree too.
+                AndroidLogFormat *p_fresh = android_log_format_new();
+                android_log_setPrintFormat(p_fresh, formats[f]);
+
+                char buffer[512];
+                ssize_t len = android_log_formatLogLineToBuffer(p_format,
+                        buffer, sizeof(buffer), &entry);
+                ASSERT_EQ((ssize_t)expectedLen, len);
+                EXPECT_EQ(0, memcmp(expected, buffer, len));
+
+                len = android_log_formatLogLineToBuffer(p_fresh,
+                        buffer, sizeof(buffer), &entry);
+                ASSERT_EQ((ssize_t)expectedLen, len);
+                EXPECT_EQ(0, memcmp(expected, buffer, len));
+
+                // No room for the terminating null is refused, not overrun.
+                EXPECT_EQ(-1, android_log_formatLogLineToBuffer(p_format,
+                        buffer, expectedLen, &entry));
+
+                android_log_format_free(p_fresh);
+                if (expected != defaultBuffer) {
+                    free(expected);
+                }
+            }
+        }
+
+        android_log_format_free(p_format);
+    }
+}
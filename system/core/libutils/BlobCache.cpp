@@ -17,12 +17,20 @@
 #define LOG_TAG "BlobCache"
 //#define LOG_NDEBUG 0
 
+#include <errno.h>
 #include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_POSIX_FILEMAP
+#include <sys/mman.h>
+#endif
 
 #include <utils/BlobCache.h>
+#include <utils/Compat.h>
 #include <utils/Errors.h>
+#include <utils/JenkinsHash.h>
 #include <utils/Log.h>
 
 namespace android {
@@ -40,20 +48,24 @@ BlobCache::BlobCache(size_t maxKeySize, size_t maxValueSize, size_t maxTotalSize
         mMaxKeySize(maxKeySize),
         mMaxValueSize(maxValueSize),
         mMaxTotalSize(maxTotalSize),
-        mTotalSize(0) {
-    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
-#ifdef _WIN32
-    srand(now);
-#else
-    mRandState[0] = (now >> 0) & 0xFFFF;
-    mRandState[1] = (now >> 16) & 0xFFFF;
-    mRandState[2] = (now >> 32) & 0xFFFF;
-#endif
-    ALOGV("initializing random seed using %lld", (unsigned long long)now);
+        mTotalSize(0),
+        mOldest(NULL),
+        mYoungest(NULL),
+        mMappedData(NULL),
+        mMappedSize(0) {
+}
+
+BlobCache::~BlobCache() {
+    removeAll();
 }
 
 void BlobCache::set(const void* key, size_t keySize, const void* value,
         size_t valueSize) {
+    set(key, keySize, value, valueSize, true);
+}
+
+void BlobCache::set(const void* key, size_t keySize, const void* value,
+        size_t valueSize, bool copyData) {
     if (mMaxKeySize < keySize) {
         ALOGV("set: not caching because the key is too large: %zu (limit: %zu)",
                 keySize, mMaxKeySize);
@@ -78,56 +90,29 @@ void BlobCache::set(const void* key, size_t keySize, const void* value,
         return;
     }
 
-    sp<Blob> dummyKey(new Blob(key, keySize, false));
-    CacheEntry dummyEntry(dummyKey, NULL);
-
-    while (true) {
-        ssize_t index = mCacheEntries.indexOf(dummyEntry);
-        if (index < 0) {
-            // Create a new cache entry.
-            sp<Blob> keyBlob(new Blob(key, keySize, true));
-            sp<Blob> valueBlob(new Blob(value, valueSize, true));
-            size_t newTotalSize = mTotalSize + keySize + valueSize;
-            if (mMaxTotalSize < newTotalSize) {
-                if (isCleanable()) {
-                    // Clean the cache and try again.
-                    clean();
-                    continue;
-                } else {
-                    ALOGV("set: not caching new key/value pair because the "
-                            "total cache size limit would be exceeded: %zu "
-                            "(limit: %zu)",
-                            keySize + valueSize, mMaxTotalSize);
-                    break;
-                }
-            }
-            mCacheEntries.add(CacheEntry(keyBlob, valueBlob));
-            mTotalSize = newTotalSize;
-            ALOGV("set: created new cache entry with %zu byte key and %zu byte value",
-                    keySize, valueSize);
-        } else {
-            // Update the existing cache entry.
-            sp<Blob> valueBlob(new Blob(value, valueSize, true));
-            sp<Blob> oldValueBlob(mCacheEntries[index].getValue());
-            size_t newTotalSize = mTotalSize + valueSize - oldValueBlob->getSize();
-            if (mMaxTotalSize < newTotalSize) {
-                if (isCleanable()) {
-                    // Clean the cache and try again.
-                    clean();
-                    continue;
-                } else {
-                    ALOGV("set: not caching new value because the total cache "
-                            "size limit would be exceeded: %zu (limit: %zu)",
-                            keySize + valueSize, mMaxTotalSize);
-                    break;
-                }
-            }
-            mCacheEntries.editItemAt(index).setValue(valueBlob);
-            mTotalSize = newTotalSize;
-            ALOGV("set: updated existing cache entry with %zu byte key and %zu byte "
-                    "value", keySize, valueSize);
+    hash_t hash = hashKey(key, keySize);
+    ssize_t index = findEntry(hash, key, keySize);
+    if (index < 0) {
+        // Create a new cache entry.
+        evictFor(keySize + valueSize, NULL);
+        sp<Blob> keyBlob(new Blob(key, keySize, copyData));
+        sp<Blob> valueBlob(new Blob(value, valueSize, copyData));
+        addEntry(hash, keyBlob, valueBlob);
+        ALOGV("set: created new cache entry with %zu byte key and %zu byte value",
+                keySize, valueSize);
+    } else {
+        // Update the existing cache entry.
+        CacheEntry& entry(mCacheEntries.editEntryAt(index));
+        size_t oldValueSize = entry.getValue()->getSize();
+        detach(entry);
+        attach(entry);
+        if (valueSize > oldValueSize) {
+            evictFor(valueSize - oldValueSize, &entry);
         }
-        break;
+        entry.setValue(new Blob(value, valueSize, copyData));
+        mTotalSize = mTotalSize - oldValueSize + valueSize;
+        ALOGV("set: updated existing cache entry with %zu byte key and %zu byte "
+                "value", keySize, valueSize);
     }
 }
 
@@ -138,17 +123,19 @@ size_t BlobCache::get(const void* key, size_t keySize, void* value,
                 keySize, mMaxKeySize);
         return 0;
     }
-    sp<Blob> dummyKey(new Blob(key, keySize, false));
-    CacheEntry dummyEntry(dummyKey, NULL);
-    ssize_t index = mCacheEntries.indexOf(dummyEntry);
+    ssize_t index = findEntry(hashKey(key, keySize), key, keySize);
     if (index < 0) {
         ALOGV("get: no cache entry found for key of size %zu", keySize);
         return 0;
     }
 
-    // The key was found. Return the value if the caller's buffer is large
-    // enough.
-    sp<Blob> valueBlob(mCacheEntries[index].getValue());
+    // The key was found. Make it the most recently used, and return the value
+    // if the caller's buffer is large enough.
+    CacheEntry& entry(mCacheEntries.editEntryAt(index));
+    detach(entry);
+    attach(entry);
+
+    sp<Blob> valueBlob(entry.getValue());
     size_t valueBlobSize = valueBlob->getSize();
     if (valueBlobSize <= valueSize) {
         ALOGV("get: copying %zu bytes to caller's buffer", valueBlobSize);
@@ -166,13 +153,9 @@ static inline size_t align4(size_t size) {
 
 size_t BlobCache::getFlattenedSize() const {
     size_t size = sizeof(Header);
-    for (size_t i = 0; i < mCacheEntries.size(); i++) {
-        const CacheEntry& e(mCacheEntries[i]);
-        sp<Blob> keyBlob = e.getKey();
-        sp<Blob> valueBlob = e.getValue();
+    for (const CacheEntry* e = mOldest; e != NULL; e = e->mYounger) {
         size = align4(size);
-        size += sizeof(EntryHeader) + keyBlob->getSize() +
-                valueBlob->getSize();
+        size += sizeof(EntryHeader) + e->getSize();
     }
     return size;
 }
@@ -189,13 +172,12 @@ status_t BlobCache::flatten(void* buffer, size_t size) const {
     header->mDeviceVersion = blobCacheDeviceVersion;
     header->mNumEntries = mCacheEntries.size();
 
-    // Write cache entries
+    // Write cache entries, least recently used first
     uint8_t* byteBuffer = reinterpret_cast<uint8_t*>(buffer);
     off_t byteOffset = align4(sizeof(Header));
-    for (size_t i = 0; i < mCacheEntries.size(); i++) {
-        const CacheEntry& e(mCacheEntries[i]);
-        sp<Blob> keyBlob = e.getKey();
-        sp<Blob> valueBlob = e.getValue();
+    for (const CacheEntry* e = mOldest; e != NULL; e = e->mYounger) {
+        sp<Blob> keyBlob = e->getKeyBlob();
+        sp<Blob> valueBlob = e->getValue();
         size_t keySize = keyBlob->getSize();
         size_t valueSize = valueBlob->getSize();
 
@@ -221,8 +203,11 @@ status_t BlobCache::flatten(void* buffer, size_t size) const {
 
 status_t BlobCache::unflatten(void const* buffer, size_t size) {
     // All errors should result in the BlobCache being in an empty state.
-    mCacheEntries.clear();
+    removeAll();
+    return unflatten(buffer, size, true);
+}
 
+status_t BlobCache::unflatten(void const* buffer, size_t size, bool copyData) {
     // Read the cache header
     if (size < sizeof(Header)) {
         ALOGE("unflatten: not enough room for cache header");
@@ -239,13 +224,21 @@ status_t BlobCache::unflatten(void const* buffer, size_t size) {
         return OK;
     }
 
-    // Read cache entries
+    // Read cache entries.  They were written least recently used first, so
+    // inserting them in order restores the recently used list.
     const uint8_t* byteBuffer = reinterpret_cast<const uint8_t*>(buffer);
     off_t byteOffset = align4(sizeof(Header));
     size_t numEntries = header->mNumEntries;
+    // Don't trust the count to size the table; a corrupt one could ask
+    // for more than can be allocated, and the entries are checked below.
+    size_t maxEntries = (size - sizeof(Header)) / sizeof(EntryHeader);
+    size_t expectedEntries = numEntries < maxEntries ? numEntries : maxEntries;
+    if (mCacheEntries.capacity() < expectedEntries) {
+        rehash(expectedEntries);
+    }
     for (size_t i = 0; i < numEntries; i++) {
         if (byteOffset + sizeof(EntryHeader) > size) {
-            mCacheEntries.clear();
+            removeAll();
             ALOGE("unflatten: not enough room for cache entry headers");
             return BAD_VALUE;
         }
@@ -257,13 +250,13 @@ status_t BlobCache::unflatten(void const* buffer, size_t size) {
         size_t entrySize = sizeof(EntryHeader) + keySize + valueSize;
 
         if (byteOffset + entrySize > size) {
-            mCacheEntries.clear();
+            removeAll();
             ALOGE("unflatten: not enough room for cache entry headers");
             return BAD_VALUE;
         }
 
         const uint8_t* data = eheader->mData;
-        set(data, keySize, data + keySize, valueSize);
+        set(data, keySize, data + keySize, valueSize, copyData);
 
         byteOffset += align4(entrySize);
     }
@@ -271,27 +264,187 @@ status_t BlobCache::unflatten(void const* buffer, size_t size) {
     return OK;
 }
 
-long int BlobCache::blob_random() {
-#ifdef _WIN32
-    return rand();
+static status_t writeFully(int fd, const void* data, size_t size) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    while (size > 0) {
+        ssize_t n = TEMP_FAILURE_RETRY(write(fd, p, size));
+        if (n <= 0) {
+            ALOGE("writeToFile: write failed: %s", strerror(errno));
+            return n < 0 ? -errno : UNKNOWN_ERROR;
+        }
+        p += n;
+        size -= n;
+    }
+    return OK;
+}
+
+status_t BlobCache::writeToFile(int fd) const {
+    static const uint8_t padding[4] = { 0, 0, 0, 0 };
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    header.mMagicNumber = blobCacheMagic;
+    header.mBlobCacheVersion = blobCacheVersion;
+    header.mDeviceVersion = blobCacheDeviceVersion;
+    header.mNumEntries = mCacheEntries.size();
+
+    status_t err = writeFully(fd, &header, sizeof(header));
+    size_t offset = sizeof(header);
+    for (const CacheEntry* e = mOldest; err == OK && e != NULL; e = e->mYounger) {
+        sp<Blob> keyBlob = e->getKeyBlob();
+        sp<Blob> valueBlob = e->getValue();
+
+        if (offset != align4(offset)) {
+            err = writeFully(fd, padding, align4(offset) - offset);
+            offset = align4(offset);
+        }
+
+        EntryHeader eheader;
+        eheader.mKeySize = keyBlob->getSize();
+        eheader.mValueSize = valueBlob->getSize();
+        if (err == OK) {
+            err = writeFully(fd, &eheader, sizeof(eheader));
+        }
+        if (err == OK) {
+            err = writeFully(fd, keyBlob->getData(), eheader.mKeySize);
+        }
+        if (err == OK) {
+            err = writeFully(fd, valueBlob->getData(), eheader.mValueSize);
+        }
+        offset += sizeof(eheader) + eheader.mKeySize + eheader.mValueSize;
+    }
+    return err;
+}
+
+status_t BlobCache::mapFromFile(int fd) {
+    // All errors should result in the BlobCache being in an empty state.
+    removeAll();
+
+#ifdef HAVE_POSIX_FILEMAP
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        ALOGE("mapFromFile: fstat failed: %s", strerror(errno));
+        return -errno;
+    }
+    if (st.st_size <= 0) {
+        ALOGE("mapFromFile: not enough room for cache header");
+        return BAD_VALUE;
+    }
+
+    size_t size = st.st_size;
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        ALOGE("mapFromFile: mmap failed: %s", strerror(errno));
+        return -errno;
+    }
+    mMappedData = data;
+    mMappedSize = size;
+
+    status_t err = unflatten(data, size, false);
+    if (err != OK || mCacheEntries.size() == 0) {
+        // Nothing refers into the mapping, so drop it now.
+        removeAll();
+    }
+    return err;
 #else
-    return nrand48(mRandState);
+    ALOGE("mapFromFile: file mappings are not supported");
+    return INVALID_OPERATION;
 #endif
 }
 
-void BlobCache::clean() {
-    // Remove a random cache entry until the total cache size gets below half
-    // the maximum total cache size.
-    while (mTotalSize > mMaxTotalSize / 2) {
-        size_t i = size_t(blob_random() % (mCacheEntries.size()));
-        const CacheEntry& entry(mCacheEntries[i]);
-        mTotalSize -= entry.getKey()->getSize() + entry.getValue()->getSize();
-        mCacheEntries.removeAt(i);
+hash_t BlobCache::hashKey(const void* key, size_t keySize) {
+    return JenkinsHashWhiten(JenkinsHashMixBytes(0,
+            reinterpret_cast<const uint8_t*>(key), keySize));
+}
+
+ssize_t BlobCache::findEntry(hash_t hash, const void* key, size_t keySize) const {
+    return mCacheEntries.find(-1, hash, KeyRef(key, keySize));
+}
+
+void BlobCache::addEntry(hash_t hash, const sp<Blob>& key, const sp<Blob>& value) {
+    if (!mCacheEntries.hasMoreRoom()) {
+        rehash(mCacheEntries.capacity() * 2);
+    }
+    CacheEntry newEntry(key, value);
+    ssize_t index = mCacheEntries.add(hash, newEntry);
+    CacheEntry& entry(mCacheEntries.editEntryAt(index));
+    attach(entry);
+    mTotalSize += entry.getSize();
+}
+
+void BlobCache::removeEntry(ssize_t index) {
+    CacheEntry& entry(mCacheEntries.editEntryAt(index));
+    detach(entry);
+    mTotalSize -= entry.getSize();
+    mCacheEntries.removeAt(index);
+}
+
+void BlobCache::evictFor(size_t size, const CacheEntry* keep) {
+    // keep is the most recently used entry, so stopping at it leaves it last.
+    while (mTotalSize + size > mMaxTotalSize && mOldest != NULL && mOldest != keep) {
+        const KeyRef& key(mOldest->getKey());
+        ALOGV("evictFor: evicting entry with %zu byte key", key.mSize);
+        removeEntry(findEntry(hashKey(key.mData, key.mSize), key.mData, key.mSize));
+    }
+}
+
+void BlobCache::attach(CacheEntry& entry) {
+    if (mYoungest == NULL) {
+        mYoungest = mOldest = &entry;
+    } else {
+        entry.mOlder = mYoungest;
+        mYoungest->mYounger = &entry;
+        mYoungest = &entry;
+    }
+}
+
+void BlobCache::detach(CacheEntry& entry) {
+    if (entry.mOlder != NULL) {
+        entry.mOlder->mYounger = entry.mYounger;
+    } else {
+        mOldest = entry.mYounger;
     }
+    if (entry.mYounger != NULL) {
+        entry.mYounger->mOlder = entry.mOlder;
+    } else {
+        mYoungest = entry.mOlder;
+    }
+
+    entry.mOlder = NULL;
+    entry.mYounger = NULL;
 }
 
-bool BlobCache::isCleanable() const {
-    return mTotalSize > mMaxTotalSize / 2;
+void BlobCache::rehash(size_t newCapacity) {
+    // The entries move to new buckets, so rebuild the list in the same order.
+    CacheEntry* oldest = mOldest;
+    mOldest = NULL;
+    mYoungest = NULL;
+    {
+        BasicHashtable<KeyRef, CacheEntry> newEntries(newCapacity);
+        for (CacheEntry* e = oldest; e != NULL; e = e->mYounger) {
+            const KeyRef& key(e->getKey());
+            CacheEntry newEntry(e->getKeyBlob(), e->getValue());
+            ssize_t index = newEntries.add(hashKey(key.mData, key.mSize), newEntry);
+            attach(newEntries.editEntryAt(index));
+        }
+        // The storage is shared, not copied, so the links stay valid once
+        // newEntries goes away.
+        mCacheEntries = newEntries;
+    }
+}
+
+void BlobCache::removeAll() {
+    mCacheEntries.clear();
+    mOldest = NULL;
+    mYoungest = NULL;
+    mTotalSize = 0;
+#ifdef HAVE_POSIX_FILEMAP
+    if (mMappedData != NULL) {
+        munmap(mMappedData, mMappedSize);
+    }
+#endif
+    mMappedData = NULL;
+    mMappedSize = 0;
 }
 
 BlobCache::Blob::Blob(const void* data, size_t size, bool copyData):
@@ -309,14 +462,6 @@ BlobCache::Blob::~Blob() {
     }
 }
 
-bool BlobCache::Blob::operator<(const Blob& rhs) const {
-    if (mSize == rhs.mSize) {
-        return memcmp(mData, rhs.mData, mSize) < 0;
-    } else {
-        return mSize < rhs.mSize;
-    }
-}
-
 const void* BlobCache::Blob::getData() const {
     return mData;
 }
@@ -325,30 +470,49 @@ size_t BlobCache::Blob::getSize() const {
     return mSize;
 }
 
-BlobCache::CacheEntry::CacheEntry() {
+BlobCache::KeyRef::KeyRef(const void* data, size_t size):
+        mData(data),
+        mSize(size) {
+}
+
+bool BlobCache::KeyRef::operator==(const KeyRef& rhs) const {
+    return mSize == rhs.mSize && memcmp(mData, rhs.mData, mSize) == 0;
+}
+
+bool BlobCache::KeyRef::operator!=(const KeyRef& rhs) const {
+    return !(*this == rhs);
 }
 
 BlobCache::CacheEntry::CacheEntry(const sp<Blob>& key, const sp<Blob>& value):
+        mOlder(NULL),
+        mYounger(NULL),
         mKey(key),
+        mKeyRef(key->getData(), key->getSize()),
         mValue(value) {
 }
 
 BlobCache::CacheEntry::CacheEntry(const CacheEntry& ce):
+        mOlder(ce.mOlder),
+        mYounger(ce.mYounger),
         mKey(ce.mKey),
+        mKeyRef(ce.mKeyRef),
         mValue(ce.mValue) {
 }
 
-bool BlobCache::CacheEntry::operator<(const CacheEntry& rhs) const {
-    return *mKey < *rhs.mKey;
-}
-
 const BlobCache::CacheEntry& BlobCache::CacheEntry::operator=(const CacheEntry& rhs) {
+    mOlder = rhs.mOlder;
+    mYounger = rhs.mYounger;
     mKey = rhs.mKey;
+    mKeyRef = rhs.mKeyRef;
     mValue = rhs.mValue;
     return *this;
 }
 
-sp<BlobCache::Blob> BlobCache::CacheEntry::getKey() const {
+const BlobCache::KeyRef& BlobCache::CacheEntry::getKey() const {
+    return mKeyRef;
+}
+
+sp<BlobCache::Blob> BlobCache::CacheEntry::getKeyBlob() const {
     return mKey;
 }
 
@@ -356,6 +520,10 @@ sp<BlobCache::Blob> BlobCache::CacheEntry::getValue() const {
     return mValue;
 }
 
+size_t BlobCache::CacheEntry::getSize() const {
+    return mKey->getSize() + mValue->getSize();
+}
+
 void BlobCache::CacheEntry::setValue(const sp<Blob>& value) {
     mValue = value;
 }
@@ -20,6 +20,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <sys/eventfd.h>
 
 
 namespace android {
@@ -61,47 +62,34 @@ int SimpleLooperCallback::handleEvent(int fd, int events, void* data) {
 static const int EPOLL_SIZE_HINT = 8;
 
 // Maximum number of file descriptors for which to retrieve poll events each iteration.
-static const int EPOLL_MAX_EVENTS = 16;
+static const int EPOLL_MAX_EVENTS = 128;
 
 static pthread_once_t gTLSOnce = PTHREAD_ONCE_INIT;
 static pthread_key_t gTLSKey = 0;
 
 Looper::Looper(bool allowNonCallbacks) :
-        mAllowNonCallbacks(allowNonCallbacks), mSendingMessage(false),
-        mResponseIndex(0), mNextMessageUptime(LLONG_MAX) {
-    int wakeFds[2];
-    int result = pipe(wakeFds);
-    LOG_ALWAYS_FATAL_IF(result != 0, "Could not create wake pipe.  errno=%d", errno);
-
-    mWakeReadPipeFd = wakeFds[0];
-    mWakeWritePipeFd = wakeFds[1];
-
-    result = fcntl(mWakeReadPipeFd, F_SETFL, O_NONBLOCK);
-    LOG_ALWAYS_FATAL_IF(result != 0, "Could not make wake read pipe non-blocking.  errno=%d",
-            errno);
-
-    result = fcntl(mWakeWritePipeFd, F_SETFL, O_NONBLOCK);
-    LOG_ALWAYS_FATAL_IF(result != 0, "Could not make wake write pipe non-blocking.  errno=%d",
-            errno);
+        mAllowNonCallbacks(allowNonCallbacks), mNextMessageSequence(0),
+        mSendingMessage(false), mResponseIndex(0), mNextMessageUptime(LLONG_MAX) {
+    mWakeEventFd = eventfd(0, EFD_NONBLOCK);
+    LOG_ALWAYS_FATAL_IF(mWakeEventFd < 0, "Could not create wake event fd.  errno=%d", errno);
 
     mIdling = false;
 
-    // Allocate the epoll instance and register the wake pipe.
+    // Allocate the epoll instance and register the wake event fd.
     mEpollFd = epoll_create(EPOLL_SIZE_HINT);
     LOG_ALWAYS_FATAL_IF(mEpollFd < 0, "Could not create epoll instance.  errno=%d", errno);
 
     struct epoll_event eventItem;
     memset(& eventItem, 0, sizeof(epoll_event)); // zero out unused members of data field union
     eventItem.events = EPOLLIN;
-    eventItem.data.fd = mWakeReadPipeFd;
-    result = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeReadPipeFd, & eventItem);
-    LOG_ALWAYS_FATAL_IF(result != 0, "Could not add wake read pipe to epoll instance.  errno=%d",
+    eventItem.data.fd = mWakeEventFd;
+    int result = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeEventFd, & eventItem);
+    LOG_ALWAYS_FATAL_IF(result != 0, "Could not add wake event fd to epoll instance.  errno=%d",
             errno);
 }
 
 Looper::~Looper() {
-    close(mWakeReadPipeFd);
-    close(mWakeWritePipeFd);
+    close(mWakeEventFd);
     close(mEpollFd);
 }
 
@@ -255,21 +243,20 @@ int Looper::pollInner(int timeoutMillis) {
     for (int i = 0; i < eventCount; i++) {
         int fd = eventItems[i].data.fd;
         uint32_t epollEvents = eventItems[i].events;
-        if (fd == mWakeReadPipeFd) {
+        if (fd == mWakeEventFd) {
             if (epollEvents & EPOLLIN) {
                 awoken();
             } else {
-                ALOGW("Ignoring unexpected epoll events 0x%x on wake read pipe.", epollEvents);
+                ALOGW("Ignoring unexpected epoll events 0x%x on wake event fd.", epollEvents);
             }
         } else {
-            ssize_t requestIndex = mRequests.indexOfKey(fd);
-            if (requestIndex >= 0) {
+            if (isFdRegisteredLocked(fd)) {
                 int events = 0;
                 if (epollEvents & EPOLLIN) events |= EVENT_INPUT;
                 if (epollEvents & EPOLLOUT) events |= EVENT_OUTPUT;
                 if (epollEvents & EPOLLERR) events |= EVENT_ERROR;
                 if (epollEvents & EPOLLHUP) events |= EVENT_HANGUP;
-                pushResponse(events, mRequests.valueAt(requestIndex));
+                pushResponse(events, mRequests.itemAt(fd));
             } else {
                 ALOGW("Ignoring unexpected epoll events 0x%x on fd %d that is "
                         "no longer registered.", epollEvents, fd);
@@ -291,7 +278,7 @@ Done: ;
             { // obtain handler
                 sp<MessageHandler> handler = messageEnvelope.handler;
                 Message message = messageEnvelope.message;
-                mMessageEnvelopes.removeAt(0);
+                removeFirstMessage();
                 mSendingMessage = true;
                 mLock.unlock();
 
@@ -370,12 +357,13 @@ void Looper::wake() {
     ALOGD("%p ~ wake", this);
 #endif
 
+    uint64_t inc = 1;
     ssize_t nWrite;
     do {
-        nWrite = write(mWakeWritePipeFd, "W", 1);
+        nWrite = write(mWakeEventFd, &inc, sizeof(uint64_t));
     } while (nWrite == -1 && errno == EINTR);
 
-    if (nWrite != 1) {
+    if (nWrite != sizeof(uint64_t)) {
         if (errno != EAGAIN) {
             ALOGW("Could not write wake signal, errno=%d", errno);
         }
@@ -387,11 +375,12 @@ void Looper::awoken() {
     ALOGD("%p ~ awoken", this);
 #endif
 
-    char buffer[16];
+    // A single read resets the counter however many wakes were posted.
+    uint64_t counter;
     ssize_t nRead;
     do {
-        nRead = read(mWakeReadPipeFd, buffer, sizeof(buffer));
-    } while ((nRead == -1 && errno == EINTR) || nRead == sizeof(buffer));
+        nRead = read(mWakeEventFd, &counter, sizeof(uint64_t));
+    } while (nRead == -1 && errno == EINTR);
 }
 
 void Looper::pushResponse(int events, const Request& request) {
@@ -411,55 +400,93 @@ int Looper::addFd(int fd, int ident, int events, const sp<LooperCallback>& callb
             events, callback.get(), data);
 #endif
 
+    if (!checkFdRequest(ident, callback)) {
+        return -1;
+    }
+
+    AutoMutex _l(mLock);
+    return addFdLocked(fd, ident, events, callback, data);
+}
+
+int Looper::addFds(const FdRegistration* registrations, size_t count) {
+    int added = 0;
+
+    AutoMutex _l(mLock);
+    for (size_t i = 0; i < count; i++) {
+        const FdRegistration& registration = registrations[i];
+#if DEBUG_CALLBACKS
+        ALOGD("%p ~ addFds - fd=%d, ident=%d, events=0x%x, callback=%p, data=%p", this,
+                registration.fd, registration.ident, registration.events,
+                registration.callback.get(), registration.data);
+#endif
+        if (checkFdRequest(registration.ident, registration.callback)
+                && addFdLocked(registration.fd, registration.ident, registration.events,
+                        registration.callback, registration.data) > 0) {
+            added += 1;
+        }
+    }
+    return added;
+}
+
+bool Looper::checkFdRequest(int ident, const sp<LooperCallback>& callback) const {
     if (!callback.get()) {
         if (! mAllowNonCallbacks) {
             ALOGE("Invalid attempt to set NULL callback but not allowed for this looper.");
-            return -1;
+            return false;
         }
 
         if (ident < 0) {
             ALOGE("Invalid attempt to set NULL callback with ident < 0.");
-            return -1;
+            return false;
         }
-    } else {
+    }
+    return true;
+}
+
+int Looper::addFdLocked(int fd, int ident, int events, const sp<LooperCallback>& callback,
+        void* data) {
+    if (fd < 0) {
+        ALOGE("Invalid attempt to add fd %d.", fd);
+        return -1;
+    }
+
+    if (callback.get()) {
         ident = POLL_CALLBACK;
     }
 
     int epollEvents = 0;
     if (events & EVENT_INPUT) epollEvents |= EPOLLIN;
     if (events & EVENT_OUTPUT) epollEvents |= EPOLLOUT;
+    if (events & EVENT_EDGE_TRIGGERED) epollEvents |= EPOLLET;
 
-    { // acquire lock
-        AutoMutex _l(mLock);
+    Request request;
+    request.fd = fd;
+    request.ident = ident;
+    request.callback = callback;
+    request.data = data;
 
-        Request request;
-        request.fd = fd;
-        request.ident = ident;
-        request.callback = callback;
-        request.data = data;
-
-        struct epoll_event eventItem;
-        memset(& eventItem, 0, sizeof(epoll_event)); // zero out unused members of data field union
-        eventItem.events = epollEvents;
-        eventItem.data.fd = fd;
-
-        ssize_t requestIndex = mRequests.indexOfKey(fd);
-        if (requestIndex < 0) {
-            int epollResult = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, & eventItem);
-            if (epollResult < 0) {
-                ALOGE("Error adding epoll events for fd %d, errno=%d", fd, errno);
-                return -1;
-            }
-            mRequests.add(fd, request);
-        } else {
-            int epollResult = epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, & eventItem);
-            if (epollResult < 0) {
-                ALOGE("Error modifying epoll events for fd %d, errno=%d", fd, errno);
-                return -1;
-            }
-            mRequests.replaceValueAt(requestIndex, request);
+    struct epoll_event eventItem;
+    memset(& eventItem, 0, sizeof(epoll_event)); // zero out unused members of data field union
+    eventItem.events = epollEvents;
+    eventItem.data.fd = fd;
+
+    if (!isFdRegisteredLocked(fd)) {
+        int epollResult = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, & eventItem);
+        if (epollResult < 0) {
+            ALOGE("Error adding epoll events for fd %d, errno=%d", fd, errno);
+            return -1;
         }
-    } // release lock
+        if (size_t(fd) >= mRequests.size()) {
+            mRequests.insertAt(Request(), mRequests.size(), fd + 1 - mRequests.size());
+        }
+    } else {
+        int epollResult = epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, & eventItem);
+        if (epollResult < 0) {
+            ALOGE("Error modifying epoll events for fd %d, errno=%d", fd, errno);
+            return -1;
+        }
+    }
+    mRequests.replaceAt(request, fd);
     return 1;
 }
 
@@ -470,8 +497,7 @@ int Looper::removeFd(int fd) {
 
     { // acquire lock
         AutoMutex _l(mLock);
-        ssize_t requestIndex = mRequests.indexOfKey(fd);
-        if (requestIndex < 0) {
+        if (!isFdRegisteredLocked(fd)) {
             return 0;
         }
 
@@ -481,7 +507,7 @@ int Looper::removeFd(int fd) {
             return -1;
         }
 
-        mRequests.removeItemsAt(requestIndex);
+        mRequests.replaceAt(Request(), fd);
     } // release lock
     return 1;
 }
@@ -508,13 +534,8 @@ void Looper::sendMessageAtTime(nsecs_t uptime, const sp<MessageHandler>& handler
     { // acquire lock
         AutoMutex _l(mLock);
 
-        size_t messageCount = mMessageEnvelopes.size();
-        while (i < messageCount && uptime >= mMessageEnvelopes.itemAt(i).uptime) {
-            i += 1;
-        }
-
-        MessageEnvelope messageEnvelope(uptime, handler, message);
-        mMessageEnvelopes.insertAt(messageEnvelope, i, 1);
+        MessageEnvelope messageEnvelope(uptime, mNextMessageSequence++, handler, message);
+        i = siftMessageUp(mMessageEnvelopes.add(messageEnvelope));
 
         // Optimization: If the Looper is currently sending a message, then we can skip
         // the call to wake() because the next thing the Looper will do after processing
@@ -539,12 +560,21 @@ void Looper::removeMessages(const sp<MessageHandler>& handler) {
     { // acquire lock
         AutoMutex _l(mLock);
 
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
-            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
-            if (messageEnvelope.handler == handler) {
-                mMessageEnvelopes.removeAt(i);
+        size_t messageCount = mMessageEnvelopes.size();
+        size_t keep = 0;
+        for (size_t i = 0; i < messageCount; i++) {
+            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(i);
+            if (messageEnvelope.handler != handler) {
+                if (keep != i) {
+                    mMessageEnvelopes.replaceAt(messageEnvelope, keep);
+                }
+                keep += 1;
             }
         }
+        if (keep != messageCount) {
+            mMessageEnvelopes.removeItemsAt(keep, messageCount - keep);
+            rebuildMessageHeap();
+        }
     } // release lock
 }
 
@@ -556,16 +586,79 @@ void Looper::removeMessages(const sp<MessageHandler>& handler, int what) {
     { // acquire lock
         AutoMutex _l(mLock);
 
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
-            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
-            if (messageEnvelope.handler == handler
-                    && messageEnvelope.message.what == what) {
-                mMessageEnvelopes.removeAt(i);
+        size_t messageCount = mMessageEnvelopes.size();
+        size_t keep = 0;
+        for (size_t i = 0; i < messageCount; i++) {
+            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(i);
+            if (messageEnvelope.handler != handler
+                    || messageEnvelope.message.what != what) {
+                if (keep != i) {
+                    mMessageEnvelopes.replaceAt(messageEnvelope, keep);
+                }
+                keep += 1;
             }
         }
+        if (keep != messageCount) {
+            mMessageEnvelopes.removeItemsAt(keep, messageCount - keep);
+            rebuildMessageHeap();
+        }
     } // release lock
 }
 
+size_t Looper::siftMessageUp(size_t index) {
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (!mMessageEnvelopes.itemAt(index).isBefore(mMessageEnvelopes.itemAt(parent))) {
+            break;
+        }
+        MessageEnvelope messageEnvelope = mMessageEnvelopes.itemAt(index);
+        mMessageEnvelopes.replaceAt(mMessageEnvelopes.itemAt(parent), index);
+        mMessageEnvelopes.replaceAt(messageEnvelope, parent);
+        index = parent;
+    }
+    return index;
+}
+
+void Looper::siftMessageDown(size_t index) {
+    size_t messageCount = mMessageEnvelopes.size();
+    for (;;) {
+        size_t first = index;
+        size_t left = 2 * index + 1;
+        size_t right = left + 1;
+        if (left < messageCount
+                && mMessageEnvelopes.itemAt(left).isBefore(mMessageEnvelopes.itemAt(first))) {
+            first = left;
+        }
+        if (right < messageCount
+                && mMessageEnvelopes.itemAt(right).isBefore(mMessageEnvelopes.itemAt(first))) {
+            first = right;
+        }
+        if (first == index) {
+            break;
+        }
+        MessageEnvelope messageEnvelope = mMessageEnvelopes.itemAt(index);
+        mMessageEnvelopes.replaceAt(mMessageEnvelopes.itemAt(first), index);
+        mMessageEnvelopes.replaceAt(messageEnvelope, first);
+        index = first;
+    }
+}
+
+void Looper::removeFirstMessage() {
+    // Fill the hole with the last message and sift it back down.
+    size_t last = mMessageEnvelopes.size() - 1;
+    if (last != 0) {
+        mMessageEnvelopes.replaceAt(mMessageEnvelopes.itemAt(last), 0);
+    }
+    mMessageEnvelopes.removeAt(last);
+    siftMessageDown(0);
+}
+
+void Looper::rebuildMessageHeap() {
+    for (size_t i = mMessageEnvelopes.size() / 2; i != 0; ) {
+        siftMessageDown(--i);
+    }
+}
+
 bool Looper::isIdling() const {
     return mIdling;
 }
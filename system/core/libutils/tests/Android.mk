@@ -7,6 +7,7 @@ test_src_files := \
     BasicHashtable_test.cpp \
     BlobCache_test.cpp \
     BitSet_test.cpp \
+    ConcurrentLruCache_test.cpp \
     Looper_test.cpp \
     LruCache_test.cpp \
     String8_test.cpp \
@@ -32,3 +33,27 @@ $(foreach file,$(test_src_files), \
     $(eval LOCAL_MODULE := $(notdir $(file:%.cpp=%))) \
     $(eval include $(BUILD_NATIVE_TEST)) \
 )
+
+# Build the benchmarks. (see ../../liblog/tests) Run with:
+#   adb shell /data/nativetest/libutils-benchmarks/libutils-benchmarks
+include $(CLEAR_VARS)
+LOCAL_MODULE := libutils-benchmarks
+LOCAL_MODULE_TAGS := tests
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+LOCAL_CFLAGS += \
+    -I$(LOCAL_PATH)/../../liblog/tests \
+    -Wall \
+    -Werror \
+    -fno-builtin \
+    -std=gnu++11
+LOCAL_SHARED_LIBRARIES := liblog libcutils libutils
+LOCAL_SRC_FILES := \
+    ../../liblog/tests/benchmark_main.cpp \
+    Looper_benchmark.cpp \
+    LruCache_benchmark.cpp
+ifndef LOCAL_SDK_VERSION
+LOCAL_C_INCLUDES += bionic bionic/libstdc++/include external/stlport/stlport
+LOCAL_SHARED_LIBRARIES += libstlport
+endif
+LOCAL_MODULE_PATH := $(TARGET_OUT_DATA_NATIVE_TESTS)/$(LOCAL_MODULE)
+include $(BUILD_EXECUTABLE)
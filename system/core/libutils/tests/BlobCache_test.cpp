@@ -16,6 +16,8 @@
 
 #include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <gtest/gtest.h>
 
@@ -235,27 +237,68 @@ TEST_F(BlobCacheTest, CacheSizeDoesntExceedTotalLimit) {
     ASSERT_GE(MAX_TOTAL_SIZE / 2, numCached);
 }
 
-TEST_F(BlobCacheTest, ExceedingTotalLimitHalvesCacheSize) {
+TEST_F(BlobCacheTest, ExceedingTotalLimitEvictsLeastRecentlyUsed) {
     // Fill up the entire cache with 1 char key/value pairs.
     const int maxEntries = MAX_TOTAL_SIZE / 2;
     for (int i = 0; i < maxEntries; i++) {
         uint8_t k = i;
         mBC->set(&k, 1, "x", 1);
     }
+    // Use the first entry, so the second is now the least recently used.
+    {
+        uint8_t k = 0;
+        ASSERT_EQ(size_t(1), mBC->get(&k, 1, NULL, 0));
+    }
     // Insert one more entry, causing a cache overflow.
     {
         uint8_t k = maxEntries;
         mBC->set(&k, 1, "x", 1);
     }
-    // Count the number of entries in the cache.
-    int numCached = 0;
+    // Only the least recently used entry should have been evicted.
     for (int i = 0; i < maxEntries+1; i++) {
+        SCOPED_TRACE(i);
         uint8_t k = i;
-        if (mBC->get(&k, 1, NULL, 0) == 1) {
-            numCached++;
-        }
+        ASSERT_EQ(size_t(i == 1 ? 0 : 1), mBC->get(&k, 1, NULL, 0));
+    }
+}
+
+TEST_F(BlobCacheTest, ExceedingTotalLimitEvictsUntilEntryFits) {
+    mBC->set("a", 1, "x", 1);
+    mBC->set("b", 1, "x", 1);
+    mBC->set("c", 1, "x", 1);
+    mBC->set("d", 1, "x", 1);
+    // 8 bytes used, so an 8 byte entry needs the two oldest evicted.
+    mBC->set("efg", 3, "yyyyy", 5);
+    ASSERT_EQ(size_t(0), mBC->get("a", 1, NULL, 0));
+    ASSERT_EQ(size_t(0), mBC->get("b", 1, NULL, 0));
+    ASSERT_EQ(size_t(1), mBC->get("c", 1, NULL, 0));
+    ASSERT_EQ(size_t(1), mBC->get("d", 1, NULL, 0));
+    ASSERT_EQ(size_t(5), mBC->get("efg", 3, NULL, 0));
+}
+
+TEST_F(BlobCacheTest, GrowingValueDoesntEvictItsOwnEntry) {
+    mBC->set("b", 1, "x", 1);
+    mBC->set("a", 1, "x", 1);
+    mBC->set("c", 1, "x", 1);
+    mBC->set("d", 1, "x", 1);
+    // "b" is the oldest, but growing it by 7 bytes should evict "a" instead.
+    mBC->set("b", 1, "yyyyyyyy", 8);
+    ASSERT_EQ(size_t(0), mBC->get("a", 1, NULL, 0));
+    ASSERT_EQ(size_t(1), mBC->get("c", 1, NULL, 0));
+    ASSERT_EQ(size_t(1), mBC->get("d", 1, NULL, 0));
+    ASSERT_EQ(size_t(8), mBC->get("b", 1, NULL, 0));
+}
+
+TEST_F(BlobCacheTest, ManyEntriesAreFound) {
+    sp<BlobCache> bc(new BlobCache(sizeof(int), sizeof(int), 1024 * 2 * sizeof(int)));
+    for (int i = 0; i < 1024; i++) {
+        bc->set(&i, sizeof(i), &i, sizeof(i));
+    }
+    for (int i = 0; i < 1024; i++) {
+        int v = -1;
+        ASSERT_EQ(sizeof(v), bc->get(&i, sizeof(i), &v, sizeof(v)));
+        ASSERT_EQ(i, v);
     }
-    ASSERT_EQ(maxEntries/2 + 1, numCached);
 }
 
 class BlobCacheFlattenTest : public BlobCacheTest {
@@ -333,6 +376,99 @@ TEST_F(BlobCacheFlattenTest, FlattenDoesntChangeCache) {
     }
 }
 
+TEST_F(BlobCacheFlattenTest, FlattenKeepsRecentlyUsedOrder) {
+    // Fill up the entire cache with 1 char key/value pairs.
+    const int maxEntries = MAX_TOTAL_SIZE / 2;
+    for (int i = 0; i < maxEntries; i++) {
+        uint8_t k = i;
+        mBC->set(&k, 1, &k, 1);
+    }
+    {
+        uint8_t k = 0;
+        ASSERT_EQ(size_t(1), mBC->get(&k, 1, NULL, 0));
+    }
+
+    roundTrip();
+
+    // Overflowing the deserialized cache should evict the same entry as the
+    // original would.
+    {
+        uint8_t k = maxEntries;
+        mBC2->set(&k, 1, &k, 1);
+    }
+    for (int i = 0; i < maxEntries+1; i++) {
+        SCOPED_TRACE(i);
+        uint8_t k = i;
+        ASSERT_EQ(size_t(i == 1 ? 0 : 1), mBC2->get(&k, 1, NULL, 0));
+    }
+}
+
+TEST_F(BlobCacheFlattenTest, WriteToFileMatchesFlatten) {
+    mBC->set("abcd", 4, "efgh", 4);
+    mBC->set("x", 1, "yz", 2);
+
+    // flatten leaves padding untouched, writeToFile writes it as zeroes.
+    size_t size = mBC->getFlattenedSize();
+    uint8_t* flat = new uint8_t[size];
+    memset(flat, 0, size);
+    ASSERT_EQ(OK, mBC->flatten(flat, size));
+
+    FILE* file = tmpfile();
+    ASSERT_TRUE(file != NULL);
+    int fd = fileno(file);
+    ASSERT_EQ(OK, mBC->writeToFile(fd));
+    ASSERT_EQ(off_t(size), lseek(fd, 0, SEEK_END));
+
+    uint8_t* written = new uint8_t[size];
+    ASSERT_EQ(ssize_t(size), pread(fd, written, size, 0));
+    ASSERT_EQ(0, memcmp(flat, written, size));
+
+    delete[] written;
+    delete[] flat;
+    fclose(file);
+}
+
+TEST_F(BlobCacheFlattenTest, MapFromFileLoadsEntries) {
+    unsigned char buf[4] = { 0xee, 0xee, 0xee, 0xee };
+    mBC->set("abcd", 4, "efgh", 4);
+    mBC->set("x", 1, "yz", 2);
+
+    FILE* file = tmpfile();
+    ASSERT_TRUE(file != NULL);
+    ASSERT_EQ(OK, mBC->writeToFile(fileno(file)));
+    ASSERT_EQ(OK, mBC2->mapFromFile(fileno(file)));
+    fclose(file);
+
+    ASSERT_EQ(size_t(4), mBC2->get("abcd", 4, buf, 4));
+    ASSERT_EQ('e', buf[0]);
+    ASSERT_EQ('h', buf[3]);
+    ASSERT_EQ(size_t(2), mBC2->get("x", 1, buf, 4));
+    ASSERT_EQ('y', buf[0]);
+    ASSERT_EQ('z', buf[1]);
+
+    // Entries set after loading replace the mapped ones.
+    mBC2->set("x", 1, "w", 1);
+    ASSERT_EQ(size_t(1), mBC2->get("x", 1, buf, 4));
+    ASSERT_EQ('w', buf[0]);
+}
+
+TEST_F(BlobCacheFlattenTest, MapFromFileCatchesBadMagic) {
+    mBC->set("abcd", 4, "efgh", 4);
+    mBC2->set("x", 1, "y", 1);
+
+    FILE* file = tmpfile();
+    ASSERT_TRUE(file != NULL);
+    ASSERT_EQ(OK, mBC->writeToFile(fileno(file)));
+    uint8_t bad = 0;
+    ASSERT_EQ(1, pwrite(fileno(file), &bad, 1, 1));
+
+    // Bad magic should cause an error and leave an empty cache.
+    ASSERT_EQ(BAD_VALUE, mBC2->mapFromFile(fileno(file)));
+    fclose(file);
+    ASSERT_EQ(size_t(0), mBC2->get("abcd", 4, NULL, 0));
+    ASSERT_EQ(size_t(0), mBC2->get("x", 1, NULL, 0));
+}
+
 TEST_F(BlobCacheFlattenTest, FlattenCatchesBufferTooSmall) {
     // Fill up the entire cache with 1 char key/value pairs.
     const int maxEntries = MAX_TOTAL_SIZE / 2;
@@ -418,4 +554,26 @@ TEST_F(BlobCacheFlattenTest, UnflattenCatchesBufferTooSmall) {
     ASSERT_EQ(size_t(0), mBC2->get("abcd", 4, buf, 4));
 }
 
+TEST_F(BlobCacheFlattenTest, UnflattenCatchesBadNumEntries) {
+    unsigned char buf[4] = { 0xee, 0xee, 0xee, 0xee };
+    mBC->set("abcd", 4, "efgh", 4);
+
+    size_t size = mBC->getFlattenedSize();
+    uint8_t* flat = new uint8_t[size];
+    ASSERT_EQ(OK, mBC->flatten(flat, size));
+    // Claim far more entries than the buffer could hold.  mNumEntries is the
+    // size_t following the three uint32_t fields of the header.
+    size_t numEntriesOffset = (3 * sizeof(uint32_t) + sizeof(size_t) - 1) &
+            ~(sizeof(size_t) - 1);
+    memset(flat + numEntriesOffset, 0xff, sizeof(size_t));
+
+    // This should be an error rather than an attempt to size the cache for
+    // them all.
+    ASSERT_EQ(BAD_VALUE, mBC2->unflatten(flat, size));
+    delete[] flat;
+
+    // The error should cause the unflatten to result in an empty cache
+    ASSERT_EQ(size_t(0), mBC2->get("abcd", 4, buf, 4));
+}
+
 } // namespace android
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <utils/ConcurrentLruCache.h>
+#include <cutils/atomic.h>
+#include <cutils/log.h>
+#include <gtest/gtest.h>
+
+namespace android {
+
+typedef int SimpleKey;
+typedef int SimpleValue;
+
+class EntryRemovedCallback : public OnEntryRemoved<SimpleKey, SimpleValue> {
+public:
+    EntryRemovedCallback() : callbackCount(0), lastKey(-1), lastValue(-1) { }
+    ~EntryRemovedCallback() {}
+    void operator()(SimpleKey& k, SimpleValue& v) {
+        android_atomic_inc(&callbackCount);
+        lastKey = k;
+        lastValue = v;
+    }
+    volatile int32_t callbackCount;
+    SimpleKey lastKey;
+    SimpleValue lastValue;
+};
+
+class ConcurrentLruCacheTest : public testing::Test {
+};
+
+TEST_F(ConcurrentLruCacheTest, Empty) {
+    ConcurrentLruCache<SimpleKey, SimpleValue> cache(100);
+    SimpleValue value = -1;
+
+    EXPECT_FALSE(cache.get(0, &value));
+    EXPECT_EQ(-1, value);
+    EXPECT_EQ(0u, cache.size());
+}
+
+TEST_F(ConcurrentLruCacheTest, Simple) {
+    ConcurrentLruCache<SimpleKey, SimpleValue> cache(100);
+
+    EXPECT_TRUE(cache.put(1, 10));
+    EXPECT_TRUE(cache.put(2, 20));
+    EXPECT_TRUE(cache.put(3, 30));
+    EXPECT_FALSE(cache.put(3, 31)) << "an existing key is not replaced";
+    EXPECT_EQ(3u, cache.size());
+
+    SimpleValue value;
+    ASSERT_TRUE(cache.get(1, &value));
+    EXPECT_EQ(10, value);
+    ASSERT_TRUE(cache.get(3, &value));
+    EXPECT_EQ(30, value);
+
+    EXPECT_TRUE(cache.remove(2));
+    EXPECT_FALSE(cache.remove(2));
+    EXPECT_FALSE(cache.get(2, &value));
+    EXPECT_EQ(2u, cache.size());
+}
+
+TEST_F(ConcurrentLruCacheTest, MaxCapacity) {
+    ConcurrentLruCache<SimpleKey, SimpleValue> cache(2, 1);
+
+    cache.put(1, 10);
+    cache.put(2, 20);
+    cache.put(3, 30);
+
+    SimpleValue value;
+    EXPECT_FALSE(cache.get(1, &value));
+    EXPECT_TRUE(cache.get(2, &value));
+    EXPECT_TRUE(cache.get(3, &value));
+    EXPECT_EQ(2u, cache.size());
+}
+
+TEST_F(ConcurrentLruCacheTest, GetRefreshesLru) {
+    ConcurrentLruCache<SimpleKey, SimpleValue> cache(2, 1);
+    SimpleValue value;
+
+    cache.put(1, 10);
+    cache.put(2, 20);
+    cache.get(1, &value);
+    cache.put(3, 30);
+
+    EXPECT_TRUE(cache.get(1, &value));
+    EXPECT_FALSE(cache.get(2, &value));
+    EXPECT_TRUE(cache.get(3, &value));
+}
+
+TEST_F(ConcurrentLruCacheTest, ClockGivesSecondChance) {
+    ConcurrentLruCache<SimpleKey, SimpleValue> cache(3, 1,
+            ConcurrentLruCache<SimpleKey, SimpleValue>::kEvictClock);
+    SimpleValue value;
+
+    cache.put(1, 10);
+    cache.put(2, 20);
+    cache.put(3, 30);
+    cache.get(1, &value);
+    cache.get(3, &value);
+    cache.put(4, 40);
+
+    EXPECT_TRUE(cache.get(1, &value));
+    EXPECT_FALSE(cache.get(2, &value)) << "only unreferenced entry should be evicted";
+    EXPECT_TRUE(cache.get(3, &value));
+    EXPECT_TRUE(cache.get(4, &value));
+    EXPECT_EQ(3u, cache.size());
+}
+
+TEST_F(ConcurrentLruCacheTest, ShardedCapacity) {
+    ConcurrentLruCache<SimpleKey, SimpleValue> cache(64, 8);
+
+    for (int i = 0; i < 1000; i++) {
+        cache.put(i, i * 10);
+    }
+    EXPECT_GE(64u, cache.size()) << "no shard should exceed its share of the capacity";
+
+    SimpleValue value;
+    ASSERT_TRUE(cache.get(999, &value)) << "the latest entry should be present";
+    EXPECT_EQ(9990, value);
+}
+
+TEST_F(ConcurrentLruCacheTest, CapacityNotEvenlyDivided) {
+    // Fewer entries than shards, and capacities the shards can't share evenly.
+    const uint32_t capacities[] = { 1, 3, 17, 100 };
+    for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++) {
+        ConcurrentLruCache<SimpleKey, SimpleValue> cache(capacities[c], 16);
+
+        for (int i = 0; i < 1000; i++) {
+            cache.put(i, i * 10);
+            ASSERT_GE(capacities[c], cache.size()) << "capacity " << capacities[c];
+        }
+    }
+}
+
+TEST_F(ConcurrentLruCacheTest, Unlimited) {
+    ConcurrentLruCache<SimpleKey, SimpleValue> cache(
+            ConcurrentLruCache<SimpleKey, SimpleValue>::kUnlimitedCapacity, 4);
+
+    for (int i = 0; i < 10000; i++) {
+        cache.put(i, i);
+    }
+    EXPECT_EQ(10000u, cache.size());
+
+    SimpleValue value;
+    for (int i = 0; i < 10000; i++) {
+        ASSERT_TRUE(cache.get(i, &value));
+        EXPECT_EQ(i, value);
+    }
+}
+
+TEST_F(ConcurrentLruCacheTest, Callback) {
+    ConcurrentLruCache<SimpleKey, SimpleValue> cache(2, 1);
+    EntryRemovedCallback callback;
+    cache.setOnEntryRemovedListener(&callback);
+
+    cache.put(1, 10);
+    cache.put(2, 20);
+    cache.put(3, 30);
+    EXPECT_EQ(1, callback.callbackCount);
+    EXPECT_EQ(1, callback.lastKey);
+    EXPECT_EQ(10, callback.lastValue);
+
+    cache.remove(2);
+    EXPECT_EQ(2, callback.callbackCount);
+    EXPECT_EQ(2, callback.lastKey);
+
+    cache.clear();
+    EXPECT_EQ(3, callback.callbackCount);
+    EXPECT_EQ(0u, cache.size());
+}
+
+struct StressArgs {
+    ConcurrentLruCache<SimpleKey, SimpleValue>* cache;
+    int seed;
+    volatile int32_t* mismatches;
+};
+
+static void* stressThread(void* arg) {
+    StressArgs* args = static_cast<StressArgs*>(arg);
+    uint32_t random = args->seed;
+
+    for (int i = 0; i < 20000; i++) {
+        random = random * 1103515245 + 12345;
+        SimpleKey key = (random >> 8) % 512;
+        SimpleValue value;
+        if ((random >> 4) & 1) {
+            args->cache->put(key, key * 3);
+        } else if (args->cache->get(key, &value) && value != key * 3) {
+            android_atomic_inc(args->mismatches);
+        }
+        if (((random >> 4) & 0xF) == 0xF) {
+            args->cache->remove(key);
+        }
+    }
+    return NULL;
+}
+
+static void stress(ConcurrentLruCache<SimpleKey, SimpleValue>& cache) {
+    const int kThreads = 8;
+    pthread_t threads[kThreads];
+    StressArgs args[kThreads];
+    volatile int32_t mismatches = 0;
+
+    for (int i = 0; i < kThreads; i++) {
+        args[i].cache = &cache;
+        args[i].seed = i + 1;
+        args[i].mismatches = &mismatches;
+        ASSERT_EQ(0, pthread_create(&threads[i], NULL, stressThread, &args[i]));
+    }
+    for (int i = 0; i < kThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    EXPECT_EQ(0, mismatches);
+    EXPECT_GE(128u, cache.size());
+}
+
+TEST_F(ConcurrentLruCacheTest, StressLru) {
+    ConcurrentLruCache<SimpleKey, SimpleValue> cache(128, 8);
+    stress(cache);
+}
+
+TEST_F(ConcurrentLruCacheTest, StressClock) {
+    ConcurrentLruCache<SimpleKey, SimpleValue> cache(128, 8,
+            ConcurrentLruCache<SimpleKey, SimpleValue>::kEvictClock);
+    stress(cache);
+}
+
+}
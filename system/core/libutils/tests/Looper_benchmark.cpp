@@ -0,0 +1,201 @@
+//
+// Copyright 2014 The Android Open Source Project
+//
+
+#include <utils/Looper.h>
+#include <utils/Timers.h>
+
+#include <unistd.h>
+
+#include "benchmark.h"
+
+namespace android {
+
+class CountingMessageHandler : public MessageHandler {
+public:
+    int count;
+
+    CountingMessageHandler() : count(0) { }
+
+    virtual void handleMessage(const Message&) {
+        count += 1;
+    }
+};
+
+// Queue pending messages at pseudo-random times far enough in the future
+// that none come due during the run.
+static void addPendingMessages(const sp<Looper>& looper,
+        const sp<MessageHandler>& handler, int count) {
+    nsecs_t future = systemTime(SYSTEM_TIME_MONOTONIC) + seconds_to_nanoseconds(3600);
+    uint32_t random = 1;
+    for (int i = 0; i < count; i++) {
+        random = random * 1103515245 + 12345;
+        looper->sendMessageAtTime(future + (random >> 8), handler, Message(i));
+    }
+}
+
+/*
+ *	Measure posting a message that is due now and dispatching it, with a
+ * number of delayed messages already pending behind it.
+ */
+static void BM_looper_post_dispatch(int iters, int pending) {
+    sp<Looper> looper = new Looper(true);
+    sp<CountingMessageHandler> handler = new CountingMessageHandler();
+    sp<CountingMessageHandler> pendingHandler = new CountingMessageHandler();
+    addPendingMessages(looper, pendingHandler, pending);
+
+    StartBenchmarkTiming();
+    for (int i = 0; i < iters; i++) {
+        looper->sendMessage(handler, Message(i));
+        looper->pollOnce(0);
+    }
+    StopBenchmarkTiming();
+
+    looper->removeMessages(pendingHandler);
+}
+BENCHMARK(BM_looper_post_dispatch)->Arg(0)->Arg(1000)->Arg(10000);
+
+/*
+ *	Measure posting delayed messages at random times into a queue already
+ * holding a number of pending messages.
+ */
+static void BM_looper_post_delayed(int iters, int pending) {
+    sp<Looper> looper = new Looper(true);
+    sp<CountingMessageHandler> handler = new CountingMessageHandler();
+    addPendingMessages(looper, handler, pending);
+
+    StartBenchmarkTiming();
+    addPendingMessages(looper, handler, iters);
+    StopBenchmarkTiming();
+
+    looper->removeMessages(handler);
+}
+BENCHMARK(BM_looper_post_delayed)->Arg(100)->Arg(1000)->Arg(10000);
+
+/*
+ *	Measure waking the looper from its own thread and polling the wake up.
+ */
+static void BM_looper_wake(int iters) {
+    sp<Looper> looper = new Looper(true);
+
+    StartBenchmarkTiming();
+    for (int i = 0; i < iters; i++) {
+        looper->wake();
+        looper->pollOnce(0);
+    }
+    StopBenchmarkTiming();
+}
+BENCHMARK(BM_looper_wake);
+
+class DrainingCallback : public LooperCallback {
+public:
+    virtual int handleEvent(int fd, int, void*) {
+        char buffer[16];
+        read(fd, buffer, sizeof(buffer));
+        return 1;
+    }
+};
+
+// Open count pipes, returning their read ends in fds[2 * i] and write ends
+// in fds[2 * i + 1].
+static bool openPipes(int* fds, int count) {
+    for (int i = 0; i < count; i++) {
+        if (pipe(fds + 2 * i)) {
+            while (i--) {
+                close(fds[2 * i]);
+                close(fds[2 * i + 1]);
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+static void closePipes(int* fds, int count) {
+    for (int i = 0; i < 2 * count; i++) {
+        close(fds[i]);
+    }
+}
+
+/*
+ *	Measure dispatching an event on one of many registered file descriptors.
+ */
+static void BM_looper_fd_dispatch(int iters, int count) {
+    sp<Looper> looper = new Looper(true);
+    sp<LooperCallback> callback = new DrainingCallback();
+    int* fds = new int[2 * count];
+    if (!openPipes(fds, count)) {
+        delete[] fds;
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        looper->addFd(fds[2 * i], 0, Looper::EVENT_INPUT, callback, NULL);
+    }
+
+    StartBenchmarkTiming();
+    for (int i = 0; i < iters; i++) {
+        write(fds[2 * (i % count) + 1], "*", 1);
+        looper->pollOnce(0);
+    }
+    StopBenchmarkTiming();
+
+    for (int i = 0; i < count; i++) {
+        looper->removeFd(fds[2 * i]);
+    }
+    closePipes(fds, count);
+    delete[] fds;
+}
+BENCHMARK(BM_looper_fd_dispatch)->Arg(1)->Arg(100)->Arg(500);
+
+/*
+ *	Measure registering and then removing many file descriptors, one at a
+ * time or as a batch.
+ */
+static void BM_looper_add_remove_fds(int iters, int count, bool batch) {
+    sp<Looper> looper = new Looper(true);
+    sp<LooperCallback> callback = new DrainingCallback();
+    int* fds = new int[2 * count];
+    if (!openPipes(fds, count)) {
+        delete[] fds;
+        return;
+    }
+    Looper::FdRegistration* registrations = new Looper::FdRegistration[count];
+    for (int i = 0; i < count; i++) {
+        registrations[i].fd = fds[2 * i];
+        registrations[i].ident = 0;
+        registrations[i].events = Looper::EVENT_INPUT;
+        registrations[i].callback = callback;
+        registrations[i].data = NULL;
+    }
+
+    StartBenchmarkTiming();
+    for (int i = 0; i < iters; i += count) {
+        if (batch) {
+            looper->addFds(registrations, count);
+        } else {
+            for (int j = 0; j < count; j++) {
+                looper->addFd(fds[2 * j], 0, Looper::EVENT_INPUT, callback, NULL);
+            }
+        }
+        for (int j = count; j-- != 0; ) {
+            looper->removeFd(fds[2 * j]);
+        }
+    }
+    StopBenchmarkTiming();
+
+    delete[] registrations;
+    closePipes(fds, count);
+    delete[] fds;
+}
+
+static void BM_looper_add_remove_fd(int iters, int count) {
+    BM_looper_add_remove_fds(iters, count, false);
+}
+BENCHMARK(BM_looper_add_remove_fd)->Arg(100)->Arg(500);
+
+static void BM_looper_add_remove_fd_batch(int iters, int count) {
+    BM_looper_add_remove_fds(iters, count, true);
+}
+BENCHMARK(BM_looper_add_remove_fd_batch)->Arg(100)->Arg(500);
+
+} // namespace android
@@ -387,6 +387,75 @@ TEST_F(LooperTest, AddFd_WhenNoCallbackAndAllowNonCallbacksIsFalse_ReturnsError)
             << "addFd should return -1 because arguments were invalid";
 }
 
+TEST_F(LooperTest, AddFds_WhenSomeRegistrationsInvalid_AddsTheRest) {
+    Pipe pipe1, pipe2, pipe3;
+    Looper::FdRegistration registrations[3];
+    registrations[0].fd = pipe1.receiveFd;
+    registrations[0].ident = 1;
+    registrations[0].events = Looper::EVENT_INPUT;
+    registrations[0].data = NULL;
+    registrations[1].fd = pipe2.receiveFd;
+    registrations[1].ident = -1;
+    registrations[1].events = Looper::EVENT_INPUT;
+    registrations[1].data = NULL;
+    registrations[2].fd = pipe3.receiveFd;
+    registrations[2].ident = 3;
+    registrations[2].events = Looper::EVENT_INPUT;
+    registrations[2].data = NULL;
+
+    int result = mLooper->addFds(registrations, 3);
+
+    EXPECT_EQ(2, result)
+            << "addFds should return 2 because one registration had a negative ident";
+
+    pipe3.writeSignal();
+    int fd;
+    result = mLooper->pollOnce(0, &fd, NULL, NULL);
+
+    EXPECT_EQ(3, result)
+            << "pollOnce result should be the ident of the FD that was signalled";
+    EXPECT_EQ(pipe3.receiveFd, fd)
+            << "pollOnce should have returned the signalled pipe fd";
+    EXPECT_EQ(1, mLooper->removeFd(pipe1.receiveFd))
+            << "removeFd should return 1 because FD was added by addFds";
+    EXPECT_EQ(0, mLooper->removeFd(pipe2.receiveFd))
+            << "removeFd should return 0 because FD was not added by addFds";
+}
+
+TEST_F(LooperTest, PollOnce_WhenEdgeTriggeredFdStillReadable_DoesNotInvokeCallbackAgain) {
+    Pipe pipe;
+    StubCallbackHandler handler(true);
+
+    pipe.writeSignal();
+    handler.setCallback(mLooper, pipe.receiveFd,
+            Looper::EVENT_INPUT | Looper::EVENT_EDGE_TRIGGERED);
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(Looper::POLL_CALLBACK, result)
+            << "pollOnce result should be Looper::POLL_CALLBACK because FD was signalled";
+    EXPECT_EQ(1, handler.callbackCount)
+            << "callback should be invoked exactly once";
+    EXPECT_EQ(Looper::EVENT_INPUT, handler.events)
+            << "callback should have received Looper::EVENT_INPUT as events";
+
+    // The signal was not read, but no new data arrived.
+    result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(Looper::POLL_TIMEOUT, result)
+            << "pollOnce result should be Looper::POLL_TIMEOUT because no new data arrived";
+    EXPECT_EQ(1, handler.callbackCount)
+            << "callback should not be invoked again";
+
+    pipe.writeSignal();
+    result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(Looper::POLL_CALLBACK, result)
+            << "pollOnce result should be Looper::POLL_CALLBACK because FD was signalled again";
+    EXPECT_EQ(2, handler.callbackCount)
+            << "callback should be invoked for the new data";
+}
+
 TEST_F(LooperTest, RemoveFd_WhenCallbackNotAdded_ReturnsZero) {
     int result = mLooper->removeFd(1);
 
@@ -690,4 +759,36 @@ TEST_F(LooperTest, RemoveMessage_WhenRemovingSomeMessagesForHandler_ShouldRemove
             << "no more messages to handle";
 }
 
+TEST_F(LooperTest, SendMessageAtTime_WhenManyMessagesOutOfOrder_ShouldInvokeHandlerInTimeOrder) {
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+    nsecs_t past = systemTime(SYSTEM_TIME_MONOTONIC) - ms2ns(1000);
+
+    // Message i is due at past + (i * 7 % 100) ms. Those with equal times
+    // must keep the order in which they were sent.
+    for (int i = 0; i < 200; i++) {
+        mLooper->sendMessageAtTime(past + ms2ns(i * 7 % 100), handler, Message(i));
+    }
+    for (int i = 0; i < 200; i += 3) {
+        mLooper->removeMessages(handler, i);
+    }
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(Looper::POLL_CALLBACK, result)
+            << "pollOnce result should be Looper::POLL_CALLBACK because messages were sent";
+    ASSERT_EQ(size_t(133), handler->messages.size())
+            << "every message not removed should have been handled";
+    for (size_t i = 1; i < handler->messages.size(); i++) {
+        int previous = handler->messages[i - 1].what;
+        int current = handler->messages[i].what;
+        int previousDue = previous * 7 % 100;
+        int currentDue = current * 7 % 100;
+        EXPECT_TRUE(previousDue < currentDue
+                || (previousDue == currentDue && previous < current))
+                << "message " << current << " handled out of order after " << previous;
+        EXPECT_NE(0, current % 3)
+                << "removed message " << current << " should not have been handled";
+    }
+}
+
 } // namespace android
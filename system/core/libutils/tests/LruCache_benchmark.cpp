@@ -0,0 +1,121 @@
+//
+// Copyright 2014 The Android Open Source Project
+//
+
+#include <utils/ConcurrentLruCache.h>
+#include <utils/LruCache.h>
+#include <utils/Mutex.h>
+
+#include <pthread.h>
+
+#include <vector>
+
+#include "benchmark.h"
+
+namespace android {
+
+static const uint32_t kCapacity = 1024;
+// Keys are drawn from a range a little larger than the capacity, so most
+// lookups hit and a steady trickle of puts evicts.  Values point into
+// gValues, so a miss is told apart by the NULL that LruCache returns.
+static const uint32_t kKeyRange = kCapacity + kCapacity / 4;
+static int gValues[kKeyRange];
+
+// The existing cache behind a single lock, as callers share it today.
+class LockedLruCache {
+public:
+    LockedLruCache() : mCache(kCapacity) { }
+
+    bool get(int key, const int** outValue) {
+        Mutex::Autolock _l(mLock);
+        *outValue = mCache.get(key);
+        return *outValue != NULL;
+    }
+
+    void put(int key, const int* value) {
+        Mutex::Autolock _l(mLock);
+        mCache.put(key, value);
+    }
+
+private:
+    Mutex mLock;
+    LruCache<int, const int*> mCache;
+};
+
+template <typename TCache>
+struct WorkerArgs {
+    TCache* cache;
+    int iters;
+    uint32_t seed;
+};
+
+// Nine lookups to every put, falling back to a put on a miss.
+template <typename TCache>
+static void* worker(void* arg) {
+    WorkerArgs<TCache>* args = static_cast<WorkerArgs<TCache>*>(arg);
+    uint32_t random = args->seed;
+    const int* value;
+
+    for (int i = 0; i < args->iters; i++) {
+        random = random * 1103515245 + 12345;
+        int key = (random >> 8) % kKeyRange;
+        if ((random >> 4) % 10 == 0 || !args->cache->get(key, &value)) {
+            args->cache->put(key, &gValues[key]);
+        }
+    }
+    return NULL;
+}
+
+// Splits iters over the given number of threads hammering one cache.
+template <typename TCache>
+static void runWorkers(TCache& cache, int iters, int threads) {
+    std::vector<pthread_t> tids(threads);
+    std::vector<WorkerArgs<TCache> > args(threads);
+
+    for (uint32_t key = 0; key < kCapacity; key++) {
+        cache.put(key, &gValues[key]);
+    }
+
+    StartBenchmarkTiming();
+    for (int i = 0; i < threads; i++) {
+        args[i].cache = &cache;
+        args[i].iters = iters / threads;
+        args[i].seed = i + 1;
+        pthread_create(&tids[i], NULL, worker<TCache>, &args[i]);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    StopBenchmarkTiming();
+}
+
+/*
+ *	Measure a mixed get/put load on LruCache guarded by one Mutex.
+ */
+static void BM_lru_cache_locked(int iters, int threads) {
+    LockedLruCache cache;
+    runWorkers(cache, iters, threads);
+}
+BENCHMARK(BM_lru_cache_locked)->Arg(1)->Arg(4)->Arg(8);
+
+/*
+ *	Measure the same load on a sharded ConcurrentLruCache.
+ */
+static void BM_lru_cache_concurrent(int iters, int threads) {
+    ConcurrentLruCache<int, const int*> cache(kCapacity);
+    runWorkers(cache, iters, threads);
+}
+BENCHMARK(BM_lru_cache_concurrent)->Arg(1)->Arg(4)->Arg(8);
+
+/*
+ *	Measure the same load on a sharded ConcurrentLruCache with CLOCK
+ * eviction, where lookups take only the shard's read lock.
+ */
+static void BM_lru_cache_concurrent_clock(int iters, int threads) {
+    ConcurrentLruCache<int, const int*> cache(kCapacity, 16,
+            ConcurrentLruCache<int, const int*>::kEvictClock);
+    runWorkers(cache, iters, threads);
+}
+BENCHMARK(BM_lru_cache_concurrent_clock)->Arg(1)->Arg(4)->Arg(8);
+
+}
@@ -72,3 +72,29 @@ LOCAL_STATIC_LIBRARIES := libziparchive-host \
 	liblog \
 	libutils
 include $(BUILD_HOST_NATIVE_TEST)
+
+# Build the benchmarks. (see ../liblog/tests) They generate the archive they
+# extract. Run with:
+#   adb shell /data/nativetest/ziparchive-benchmarks/ziparchive-benchmarks
+include $(CLEAR_VARS)
+LOCAL_MODULE := ziparchive-benchmarks
+LOCAL_MODULE_TAGS := tests
+LOCAL_CPP_EXTENSION := .cc
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+LOCAL_CFLAGS += \
+    -I$(LOCAL_PATH)/../liblog/tests \
+    -Wall \
+    -Werror \
+    -fno-builtin \
+    -std=gnu++11
+LOCAL_SRC_FILES := \
+    ../liblog/tests/benchmark_main.cpp \
+    zip_archive_benchmark.cc
+LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_STATIC_LIBRARIES := libziparchive libz libutils
+ifndef LOCAL_SDK_VERSION
+LOCAL_C_INCLUDES += bionic bionic/libstdc++/include external/stlport/stlport
+LOCAL_SHARED_LIBRARIES += libstlport
+endif
+LOCAL_MODULE_PATH := $(TARGET_OUT_DATA_NATIVE_TESTS)/$(LOCAL_MODULE)
+include $(BUILD_EXECUTABLE)
@@ -31,8 +31,16 @@
 #include <utils/FileMap.h>
 #include <zlib.h>
 
+#if defined(HAVE_PTHREADS)
+#include <pthread.h>
+#endif
+
 #include <JNIHelp.h>  // TEMP_FAILURE_RETRY may or may not be in unistd
 
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
 #include "ziparchive/zip_archive.h"
 
 // This is for windows. If we don't open a file in binary mode, weird
@@ -215,7 +223,8 @@ static const char* kErrorMessages[] = {
   "Inconsistent information",
   "Invalid entry name",
   "I/O Error",
-  "File mapping failed"
+  "File mapping failed",
+  "Unsupported compression method"
 };
 
 static const int32_t kErrorMessageUpperBound = 0;
@@ -262,10 +271,31 @@ static const int32_t kIoError = -11;
 // We were not able to mmap the central directory or entry contents.
 static const int32_t kMmapFailed = -12;
 
-static const int32_t kErrorMessageLowerBound = -13;
+// The entry's compression method is not supported by the operation, such
+// as mapping a deflated entry, or by this implementation.
+static const int32_t kUnsupportedMethod = -13;
+
+static const int32_t kErrorMessageLowerBound = -14;
+
+// The size of the chunks passed to a ProcessZipEntryFunction, and of the
+// buffer of compressed data read for each call to inflate.
+static const uint32_t kBufSize = 32768;
+
+// The most read at once when copying a stored entry straight into the
+// caller's memory.
+static const uint32_t kDirectReadSize = 1024 * 1024;
 
 static const char kTempMappingFileName[] = "zip: ExtractFileToFile";
 
+/*
+ * A zlib stream used to inflate entries, set up on first use and reset
+ * for each entry after that.
+ */
+struct Inflater {
+  z_stream zstream;
+  bool initialized;
+};
+
 /*
  * A Read-only Zip archive.
  *
@@ -304,6 +334,25 @@ struct ZipArchive {
    */
   uint32_t hash_table_size;
   ZipEntryName* hash_table;
+
+  /*
+   * Pointers to the hash table entries, sorted by name, so that iterating
+   * over the entries with a given prefix only visits those entries. Built
+   * on the first iteration with a prefix, or when the archive is opened
+   * with kOpenBuildPrefixIndex.
+   */
+  const ZipEntryName** sorted_index;
+  uint32_t sorted_index_count;
+#if defined(HAVE_PTHREADS)
+  /* guards building sorted_index, which iterating threads may race to do */
+  pthread_mutex_t sorted_index_lock;
+#endif
+
+  /*
+   * The inflater used to extract entries through this handle.  Batch
+   * extraction gives each of its workers an inflater of its own.
+   */
+  Inflater inflater;
 };
 
 // Returns 0 on success and negative values on failure.
@@ -320,28 +369,112 @@ static android::FileMap* MapFileSegment(const int fd, const off64_t start,
   return file_map;
 }
 
-static int32_t CopyFileToFile(int fd, uint8_t* begin, const uint32_t length, uint64_t *crc_out) {
-  static const uint32_t kBufSize = 32768;
-  uint8_t buf[kBufSize];
+/*
+ * Prepare |inflater| for a new entry, setting it up on first use.
+ */
+static int32_t ResetInflater(Inflater* inflater) {
+  z_stream* zstream = &inflater->zstream;
+
+  if (inflater->initialized) {
+    const int zerr = inflateReset(zstream);
+    if (zerr != Z_OK) {
+      ALOGW("Call to inflateReset failed (zerr=%d)", zerr);
+      return kZlibError;
+    }
+    return 0;
+  }
 
+  memset(zstream, 0, sizeof(*zstream));
+  zstream->zalloc = Z_NULL;
+  zstream->zfree = Z_NULL;
+  zstream->opaque = Z_NULL;
+  zstream->next_in = NULL;
+  zstream->avail_in = 0;
+  zstream->data_type = Z_UNKNOWN;
+
+  /*
+   * Use the undocumented "negative window bits" feature to tell zlib
+   * that there's no zlib header waiting for it.
+   */
+  const int zerr = inflateInit2(zstream, -MAX_WBITS);
+  if (zerr != Z_OK) {
+    if (zerr == Z_VERSION_ERROR) {
+      ALOGE("Installed zlib is not compatible with linked version (%s)",
+        ZLIB_VERSION);
+    } else {
+      ALOGW("Call to inflateInit2 failed (zerr=%d)", zerr);
+    }
+
+    return kZlibError;
+  }
+
+  inflater->initialized = true;
+  return 0;
+}
+
+static void ReleaseInflater(Inflater* inflater) {
+  if (inflater->initialized) {
+    inflateEnd(&inflater->zstream);
+    inflater->initialized = false;
+  }
+}
+
+// Attempts to read |len| bytes into |buf| at offset |off|.
+//
+// This method uses pread64 on platforms that support it and
+// lseek64 + read on platforms that don't. This implies that
+// callers should not rely on the |fd| offset being incremented
+// as a side effect of this call.
+static inline ssize_t ReadAtOffset(int fd, uint8_t* buf, size_t len,
+                                   off64_t off) {
+#ifdef HAVE_PREAD
+  return TEMP_FAILURE_RETRY(pread64(fd, buf, len, off));
+#else
+  // The only supported platform that doesn't support pread at the moment
+  // is Windows. Only recent versions of windows support unix like forks,
+  // and even there the semantics are quite different.
+  if (lseek64(fd, off, SEEK_SET) != off) {
+    ALOGW("Zip: failed seek to offset %" PRId64, off);
+    return kIoError;
+  }
+
+  return TEMP_FAILURE_RETRY(read(fd, buf, len));
+#endif  // HAVE_PREAD
+}
+
+/*
+ * Copy |length| stored bytes from |offset| in |fd|.  If |func|
+ * is NULL they are read straight into |begin|, which must hold |length|
+ * bytes, a chunk of up to kDirectReadSize at a time.  Otherwise |begin| is
+ * a buffer of kBufSize bytes that is passed to |func| after each read.
+ */
+static int32_t CopyFileToFile(int fd, off64_t offset, uint8_t* begin,
+                              const uint32_t length,
+                              ProcessZipEntryFunction func, void* cookie,
+                              uint64_t *crc_out) {
   uint32_t count = 0;
   uint64_t crc = 0;
   while (count < length) {
     uint32_t remaining = length - count;
 
-    // Safe conversion because kBufSize is narrow enough for a 32 bit signed
-    // value.
-    ssize_t get_size = (remaining > kBufSize) ? kBufSize : remaining;
-    ssize_t actual = TEMP_FAILURE_RETRY(read(fd, buf, get_size));
+    // Safe conversion because both chunk sizes are narrow enough for a 32
+    // bit signed value.
+    const uint32_t chunk_size = (func == NULL) ? kDirectReadSize : kBufSize;
+    ssize_t get_size = (remaining > chunk_size) ? chunk_size : remaining;
+    uint8_t* buf = (func == NULL) ? begin + count : begin;
+    ssize_t actual = ReadAtOffset(fd, buf, get_size, offset + count);
 
     if (actual != get_size) {
       ALOGW("CopyFileToFile: copy read failed (" ZD " vs " ZD ")", actual, get_size);
       return kIoError;
     }
 
-    memcpy(begin + count, buf, get_size);
     crc = crc32(crc, buf, get_size);
     count += get_size;
+
+    if (func != NULL && !func(buf, get_size, cookie)) {
+      return kIoError;
+    }
   }
 
   *crc_out = crc;
@@ -427,6 +560,71 @@ static int32_t AddToHash(ZipEntryName *hash_table, const uint64_t hash_table_siz
   return 0;
 }
 
+/*
+ * Compare two entry names as unsigned bytes, a name sorting before any
+ * longer name it is a prefix of.
+ */
+static int CompareNames(const char* lhs, uint16_t lhs_length,
+                        const char* rhs, uint16_t rhs_length) {
+  const int result = memcmp(lhs, rhs, lhs_length < rhs_length ? lhs_length : rhs_length);
+  if (result != 0) {
+    return result;
+  }
+  return static_cast<int>(lhs_length) - static_cast<int>(rhs_length);
+}
+
+static int CompareEntryNames(const void* lhs, const void* rhs) {
+  const ZipEntryName* lhs_name = *reinterpret_cast<const ZipEntryName* const*>(lhs);
+  const ZipEntryName* rhs_name = *reinterpret_cast<const ZipEntryName* const*>(rhs);
+  return CompareNames(lhs_name->name, lhs_name->name_length,
+                      rhs_name->name, rhs_name->name_length);
+}
+
+/*
+ * Build the sorted index of entry names from the hash table.
+ */
+static int32_t BuildSortedIndex(ZipArchive* archive) {
+  const ZipEntryName** sorted_index = reinterpret_cast<const ZipEntryName**>(
+      malloc(archive->num_entries * sizeof(ZipEntryName*)));
+  if (sorted_index == NULL) {
+    ALOGW("Zip: unable to allocate the sorted index");
+    return kIoError;
+  }
+
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < archive->hash_table_size; ++i) {
+    if (archive->hash_table[i].name != NULL) {
+      sorted_index[count++] = &archive->hash_table[i];
+    }
+  }
+  qsort(sorted_index, count, sizeof(ZipEntryName*), CompareEntryNames);
+
+  archive->sorted_index = sorted_index;
+  archive->sorted_index_count = count;
+  return 0;
+}
+
+/*
+ * Return the position in the sorted index of the first entry whose name
+ * sorts at or after |prefix|, which is where the entries starting with
+ * |prefix| begin.
+ */
+static uint32_t SortedIndexLowerBound(const ZipArchive* archive,
+                                      const char* prefix, uint16_t prefix_len) {
+  uint32_t low = 0;
+  uint32_t high = archive->sorted_index_count;
+  while (low < high) {
+    const uint32_t mid = low + (high - low) / 2;
+    const ZipEntryName* name = archive->sorted_index[mid];
+    if (CompareNames(name->name, name->name_length, prefix, prefix_len) < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
 static int32_t MapCentralDirectory0(int fd, const char* debug_file_name,
                                     ZipArchive* archive, off64_t file_length,
                                     off64_t read_amount, uint8_t* scan_buffer) {
@@ -646,7 +844,8 @@ bail:
 }
 
 static int32_t OpenArchiveInternal(ZipArchive* archive,
-                                   const char* debug_file_name) {
+                                   const char* debug_file_name,
+                                   uint32_t flags) {
   int32_t result = -1;
   if ((result = MapCentralDirectory(archive->fd, debug_file_name, archive))) {
     return result;
@@ -656,23 +855,43 @@ static int32_t OpenArchiveInternal(ZipArchive* archive,
     return result;
   }
 
+  if ((flags & kOpenBuildPrefixIndex) && (result = BuildSortedIndex(archive))) {
+    return result;
+  }
+
   return 0;
 }
 
 int32_t OpenArchiveFd(int fd, const char* debug_file_name,
                       ZipArchiveHandle* handle) {
+  return OpenArchiveFdWithFlags(fd, debug_file_name, 0, handle);
+}
+
+int32_t OpenArchiveFdWithFlags(int fd, const char* debug_file_name,
+                               uint32_t flags, ZipArchiveHandle* handle) {
   ZipArchive* archive = (ZipArchive*) malloc(sizeof(ZipArchive));
   memset(archive, 0, sizeof(*archive));
+#if defined(HAVE_PTHREADS)
+  pthread_mutex_init(&archive->sorted_index_lock, NULL);
+#endif
   *handle = archive;
 
   archive->fd = fd;
 
-  return OpenArchiveInternal(archive, debug_file_name);
+  return OpenArchiveInternal(archive, debug_file_name, flags);
 }
 
 int32_t OpenArchive(const char* fileName, ZipArchiveHandle* handle) {
+  return OpenArchiveWithFlags(fileName, 0, handle);
+}
+
+int32_t OpenArchiveWithFlags(const char* fileName, uint32_t flags,
+                             ZipArchiveHandle* handle) {
   ZipArchive* archive = (ZipArchive*) malloc(sizeof(ZipArchive));
   memset(archive, 0, sizeof(*archive));
+#if defined(HAVE_PTHREADS)
+  pthread_mutex_init(&archive->sorted_index_lock, NULL);
+#endif
   *handle = archive;
 
   const int fd = open(fileName, O_RDONLY | O_BINARY, 0);
@@ -683,7 +902,7 @@ int32_t OpenArchive(const char* fileName, ZipArchiveHandle* handle) {
     archive->fd = fd;
   }
 
-  return OpenArchiveInternal(archive, fileName);
+  return OpenArchiveInternal(archive, fileName, flags);
 }
 
 /*
@@ -700,14 +919,19 @@ void CloseArchive(ZipArchiveHandle handle) {
   if (archive->directory_map != NULL) {
     archive->directory_map->release();
   }
+  ReleaseInflater(&archive->inflater);
   free(archive->hash_table);
+  free(archive->sorted_index);
+#if defined(HAVE_PTHREADS)
+  pthread_mutex_destroy(&archive->sorted_index_lock);
+#endif
   free(archive);
 }
 
-static int32_t UpdateEntryFromDataDescriptor(int fd,
+static int32_t UpdateEntryFromDataDescriptor(int fd, off64_t dd_offset,
                                              ZipEntry *entry) {
   uint8_t ddBuf[sizeof(DataDescriptor) + sizeof(DataDescriptor::kOptSignature)];
-  ssize_t actual = TEMP_FAILURE_RETRY(read(fd, ddBuf, sizeof(ddBuf)));
+  ssize_t actual = ReadAtOffset(fd, ddBuf, sizeof(ddBuf), dd_offset);
   if (actual != sizeof(ddBuf)) {
     return kIoError;
   }
@@ -723,29 +947,6 @@ static int32_t UpdateEntryFromDataDescriptor(int fd,
   return 0;
 }
 
-// Attempts to read |len| bytes into |buf| at offset |off|.
-//
-// This method uses pread64 on platforms that support it and
-// lseek64 + read on platforms that don't. This implies that
-// callers should not rely on the |fd| offset being incremented
-// as a side effect of this call.
-static inline ssize_t ReadAtOffset(int fd, uint8_t* buf, size_t len,
-                                   off64_t off) {
-#ifdef HAVE_PREAD
-  return TEMP_FAILURE_RETRY(pread64(fd, buf, len, off));
-#else
-  // The only supported platform that doesn't support pread at the moment
-  // is Windows. Only recent versions of windows support unix like forks,
-  // and even there the semantics are quite different.
-  if (lseek64(fd, off, SEEK_SET) != off) {
-    ALOGW("Zip: failed seek to offset %" PRId64, off);
-    return kIoError;
-  }
-
-  return TEMP_FAILURE_RETRY(read(fd, buf, len));
-#endif  // HAVE_PREAD
-}
-
 static int32_t FindEntry(const ZipArchive* archive, const int ent,
                          ZipEntry* data) {
   const uint16_t nameLen = archive->hash_table[ent].name_length;
@@ -880,8 +1081,14 @@ static int32_t FindEntry(const ZipArchive* archive, const int ent,
   return 0;
 }
 
+/*
+ * Iteration without a prefix walks the hash table.  Iteration with a prefix
+ * walks the sorted index from the first name at or after the prefix, and
+ * stops at the first name that does not start with it.
+ */
 struct IterationHandle {
   uint32_t position;
+  uint32_t start;
   const char* prefix;
   uint16_t prefix_len;
   ZipArchive* archive;
@@ -895,13 +1102,36 @@ int32_t StartIteration(ZipArchiveHandle handle, void** cookie_ptr, const char* p
     return kInvalidHandle;
   }
 
+  const size_t prefix_len = (prefix != NULL) ? strlen(prefix) : 0;
+  if (prefix_len > 65535) {
+    ALOGW("Zip: Invalid prefix %.*s...", 64, prefix);
+    return kInvalidEntryName;
+  }
+
+  uint32_t start = 0;
+  if (prefix_len != 0) {
+#if defined(HAVE_PTHREADS)
+    pthread_mutex_lock(&archive->sorted_index_lock);
+#endif
+    const int32_t result =
+        (archive->sorted_index == NULL) ? BuildSortedIndex(archive) : 0;
+#if defined(HAVE_PTHREADS)
+    pthread_mutex_unlock(&archive->sorted_index_lock);
+#endif
+    if (result) {
+      return result;
+    }
+    start = SortedIndexLowerBound(archive, prefix, prefix_len);
+  } else {
+    prefix = NULL;
+  }
+
   IterationHandle* cookie = (IterationHandle*) malloc(sizeof(IterationHandle));
-  cookie->position = 0;
+  cookie->position = start;
+  cookie->start = start;
   cookie->prefix = prefix;
+  cookie->prefix_len = prefix_len;
   cookie->archive = archive;
-  if (prefix != NULL) {
-    cookie->prefix_len = strlen(prefix);
-  }
 
   *cookie_ptr = cookie ;
   return 0;
@@ -943,10 +1173,28 @@ int32_t Next(void* cookie, ZipEntry* data, ZipEntryName* name) {
   const uint32_t hash_table_length = archive->hash_table_size;
   const ZipEntryName *hash_table = archive->hash_table;
 
+  if (handle->prefix != NULL) {
+    if (currentOffset < archive->sorted_index_count) {
+      const ZipEntryName* entry_name = archive->sorted_index[currentOffset];
+      if (entry_name->name_length >= handle->prefix_len &&
+          memcmp(handle->prefix, entry_name->name, handle->prefix_len) == 0) {
+        handle->position = currentOffset + 1;
+        const int error = FindEntry(archive, entry_name - hash_table, data);
+        if (!error) {
+          name->name = entry_name->name;
+          name->name_length = entry_name->name_length;
+        }
+
+        return error;
+      }
+    }
+
+    handle->position = handle->start;
+    return kIterationEnd;
+  }
+
   for (uint32_t i = currentOffset; i < hash_table_length; ++i) {
-    if (hash_table[i].name != NULL &&
-        (handle->prefix == NULL ||
-         (memcmp(handle->prefix, hash_table[i].name, handle->prefix_len) == 0))) {
+    if (hash_table[i].name != NULL) {
       handle->position = (i + 1);
       const int error = FindEntry(archive, i, data);
       if (!error) {
@@ -962,153 +1210,252 @@ int32_t Next(void* cookie, ZipEntry* data, ZipEntryName* name) {
   return kIterationEnd;
 }
 
-static int32_t InflateToFile(int fd, const ZipEntry* entry,
+/*
+ * Inflate |entry| from |fd| using |inflater|.  If |func| is NULL the
+ * output goes straight to |begin|, which must hold |length| bytes.
+ * Otherwise |begin| is a buffer of |length| bytes that is passed to |func|
+ * each time it fills, and at the end of the entry.
+ */
+static int32_t InflateToFile(int fd, Inflater* inflater, const ZipEntry* entry,
                              uint8_t* begin, uint32_t length,
+                             ProcessZipEntryFunction func, void* cookie,
                              uint64_t* crc_out) {
-  int32_t result = -1;
-  const uint32_t kBufSize = 32768;
   uint8_t read_buf[kBufSize];
-  uint8_t write_buf[kBufSize];
-  z_stream zstream;
   int zerr;
 
-  /*
-   * Initialize the zlib stream struct.
-   */
-  memset(&zstream, 0, sizeof(zstream));
-  zstream.zalloc = Z_NULL;
-  zstream.zfree = Z_NULL;
-  zstream.opaque = Z_NULL;
-  zstream.next_in = NULL;
-  zstream.avail_in = 0;
-  zstream.next_out = (Bytef*) write_buf;
-  zstream.avail_out = kBufSize;
-  zstream.data_type = Z_UNKNOWN;
-
-  /*
-   * Use the undocumented "negative window bits" feature to tell zlib
-   * that there's no zlib header waiting for it.
-   */
-  zerr = inflateInit2(&zstream, -MAX_WBITS);
-  if (zerr != Z_OK) {
-    if (zerr == Z_VERSION_ERROR) {
-      ALOGE("Installed zlib is not compatible with linked version (%s)",
-        ZLIB_VERSION);
-    } else {
-      ALOGW("Call to inflateInit2 failed (zerr=%d)", zerr);
-    }
-
-    return kZlibError;
+  int32_t result = ResetInflater(inflater);
+  if (result) {
+    return result;
   }
 
+  z_stream* zstream = &inflater->zstream;
+  zstream->next_out = (Bytef*) begin;
+  zstream->avail_out = length;
+
   const uint32_t uncompressed_length = entry->uncompressed_length;
 
+  off64_t offset = entry->offset;
   uint32_t compressed_length = entry->compressed_length;
-  uint32_t write_count = 0;
+  uint64_t crc = 0;
   do {
     /* read as much as we can */
-    if (zstream.avail_in == 0) {
+    if (zstream->avail_in == 0) {
       const ZD_TYPE getSize = (compressed_length > kBufSize) ? kBufSize : compressed_length;
-      const ZD_TYPE actual = TEMP_FAILURE_RETRY(read(fd, read_buf, getSize));
+      const ZD_TYPE actual = ReadAtOffset(fd, read_buf, getSize, offset);
       if (actual != getSize) {
         ALOGW("Zip: inflate read failed (" ZD " vs " ZD ")", actual, getSize);
-        result = kIoError;
-        goto z_bail;
+        return kIoError;
       }
 
       compressed_length -= getSize;
+      offset += getSize;
 
-      zstream.next_in = read_buf;
-      zstream.avail_in = getSize;
+      zstream->next_in = read_buf;
+      zstream->avail_in = getSize;
     }
 
     /* uncompress the data */
-    zerr = inflate(&zstream, Z_NO_FLUSH);
+    zerr = inflate(zstream, Z_NO_FLUSH);
+    if (zerr == Z_BUF_ERROR && zstream->avail_out == 0) {
+      // The file might have declared a bogus length.
+      ALOGW("Zip: inflated data exceeds %" PRIu32 " bytes", length);
+      return kInconsistentInformation;
+    }
     if (zerr != Z_OK && zerr != Z_STREAM_END) {
       ALOGW("Zip: inflate zerr=%d (nIn=%p aIn=%u nOut=%p aOut=%u)",
-          zerr, zstream.next_in, zstream.avail_in,
-          zstream.next_out, zstream.avail_out);
-      result = kZlibError;
-      goto z_bail;
+          zerr, zstream->next_in, zstream->avail_in,
+          zstream->next_out, zstream->avail_out);
+      return kZlibError;
     }
 
-    /* write when we're full or when we're done */
-    if (zstream.avail_out == 0 ||
-      (zerr == Z_STREAM_END && zstream.avail_out != kBufSize)) {
-      const size_t write_size = zstream.next_out - write_buf;
-      // The file might have declared a bogus length.
-      if (write_size + write_count > length) {
-        goto z_bail;
+    /* hand over the output when we're full or when we're done */
+    if (func != NULL && (zstream->avail_out == 0 ||
+        (zerr == Z_STREAM_END && zstream->avail_out != length))) {
+      const size_t write_size = zstream->next_out - begin;
+      crc = crc32(crc, begin, write_size);
+      if (!func(begin, write_size, cookie)) {
+        return kIoError;
       }
-      memcpy(begin + write_count, write_buf, write_size);
-      write_count += write_size;
 
-      zstream.next_out = write_buf;
-      zstream.avail_out = kBufSize;
+      zstream->next_out = begin;
+      zstream->avail_out = length;
     }
   } while (zerr == Z_OK);
 
   assert(zerr == Z_STREAM_END);     /* other errors should've been caught */
 
-  // stream.adler holds the crc32 value for such streams.
-  *crc_out = zstream.adler;
+  // A raw deflate stream carries no checksum of its own, so compute the
+  // crc of the output while it is still in the cache.
+  if (func == NULL) {
+    crc = crc32(crc, begin, zstream->next_out - begin);
+  }
+  *crc_out = crc;
 
-  if (zstream.total_out != uncompressed_length || compressed_length != 0) {
+  if (zstream->total_out != uncompressed_length || compressed_length != 0) {
     ALOGW("Zip: size mismatch on inflated file (%lu vs %" PRIu32 ")",
-        zstream.total_out, uncompressed_length);
-    result = kInconsistentInformation;
-    goto z_bail;
+        zstream->total_out, uncompressed_length);
+    return kInconsistentInformation;
   }
 
-  result = 0;
-
-z_bail:
-  inflateEnd(&zstream);    /* free up any allocated structures */
-
-  return result;
+  return 0;
 }
 
-int32_t ExtractToMemory(ZipArchiveHandle handle,
-                        ZipEntry* entry, uint8_t* begin, uint32_t size) {
-  ZipArchive* archive = (ZipArchive*) handle;
+/*
+ * Extract |entry| either to |begin|, or a chunk at a time to |func|, as
+ * described for CopyFileToFile and InflateToFile.  Only positioned reads
+ * are made on the archive's fd, so with distinct inflaters several entries
+ * can be extracted at once.
+ */
+static int32_t ExtractEntry(ZipArchive* archive, Inflater* inflater, ZipEntry* entry,
+                            uint8_t* begin, uint32_t size,
+                            ProcessZipEntryFunction func, void* cookie) {
   const uint16_t method = entry->method;
-  off64_t data_offset = entry->offset;
+  const off64_t data_end = entry->offset + entry->compressed_length;
 
-  if (lseek64(archive->fd, data_offset, SEEK_SET) != data_offset) {
-    ALOGW("Zip: lseek to data at %" PRId64 " failed", (int64_t)data_offset);
-    return kIoError;
-  }
-
-  // this should default to kUnknownCompressionMethod.
-  int32_t return_value = -1;
+  int32_t return_value = kUnsupportedMethod;
   uint64_t crc = 0;
   if (method == kCompressStored) {
-    return_value = CopyFileToFile(archive->fd, begin, size, &crc);
+    // Copy the entry's own length, so that its crc can be checked.
+    const uint32_t length = entry->uncompressed_length;
+    if (func == NULL && length > size) {
+      ALOGW("Zip: stored data exceeds %" PRIu32 " bytes", size);
+      return kInconsistentInformation;
+    }
+    return_value = CopyFileToFile(archive->fd, entry->offset, begin, length,
+                                  func, cookie, &crc);
   } else if (method == kCompressDeflated) {
-    return_value = InflateToFile(archive->fd, entry, begin, size, &crc);
+    return_value = InflateToFile(archive->fd, inflater, entry, begin, size,
+                                 func, cookie, &crc);
+  }
+  if (return_value) {
+    return return_value;
   }
 
-  if (!return_value && entry->has_data_descriptor) {
-    return_value = UpdateEntryFromDataDescriptor(archive->fd, entry);
+  if (entry->has_data_descriptor) {
+    return_value = UpdateEntryFromDataDescriptor(archive->fd, data_end, entry);
     if (return_value) {
       return return_value;
     }
   }
 
-  // TODO: Fix this check by passing the right flags to inflate2 so that
-  // it calculates the CRC for us.
-  if (entry->crc32 != crc && false) {
+  if (entry->crc32 != crc) {
     ALOGW("Zip: crc mismatch: expected %" PRIu32 ", was %" PRIu64, entry->crc32, crc);
     return kInconsistentInformation;
   }
 
-  return return_value;
+  return 0;
 }
 
-int32_t ExtractEntryToFile(ZipArchiveHandle handle,
-                           ZipEntry* entry, int fd) {
-  const int32_t declared_length = entry->uncompressed_length;
+int32_t ExtractToMemory(ZipArchiveHandle handle,
+                        ZipEntry* entry, uint8_t* begin, uint32_t size) {
+  ZipArchive* archive = (ZipArchive*) handle;
+  return ExtractEntry(archive, &archive->inflater, entry, begin, size, NULL, NULL);
+}
+
+int32_t ProcessZipEntryContents(ZipArchiveHandle handle, ZipEntry* entry,
+                                ProcessZipEntryFunction func, void* cookie) {
+  ZipArchive* archive = (ZipArchive*) handle;
+  uint8_t buf[kBufSize];
+  return ExtractEntry(archive, &archive->inflater, entry, buf, kBufSize, func, cookie);
+}
+
+int32_t MapStoredEntry(ZipArchiveHandle handle, const ZipEntry* entry,
+                       const uint8_t** data, ZipEntryMapHandle* map_handle) {
+  ZipArchive* archive = (ZipArchive*) handle;
+  *data = NULL;
+  *map_handle = NULL;
+
+  if (entry->method != kCompressStored) {
+    ALOGW("Zip: can only map stored entries, method is %" PRIu16, entry->method);
+    return kUnsupportedMethod;
+  }
+
+  // There is nothing to map for an empty entry.
+  if (entry->uncompressed_length == 0) {
+    return 0;
+  }
+
+  android::FileMap* map = MapFileSegment(archive->fd, entry->offset,
+                                         entry->uncompressed_length,
+                                         true /* read only */, kTempMappingFileName);
+  if (map == NULL) {
+    return kMmapFailed;
+  }
+
+  *data = reinterpret_cast<const uint8_t*>(map->getDataPtr());
+  *map_handle = map;
+  return 0;
+}
+
+void UnmapEntry(ZipEntryMapHandle map_handle) {
+  if (map_handle != NULL) {
+    reinterpret_cast<android::FileMap*>(map_handle)->release();
+  }
+}
+
+#if defined(__linux__)
+/*
+ * Copy a stored entry to |fd| at |current_offset| within the kernel.
+ * Returns 1 if the entry can't be copied this way, so the caller should
+ * fall back to extracting through a mapping.  The copy never reaches user
+ * space, so the crc is computed over a read-only mapping of the entry in
+ * the archive instead, which also brings it into the page cache for
+ * sendfile.
+ */
+static int32_t SendStoredEntry(ZipArchive* archive, ZipEntry* entry, int fd,
+                               off64_t current_offset) {
+  android::FileMap* map = MapFileSegment(archive->fd, entry->offset,
+                                         entry->uncompressed_length,
+                                         true /* read only */, kTempMappingFileName);
+  if (map == NULL) {
+    return 1;
+  }
+  const uint32_t crc = crc32(0L, reinterpret_cast<const Bytef*>(map->getDataPtr()),
+                             entry->uncompressed_length);
+  map->release();
+
+  off64_t in_offset = entry->offset;
+  uint32_t remaining = entry->uncompressed_length;
+  while (remaining > 0) {
+    const ssize_t sent = TEMP_FAILURE_RETRY(sendfile64(fd, archive->fd, &in_offset, remaining));
+    if (sent <= 0) {
+      if (sent < 0 && remaining == entry->uncompressed_length &&
+          (errno == EINVAL || errno == ENOSYS)) {
+        return 1;
+      }
+      ALOGW("Zip: sendfile of stored entry failed: %s", sent ? strerror(errno) : "EOF");
+      return kIoError;
+    }
+    remaining -= sent;
+  }
+
+  // sendfile advanced |fd| but ExtractEntryToFile leaves it where it was.
+  if (lseek64(fd, current_offset, SEEK_SET) != current_offset) {
+    ALOGW("Zip: unable to restore offset on fd %d: %s", fd, strerror(errno));
+    return kIoError;
+  }
+
+  if (entry->has_data_descriptor) {
+    const int32_t result = UpdateEntryFromDataDescriptor(archive->fd, in_offset, entry);
+    if (result) {
+      return result;
+    }
+  }
+
+  if (entry->crc32 != crc) {
+    ALOGW("Zip: crc mismatch: expected %" PRIu32 ", was %" PRIu32, entry->crc32, crc);
+    return kInconsistentInformation;
+  }
+
+  return 0;
+}
+#endif  // __linux__
 
+/*
+ * Extend or truncate |fd| to hold |length| bytes from its current offset,
+ * which is returned in |offset|, as ExtractEntryToFile promises to.
+ */
+static int32_t PrepareOutputFile(int fd, uint32_t length, off64_t* offset) {
   const off64_t current_offset = lseek64(fd, 0, SEEK_CUR);
   if (current_offset == -1) {
     ALOGW("Zip: unable to seek to current location on fd %d: %s", fd,
@@ -1116,13 +1463,28 @@ int32_t ExtractEntryToFile(ZipArchiveHandle handle,
     return kIoError;
   }
 
-  int result = TEMP_FAILURE_RETRY(ftruncate(fd, declared_length + current_offset));
+  int result = TEMP_FAILURE_RETRY(ftruncate(fd, length + current_offset));
   if (result == -1) {
     ALOGW("Zip: unable to truncate file to %" PRId64 ": %s",
-          (int64_t)(declared_length + current_offset), strerror(errno));
+          (int64_t)(length + current_offset), strerror(errno));
     return kIoError;
   }
 
+  *offset = current_offset;
+  return 0;
+}
+
+int32_t ExtractEntryToFile(ZipArchiveHandle handle,
+                           ZipEntry* entry, int fd) {
+  ZipArchive* archive = (ZipArchive*) handle;
+  const int32_t declared_length = entry->uncompressed_length;
+
+  off64_t current_offset;
+  int32_t result = PrepareOutputFile(fd, declared_length, &current_offset);
+  if (result) {
+    return result;
+  }
+
   // Don't attempt to map a region of length 0. We still need the
   // ftruncate() though, since the API guarantees that we will truncate
   // the file to the end of the uncompressed output.
@@ -1130,6 +1492,16 @@ int32_t ExtractEntryToFile(ZipArchiveHandle handle,
       return 0;
   }
 
+#if defined(__linux__)
+  // Stored entries can be copied without passing through user space.
+  if (entry->method == kCompressStored) {
+    result = SendStoredEntry(archive, entry, fd, current_offset);
+    if (result <= 0) {
+      return result;
+    }
+  }
+#endif
+
   android::FileMap* map  = MapFileSegment(fd, current_offset, declared_length,
                                           false, kTempMappingFileName);
   if (map == NULL) {
@@ -1143,6 +1515,184 @@ int32_t ExtractEntryToFile(ZipArchiveHandle handle,
   return error;
 }
 
+// Writes |len| bytes from |buf| at offset |off| in |fd|, with the same
+// caveats as ReadAtOffset.
+static inline ssize_t WriteAtOffset(int fd, const uint8_t* buf, size_t len,
+                                    off64_t off) {
+#ifdef HAVE_PREAD
+  return TEMP_FAILURE_RETRY(pwrite64(fd, buf, len, off));
+#else
+  if (lseek64(fd, off, SEEK_SET) != off) {
+    ALOGW("Zip: failed seek to offset %" PRId64, off);
+    return kIoError;
+  }
+
+  return TEMP_FAILURE_RETRY(write(fd, buf, len));
+#endif  // HAVE_PREAD
+}
+
+struct FileWriter {
+  int fd;
+  off64_t offset;
+};
+
+static bool WriteToFile(const uint8_t* buf, size_t buf_size, void* cookie) {
+  FileWriter* writer = reinterpret_cast<FileWriter*>(cookie);
+  while (buf_size > 0) {
+    const ssize_t written = WriteAtOffset(writer->fd, buf, buf_size, writer->offset);
+    if (written <= 0) {
+      ALOGW("Zip: write to fd %d failed: %s", writer->fd,
+            written ? strerror(errno) : "no progress");
+      return false;
+    }
+    buf += written;
+    buf_size -= written;
+    writer->offset += written;
+  }
+  return true;
+}
+
+/*
+ * Extract |entry| to |fd| as ExtractEntryToFile would, but a chunk at a
+ * time through a buffer rather than through a mapping of |fd|.  Each chunk
+ * is read, inflated, added to the crc and written while it is in the cache,
+ * and no mapping has to be torn down afterwards, which would interrupt the
+ * other threads of a batch.
+ */
+static int32_t WriteEntryToFile(ZipArchive* archive, Inflater* inflater,
+                                ZipEntry* entry, int fd) {
+  FileWriter writer;
+  writer.fd = fd;
+  int32_t result = PrepareOutputFile(fd, entry->uncompressed_length, &writer.offset);
+  if (result) {
+    return result;
+  }
+
+  uint8_t buf[kBufSize];
+  return ExtractEntry(archive, inflater, entry, buf, kBufSize, WriteToFile, &writer);
+}
+
+/*
+ * The requests of an ExtractEntriesToFiles call, largest first, and the
+ * index of the next one to hand to a worker.
+ */
+struct ExtractBatch {
+  ZipArchive* archive;
+  ZipExtractRequest** requests;
+  size_t num_requests;
+  size_t next;
+#if defined(HAVE_PTHREADS)
+  pthread_mutex_t lock;
+#endif
+};
+
+static ZipExtractRequest* NextRequest(ExtractBatch* batch) {
+  ZipExtractRequest* request = NULL;
+#if defined(HAVE_PTHREADS)
+  pthread_mutex_lock(&batch->lock);
+#endif
+  if (batch->next < batch->num_requests) {
+    request = batch->requests[batch->next++];
+  }
+#if defined(HAVE_PTHREADS)
+  pthread_mutex_unlock(&batch->lock);
+#endif
+  return request;
+}
+
+static void* ExtractWorker(void* arg) {
+  ExtractBatch* batch = reinterpret_cast<ExtractBatch*>(arg);
+  Inflater inflater;
+  inflater.initialized = false;
+
+  ZipExtractRequest* request;
+  while ((request = NextRequest(batch)) != NULL) {
+    request->result = WriteEntryToFile(batch->archive, &inflater, &request->entry,
+                                       request->fd);
+  }
+
+  ReleaseInflater(&inflater);
+  return NULL;
+}
+
+static int CompareRequestSizes(const void* lhs, const void* rhs) {
+  const ZipExtractRequest* l = *reinterpret_cast<ZipExtractRequest* const*>(lhs);
+  const ZipExtractRequest* r = *reinterpret_cast<ZipExtractRequest* const*>(rhs);
+  if (l->entry.uncompressed_length != r->entry.uncompressed_length) {
+    return (l->entry.uncompressed_length > r->entry.uncompressed_length) ? -1 : 1;
+  }
+  return (l < r) ? -1 : (l > r);
+}
+
+int32_t ExtractEntriesToFiles(ZipArchiveHandle handle, ZipExtractRequest* requests,
+                              size_t num_requests, uint32_t num_threads) {
+  if (num_requests == 0) {
+    return 0;
+  }
+
+  // Hand out the largest entries first, so that a big entry isn't left
+  // to run on its own once the others are done.
+  ZipExtractRequest** order =
+      reinterpret_cast<ZipExtractRequest**>(malloc(num_requests * sizeof(*order)));
+  if (order == NULL) {
+    return kIoError;
+  }
+  for (size_t i = 0; i < num_requests; i++) {
+    order[i] = &requests[i];
+  }
+  qsort(order, num_requests, sizeof(*order), CompareRequestSizes);
+
+  ExtractBatch batch;
+  batch.archive = (ZipArchive*) handle;
+  batch.requests = order;
+  batch.num_requests = num_requests;
+  batch.next = 0;
+
+#if defined(HAVE_PTHREADS) && defined(HAVE_PREAD)
+  if (num_threads == 0) {
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = (cpus > 0) ? cpus : 1;
+  }
+  if (num_threads > num_requests) {
+    num_threads = num_requests;
+  }
+
+  // The calling thread is one of the workers.
+  pthread_mutex_init(&batch.lock, NULL);
+  pthread_t* threads = new pthread_t[num_threads];
+  uint32_t started = 0;
+  while (started + 1 < num_threads &&
+      pthread_create(&threads[started], NULL, ExtractWorker, &batch) == 0) {
+    started++;
+  }
+  ExtractWorker(&batch);
+  for (uint32_t i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  delete[] threads;
+  pthread_mutex_destroy(&batch.lock);
+#else
+  // Without pread, concurrent reads would race on the archive's offset.
+  (void) num_threads;
+#if defined(HAVE_PTHREADS)
+  pthread_mutex_init(&batch.lock, NULL);
+#endif
+  ExtractWorker(&batch);
+#if defined(HAVE_PTHREADS)
+  pthread_mutex_destroy(&batch.lock);
+#endif
+#endif
+
+  free(order);
+
+  for (size_t i = 0; i < num_requests; i++) {
+    if (requests[i].result) {
+      return requests[i].result;
+    }
+  }
+  return 0;
+}
+
 const char* ErrorCodeString(int32_t error_code) {
   if (error_code > kErrorMessageLowerBound && error_code < kErrorMessageUpperBound) {
     return kErrorMessages[error_code * -1];
@@ -0,0 +1,241 @@
+//
+// Copyright 2014 The Android Open Source Project
+//
+
+#include "ziparchive/zip_archive.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+
+// The shape of the generated archive: many small entries, alternately
+// deflated like dex files and resources and stored like native libraries.
+static const size_t kNumEntries = 30000;
+static const size_t kEntryUnitSize = 256;
+
+// The output files are reused across entries, so that the number of
+// entries isn't bounded by RLIMIT_NOFILE.
+static const size_t kNumOutputFiles = 64;
+
+static void Fail(const char* what, const char* detail) {
+  fprintf(stderr, "ziparchive-benchmarks: %s: %s\n", what, detail);
+  exit(EXIT_FAILURE);
+}
+
+static void CheckZip(int32_t result, const char* what) {
+  if (result != 0) {
+    Fail(what, ErrorCodeString(result));
+  }
+}
+
+// Returns an unlinked temporary file, on the device if we're on one.
+static int OpenTemporaryFile() {
+  char path[] = "/data/local/tmp/ziparchive_benchmark_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd != -1) {
+    unlink(path);
+    return fd;
+  }
+  char host_path[] = "/tmp/ziparchive_benchmark_XXXXXX";
+  fd = mkstemp(host_path);
+  if (fd == -1) {
+    Fail("couldn't create a temporary file", strerror(errno));
+  }
+  unlink(host_path);
+  return fd;
+}
+
+static void Put16(std::vector<uint8_t>* out, uint16_t value) {
+  out->push_back(value & 0xff);
+  out->push_back(value >> 8);
+}
+
+static void Put32(std::vector<uint8_t>* out, uint32_t value) {
+  Put16(out, value & 0xffff);
+  Put16(out, value >> 16);
+}
+
+// Writes the fields common to local and central directory file headers,
+// from "version needed to extract" through "extra field length".
+static void PutFileHeader(std::vector<uint8_t>* out, uint16_t method, uint32_t crc,
+                          uint32_t compressed_length, uint32_t uncompressed_length,
+                          const std::string& name) {
+  Put16(out, 20);  // version needed to extract
+  Put16(out, 0);   // general purpose bit flags
+  Put16(out, method);
+  Put16(out, 0);   // modification time
+  Put16(out, 0x21);  // modification date, 1980-01-01
+  Put32(out, crc);
+  Put32(out, compressed_length);
+  Put32(out, uncompressed_length);
+  Put16(out, name.size());
+  Put16(out, 0);   // extra field length
+}
+
+static std::vector<uint8_t> Deflate(const std::vector<uint8_t>& data) {
+  z_stream zstream;
+  memset(&zstream, 0, sizeof(zstream));
+  // A negative window size asks for a raw deflate stream, as zip uses.
+  if (deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    Fail("deflateInit2 failed", zstream.msg ? zstream.msg : "");
+  }
+  std::vector<uint8_t> out(deflateBound(&zstream, data.size()));
+  zstream.next_in = const_cast<Bytef*>(&data[0]);
+  zstream.avail_in = data.size();
+  zstream.next_out = &out[0];
+  zstream.avail_out = out.size();
+  if (deflate(&zstream, Z_FINISH) != Z_STREAM_END) {
+    Fail("deflate failed", zstream.msg ? zstream.msg : "");
+  }
+  out.resize(zstream.total_out);
+  deflateEnd(&zstream);
+  return out;
+}
+
+// Returns a file holding the generated archive.  It's created once and
+// shared by every benchmark; each caller gets its own descriptor for it.
+static int OpenGeneratedArchive() {
+  static int archive_fd = -1;
+  if (archive_fd == -1) {
+    std::vector<uint8_t> archive;
+    std::vector<uint8_t> directory;
+    uint32_t seed = 1;
+    for (size_t i = 0; i < kNumEntries; i++) {
+      char name[32];
+      const bool stored = (i % 2) != 0;
+      snprintf(name, sizeof(name), stored ? "lib/%zu.so" : "res/%zu.xml", i);
+      const std::string entry_name(name);
+
+      // Stored entries are noise, deflated entries are text.
+      std::vector<uint8_t> data((i % 4 + 1) * kEntryUnitSize);
+      for (size_t j = 0; j < data.size(); j++) {
+        seed = seed * 1103515245 + 12345;
+        data[j] = stored ? (seed >> 16) : "<item name=\"x\"/>\n"[j % 17];
+      }
+      const uint32_t crc = crc32(0L, &data[0], data.size());
+      const std::vector<uint8_t> contents = stored ? data : Deflate(data);
+      const uint16_t method = stored ? kCompressStored : kCompressDeflated;
+
+      Put32(&directory, 0x02014b50);
+      Put16(&directory, 20);  // version made by
+      PutFileHeader(&directory, method, crc, contents.size(), data.size(), entry_name);
+      Put16(&directory, 0);   // file comment length
+      Put16(&directory, 0);   // disk number start
+      Put16(&directory, 0);   // internal file attributes
+      Put32(&directory, 0);   // external file attributes
+      Put32(&directory, archive.size());
+      directory.insert(directory.end(), entry_name.begin(), entry_name.end());
+
+      Put32(&archive, 0x04034b50);
+      PutFileHeader(&archive, method, crc, contents.size(), data.size(), entry_name);
+      archive.insert(archive.end(), entry_name.begin(), entry_name.end());
+      archive.insert(archive.end(), contents.begin(), contents.end());
+    }
+
+    const uint32_t directory_offset = archive.size();
+    archive.insert(archive.end(), directory.begin(), directory.end());
+    Put32(&archive, 0x06054b50);
+    Put16(&archive, 0);  // number of this disk
+    Put16(&archive, 0);  // disk where the central directory starts
+    Put16(&archive, kNumEntries);
+    Put16(&archive, kNumEntries);
+    Put32(&archive, directory.size());
+    Put32(&archive, directory_offset);
+    Put16(&archive, 0);  // comment length
+
+    archive_fd = OpenTemporaryFile();
+    if (TEMP_FAILURE_RETRY(write(archive_fd, &archive[0], archive.size())) !=
+        static_cast<ssize_t>(archive.size())) {
+      Fail("couldn't write the generated archive", strerror(errno));
+    }
+  }
+
+  const int fd = dup(archive_fd);
+  if (fd == -1) {
+    Fail("couldn't dup the generated archive", strerror(errno));
+  }
+  return fd;
+}
+
+// Extract every entry of the generated archive, in the way a package
+// install extracts the dex files and native libraries of an APK.
+static void ExtractArchive(int iters, int threads) {
+  ZipArchiveHandle handle;
+  CheckZip(OpenArchiveFd(OpenGeneratedArchive(), "generated", &handle),
+           "couldn't open the generated archive");
+
+  std::vector<ZipEntry> entries;
+  void* cookie;
+  CheckZip(StartIteration(handle, &cookie, NULL), "couldn't iterate the archive");
+  ZipEntry entry;
+  ZipEntryName name;
+  int32_t result;
+  while ((result = Next(cookie, &entry, &name)) == 0) {
+    entries.push_back(entry);
+  }
+  if (result != -1) {
+    CheckZip(result, "couldn't iterate the archive");
+  }
+  if (entries.size() != kNumEntries) {
+    Fail("unexpected number of entries in the generated archive", "");
+  }
+
+  std::vector<ZipExtractRequest> requests(kNumOutputFiles);
+  for (size_t i = 0; i < requests.size(); i++) {
+    requests[i].fd = OpenTemporaryFile();
+  }
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; i++) {
+    // Extract the entries a batch at a time, one entry to each output file.
+    for (size_t first = 0; first < entries.size(); first += requests.size()) {
+      const size_t count = std::min(requests.size(), entries.size() - first);
+      for (size_t j = 0; j < count; j++) {
+        requests[j].entry = entries[first + j];
+        lseek64(requests[j].fd, 0, SEEK_SET);
+      }
+      if (threads == 0) {
+        for (size_t j = 0; j < count; j++) {
+          CheckZip(ExtractEntryToFile(handle, &requests[j].entry, requests[j].fd),
+                   "ExtractEntryToFile failed");
+        }
+      } else {
+        CheckZip(ExtractEntriesToFiles(handle, &requests[0], count, threads),
+                 "ExtractEntriesToFiles failed");
+      }
+    }
+  }
+  StopBenchmarkTiming();
+
+  for (size_t i = 0; i < requests.size(); i++) {
+    close(requests[i].fd);
+  }
+  CloseArchive(handle);
+}
+
+/*
+ *	Measure extracting the entries one at a time with ExtractEntryToFile.
+ */
+static void BM_zip_extract_serial(int iters) {
+  ExtractArchive(iters, 0);
+}
+BENCHMARK(BM_zip_extract_serial);
+
+/*
+ *	Measure extracting the entries with ExtractEntriesToFiles over a number
+ * of threads.
+ */
+static void BM_zip_extract_batch(int iters, int threads) {
+  ExtractArchive(iters, threads);
+}
+BENCHMARK(BM_zip_extract_batch)->Arg(1)->Arg(2)->Arg(4);
@@ -94,6 +94,79 @@ TEST(ziparchive, Iteration) {
   CloseArchive(handle);
 }
 
+TEST(ziparchive, IterationWithPrefix) {
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kValidZip, &handle));
+
+  void* iteration_cookie;
+  ASSERT_EQ(0, StartIteration(handle, &iteration_cookie, "b/"));
+
+  ZipEntry data;
+  ZipEntryName name;
+
+  // Entries with a prefix are returned in name order.
+  ASSERT_EQ(0, Next(iteration_cookie, &data, &name));
+  AssertNameEquals("b/", name);
+
+  ASSERT_EQ(0, Next(iteration_cookie, &data, &name));
+  AssertNameEquals("b/c.txt", name);
+
+  ASSERT_EQ(0, Next(iteration_cookie, &data, &name));
+  AssertNameEquals("b/d.txt", name);
+
+  // End of iteration.
+  ASSERT_EQ(-1, Next(iteration_cookie, &data, &name));
+
+  CloseArchive(handle);
+}
+
+TEST(ziparchive, IterationWithPrefixIndexBuiltOnOpen) {
+  const std::string abs_path = test_data_dir + "/" + kValidZip;
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWithFlags(abs_path.c_str(), kOpenBuildPrefixIndex, &handle));
+
+  void* iteration_cookie;
+  ASSERT_EQ(0, StartIteration(handle, &iteration_cookie, "b"));
+
+  ZipEntry data;
+  ZipEntryName name;
+
+  ASSERT_EQ(0, Next(iteration_cookie, &data, &name));
+  AssertNameEquals("b.txt", name);
+
+  ASSERT_EQ(0, Next(iteration_cookie, &data, &name));
+  AssertNameEquals("b/", name);
+
+  ASSERT_EQ(0, Next(iteration_cookie, &data, &name));
+  AssertNameEquals("b/c.txt", name);
+
+  ASSERT_EQ(0, Next(iteration_cookie, &data, &name));
+  AssertNameEquals("b/d.txt", name);
+
+  // End of iteration.
+  ASSERT_EQ(-1, Next(iteration_cookie, &data, &name));
+
+  CloseArchive(handle);
+}
+
+TEST(ziparchive, IterationWithUnmatchedPrefix) {
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kValidZip, &handle));
+
+  void* iteration_cookie;
+  ZipEntry data;
+  ZipEntryName name;
+
+  ASSERT_EQ(0, StartIteration(handle, &iteration_cookie, "x"));
+  ASSERT_EQ(-1, Next(iteration_cookie, &data, &name));
+
+  // A prefix longer than any matching name.
+  ASSERT_EQ(0, StartIteration(handle, &iteration_cookie, "b/c.txt/"));
+  ASSERT_EQ(-1, Next(iteration_cookie, &data, &name));
+
+  CloseArchive(handle);
+}
+
 TEST(ziparchive, FindEntry) {
   ZipArchiveHandle handle;
   ASSERT_EQ(0, OpenArchiveWrapper(kValidZip, &handle));
@@ -140,6 +213,75 @@ TEST(ziparchive, ExtractToMemory) {
   CloseArchive(handle);
 }
 
+static bool AppendToVector(const uint8_t* buf, size_t buf_size, void* cookie) {
+  std::vector<uint8_t>* output = reinterpret_cast<std::vector<uint8_t>*>(cookie);
+  output->insert(output->end(), buf, buf + buf_size);
+  return true;
+}
+
+static bool StopProcessing(const uint8_t*, size_t, void*) {
+  return false;
+}
+
+TEST(ziparchive, ProcessZipEntryContents) {
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kValidZip, &handle));
+
+  // An entry that's deflated.
+  ZipEntry data;
+  ASSERT_EQ(0, FindEntry(handle, "a.txt", &data));
+  std::vector<uint8_t> output;
+  ASSERT_EQ(0, ProcessZipEntryContents(handle, &data, AppendToVector, &output));
+  ASSERT_EQ(sizeof(kATxtContents), output.size());
+  ASSERT_EQ(0, memcmp(&output[0], kATxtContents, sizeof(kATxtContents)));
+
+  // An entry that's stored, extracted with the same inflater state reused.
+  ASSERT_EQ(0, FindEntry(handle, "b.txt", &data));
+  output.clear();
+  ASSERT_EQ(0, ProcessZipEntryContents(handle, &data, AppendToVector, &output));
+  ASSERT_EQ(sizeof(kBTxtContents), output.size());
+  ASSERT_EQ(0, memcmp(&output[0], kBTxtContents, sizeof(kBTxtContents)));
+
+  // The deflated entry again, after the inflater has been used once.
+  ASSERT_EQ(0, FindEntry(handle, "a.txt", &data));
+  output.clear();
+  ASSERT_EQ(0, ProcessZipEntryContents(handle, &data, AppendToVector, &output));
+  ASSERT_EQ(sizeof(kATxtContents), output.size());
+  ASSERT_EQ(0, memcmp(&output[0], kATxtContents, sizeof(kATxtContents)));
+
+  // Stopping the extraction is an error.
+  ASSERT_GT(0, ProcessZipEntryContents(handle, &data, StopProcessing, NULL));
+
+  CloseArchive(handle);
+}
+
+TEST(ziparchive, MapStoredEntry) {
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kValidZip, &handle));
+
+  ZipEntry data;
+  const uint8_t* contents;
+  ZipEntryMapHandle map_handle;
+
+  // An entry that's stored.
+  ASSERT_EQ(0, FindEntry(handle, "b.txt", &data));
+  ASSERT_EQ(0, MapStoredEntry(handle, &data, &contents, &map_handle));
+  ASSERT_TRUE(map_handle != NULL);
+
+  // The mapping outlives the archive.
+  CloseArchive(handle);
+  ASSERT_EQ(0, memcmp(contents, kBTxtContents, sizeof(kBTxtContents)));
+  UnmapEntry(map_handle);
+
+  // An entry that's deflated can't be mapped.
+  ASSERT_EQ(0, OpenArchiveWrapper(kValidZip, &handle));
+  ASSERT_EQ(0, FindEntry(handle, "a.txt", &data));
+  ASSERT_GT(0, MapStoredEntry(handle, &data, &contents, &map_handle));
+  ASSERT_TRUE(map_handle == NULL);
+
+  CloseArchive(handle);
+}
+
 static const uint32_t kEmptyEntriesZip[] = {
       0x04034b50, 0x0000000a, 0x63600000, 0x00004438, 0x00000000, 0x00000000,
       0x00090000, 0x6d65001c, 0x2e797470, 0x55747874, 0x03000954, 0x52e25c13,
@@ -247,6 +389,166 @@ TEST(ziparchive, ExtractToFile) {
   close(fd);
 }
 
+TEST(ziparchive, ExtractStoredEntryToFile) {
+  char kTempFilePattern[] = "zip_archive_input_XXXXXX";
+  int fd = make_temporary_file(kTempFilePattern);
+  ASSERT_NE(-1, fd);
+  const uint8_t data[8] = { '1', '2', '3', '4', '5', '6', '7', '8' };
+  const ssize_t data_size = sizeof(data);
+
+  ASSERT_EQ(data_size, TEMP_FAILURE_RETRY(write(fd, data, data_size)));
+
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kValidZip, &handle));
+
+  ZipEntry entry;
+  ASSERT_EQ(0, FindEntry(handle, "b.txt", &entry));
+  ASSERT_EQ(kCompressStored, entry.method);
+  ASSERT_EQ(0, ExtractEntryToFile(handle, &entry, fd));
+
+  // The offset of the file is left where it was.
+  ASSERT_EQ(data_size, lseek64(fd, 0, SEEK_CUR));
+
+  // Assert that the file holds the original data and then the entry.
+  std::vector<uint8_t> file_data(data_size + sizeof(kBTxtContents));
+  ASSERT_EQ(0, lseek64(fd, 0, SEEK_SET));
+  ASSERT_EQ(static_cast<ssize_t>(file_data.size()),
+            TEMP_FAILURE_RETRY(read(fd, &file_data[0], file_data.size())));
+  ASSERT_EQ(0, memcmp(&file_data[0], data, data_size));
+  ASSERT_EQ(0, memcmp(&file_data[data_size], kBTxtContents, sizeof(kBTxtContents)));
+  ASSERT_EQ(static_cast<off64_t>(file_data.size()), lseek64(fd, 0, SEEK_END));
+
+  // The next entry still extracts from the right place in the archive.
+  ASSERT_EQ(0, FindEntry(handle, "a.txt", &entry));
+  std::vector<uint8_t> output;
+  ASSERT_EQ(0, ProcessZipEntryContents(handle, &entry, AppendToVector, &output));
+  ASSERT_EQ(0, memcmp(&output[0], kATxtContents, sizeof(kATxtContents)));
+
+  CloseArchive(handle);
+  close(fd);
+}
+
+TEST(ziparchive, ExtractCorruptStoredEntryToFile) {
+  // Copy the archive, corrupting the first byte of the stored b.txt.
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kValidZip, &handle));
+  ZipEntry entry;
+  ASSERT_EQ(0, FindEntry(handle, "b.txt", &entry));
+  ASSERT_EQ(kCompressStored, entry.method);
+  const int valid_fd = GetFileDescriptor(handle);
+  const off64_t archive_size = lseek64(valid_fd, 0, SEEK_END);
+  ASSERT_LT(0, archive_size);
+  std::vector<uint8_t> archive_data(archive_size);
+  ASSERT_EQ(0, lseek64(valid_fd, 0, SEEK_SET));
+  ASSERT_EQ(static_cast<ssize_t>(archive_size),
+            TEMP_FAILURE_RETRY(read(valid_fd, &archive_data[0], archive_size)));
+  CloseArchive(handle);
+  archive_data[entry.offset] ^= 0xff;
+
+  char kArchivePattern[] = "zip_archive_corrupt_XXXXXX";
+  const int archive_fd = make_temporary_file(kArchivePattern);
+  ASSERT_NE(-1, archive_fd);
+  ASSERT_EQ(static_cast<ssize_t>(archive_size),
+            TEMP_FAILURE_RETRY(write(archive_fd, &archive_data[0], archive_size)));
+  ASSERT_EQ(0, lseek64(archive_fd, 0, SEEK_SET));
+
+  // The damage is caught however the stored entry is copied.
+  ASSERT_EQ(0, OpenArchiveFd(archive_fd, "corrupt", &handle));
+  ASSERT_EQ(0, FindEntry(handle, "b.txt", &entry));
+  char kTempFilePattern[] = "zip_archive_input_XXXXXX";
+  const int fd = make_temporary_file(kTempFilePattern);
+  ASSERT_NE(-1, fd);
+  ASSERT_GT(0, ExtractEntryToFile(handle, &entry, fd));
+
+  // Entries that weren't damaged still extract.
+  ASSERT_EQ(0, FindEntry(handle, "a.txt", &entry));
+  ASSERT_EQ(0, ExtractEntryToFile(handle, &entry, fd));
+
+  close(fd);
+  CloseArchive(handle);
+}
+
+static void AssertFileContents(int fd, const uint8_t* contents, size_t size) {
+  std::vector<uint8_t> file_data(size);
+  ASSERT_EQ(static_cast<off64_t>(size), lseek64(fd, 0, SEEK_END));
+  ASSERT_EQ(0, lseek64(fd, 0, SEEK_SET));
+  ASSERT_EQ(static_cast<ssize_t>(size),
+            TEMP_FAILURE_RETRY(read(fd, &file_data[0], size)));
+  ASSERT_EQ(0, memcmp(&file_data[0], contents, size));
+}
+
+TEST(ziparchive, ExtractEntriesToFiles) {
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kValidZip, &handle));
+
+  static const char* kEntryNames[] = { "a.txt", "b.txt", "b/c.txt", "b/d.txt" };
+  static const size_t kNumEntries = sizeof(kEntryNames) / sizeof(kEntryNames[0]);
+
+  // More threads than entries, and a single thread.
+  static const uint32_t kThreadCounts[] = { 8, 1 };
+  for (size_t t = 0; t < sizeof(kThreadCounts) / sizeof(kThreadCounts[0]); t++) {
+    ZipExtractRequest requests[kNumEntries];
+    for (size_t i = 0; i < kNumEntries; i++) {
+      char kTempFilePattern[] = "zip_archive_input_XXXXXX";
+      ASSERT_EQ(0, FindEntry(handle, kEntryNames[i], &requests[i].entry));
+      requests[i].fd = make_temporary_file(kTempFilePattern);
+      ASSERT_NE(-1, requests[i].fd);
+      requests[i].result = 1;
+    }
+
+    ASSERT_EQ(0, ExtractEntriesToFiles(handle, requests, kNumEntries, kThreadCounts[t]));
+    for (size_t i = 0; i < kNumEntries; i++) {
+      ASSERT_EQ(0, requests[i].result);
+    }
+    AssertFileContents(requests[0].fd, kATxtContents, sizeof(kATxtContents));
+    AssertFileContents(requests[1].fd, kBTxtContents, sizeof(kBTxtContents));
+
+    for (size_t i = 0; i < kNumEntries; i++) {
+      close(requests[i].fd);
+    }
+  }
+
+  CloseArchive(handle);
+}
+
+TEST(ziparchive, ExtractEntriesToFilesChecksCrc) {
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kValidZip, &handle));
+
+  // One deflated entry and one stored entry, each with a bad crc, between
+  // two good entries.
+  static const char* kEntryNames[] = { "b/c.txt", "a.txt", "b.txt", "b/d.txt" };
+  static const size_t kNumEntries = sizeof(kEntryNames) / sizeof(kEntryNames[0]);
+  ZipExtractRequest requests[kNumEntries];
+  for (size_t i = 0; i < kNumEntries; i++) {
+    char kTempFilePattern[] = "zip_archive_input_XXXXXX";
+    ASSERT_EQ(0, FindEntry(handle, kEntryNames[i], &requests[i].entry));
+    requests[i].fd = make_temporary_file(kTempFilePattern);
+    ASSERT_NE(-1, requests[i].fd);
+  }
+  requests[1].entry.crc32 ^= 1;
+  requests[2].entry.crc32 ^= 1;
+
+  const int32_t result = ExtractEntriesToFiles(handle, requests, kNumEntries, 2);
+  ASSERT_GT(0, result);
+  ASSERT_EQ(0, requests[0].result);
+  ASSERT_EQ(result, requests[1].result);
+  ASSERT_GT(0, requests[2].result);
+  ASSERT_EQ(0, requests[3].result);
+
+  // The same check applies to extracting a single entry.
+  ZipEntry entry;
+  ASSERT_EQ(0, FindEntry(handle, "a.txt", &entry));
+  entry.crc32 ^= 1;
+  std::vector<uint8_t> buffer(entry.uncompressed_length);
+  ASSERT_GT(0, ExtractToMemory(handle, &entry, &buffer[0], buffer.size()));
+
+  for (size_t i = 0; i < kNumEntries; i++) {
+    close(requests[i].fd);
+  }
+  CloseArchive(handle);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
 
@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "logarchive.h"
+
+namespace android {
+
+static uint32_t hashTag(const char *tag, size_t len) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(tag[i])) * 16777619u;
+    }
+    return hash;
+}
+
+static ssize_t writeFully(int fd, const void *buf, size_t len) {
+    const char *p = static_cast<const char *>(buf);
+    size_t left = len;
+
+    while (left > 0) {
+        ssize_t ret = TEMP_FAILURE_RETRY(write(fd, p, left));
+        if (ret <= 0) {
+            return -1;
+        }
+        p += ret;
+        left -= ret;
+    }
+    return len;
+}
+
+// returns len, 0 at end of file, or -1 on error or a short read
+static ssize_t readFully(int fd, void *buf, size_t len) {
+    char *p = static_cast<char *>(buf);
+    size_t left = len;
+
+    while (left > 0) {
+        ssize_t ret = TEMP_FAILURE_RETRY(::read(fd, p, left));
+        if (ret < 0) {
+            return -1;
+        }
+        if (ret == 0) {
+            return (left == len) ? 0 : -1;
+        }
+        p += ret;
+        left -= ret;
+    }
+    return len;
+}
+
+LogArchiveWriter::LogArchiveWriter() {
+    reset();
+}
+
+void LogArchiveWriter::reset() {
+    memset(&mHeader, 0, sizeof(mHeader));
+    mHeader.magic = LOG_ARCHIVE_BLOCK_MAGIC;
+    mStarted = 0;
+    mIndexSize = 0;
+    mTags = 0;
+    memset(mTagTable, 0, sizeof(mTagTable));
+    mRecordsSize = 0;
+}
+
+ssize_t LogArchiveWriter::writeHeader(int fd) {
+    log_archive_header header;
+    header.magic = LOG_ARCHIVE_MAGIC;
+    header.version = LOG_ARCHIVE_VERSION;
+    return writeFully(fd, &header, sizeof(header));
+}
+
+void LogArchiveWriter::addTag(const char *tag, android_LogPriority pri) {
+    size_t len = strlen(tag);
+    if (len > UINT8_MAX) {
+        mHeader.flags |= LOG_ARCHIVE_BLOCK_ALL_TAGS;
+        return;
+    }
+
+    uint32_t hash = hashTag(tag, len);
+    size_t i = hash & (tagTableSize - 1);
+    while (mTagTable[i].offset) {
+        char *entry = mIndex + mTagTable[i].offset - 1;
+        if ((mTagTable[i].hash == hash)
+                && (static_cast<unsigned char>(entry[1]) == len)
+                && !memcmp(entry + 2, tag, len)) {
+            if (entry[0] < pri) {
+                entry[0] = pri;
+            }
+            return;
+        }
+        i = (i + 1) & (tagTableSize - 1);
+    }
+
+    if (mTags >= maxTags) {
+        mHeader.flags |= LOG_ARCHIVE_BLOCK_ALL_TAGS;
+        return;
+    }
+
+    char *entry = mIndex + mIndexSize;
+    entry[0] = pri;
+    entry[1] = len;
+    memcpy(entry + 2, tag, len);
+    mTagTable[i].hash = hash;
+    mTagTable[i].offset = mIndexSize + 1;
+    mIndexSize += 2 + len;
+    ++mTags;
+}
+
+void LogArchiveWriter::add(struct log_msg *msg, const char *tag,
+                           android_LogPriority pri) {
+    size_t len = msg->len();
+    if ((mRecordsSize + len) > sizeof(mRecords)) {
+        return; // caller did not flush when asked
+    }
+    memcpy(mRecords + mRecordsSize, msg->buf, len);
+    mRecordsSize += len;
+
+    uint32_t sec = msg->entry.sec;
+    uint32_t nsec = msg->entry.nsec;
+    if (mHeader.count == 0) {
+        mStarted = log_time(CLOCK_MONOTONIC).nsec();
+        mHeader.first_sec = mHeader.last_sec = sec;
+        mHeader.first_nsec = mHeader.last_nsec = nsec;
+    } else if (log_time(sec, nsec) < log_time(mHeader.first_sec,
+                                               mHeader.first_nsec)) {
+        mHeader.first_sec = sec;
+        mHeader.first_nsec = nsec;
+    } else if (log_time(sec, nsec) > log_time(mHeader.last_sec,
+                                              mHeader.last_nsec)) {
+        mHeader.last_sec = sec;
+        mHeader.last_nsec = nsec;
+    }
+
+    uint32_t pid = msg->entry.pid & 0xFF;
+    mHeader.pids[pid / 32] |= 1U << (pid % 32);
+
+    addTag(tag, pri);
+    ++mHeader.count;
+}
+
+bool LogArchiveWriter::needsFlush() const {
+    if (mHeader.count == 0) {
+        return false;
+    }
+    return (mRecordsSize >= blockRecordsSize)
+        || ((log_time(CLOCK_MONOTONIC).nsec() - mStarted)
+                >= (blockLatencySec * NS_PER_SEC));
+}
+
+ssize_t LogArchiveWriter::flush(int fd) {
+    if (mHeader.count == 0) {
+        return 0;
+    }
+
+    mHeader.index_size = mIndexSize;
+    mHeader.size = mIndexSize + mRecordsSize;
+
+    ssize_t ret = -1;
+    if ((writeFully(fd, &mHeader, sizeof(mHeader)) >= 0)
+            && (writeFully(fd, mIndex, mIndexSize) >= 0)
+            && (writeFully(fd, mRecords, mRecordsSize) >= 0)) {
+        ret = sizeof(mHeader) + mHeader.size;
+    }
+
+    reset();
+    return ret;
+}
+
+LogArchiveReader::LogArchiveReader(int fd, AndroidLogFormat *format,
+                                   log_time start, log_time end, pid_t pid)
+        : mFd(fd)
+        , mFormat(format)
+        , mStart(start)
+        , mEnd(end)
+        , mPid(pid)
+        , mBlock(NULL)
+        , mBlockCapacity(0)
+        , mBlockPos(0)
+        , mBlockEnd(0) {
+}
+
+LogArchiveReader::~LogArchiveReader() {
+    free(mBlock);
+}
+
+bool LogArchiveReader::blockMatches(const log_archive_block_header &header,
+                                    const char *index) const {
+    if ((log_time(header.last_sec, header.last_nsec) < mStart)
+            || (log_time(header.first_sec, header.first_nsec) > mEnd)) {
+        return false;
+    }
+
+    if (mPid) {
+        uint32_t pid = mPid & 0xFF;
+        if (!(header.pids[pid / 32] & (1U << (pid % 32)))) {
+            return false;
+        }
+    }
+
+    if (header.flags & LOG_ARCHIVE_BLOCK_ALL_TAGS) {
+        return true;
+    }
+
+    const char *end = index + header.index_size;
+    while ((index + 2) <= end) {
+        android_LogPriority pri = static_cast<android_LogPriority>(index[0]);
+        size_t len = static_cast<unsigned char>(index[1]);
+        if ((index + 2 + len) > end) {
+            break;
+        }
+
+        char tag[UINT8_MAX + 1];
+        memcpy(tag, index + 2, len);
+        tag[len] = '\0';
+        if (android_log_shouldPrintLine(mFormat, tag, pri)) {
+            return true;
+        }
+        index += 2 + len;
+    }
+    return false;
+}
+
+int LogArchiveReader::nextBlock() {
+    if (mFd < 0) {
+        return -1;
+    }
+
+    // Validate the file header on the first call
+    if (mBlock == NULL) {
+        log_archive_header header;
+        if ((readFully(mFd, &header, sizeof(header)) != sizeof(header))
+                || (header.magic != LOG_ARCHIVE_MAGIC)
+                || (header.version != LOG_ARCHIVE_VERSION)) {
+            return -1;
+        }
+        mBlockCapacity = 64 * 1024;
+        mBlock = static_cast<char *>(malloc(mBlockCapacity));
+        if (!mBlock) {
+            return -1;
+        }
+    }
+
+    for (;;) {
+        log_archive_block_header header;
+        ssize_t ret = readFully(mFd, &header, sizeof(header));
+        if (ret <= 0) {
+            return ret;
+        }
+        if ((header.magic != LOG_ARCHIVE_BLOCK_MAGIC)
+                || (header.size > LogArchiveWriter::maxBlockSize)
+                || (header.index_size > header.size)) {
+            return -1;
+        }
+
+        if (header.size > mBlockCapacity) {
+            char *block = static_cast<char *>(realloc(mBlock, header.size));
+            if (!block) {
+                return -1;
+            }
+            mBlock = block;
+            mBlockCapacity = header.size;
+        }
+
+        if (header.index_size && (readFully(mFd, mBlock, header.index_size)
+                                      != static_cast<ssize_t>(header.index_size))) {
+            return -1;
+        }
+
+        size_t recordsSize = header.size - header.index_size;
+        bool matches = blockMatches(header, mBlock);
+        if (!matches) {
+            if (lseek(mFd, recordsSize, SEEK_CUR) >= 0) {
+                continue;
+            }
+            if (errno != ESPIPE) {
+                return -1;
+            }
+            // Not seekable, read past the records instead
+        }
+
+        if (readFully(mFd, mBlock, recordsSize)
+                != static_cast<ssize_t>(recordsSize)) {
+            return -1;
+        }
+        if (!matches) {
+            continue;
+        }
+        mBlockPos = 0;
+        mBlockEnd = recordsSize;
+        return 1;
+    }
+}
+
+int LogArchiveReader::read(struct log_msg *msg) {
+    for (;;) {
+        if (mBlockPos >= mBlockEnd) {
+            int ret = nextBlock();
+            if (ret <= 0) {
+                return ret;
+            }
+            continue;
+        }
+
+        // The leading len and hdr_size of the logger_entry
+        uint16_t len, hdr_size;
+        if ((mBlockEnd - mBlockPos) < (2 * sizeof(uint16_t))) {
+            return -1;
+        }
+        memcpy(&len, mBlock + mBlockPos, sizeof(len));
+        memcpy(&hdr_size, mBlock + mBlockPos + sizeof(len), sizeof(hdr_size));
+        size_t size = (hdr_size ? hdr_size : sizeof(struct logger_entry)) + len;
+        if ((size > LOGGER_ENTRY_MAX_LEN) || (size > (mBlockEnd - mBlockPos))) {
+            return -1;
+        }
+
+        memcpy(msg->buf, mBlock + mBlockPos, size);
+        msg->buf[size] = '\0';
+        mBlockPos += size;
+
+        log_time realtime(msg->entry.sec, msg->entry.nsec);
+        if ((realtime < mStart) || (realtime > mEnd)) {
+            continue;
+        }
+        if (mPid && (msg->entry.pid != mPid)) {
+            continue;
+        }
+        return 1;
+    }
+}
+
+}
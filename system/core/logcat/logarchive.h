@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGCAT_LOG_ARCHIVE_H__
+#define _LOGCAT_LOG_ARCHIVE_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <log/log.h>
+#include <log/log_read.h>
+#include <log/logger.h>
+#include <log/logprint.h>
+
+// Compact binary capture written by logcat -A and read back by logcat -i.
+//
+// The file is a log_archive_header followed by blocks. Each block is a
+// log_archive_block_header, an index of the tags logged in the block and
+// then the records, each the logger_entry_v3 as read from logd. A reader
+// looking for a time range, a pid or a set of tags decides from the block
+// header and tag index alone whether it can skip the block's records.
+//
+// Each tag index entry is a uint8_t of the highest priority logged with
+// the tag, a uint8_t length and the tag, without a null terminator.
+
+#define LOG_ARCHIVE_MAGIC        0x4143474c // "LGCA"
+#define LOG_ARCHIVE_VERSION      1
+#define LOG_ARCHIVE_BLOCK_MAGIC  0x4b42474c // "LGBK"
+
+// Some tags in the block are missing from its index
+#define LOG_ARCHIVE_BLOCK_ALL_TAGS 0x1
+
+struct log_archive_header {
+    uint32_t magic;
+    uint32_t version;
+} __attribute__((__packed__));
+
+struct log_archive_block_header {
+    uint32_t magic;
+    uint32_t size;       // bytes following this header, index and records
+    uint32_t index_size; // bytes of tag index
+    uint32_t count;      // records in the block
+    uint32_t flags;
+    uint32_t first_sec;  // earliest record in the block
+    uint32_t first_nsec;
+    uint32_t last_sec;   // latest record in the block
+    uint32_t last_nsec;
+    uint32_t pids[8];    // bitmap of (pid % 256) over all records
+} __attribute__((__packed__));
+
+namespace android {
+
+class LogArchiveWriter {
+public:
+    // A block is written out once it holds this many bytes of records
+    static const size_t blockRecordsSize = 64 * 1024;
+    // or its first record has waited this long
+    static const unsigned int blockLatencySec = 1;
+    static const size_t maxTags = 128;
+    // No block written is larger than this, index and records
+    static const size_t maxBlockSize = maxTags * (2 + UINT8_MAX)
+                                     + blockRecordsSize + LOGGER_ENTRY_MAX_LEN;
+
+private:
+    static const size_t tagTableSize = 256; // power of two, > maxTags
+
+    log_archive_block_header mHeader;
+    uint64_t mStarted; // CLOCK_MONOTONIC at first record of the block
+
+    size_t mIndexSize;
+    char mIndex[maxTags * (2 + UINT8_MAX)];
+    size_t mTags;
+    struct {
+        uint32_t hash;
+        uint32_t offset; // of the entry in mIndex, plus one; 0 when empty
+    } mTagTable[tagTableSize];
+
+    size_t mRecordsSize;
+    char mRecords[blockRecordsSize + LOGGER_ENTRY_MAX_LEN];
+
+    void addTag(const char *tag, android_LogPriority pri);
+    void reset();
+
+public:
+    LogArchiveWriter();
+
+    // Writes the file header, for the start of a new archive
+    static ssize_t writeHeader(int fd);
+
+    void add(struct log_msg *msg, const char *tag, android_LogPriority pri);
+
+    bool empty() const { return mHeader.count == 0; }
+    bool needsFlush() const;
+
+    // returns bytes written, or -1 on error
+    ssize_t flush(int fd);
+};
+
+class LogArchiveReader {
+    int mFd;
+    AndroidLogFormat *mFormat;
+    log_time mStart;
+    log_time mEnd;
+    pid_t mPid;
+
+    char *mBlock;
+    size_t mBlockCapacity;
+    size_t mBlockPos;
+    size_t mBlockEnd;
+
+    bool blockMatches(const log_archive_block_header &header,
+                      const char *index) const;
+    int nextBlock();
+
+public:
+    // Records are returned if they lie within [start, end], were logged by
+    // pid (any if 0), and a tag in their block passes format's filters.
+    LogArchiveReader(int fd, AndroidLogFormat *format,
+                     log_time start, log_time end, pid_t pid);
+    ~LogArchiveReader();
+
+    // returns 1 with the next record in msg, 0 at end of archive, or
+    // -1 on error or a corrupt archive
+    int read(struct log_msg *msg);
+};
+
+}
+
+#endif // _LOGCAT_LOG_ARCHIVE_H__
@@ -13,6 +13,7 @@
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <arpa/inet.h>
 
 #include <cutils/sockets.h>
@@ -23,6 +24,8 @@
 #include <log/logprint.h>
 #include <log/event_tag_map.h>
 
+#include "logarchive.h"
+
 #define DEFAULT_LOG_ROTATE_SIZE_KBYTES 16
 #define DEFAULT_MAX_ROTATED_LOGS 4
 
@@ -62,6 +65,18 @@ static off_t g_outByteCount = 0;
 static int g_printBinary = 0;
 static int g_devCount = 0;
 
+// When dumping (-d, -t), formatted lines are packed into g_outBuffer
+// and written out together rather than with one write() per line.
+static bool g_outBuffered = false;
+static char g_outBuffer[64 * 1024];
+static size_t g_outBufferLen = 0;
+
+// -A, records are written as a compact indexed archive rather than text
+static LogArchiveWriter *g_archive = NULL;
+// While a block is pending, a repeating SIGALRM interrupts the blocking
+// read so that the block is written out even if no more records arrive.
+static bool g_archiveTimer = false;
+
 static EventTagMap* g_eventTagMap = NULL;
 
 static int openLogFile (const char *pathname)
@@ -69,6 +84,53 @@ static int openLogFile (const char *pathname)
     return open(pathname, O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR);
 }
 
+static void setArchiveTimer(bool armed)
+{
+    struct itimerval timer;
+
+    memset(&timer, 0, sizeof(timer));
+    if (armed) {
+        timer.it_interval.tv_sec = LogArchiveWriter::blockLatencySec;
+        timer.it_value.tv_sec = LogArchiveWriter::blockLatencySec;
+    }
+    setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+static void flushArchive()
+{
+    ssize_t ret = g_archive->flush(g_outFD);
+
+    if (ret < 0) {
+        perror("output error");
+        exit(-1);
+    }
+    g_outByteCount += ret;
+
+    if (g_archiveTimer) {
+        setArchiveTimer(false);
+    }
+}
+
+static void flushOutput()
+{
+    const char *p = g_outBuffer;
+
+    if (g_archive) {
+        flushArchive();
+    }
+
+    while (g_outBufferLen > 0) {
+        ssize_t ret = TEMP_FAILURE_RETRY(write(g_outFD, p, g_outBufferLen));
+
+        if (ret < 0) {
+            perror("output error");
+            exit(-1);
+        }
+        p += ret;
+        g_outBufferLen -= ret;
+    }
+}
+
 static void rotateLogs()
 {
     int err;
@@ -78,6 +140,7 @@ static void rotateLogs()
         return;
     }
 
+    flushOutput();
     close(g_outFD);
 
     for (int i = g_maxRotatedLogs ; i > 0 ; i--) {
@@ -110,15 +173,43 @@ static void rotateLogs()
 
     g_outByteCount = 0;
 
+    if (g_archive) {
+        g_outByteCount = LogArchiveWriter::writeHeader(g_outFD);
+        if (g_outByteCount < 0) {
+            perror("output error");
+            exit(-1);
+        }
+    }
 }
 
 void printBinary(struct log_msg *buf)
 {
     size_t size = buf->len();
 
+    flushOutput();
     TEMP_FAILURE_RETRY(write(g_outFD, buf, size));
 }
 
+static int bufferLogLine(const AndroidLogEntry *entry)
+{
+    ssize_t len = android_log_formatLogLineToBuffer(g_logformat,
+            g_outBuffer + g_outBufferLen, sizeof(g_outBuffer) - g_outBufferLen,
+            entry);
+
+    if (len < 0) {
+        flushOutput();
+        len = android_log_formatLogLineToBuffer(g_logformat, g_outBuffer,
+                                                sizeof(g_outBuffer), entry);
+        if (len < 0) {
+            // larger than the whole buffer, write it on its own
+            return android_log_printLogLine(g_logformat, g_outFD, entry);
+        }
+    }
+    g_outBufferLen += len;
+
+    return len;
+}
+
 static void processBuffer(log_device_t* dev, struct log_msg *buf)
 {
     int bytesWritten = 0;
@@ -151,7 +242,11 @@ static void processBuffer(log_device_t* dev, struct log_msg *buf)
             }
         }
 
-        bytesWritten = android_log_printLogLine(g_logformat, g_outFD, &entry);
+        if (g_outBuffered) {
+            bytesWritten = bufferLogLine(&entry);
+        } else {
+            bytesWritten = android_log_printLogLine(g_logformat, g_outFD, &entry);
+        }
 
         if (bytesWritten < 0) {
             perror("output error");
@@ -172,13 +267,74 @@ error:
     return;
 }
 
+static void maybeFlushArchive()
+{
+    if (g_archive->needsFlush()) {
+        flushArchive();
+
+        if (g_logRotateSizeKBytes > 0
+            && (g_outByteCount / 1024) >= g_logRotateSizeKBytes
+        ) {
+            rotateLogs();
+        }
+    }
+}
+
+static void caughtArchiveTimer(int /*signum*/)
+{
+}
+
+// Drive flushing of a pending archive block from a timer while blocked
+// in android_logger_list_read(), which returns -EINTR when it fires.
+static void startArchiveTimer()
+{
+    struct sigaction action;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = caughtArchiveTimer;
+    sigemptyset(&action.sa_mask);
+    // no SA_RESTART, the read must be interrupted
+    if (sigaction(SIGALRM, &action, NULL) == 0) {
+        g_archiveTimer = true;
+    }
+}
+
+static void archiveBuffer(log_device_t* dev, struct log_msg *buf)
+{
+    int err;
+    AndroidLogEntry entry;
+    char binaryMsgBuf[1024];
+
+    // Parse only for the tag and priority to index the record under
+    if (dev->binary) {
+        err = android_log_processBinaryLogBuffer(&buf->entry_v1, &entry,
+                                                 g_eventTagMap,
+                                                 binaryMsgBuf,
+                                                 sizeof(binaryMsgBuf));
+    } else {
+        err = android_log_processLogBuffer(&buf->entry_v1, &entry);
+    }
+    if (err < 0) {
+        return;
+    }
+
+    bool started = g_archive->empty();
+    g_archive->add(buf, entry.tag, entry.priority);
+    if (g_archiveTimer && started) {
+        setArchiveTimer(true);
+    }
+
+    maybeFlushArchive();
+}
+
 static void maybePrintStart(log_device_t* dev) {
     if (!dev->printed) {
         dev->printed = true;
-        if (g_devCount > 1 && !g_printBinary) {
+        if (g_devCount > 1 && !g_printBinary && !g_archive) {
             char buf[1024];
             snprintf(buf, sizeof(buf), "--------- beginning of %s\n",
                      dev->device);
+            flushOutput();
             if (write(g_outFD, buf, strlen(buf)) < 0) {
                 perror("output error");
                 exit(-1);
@@ -207,6 +363,70 @@ static void setupOutput()
 
         g_outByteCount = statbuf.st_size;
     }
+
+    if (g_archive && (g_outByteCount == 0)) {
+        g_outByteCount = LogArchiveWriter::writeHeader(g_outFD);
+        if (g_outByteCount < 0) {
+            perror("output error");
+            exit(-1);
+        }
+    }
+}
+
+// Print the records of a logcat -A archive that match the time range, pid
+// and filterspecs, skipping blocks that cannot hold any.
+static int readArchive(const char *pathname, log_device_t **devices,
+                       bool anyDevice, log_time start, log_time end, pid_t pid)
+{
+    int fd = open(pathname, O_RDONLY);
+
+    if (fd < 0) {
+        perror("couldn't open archive");
+        return EXIT_FAILURE;
+    }
+
+    if (!g_eventTagMap) {
+        g_eventTagMap = android_openEventTagMap(EVENT_TAG_MAP_FILE);
+    }
+
+    LogArchiveReader reader(fd, g_logformat, start, end, pid);
+    struct log_msg log_msg;
+    int ret;
+
+    g_outBuffered = true;
+
+    while ((ret = reader.read(&log_msg)) > 0) {
+        log_id_t id = log_msg.id();
+        log_device_t* dev;
+        log_device_t** last = devices;
+
+        for (dev = *devices; dev; dev = dev->next) {
+            if (android_name_to_log_id(dev->device) == id) {
+                break;
+            }
+            last = &dev->next;
+        }
+        if (!dev) {
+            const char *name = android_log_id_to_name(id);
+            if (!anyDevice || !name) {
+                continue;
+            }
+            dev = *last = new log_device_t(name, id == LOG_ID_EVENTS, name[0]);
+            g_devCount++;
+        }
+
+        maybePrintStart(dev);
+        processBuffer(dev, &log_msg);
+    }
+
+    flushOutput();
+    close(fd);
+
+    if (ret < 0) {
+        fprintf(stderr, "read: corrupt or truncated archive %s\n", pathname);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
 }
 
 static void show_help(const char *cmd)
@@ -231,6 +451,12 @@ static void show_help(const char *cmd)
                     "                  allowed and results are interleaved. The default is\n"
                     "                  -b main -b system -b crash.\n"
                     "  -B              output the log in binary.\n"
+                    "  -A              output the log as a compact indexed archive, for -i.\n"
+                    "  -i <archive>    print the log from an archive written with -A, rather\n"
+                    "                  than the device. Blocks outside the -t/-T '<time>',\n"
+                    "                  -e and -k selections or the filterspecs are skipped.\n"
+                    "  -e '<time>'     with -i, print only lines up to time\n"
+                    "  -k <pid>        with -i, print only lines from process pid\n"
                     "  -S              output statistics.\n"
                     "  -G <size>       set size of log ring buffer, may suffix with K or M.\n"
                     "  -p              print prune white and ~black list. Service is specified as\n"
@@ -323,6 +549,10 @@ int main(int argc, char **argv)
     struct logger_list *logger_list;
     unsigned int tail_lines = 0;
     log_time tail_time(log_time::EPOCH);
+    log_time end_time(log_time::tv_sec_max, log_time::tv_nsec_max);
+    const char *archiveInput = NULL;
+    pid_t archivePid = 0;
+    bool anyDevice;
 
     signal(SIGPIPE, exit);
 
@@ -336,7 +566,7 @@ int main(int argc, char **argv)
     for (;;) {
         int ret;
 
-        ret = getopt(argc, argv, "cdt:T:gG:sQf:r::n:v:b:BSpP:");
+        ret = getopt(argc, argv, "cdt:T:gG:sQf:r::n:v:b:BAi:e:k:SpP:");
 
         if (ret < 0) {
             break;
@@ -501,6 +731,36 @@ int main(int argc, char **argv)
                 android::g_printBinary = 1;
             break;
 
+            case 'A':
+                if (!android::g_archive) {
+                    android::g_archive = new android::LogArchiveWriter();
+                }
+            break;
+
+            case 'i':
+                archiveInput = optarg;
+            break;
+
+            case 'e': {
+                char *cp = end_time.strptime(optarg, log_time::default_format);
+                if (!cp || *cp) {
+                    fprintf(stderr,
+                            "ERROR: -e \"%s\" not in \"%s\" time format\n",
+                            optarg, log_time::default_format);
+                    exit(1);
+                }
+            }
+            break;
+
+            case 'k':
+                if (!isdigit(optarg[0])) {
+                    fprintf(stderr,"Invalid parameter to -k\n");
+                    android::show_help(argv[0]);
+                    exit(-1);
+                }
+                archivePid = atoi(optarg);
+            break;
+
             case 'f':
                 // redirect output to a file
 
@@ -622,6 +882,21 @@ int main(int argc, char **argv)
         }
     }
 
+    if (android::g_archive && (android::g_printBinary || archiveInput)) {
+        fprintf(stderr,"-A can not be used with -B or -i\n");
+        android::show_help(argv[0]);
+        exit(-1);
+    }
+
+    if (archiveInput && tail_lines) {
+        fprintf(stderr,"-i only accepts a '<time>' for -t or -T\n");
+        android::show_help(argv[0]);
+        exit(-1);
+    }
+
+    // An archive is read for every buffer it holds unless -b was given
+    anyDevice = !devices;
+
     if (!devices) {
         dev = devices = new log_device_t("main", false, 'm');
         android::g_devCount = 1;
@@ -691,6 +966,11 @@ int main(int argc, char **argv)
         }
     }
 
+    if (archiveInput) {
+        return android::readArchive(archiveInput, &devices, anyDevice,
+                                    tail_time, end_time, archivePid);
+    }
+
     dev = devices;
     if (tail_time != log_time::EPOCH) {
         logger_list = android_logger_list_alloc_time(mode, tail_time, 0);
@@ -832,10 +1112,26 @@ int main(int argc, char **argv)
     if (needBinary)
         android::g_eventTagMap = android_openEventTagMap(EVENT_TAG_MAP_FILE);
 
+    android::g_outBuffered = (mode & O_NDELAY) != 0;
+
+    // A dump ends, and liblog uses SIGALRM itself to time out its reads
+    if (android::g_archive && !(mode & O_NDELAY)) {
+        android::startArchiveTimer();
+    }
+
     while (1) {
         struct log_msg log_msg;
         int ret = android_logger_list_read(logger_list, &log_msg);
 
+        if ((ret == -EINTR) && android::g_archiveTimer) {
+            android::maybeFlushArchive();
+            continue;
+        }
+
+        if (ret <= 0) {
+            android::flushOutput();
+        }
+
         if (ret == 0) {
             fprintf(stderr, "read: Unexpected EOF!\n");
             exit(EXIT_FAILURE);
@@ -871,6 +1167,8 @@ int main(int argc, char **argv)
         android::maybePrintStart(dev);
         if (android::g_printBinary) {
             android::printBinary(&log_msg);
+        } else if (android::g_archive) {
+            android::archiveBuffer(dev, &log_msg);
         } else {
             android::processBuffer(dev, &log_msg);
         }
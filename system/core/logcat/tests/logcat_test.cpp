@@ -19,6 +19,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 #include <gtest/gtest.h>
 #include <log/log.h>
@@ -649,3 +651,83 @@ TEST(logcat, white_black_adjust) {
     free(list);
     list = NULL;
 }
+
+static int count_lines(const char *command) {
+    FILE *fp = popen(command, "r");
+    if (!fp) {
+        return -1;
+    }
+
+    char buffer[5120];
+    int count = 0;
+
+    while (fgets(buffer, sizeof(buffer), fp)) {
+        if (strncmp(begin, buffer, sizeof(begin) - 1)) {
+            ++count;
+        }
+    }
+
+    pclose(fp);
+    return count;
+}
+
+TEST(logcat, archive) {
+    static const char archive[] = "/data/local/tmp/logcat.archive";
+
+    unlink(archive);
+    ASSERT_EQ(0, system(
+      "logcat -b events -b main -d -A -f /data/local/tmp/logcat.archive"
+      " 2>/dev/null"));
+
+    // Everything archived is read back
+    int count = count_lines(
+      "logcat -i /data/local/tmp/logcat.archive -v brief 2>/dev/null");
+    EXPECT_LT(0, count);
+
+    // Only lines of the events buffer when asked for
+    int events = count_lines(
+      "logcat -i /data/local/tmp/logcat.archive -b events 2>/dev/null");
+    EXPECT_LT(0, events);
+    EXPECT_GT(count, events);
+
+    // Nothing from a pid beyond PID_MAX_LIMIT, or a tag that never logged
+    EXPECT_EQ(0, count_lines(
+      "logcat -i /data/local/tmp/logcat.archive -k 4194304 2>/dev/null"));
+    EXPECT_EQ(0, count_lines(
+      "logcat -i /data/local/tmp/logcat.archive -s logcat_archive_none"
+      " 2>/dev/null"));
+
+    // Nothing from before the archive started
+    EXPECT_EQ(0, count_lines(
+      "logcat -i /data/local/tmp/logcat.archive -e '01-01 00:00:00.000'"
+      " 2>/dev/null"));
+
+    unlink(archive);
+}
+
+TEST(logcat, archive_idle_flush) {
+    static const char archive[] = "/data/local/tmp/logcat.archive";
+
+    unlink(archive);
+
+    // A streaming capture of one record, which then sits idle
+    pid_t pid = fork();
+    ASSERT_LE(0, pid);
+    if (pid == 0) {
+        execlp("logcat", "logcat", "-b", "main", "-T", "1", "-A",
+               "-f", archive, (char *)NULL);
+        _exit(EXIT_FAILURE);
+    }
+
+    // Its block is written out within a second or so without more records
+    sleep(3);
+    int count = count_lines(
+      "logcat -i /data/local/tmp/logcat.archive -v brief 2>/dev/null");
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+
+    EXPECT_LT(0, count);
+
+    unlink(archive);
+}
@@ -94,7 +94,11 @@ static unsigned long property_get_size(const char *key) {
 
 LogBuffer::LogBuffer(LastLogTimes *times)
         : mTimes(*times) {
-    pthread_mutex_init(&mLogElementsLock, NULL);
+    log_id_for_each(i) {
+        pthread_mutex_init(&mLogElementsLock[i], NULL);
+        mEraseCount[i] = 0;
+    }
+    pthread_mutex_init(&mDgramQlenLock, NULL);
     dgram_qlen_statistics = false;
 
     static const char global_tuneable[] = "persist.logd.size"; // Settings App
@@ -132,6 +136,18 @@ LogBuffer::LogBuffer(LastLogTimes *times)
     }
 }
 
+LogBuffer::~LogBuffer() {
+    log_id_for_each(i) {
+        LogBufferElementCollection::iterator it = mLogElements[i].begin();
+        while (it != mLogElements[i].end()) {
+            delete *it;
+            it = mLogElements[i].erase(it);
+        }
+        pthread_mutex_destroy(&mLogElementsLock[i]);
+    }
+    pthread_mutex_destroy(&mDgramQlenLock);
+}
+
 void LogBuffer::log(log_id_t log_id, log_time realtime,
                     uid_t uid, pid_t pid, pid_t tid,
                     const char *msg, unsigned short len) {
@@ -141,13 +157,14 @@ void LogBuffer::log(log_id_t log_id, log_time realtime,
     LogBufferElement *elem = new LogBufferElement(log_id, realtime,
                                                   uid, pid, tid, msg, len);
 
-    pthread_mutex_lock(&mLogElementsLock);
+    LogBufferElementCollection &list = mLogElements[log_id];
+    pthread_mutex_lock(&mLogElementsLock[log_id]);
 
     // Insert elements in time sorted order if possible
     //  NB: if end is region locked, place element at end of list
-    LogBufferElementCollection::iterator it = mLogElements.end();
+    LogBufferElementCollection::iterator it = list.end();
     LogBufferElementCollection::iterator last = it;
-    while (--it != mLogElements.begin()) {
+    while (--it != list.begin()) {
         if ((*it)->getRealTime() <= realtime) {
             // halves the peak performance, use with caution
             if (dgram_qlen_statistics) {
@@ -156,14 +173,16 @@ void LogBuffer::log(log_id_t log_id, log_time realtime,
                 for (unsigned short i = 0; (buckets = stats.dgram_qlen(i)); ++i) {
                     buckets -= num;
                     num += buckets;
-                    while (buckets && (--ib != mLogElements.begin())) {
+                    while (buckets && (--ib != list.begin())) {
                         --buckets;
                     }
                     if (buckets) {
                         break;
                     }
+                    pthread_mutex_lock(&mDgramQlenLock);
                     stats.recordDiff(
                         elem->getRealTime() - (*ib)->getRealTime(), i);
+                    pthread_mutex_unlock(&mDgramQlenLock);
                 }
             }
             break;
@@ -171,8 +190,8 @@ void LogBuffer::log(log_id_t log_id, log_time realtime,
         last = it;
     }
 
-    if (last == mLogElements.end()) {
-        mLogElements.push_back(elem);
+    if (last == list.end()) {
+        elem->mPosition = list.insert(list.end(), elem);
     } else {
         log_time end = log_time::EPOCH;
         bool end_set = false;
@@ -198,23 +217,103 @@ void LogBuffer::log(log_id_t log_id, log_time realtime,
 
         if (end_always
                 || (end_set && (end >= (*last)->getMonotonicTime()))) {
-            mLogElements.push_back(elem);
+            elem->mPosition = list.insert(list.end(), elem);
         } else {
-            mLogElements.insert(last,elem);
+            elem->mPosition = list.insert(last, elem);
         }
 
         LogTimeEntry::unlock();
     }
 
+    linkUid(elem);
     stats.add(len, log_id, uid, pid);
     maybePrune(log_id);
-    pthread_mutex_unlock(&mLogElementsLock);
+    pthread_mutex_unlock(&mLogElementsLock[log_id]);
+}
+
+// Add an element to the chain of its log id and uid.
+//
+// mLogElementsLock[id] must be held when this function is called.
+void LogBuffer::linkUid(LogBufferElement *e) {
+    LogBufferUidChains &chains = mUidChains[e->getLogId()];
+    ssize_t index = chains.indexOfKey(e->getUid());
+    if (index < 0) {
+        index = chains.add(e->getUid(), LogBufferUidChain());
+    }
+    LogBufferUidChain &chain = chains.editValueAt(index);
+
+    // Nearly always appended, walk back for the odd out of order entry
+    LogBufferElement *prev = chain.mTail;
+    while (prev && (e->getRealTime() < prev->getRealTime())) {
+        prev = prev->mUidPrev;
+    }
+
+    e->mUidPrev = prev;
+    e->mUidNext = prev ? prev->mUidNext : chain.mHead;
+    if (e->mUidNext) {
+        e->mUidNext->mUidPrev = e;
+    } else {
+        chain.mTail = e;
+    }
+    if (prev) {
+        prev->mUidNext = e;
+    } else {
+        chain.mHead = e;
+    }
+
+    chain.mSizes += e->getMsgLen();
+    ++chain.mElements;
+}
+
+// Remove an element from the chain of its log id and uid.
+//
+// mLogElementsLock[id] must be held when this function is called.
+void LogBuffer::unlinkUid(LogBufferElement *e) {
+    LogBufferUidChains &chains = mUidChains[e->getLogId()];
+    ssize_t index = chains.indexOfKey(e->getUid());
+    if (index < 0) {
+        return;
+    }
+    LogBufferUidChain &chain = chains.editValueAt(index);
+
+    if (e->mUidPrev) {
+        e->mUidPrev->mUidNext = e->mUidNext;
+    } else {
+        chain.mHead = e->mUidNext;
+    }
+    if (e->mUidNext) {
+        e->mUidNext->mUidPrev = e->mUidPrev;
+    } else {
+        chain.mTail = e->mUidPrev;
+    }
+    e->mUidPrev = e->mUidNext = NULL;
+
+    chain.mSizes -= e->getMsgLen();
+    if (--chain.mElements == 0) {
+        chains.removeItemsAt(index);
+    }
+}
+
+// Remove and delete an element, returning the one that followed it.
+//
+// mLogElementsLock[id] must be held when this function is called.
+LogBufferElementCollection::iterator LogBuffer::erase(
+        LogBufferElementCollection::iterator it) {
+    LogBufferElement *e = *it;
+    log_id_t id = e->getLogId();
+
+    unlinkUid(e);
+    it = mLogElements[id].erase(it);
+    ++mEraseCount[id];
+    stats.subtract(e->getMsgLen(), id, e->getUid(), e->getPid());
+    delete e;
+    return it;
 }
 
 // If we're using more than 256K of memory for log entries, prune
 // at least 10% of the log entries.
 //
-// mLogElementsLock must be held when this function is called.
+// mLogElementsLock[id] must be held when this function is called.
 void LogBuffer::maybePrune(log_id_t id) {
     size_t sizes = stats.sizes(id);
     if (sizes > log_buffer_size(id)) {
@@ -231,8 +330,9 @@ void LogBuffer::maybePrune(log_id_t id) {
 
 // prune "pruneRows" of type "id" from the buffer.
 //
-// mLogElementsLock must be held when this function is called.
+// mLogElementsLock[id] must be held when this function is called.
 void LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
+    LogBufferElementCollection &list = mLogElements[id];
     LogTimeEntry *oldest = NULL;
 
     LogTimeEntry::lock();
@@ -249,34 +349,23 @@ void LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
     }
 
     LogBufferElementCollection::iterator it;
+    LogBufferUidChains &chains = mUidChains[id];
 
     if (caller_uid != AID_ROOT) {
-        for(it = mLogElements.begin(); it != mLogElements.end();) {
-            LogBufferElement *e = *it;
-
+        ssize_t index = chains.indexOfKey(caller_uid);
+        LogBufferElement *e = (index < 0) ? NULL : chains.valueAt(index).mHead;
+        while (e) {
             if (oldest && (oldest->mStart <= e->getMonotonicTime())) {
                 break;
             }
 
-            if (e->getLogId() != id) {
-                ++it;
-                continue;
-            }
-
-            uid_t uid = e->getUid();
-
-            if (uid == caller_uid) {
-                it = mLogElements.erase(it);
-                unsigned short len = e->getMsgLen();
-                stats.subtract(len, id, uid, e->getPid());
-                delete e;
-                pruneRows--;
-                if (pruneRows == 0) {
-                    break;
-                }
-            } else {
-                ++it;
+            LogBufferElement *next = e->mUidNext;
+            erase(e->mPosition);
+            pruneRows--;
+            if (pruneRows == 0) {
+                break;
             }
+            e = next;
         }
         LogTimeEntry::unlock();
         return;
@@ -290,55 +379,55 @@ void LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
         size_t second_worst_sizes = 0;
 
         if ((id != LOG_ID_CRASH) && mPrune.worstUidEnabled()) {
-            LidStatistics &l = stats.id(id);
-            l.sort();
-            UidStatisticsCollection::iterator iu = l.begin();
-            if (iu != l.end()) {
-                UidStatistics *u = *iu;
-                worst = u->getUid();
-                worst_sizes = u->sizes();
-                if (++iu != l.end()) {
-                    second_worst_sizes = (*iu)->sizes();
+            for (size_t i = 0; i < chains.size(); ++i) {
+                size_t sizes = chains.valueAt(i).mSizes;
+                if (sizes > worst_sizes) {
+                    second_worst_sizes = worst_sizes;
+                    worst_sizes = sizes;
+                    worst = chains.keyAt(i);
+                } else if (sizes > second_worst_sizes) {
+                    second_worst_sizes = sizes;
                 }
             }
         }
 
         bool kick = false;
-        for(it = mLogElements.begin(); it != mLogElements.end();) {
-            LogBufferElement *e = *it;
-
+        ssize_t index = (worst == (uid_t) -1) ? -1 : chains.indexOfKey(worst);
+        LogBufferElement *e = (index < 0) ? NULL : chains.valueAt(index).mHead;
+        while (e) {
             if (oldest && (oldest->mStart <= e->getMonotonicTime())) {
                 break;
             }
 
-            if (e->getLogId() != id) {
-                ++it;
-                continue;
+            LogBufferElement *next = e->mUidNext;
+            unsigned short len = e->getMsgLen();
+            erase(e->mPosition);
+            kick = true;
+            pruneRows--;
+            if ((pruneRows == 0) || (worst_sizes < second_worst_sizes)) {
+                break;
             }
+            worst_sizes -= len;
+            e = next;
+        }
 
-            uid_t uid = e->getUid();
+        if ((pruneRows > 0) && mPrune.hasNaughty()) {
+            for(it = list.begin(); it != list.end();) {
+                LogBufferElement *element = *it;
 
-            if (uid == worst) {
-                it = mLogElements.erase(it);
-                unsigned short len = e->getMsgLen();
-                stats.subtract(len, id, worst, e->getPid());
-                delete e;
-                kick = true;
-                pruneRows--;
-                if ((pruneRows == 0) || (worst_sizes < second_worst_sizes)) {
+                if (oldest && (oldest->mStart <= element->getMonotonicTime())) {
                     break;
                 }
-                worst_sizes -= len;
-            } else if (mPrune.naughty(e)) { // BlackListed
-                it = mLogElements.erase(it);
-                stats.subtract(e->getMsgLen(), id, uid, e->getPid());
-                delete e;
-                pruneRows--;
-                if (pruneRows == 0) {
-                    break;
+
+                if (mPrune.naughty(element)) { // BlackListed
+                    it = erase(it);
+                    pruneRows--;
+                    if (pruneRows == 0) {
+                        break;
+                    }
+                } else {
+                    ++it;
                 }
-            } else {
-                ++it;
             }
         }
 
@@ -348,58 +437,46 @@ void LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
     }
 
     bool whitelist = false;
-    it = mLogElements.begin();
-    while((pruneRows > 0) && (it != mLogElements.end())) {
+    it = list.begin();
+    while((pruneRows > 0) && (it != list.end())) {
         LogBufferElement *e = *it;
-        if (e->getLogId() == id) {
-            if (oldest && (oldest->mStart <= e->getMonotonicTime())) {
-                if (!whitelist) {
-                    if (stats.sizes(id) > (2 * log_buffer_size(id))) {
-                        // kick a misbehaving log reader client off the island
-                        oldest->release_Locked();
-                    } else {
-                        oldest->triggerSkip_Locked(pruneRows);
-                    }
+        if (oldest && (oldest->mStart <= e->getMonotonicTime())) {
+            if (!whitelist) {
+                if (stats.sizes(id) > (2 * log_buffer_size(id))) {
+                    // kick a misbehaving log reader client off the island
+                    oldest->release_Locked();
+                } else {
+                    oldest->triggerSkip_Locked(pruneRows);
                 }
-                break;
-            }
-
-            if (mPrune.nice(e)) { // WhiteListed
-                whitelist = true;
-                it++;
-                continue;
             }
+            break;
+        }
 
-            it = mLogElements.erase(it);
-            stats.subtract(e->getMsgLen(), id, e->getUid(), e->getPid());
-            delete e;
-            pruneRows--;
-        } else {
+        if (mPrune.nice(e)) { // WhiteListed
+            whitelist = true;
             it++;
+            continue;
         }
+
+        it = erase(it);
+        pruneRows--;
     }
 
     if (whitelist && (pruneRows > 0)) {
-        it = mLogElements.begin();
-        while((it != mLogElements.end()) && (pruneRows > 0)) {
+        it = list.begin();
+        while((it != list.end()) && (pruneRows > 0)) {
             LogBufferElement *e = *it;
-            if (e->getLogId() == id) {
-                if (oldest && (oldest->mStart <= e->getMonotonicTime())) {
-                    if (stats.sizes(id) > (2 * log_buffer_size(id))) {
-                        // kick a misbehaving log reader client off the island
-                        oldest->release_Locked();
-                    } else {
-                        oldest->triggerSkip_Locked(pruneRows);
-                    }
-                    break;
+            if (oldest && (oldest->mStart <= e->getMonotonicTime())) {
+                if (stats.sizes(id) > (2 * log_buffer_size(id))) {
+                    // kick a misbehaving log reader client off the island
+                    oldest->release_Locked();
+                } else {
+                    oldest->triggerSkip_Locked(pruneRows);
                 }
-                it = mLogElements.erase(it);
-                stats.subtract(e->getMsgLen(), id, e->getUid(), e->getPid());
-                delete e;
-                pruneRows--;
-            } else {
-                it++;
+                break;
             }
+            it = erase(it);
+            pruneRows--;
         }
     }
 
@@ -408,16 +485,16 @@ void LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
 
 // clear all rows of type "id" from the buffer.
 void LogBuffer::clear(log_id_t id, uid_t uid) {
-    pthread_mutex_lock(&mLogElementsLock);
+    pthread_mutex_lock(&mLogElementsLock[id]);
     prune(id, ULONG_MAX, uid);
-    pthread_mutex_unlock(&mLogElementsLock);
+    pthread_mutex_unlock(&mLogElementsLock[id]);
 }
 
 // get the used space associated with "id".
 unsigned long LogBuffer::getSizeUsed(log_id_t id) {
-    pthread_mutex_lock(&mLogElementsLock);
+    pthread_mutex_lock(&mLogElementsLock[id]);
     size_t retval = stats.sizes(id);
-    pthread_mutex_unlock(&mLogElementsLock);
+    pthread_mutex_unlock(&mLogElementsLock[id]);
     return retval;
 }
 
@@ -427,56 +504,155 @@ int LogBuffer::setSize(log_id_t id, unsigned long size) {
     if (!valid_size(size)) {
         return -1;
     }
-    pthread_mutex_lock(&mLogElementsLock);
+    pthread_mutex_lock(&mLogElementsLock[id]);
     log_buffer_size(id) = size;
-    pthread_mutex_unlock(&mLogElementsLock);
+    pthread_mutex_unlock(&mLogElementsLock[id]);
     return 0;
 }
 
 // get the total space allocated to "id"
 unsigned long LogBuffer::getSize(log_id_t id) {
-    pthread_mutex_lock(&mLogElementsLock);
+    pthread_mutex_lock(&mLogElementsLock[id]);
     size_t retval = log_buffer_size(id);
-    pthread_mutex_unlock(&mLogElementsLock);
+    pthread_mutex_unlock(&mLogElementsLock[id]);
     return retval;
 }
 
+void LogBuffer::lockAll() {
+    log_id_for_each(i) {
+        pthread_mutex_lock(&mLogElementsLock[i]);
+    }
+}
+
+void LogBuffer::unlockAll() {
+    log_id_for_each(i) {
+        pthread_mutex_unlock(&mLogElementsLock[i]);
+    }
+}
+
+uid_t LogBuffer::pidToUid(pid_t pid) {
+    lockAll();
+    uid_t uid = stats.pidToUid(pid);
+    unlockAll();
+    return uid;
+}
+
+// Each log id's elements are in time order, so merge them by always sending
+// the oldest pending element. Only the lock of the log id being examined is
+// held at any time; as before, range locking in LastLogTimes keeps pruning
+// away from the element being sent. It does not protect our position in the
+// other log ids, which may lag behind, so a position is only trusted while
+// nothing has been erased from its log id since it was taken; otherwise it
+// is found again by time.
 log_time LogBuffer::flushTo(
         SocketClient *reader, const log_time start, bool privileged,
         bool (*filter)(const LogBufferElement *element, void *arg), void *arg) {
-    LogBufferElementCollection::iterator it;
     log_time max = start;
     uid_t uid = reader->getUid();
 
-    pthread_mutex_lock(&mLogElementsLock);
-    for (it = mLogElements.begin(); it != mLogElements.end(); ++it) {
-        LogBufferElement *element = *it;
+    // last[i] is the last element looked at in log id i (valid once
+    // started[i]) and lastRealTime[i]/lastMonotonicTime[i] its times;
+    // next[i] is the pending element, if any, pending[i] its position and
+    // nextRealTime[i] its time. All of these are only valid while
+    // mEraseCount[i] is still erased[i].
+    LogBufferElementCollection::iterator last[LOG_ID_MAX];
+    LogBufferElementCollection::iterator pending[LOG_ID_MAX];
+    LogBufferElement *next[LOG_ID_MAX];
+    log_time nextRealTime[LOG_ID_MAX];
+    log_time lastRealTime[LOG_ID_MAX];
+    log_time lastMonotonicTime[LOG_ID_MAX];
+    unsigned long erased[LOG_ID_MAX];
+    bool started[LOG_ID_MAX];
+    log_id_for_each(i) {
+        next[i] = NULL;
+        started[i] = false;
+        erased[i] = 0;
+    }
 
-        if (!privileged && (element->getUid() != uid)) {
-            continue;
+    while (true) {
+        // Refill every log id without a pending element; new entries may
+        // have arrived since we last looked.
+        log_id_for_each(i) {
+            LogBufferElementCollection &list = mLogElements[i];
+            pthread_mutex_lock(&mLogElementsLock[i]);
+            LogBufferElementCollection::iterator it = list.begin();
+            if (erased[i] != mEraseCount[i]) {
+                // Our position may have been pruned; skip past everything
+                // at or before the last element we looked at.
+                erased[i] = mEraseCount[i];
+                next[i] = NULL;
+                if (started[i]) {
+                    while ((it != list.end())
+                            && (((*it)->getRealTime() < lastRealTime[i])
+                                || (((*it)->getRealTime() == lastRealTime[i])
+                                    && ((*it)->getMonotonicTime()
+                                        <= lastMonotonicTime[i])))) {
+                        ++it;
+                    }
+                }
+            } else if (next[i]) {
+                pthread_mutex_unlock(&mLogElementsLock[i]);
+                continue;
+            } else if (started[i]) {
+                it = last[i];
+                ++it;
+            }
+            for (; it != list.end(); ++it) {
+                LogBufferElement *element = *it;
+                if ((privileged || (element->getUid() == uid))
+                        && (element->getMonotonicTime() > start)) {
+                    next[i] = element;
+                    nextRealTime[i] = element->getRealTime();
+                    pending[i] = it;
+                    break;
+                }
+                last[i] = it;
+                lastRealTime[i] = element->getRealTime();
+                lastMonotonicTime[i] = element->getMonotonicTime();
+                started[i] = true;
+            }
+            pthread_mutex_unlock(&mLogElementsLock[i]);
         }
 
-        if (element->getMonotonicTime() <= start) {
+        log_id_t oldest = LOG_ID_MAX;
+        log_id_for_each(i) {
+            if (next[i] && ((oldest == LOG_ID_MAX)
+                    || (nextRealTime[i] < nextRealTime[oldest]))) {
+                oldest = i;
+            }
+        }
+        if (oldest == LOG_ID_MAX) {
+            break;
+        }
+
+        pthread_mutex_lock(&mLogElementsLock[oldest]);
+        if (erased[oldest] != mEraseCount[oldest]) {
+            // Pruned since we looked, so next[oldest] may be gone.
+            pthread_mutex_unlock(&mLogElementsLock[oldest]);
             continue;
         }
 
+        LogBufferElement *element = next[oldest];
+        last[oldest] = pending[oldest];
+        lastRealTime[oldest] = element->getRealTime();
+        lastMonotonicTime[oldest] = element->getMonotonicTime();
+        started[oldest] = true;
+        next[oldest] = NULL;
+
         // NB: calling out to another object with mLogElementsLock held (safe)
-        if (filter && !(*filter)(element, arg)) {
+        bool keep = !filter || (*filter)(element, arg);
+        pthread_mutex_unlock(&mLogElementsLock[oldest]);
+        if (!keep) {
             continue;
         }
 
-        pthread_mutex_unlock(&mLogElementsLock);
-
         // range locking in LastLogTimes looks after us
         max = element->flushTo(reader);
 
         if (max == element->FLUSH_ERROR) {
             return max;
         }
-
-        pthread_mutex_lock(&mLogElementsLock);
     }
-    pthread_mutex_unlock(&mLogElementsLock);
 
     return max;
 }
@@ -484,20 +660,20 @@ log_time LogBuffer::flushTo(
 void LogBuffer::formatStatistics(char **strp, uid_t uid, unsigned int logMask) {
     log_time oldest(CLOCK_MONOTONIC);
 
-    pthread_mutex_lock(&mLogElementsLock);
+    lockAll();
 
     // Find oldest element in the log(s)
-    LogBufferElementCollection::iterator it;
-    for (it = mLogElements.begin(); it != mLogElements.end(); ++it) {
-        LogBufferElement *element = *it;
-
-        if ((logMask & (1 << element->getLogId()))) {
+    log_id_for_each(i) {
+        if (!(logMask & (1 << i)) || mLogElements[i].empty()) {
+            continue;
+        }
+        LogBufferElement *element = *mLogElements[i].begin();
+        if (element->getMonotonicTime() < oldest) {
             oldest = element->getMonotonicTime();
-            break;
         }
     }
 
     stats.format(strp, uid, logMask, oldest);
 
-    pthread_mutex_unlock(&mLogElementsLock);
+    unlockAll();
 }
@@ -21,6 +21,7 @@
 
 #include <log/log.h>
 #include <sysutils/SocketClient.h>
+#include <utils/KeyedVector.h>
 #include <utils/List.h>
 
 #include <private/android_filesystem_config.h>
@@ -32,13 +33,36 @@
 
 typedef android::List<LogBufferElement *> LogBufferElementCollection;
 
-class LogBuffer {
-    LogBufferElementCollection mLogElements;
-    pthread_mutex_t mLogElementsLock;
+// The elements of one log id and uid, oldest first, linked through
+// LogBufferElement so that pruning a uid only visits its own elements.
+struct LogBufferUidChain {
+    LogBufferElement *mHead;
+    LogBufferElement *mTail;
+    size_t mSizes;
+    size_t mElements;
+
+    LogBufferUidChain() : mHead(NULL), mTail(NULL), mSizes(0), mElements(0) { }
+};
+
+typedef android::KeyedVector<uid_t, LogBufferUidChain> LogBufferUidChains;
 
+// Elements are kept in one collection per log id, each guarded by its own
+// lock, so that writers, readers and pruning of one buffer do not stall
+// those of another. Each collection is in time order; readers merge them.
+// When more than one lock is needed they are taken in log id order.
+class LogBuffer {
+    LogBufferElementCollection mLogElements[LOG_ID_MAX];
+    pthread_mutex_t mLogElementsLock[LOG_ID_MAX];
+    LogBufferUidChains mUidChains[LOG_ID_MAX];
+    // bumped whenever an element is erased, so that flushTo can tell
+    // whether its saved positions are still valid
+    unsigned long mEraseCount[LOG_ID_MAX];
+
+    // per log id parts are guarded by the corresponding mLogElementsLock
     LogStatistics stats;
 
     bool dgram_qlen_statistics;
+    pthread_mutex_t mDgramQlenLock;
 
     PruneList mPrune;
 
@@ -48,6 +72,7 @@ public:
     LastLogTimes &mTimes;
 
     LogBuffer(LastLogTimes *times);
+    ~LogBuffer();
 
     void log(log_id_t log_id, log_time realtime,
              uid_t uid, pid_t pid, pid_t tid,
@@ -75,9 +100,16 @@ public:
 
     // helper
     char *pidToName(pid_t pid) { return stats.pidToName(pid); }
-    uid_t pidToUid(pid_t pid) { return stats.pidToUid(pid); }
+    uid_t pidToUid(pid_t pid);
 
 private:
+    void lockAll();
+    void unlockAll();
+
+    void linkUid(LogBufferElement *e);
+    void unlinkUid(LogBufferElement *e);
+    LogBufferElementCollection::iterator erase(LogBufferElementCollection::iterator it);
+
     void maybePrune(log_id_t id);
     void prune(log_id_t id, unsigned long pruneRows, uid_t uid = AID_ROOT);
 
@@ -35,7 +35,9 @@ LogBufferElement::LogBufferElement(log_id_t log_id, log_time realtime,
         , mTid(tid)
         , mMsgLen(len)
         , mMonotonicTime(CLOCK_MONOTONIC)
-        , mRealTime(realtime) {
+        , mRealTime(realtime)
+        , mUidPrev(NULL)
+        , mUidNext(NULL) {
     mMsg = new char[len];
     memcpy(mMsg, msg, len);
 }
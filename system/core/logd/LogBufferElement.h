@@ -21,8 +21,11 @@
 #include <sysutils/SocketClient.h>
 #include <log/log.h>
 #include <log/log_read.h>
+#include <utils/List.h>
 
 class LogBufferElement {
+    friend class LogBuffer;
+
     const log_id_t mLogId;
     const uid_t mUid;
     const pid_t mPid;
@@ -32,6 +35,12 @@ class LogBufferElement {
     const log_time mMonotonicTime;
     const log_time mRealTime;
 
+    // Maintained by LogBuffer: our position in its collection, and our
+    // neighbours in the chain of elements with the same log id and uid.
+    android::List<LogBufferElement *>::iterator mPosition;
+    LogBufferElement *mUidPrev;
+    LogBufferElement *mUidNext;
+
 public:
     LogBufferElement(log_id_t log_id, log_time realtime,
                      uid_t uid, pid_t pid, pid_t tid,
@@ -61,6 +61,7 @@ public:
     int init(char *str);
 
     bool naughty(LogBufferElement *element);
+    bool hasNaughty() const { return !mNaughty.empty(); }
     bool nice(LogBufferElement *element);
     bool worstUidEnabled() const { return mWorstUidEnabled; }
 
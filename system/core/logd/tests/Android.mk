@@ -23,6 +23,42 @@ LOCAL_PATH := $(call my-dir)
 test_module_prefix := logd-
 test_tags := tests
 
+benchmark_c_flags := \
+    -I$(LOCAL_PATH)/.. \
+    -I$(LOCAL_PATH)/../../liblog/tests \
+    -Wall \
+    -Werror \
+    -fno-builtin \
+    -std=gnu++11
+
+benchmark_src_files := \
+    ../../liblog/tests/benchmark_main.cpp \
+    logd_benchmark.cpp \
+    ../FlushCommand.cpp \
+    ../LogBuffer.cpp \
+    ../LogBufferElement.cpp \
+    ../LogCommand.cpp \
+    ../LogReader.cpp \
+    ../LogStatistics.cpp \
+    ../LogTimes.cpp \
+    ../LogWhiteBlackList.cpp
+
+# Build benchmarks for the device. Run with:
+#   adb shell logd-benchmarks
+include $(CLEAR_VARS)
+LOCAL_MODULE := $(test_module_prefix)benchmarks
+LOCAL_MODULE_TAGS := $(test_tags)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+LOCAL_CFLAGS += $(benchmark_c_flags)
+LOCAL_SHARED_LIBRARIES += libsysutils liblog libcutils libutils
+LOCAL_SRC_FILES := $(benchmark_src_files)
+ifndef LOCAL_SDK_VERSION
+LOCAL_C_INCLUDES += bionic bionic/libstdc++/include external/stlport/stlport
+LOCAL_SHARED_LIBRARIES += libstlport
+endif
+LOCAL_MODULE_PATH := $(TARGET_OUT_DATA_NATIVE_TESTS)/$(LOCAL_MODULE)
+include $(BUILD_EXECUTABLE)
+
 # -----------------------------------------------------------------------------
 # Unit tests.
 # -----------------------------------------------------------------------------
@@ -51,3 +87,18 @@ LOCAL_CFLAGS += $(test_c_flags)
 LOCAL_SHARED_LIBRARIES := libcutils
 LOCAL_SRC_FILES := $(test_src_files)
 include $(BUILD_NATIVE_TEST)
+
+# -----------------------------------------------------------------------------
+# Unit tests that drive a LogBuffer directly.
+# -----------------------------------------------------------------------------
+
+# Build tests for the log buffer. Run with:
+#   adb shell /data/nativetest/logd-buffer-tests/logd-buffer-tests
+include $(CLEAR_VARS)
+LOCAL_MODULE := $(test_module_prefix)buffer-tests
+LOCAL_MODULE_TAGS := $(test_tags)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+LOCAL_CFLAGS += $(benchmark_c_flags)
+LOCAL_SHARED_LIBRARIES := libsysutils liblog libcutils libutils
+LOCAL_SRC_FILES := logbuffer_test.cpp $(filter-out %benchmark_main.cpp logd_benchmark.cpp,$(benchmark_src_files))
+include $(BUILD_NATIVE_TEST)
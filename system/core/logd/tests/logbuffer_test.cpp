@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <log/log.h>
+#include <log/log_read.h>
+#include <sysutils/SocketClient.h>
+
+#include "LogBuffer.h"
+#include "LogTimes.h"
+
+// These drive a LogBuffer directly, without logd's sockets.
+
+static const uid_t test_uid = 10000;
+
+static void log_at(LogBuffer *logbuf, log_id_t id, uint32_t sec) {
+    char msg[16];
+    memset(msg, 0, sizeof(msg));
+    msg[0] = ANDROID_LOG_INFO;
+    strcpy(msg + 1, "test");
+    logbuf->log(id, log_time(sec, 0), test_uid, 1000, 1000, msg, sizeof(msg));
+}
+
+struct StalledReader {
+    LogBuffer *logbuf;
+    std::vector<log_id_t> ids;
+    std::vector<uint32_t> secs;
+};
+
+// Records what the reader was offered. On reaching the system entry at 2s,
+// it stalls to let the main buffer be cleared and refilled underneath it,
+// pruning both the main entry it last looked at and the one it has pending.
+static bool StalledReaderFilter(const LogBufferElement *element, void *arg) {
+    StalledReader *reader = reinterpret_cast<StalledReader *>(arg);
+
+    reader->ids.push_back(element->getLogId());
+    reader->secs.push_back(element->getRealTime().tv_sec);
+
+    if ((element->getLogId() == LOG_ID_SYSTEM)
+            && (element->getRealTime().tv_sec == 2)) {
+        reader->logbuf->clear(LOG_ID_MAIN);
+        log_at(reader->logbuf, LOG_ID_MAIN, 4);
+    }
+    return false;
+}
+
+TEST(logbuffer, prune_while_reader_stalled) {
+    LastLogTimes times;
+    LogBuffer *logbuf = new LogBuffer(&times);
+
+    log_at(logbuf, LOG_ID_MAIN, 1);
+    log_at(logbuf, LOG_ID_MAIN, 100);
+    log_at(logbuf, LOG_ID_SYSTEM, 2);
+    log_at(logbuf, LOG_ID_SYSTEM, 3);
+
+    StalledReader reader;
+    reader.logbuf = logbuf;
+    SocketClient client(-1, false);
+    logbuf->flushTo(&client, log_time::EPOCH, true, StalledReaderFilter, &reader);
+
+    // The main entry at 100s was pruned before it was reached, and the one
+    // logged at 4s in its place is picked up in order.
+    static const log_id_t expected_ids[] = {
+        LOG_ID_MAIN, LOG_ID_SYSTEM, LOG_ID_SYSTEM, LOG_ID_MAIN
+    };
+    static const uint32_t expected_secs[] = { 1, 2, 3, 4 };
+    ASSERT_EQ(4U, reader.ids.size());
+    for (size_t i = 0; i < reader.ids.size(); ++i) {
+        EXPECT_EQ(expected_ids[i], reader.ids[i]);
+        EXPECT_EQ(expected_secs[i], reader.secs[i]);
+    }
+
+    delete logbuf;
+}
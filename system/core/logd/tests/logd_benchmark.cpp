@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <log/log.h>
+#include <log/log_read.h>
+
+#include "benchmark.h"
+
+#include "LogBuffer.h"
+#include "LogTimes.h"
+
+// These drive a LogBuffer directly, without the sockets, to measure the
+// cost of storing and pruning entries in logd itself.
+
+static const uid_t chatty_uid = 10000;
+static const unsigned short payload_size = 100;
+
+static void fill_payload(char *msg) {
+    memset(msg, 'x', payload_size);
+    msg[0] = ANDROID_LOG_INFO;
+    strcpy(msg + 1, "benchmark");
+}
+
+/*
+ *	Measure the cost of logging into a full buffer, where every entry
+ * eventually has to be pruned. Half of the entries come from one chatty
+ * uid and the rest are spread over "uids" others, so that pruning by worst
+ * offender has many quiet uids to skip past.
+ */
+static void BM_logd_log_prune(int iters, int uids) {
+    LastLogTimes times;
+    LogBuffer *logbuf = new LogBuffer(&times);
+    logbuf->setSize(LOG_ID_MAIN, 64 * 1024);
+
+    char msg[payload_size];
+    fill_payload(msg);
+
+    StartBenchmarkTiming();
+
+    for (int i = 0; i < iters; ++i) {
+        uid_t uid = (i & 1) ? chatty_uid : (chatty_uid + 1 + (i / 2) % uids);
+        logbuf->log(LOG_ID_MAIN, log_time(CLOCK_REALTIME),
+                    uid, 1000 + uid, 1000 + uid, msg, payload_size);
+    }
+
+    StopBenchmarkTiming();
+
+    delete logbuf;
+}
+BENCHMARK(BM_logd_log_prune)->Arg(1)->Arg(10)->Arg(100);
+
+/*
+ *	Measure clearing the entries of a single uid from a buffer that is
+ * mostly full of other uids' entries, as "logcat -c" run by an app does.
+ */
+static void BM_logd_clear_uid(int iters, int entries) {
+    LastLogTimes times;
+    LogBuffer *logbuf = new LogBuffer(&times);
+    logbuf->setSize(LOG_ID_MAIN, 256 * 1024 * 1024);
+
+    char msg[payload_size];
+    fill_payload(msg);
+
+    for (int i = 0; i < entries; ++i) {
+        uid_t uid = chatty_uid + 1 + i % 100;
+        logbuf->log(LOG_ID_MAIN, log_time(CLOCK_REALTIME),
+                    uid, 1000 + uid, 1000 + uid, msg, payload_size);
+    }
+
+    StartBenchmarkTiming();
+
+    for (int i = 0; i < iters; ++i) {
+        logbuf->log(LOG_ID_MAIN, log_time(CLOCK_REALTIME),
+                    chatty_uid, 1000, 1000, msg, payload_size);
+        logbuf->clear(LOG_ID_MAIN, chatty_uid);
+    }
+
+    StopBenchmarkTiming();
+
+    delete logbuf;
+}
+BENCHMARK(BM_logd_clear_uid)->Arg(1000)->Arg(10000)->Arg(100000);